@@ -12,6 +12,9 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include "batch_math.h"
+#include "command_buffer.h"
+
 #include <iostream>
 using std::cout;
 using std::endl;
@@ -260,7 +263,7 @@ int main() {
       &width, &height, &nrChannels, 0);
   if (data) {
     // copy data
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB,
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB,
                  GL_UNSIGNED_BYTE, data);
     glGenerateMipmap(GL_TEXTURE_2D);
   } else {
@@ -286,7 +289,8 @@ int main() {
       &width, &height, &nrChannels, 0);
   if (data) {
     // copy data
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA,
+    // keep the alpha channel, GL_RGB would silently drop it
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
                  GL_UNSIGNED_BYTE, data);
     glGenerateMipmap(GL_TEXTURE_2D);
   } else {
@@ -312,6 +316,22 @@ int main() {
       glm::vec3(1.3f, -2.0f, -2.5f),  glm::vec3(1.5f, 2.0f, -2.5f),
       glm::vec3(1.5f, 0.2f, -1.5f),   glm::vec3(-1.3f, 1.0f, -1.5f)};
 
+  // cube transforms as structure of arrays for batch::composeTRS
+  float cubeX[cubeNum], cubeY[cubeNum], cubeZ[cubeNum];
+  float cubeRotX[cubeNum], cubeRotZero[cubeNum], cubeRotW[cubeNum];
+  float cubeScale[cubeNum];
+  for (unsigned i = 0; i < cubeNum; ++i) {
+    cubeX[i] = cubePositions[i].x;
+    cubeY[i] = cubePositions[i].y;
+    cubeZ[i] = cubePositions[i].z;
+    cubeRotZero[i] = 0.f;
+    cubeScale[i] = 1.f;
+  }
+  const batch::TRSArrays cubeTRS = {cubeX,       cubeY,    cubeZ,     cubeRotX,  cubeRotZero,
+                                    cubeRotZero, cubeRotW, cubeScale, cubeScale, cubeScale};
+  glm::mat4 cubeModels[cubeNum];
+  CommandBuffer commands;
+
   glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
   // render loop
   // -----------
@@ -354,23 +374,33 @@ int main() {
     projection = glm::perspective(
         glm::radians(fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
 
-    for (int i = 0; i < cubeNum; i++) {
-      glm::mat4 model = glm::mat4(1.0f);
-      model = glm::translate(model, cubePositions[i]);
-      model = glm::rotate(model, float(glfwGetTime()) * glm::radians(10.0f),
-                          glm::vec3(1.0f, 0.0f, 0.0f));
+    // every cube rotates about x
+    float angle = float(glfwGetTime()) * glm::radians(10.0f);
+    for (unsigned i = 0; i < cubeNum; ++i) {
+      cubeRotX[i] = sin(angle * 0.5f);
+      cubeRotW[i] = cos(angle * 0.5f);
+    }
+    batch::composeTRS(cubeTRS, nullptr, cubeNum, cubeModels);
 
-      int modelLoc = glGetUniformLocation(shaderProgram1, "model");
-      int viewLoc = glGetUniformLocation(shaderProgram1, "view");
-      int projectionLoc = glGetUniformLocation(shaderProgram1, "projection");
+    int modelLoc = glGetUniformLocation(shaderProgram1, "model");
+    int viewLoc = glGetUniformLocation(shaderProgram1, "view");
+    int projectionLoc = glGetUniformLocation(shaderProgram1, "projection");
 
-      glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-      glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-      glUniformMatrix4fv(projectionLoc, 1, GL_FALSE,
-                         glm::value_ptr(projection));
+    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE,
+                       glm::value_ptr(projection));
 
-      glDrawArrays(GL_TRIANGLES, 0, 36);
+    for (int i = 0; i < cubeNum; i++) {
+      const glm::mat4 *model = commands.copy(&cubeModels[i], 1);
+      commands.record(commandKey(0, shaderProgram1), [=](ReplayState &state) {
+        state.useProgram(shaderProgram1);
+        state.bindVertexArray(VAO);
+        glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(*model));
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+      });
     }
+    replayCommands(commands);
+    commands.clear();
 
     glBindVertexArray(0); // no need to unbind it every time
 
@@ -8,8 +8,18 @@
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+// count heap allocations, see allocation_tracker.h
+#define LEARNOPENGL_TRACK_ALLOCATIONS
+#include "allocation_tracker.h"
 // shader class
 #include "shader.h"
+#include "gl_ext.h"
+#include "texture_cache.h"
+#include "readback.h"
+#include "batch_math.h"
+#include "command_buffer.h"
+#include "frame_arena.h"
+#include "parallel.h"
 
 #include <filesystem>
 #include <iostream>
@@ -43,7 +53,6 @@ void processInput(GLFWwindow *window);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xpos, double ypos);
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
-unsigned loadTexture(const string &imagePath);
 
 int main() {
   // bubu
@@ -77,6 +86,7 @@ int main() {
     cout << "Failed to initialize GLAD" << endl;
     return -1;
   }
+  loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
   const std::string shaderPath = std::string(SUBPROJECT_SOURCE_DIR) + "/shaders";
   const std::string lightingVertex = getPath(shaderPath + "/multiple_lights.vs");
@@ -154,8 +164,12 @@ int main() {
   glEnable(GL_DEPTH_TEST);
 
   // texture
-  unsigned diffuseMap = loadTexture(getPath((std::string(PROJECT_SOURCE_DIR) + "/resources/container2.png")));
-  unsigned specularMap = loadTexture(getPath((std::string(PROJECT_SOURCE_DIR) + "/resources/container2_specular.png")));
+  TextureCache &textureCache = TextureCache::instance();
+  textureCache.setDiskCache(std::string(PROJECT_SOURCE_DIR) + "/.texture_cache");
+  textureCache.configureFromEnv();
+  TextureHandle diffuseMap = textureCache.load(getPath((std::string(PROJECT_SOURCE_DIR) + "/resources/container2.png")));
+  TextureHandle specularMap = textureCache.load(getPath((std::string(PROJECT_SOURCE_DIR) + "/resources/container2_specular.png")), TextureUsage::Data);
+  textureCache.report("lighting");
 
   const unsigned cubeNum = 10;
   glm::vec3 cubePositions[] = {
@@ -226,7 +240,17 @@ int main() {
   lighting.setVec3("dirLight.diffuse", diffuseColor);
   lighting.setVec3("dirLight.specular", 1.0f, 1.0f, 1.0f);
 
+  unsigned captureFrames = 0;
+  std::unique_ptr<FrameReadback> readback = createReadbackFromEnv(captureFrames);
+
+  // per-object uniforms of the recorded draws
+  const GLint cubeModelLocation = glGetUniformLocation(lighting.ID, "model");
+  const GLint cubeNormalLocation = glGetUniformLocation(lighting.ID, "normalMatrix");
+  const GLint lightModelLocation = glGetUniformLocation(lightCube.ID, "model");
+  CommandBufferPool commands;
+
   while (!glfwWindowShouldClose(window)) {
+    FrameArena::beginFrame();
     processInput(window);
 
     float currentFrame = (float)glfwGetTime();
@@ -240,13 +264,13 @@ int main() {
 
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    int fbWidth, fbHeight;
+    glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
 
-    glm::mat4 model = glm::mat4(1.0f);
     glm::mat4 view = glm::mat4(1.0f);
     view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
     glm::mat4 projection = glm::perspective(
         glm::radians(fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-    glm::mat4 normalMatrix = glm::transpose(glm::inverse(model));
 
     lighting.use();
     lighting.setVec3("viewPos", cameraPos);
@@ -255,54 +279,92 @@ int main() {
 
     lighting.setMat4("view", view);
     lighting.setMat4("projection", projection);
-    lighting.setMat4("normalMatrix", normalMatrix);
+
+    lightCube.use();
+    lightCube.setVec3("lightColor", lightColor);
+    lightCube.setMat4("view", view);
+    lightCube.setMat4("projection", projection);
 
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, diffuseMap);
+    diffuseMap.bind();
     glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, specularMap);
+    specularMap.bind();
 
     for (int i = 0; i < cubeNum; ++i) {
-      model = glm::mat4(1.0f);
-      // model = glm::rotate(model, (float)glfwGetTime() * glm::radians(50.0f),
-      //                     glm::vec3(1.0f, 0.0f, 0.0f));
-      model = glm::translate(model, cubePositions[i]);
-      lighting.setMat4("model", model);
-
-      glBindVertexArray(containerVAO);
-      glDrawArrays(GL_TRIANGLES, 0, 36);
+      // unit cube, every face maps the whole texture
+      float distance = glm::length(cameraPos - cubePositions[i]) - 0.87f;
+      textureCache.requestFootprint(diffuseMap, 1.0f, distance, glm::radians(fov), fbHeight);
+      textureCache.requestFootprint(specularMap, 1.0f, distance, glm::radians(fov), fbHeight);
     }
-    glBindVertexArray(0);
-
-    lightCube.use();
-    lightCube.setVec3("lightColor", lightColor);
-    lightCube.setMat4("view", view);
-    lightCube.setMat4("projection", projection);
 
+    // the draws are prepared on the job system and replayed here
+    parallelFor(cubeNum, 4, [&](size_t begin, size_t end) {
+      CommandBuffer &buffer = commands.local();
+      for (size_t i = begin; i < end; ++i) {
+        glm::mat4 model = glm::mat4(1.0f);
+        // model = glm::rotate(model, (float)glfwGetTime() * glm::radians(50.0f),
+        //                     glm::vec3(1.0f, 0.0f, 0.0f));
+        model = glm::translate(model, cubePositions[i]);
+        glm::mat3 normalMatrix = batch::normalMatrix(model);
+        buffer.record(commandKey(0, lighting.ID), [=, program = lighting.ID](ReplayState &state) {
+          state.useProgram(program);
+          state.bindVertexArray(containerVAO);
+          glUniformMatrix4fv(cubeModelLocation, 1, GL_FALSE, &model[0][0]);
+          glUniformMatrix3fv(cubeNormalLocation, 1, GL_FALSE, &normalMatrix[0][0]);
+          glDrawArrays(GL_TRIANGLES, 0, 36);
+        });
+      }
+    });
+
+    CommandBuffer &buffer = commands.local();
     for (int i = 0; i < 4; ++i) {
 
-      model = glm::mat4(1.0f);
+      glm::mat4 model = glm::mat4(1.0f);
       model = glm::translate(model, pointLightPositions[i]);
       model = glm::scale(model, glm::vec3(0.2f));
 
-      lightCube.setMat4("model", model);
-
-      glBindVertexArray(lightcubeVAO);
-      glDrawArrays(GL_TRIANGLES, 0, 36);
+      buffer.record(commandKey(0, lightCube.ID), [=, program = lightCube.ID](ReplayState &state) {
+        state.useProgram(program);
+        state.bindVertexArray(lightcubeVAO);
+        glUniformMatrix4fv(lightModelLocation, 1, GL_FALSE, &model[0][0]);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+      });
     }
 
-    glBindVertexArray(0);
+    commands.replay();
+    commands.clear();
+    textureCache.update();
+
+    if (readback) {
+      readback->capture(fbWidth, fbHeight);
+      if (captureFrames && readback->framesCaptured() >= captureFrames) {
+        glfwSetWindowShouldClose(window, true);
+      }
+    }
 
     glfwSwapBuffers(window);
     glfwPollEvents();
+    AllocationTracker::endFrame();
   }
 
+  int exitCode = 0;
+  if (readback) {
+    readback->flush();
+    exitCode = readback->goldenFailures() ? 1 : 0;
+    readback.reset();
+  }
+
+  // the draws are split with parallelFor every frame; once its job pool
+  // and the arenas have grown, frames should not allocate at all
+  AllocationTracker::report(std::cerr);
+
   glDeleteVertexArrays(1, &containerVAO);
   glDeleteVertexArrays(1, &lightcubeVAO);
   glDeleteBuffers(1, &VBO);
 
+  TextureCache::instance().releaseGL();
   glfwTerminate();
-  return 0;
+  return exitCode;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback
@@ -374,42 +436,6 @@ void scroll_callback(GLFWwindow *window, double xpos, double ypos) {
   }
 }
 
-unsigned loadTexture(const std::string &imagePath) {
-  unsigned textureID;
-  glGenTextures(1, &textureID);
-
-
-  int width, height, nrChannels;
-  unsigned char *data = stbi_load(imagePath.c_str(), &width, &height, &nrChannels, 0);
-
-  if (data) {
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                    GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    GLenum format;
-    if (nrChannels == 1)
-        format = GL_RED;
-    else if (nrChannels == 3)
-        format = GL_RGB;
-    else if (nrChannels == 4)
-        format = GL_RGBA;
-    // copy data
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-  } else {
-    cout << "ERROR: Failed to load texture: " << imagePath << endl;
-  }
-
-  stbi_image_free(data);
-
-  return textureID;
-}
-
 std::string getPath(const std::string& path) {
     fs::path fsPath(path);
     return fsPath.make_preferred().string();
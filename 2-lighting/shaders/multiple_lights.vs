@@ -10,11 +10,11 @@ out vec2 TexCoord;
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
-uniform mat4 normalMatrix;
+uniform mat3 normalMatrix;
 
 void main() {
   gl_Position = projection * view * model * vec4(aPos, 1.0);
   FragPos = vec3(model * vec4(aPos, 1.0));
-  Normal = mat3(normalMatrix) * aNormal;
+  Normal = normalMatrix * aNormal;
   TexCoord = aTexCoord;
 }
@@ -6,12 +6,21 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+// count heap allocations, see allocation_tracker.h
+#define LEARNOPENGL_TRACK_ALLOCATIONS
+#include "allocation_tracker.h"
+#include "gl_ext.h"
 #include "model.h"
+#include "readback.h"
+#include "render_thread.h"
 
+#include <cmath>
 #include <filesystem>
 #include <iostream>
+#include <random>
 #include <string>
-using std::endl, std::string;
+#include <vector>
+using std::endl, std::string, std::vector;
 namespace fs = std::filesystem;
 
 constexpr unsigned SCR_WIDTH = 800;
@@ -34,11 +43,22 @@ glm::vec3 direction;
 
 float fov = 45.0f;
 
+int fbWidth = SCR_WIDTH, fbHeight = SCR_HEIGHT;
+
+// what drawing a frame needs, as simulated; the crowd's instance data never
+// changes, so it isn't copied
+struct FrameSnapshot {
+  glm::mat4 view, projection, model;
+  glm::vec3 cameraPos, cameraFront;
+  float fovY = 0.f, time = 0.f;
+  int fbWidth = 0, fbHeight = 0;
+  SceneGraph pose; // the model's nodes, animated and updated
+};
+
 void processInput(GLFWwindow *window);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xpos, double ypos);
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
-unsigned loadTexture(const string &imagePath);
 
 int main() {
   // bubu
@@ -62,6 +82,8 @@ int main() {
   }
 
   glfwMakeContextCurrent(window);
+  JobSystem::instance().setGLThread();
+  glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
   glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
   glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -72,18 +94,61 @@ int main() {
     cerr << "Failed to initialize GLAD" << endl;
     return -1;
   }
+  loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
-  stbi_set_flip_vertically_on_load(true);
   glEnable(GL_DEPTH_TEST);
 
   const std::string shaderPath = std::string(SUBPROJECT_SOURCE_DIR) + "/shaders";
   const std::string modelVertex = getPath(shaderPath + "/model_loading.vs");
   const std::string modelFragment = getPath(shaderPath + "/model_loading.fs");
 
-  Shader modelShader(modelVertex, modelFragment);
-  const string path = getPath(std::string(SUBPROJECT_SOURCE_DIR) + "/backpack/backpack.obj");
+  // LEARNOPENGL_PACK_TEXTURES=1 draws from texture arrays / atlases
+  const char *packEnv = getenv("LEARNOPENGL_PACK_TEXTURES");
+  const bool packTextures = packEnv && std::string(packEnv) == "1";
+  // LEARNOPENGL_CROWD=<n> draws n copies playing the first animation from
+  // vertex animation textures, each at its own time
+  const char *crowdEnv = getenv("LEARNOPENGL_CROWD");
+  const size_t crowd = crowdEnv ? strtoul(crowdEnv, nullptr, 10) : 0;
+  std::string defines = packTextures ? "#define PACKED_TEXTURES\n" : "";
+  if (crowd) {
+    defines += "#define VERTEX_ANIMATION\n";
+  }
+  Shader modelShader(modelVertex, modelFragment, defines);
+  // LEARNOPENGL_MODEL=<file> loads another model, e.g. an animated one
+  const char *modelEnv = getenv("LEARNOPENGL_MODEL");
+  const string path = modelEnv ? getPath(modelEnv) : getPath(std::string(SUBPROJECT_SOURCE_DIR) + "/backpack/backpack.obj");
+
+  TextureCache::instance().setDiskCache(std::string(PROJECT_SOURCE_DIR) + "/.texture_cache");
+  TextureCache::instance().setFlipVertically(true);
+  TextureCache::instance().configureFromEnv();
+  Model ourModel(path, packTextures);
+  TextureCache::instance().report("model");
+
+  // plays the first animation, if any, on a loop
+  Animator animator(ourModel.scene);
+  if (!ourModel.animations().empty()) {
+    animator.play(ourModel.animations()[0]);
+  }
 
-  Model ourModel = (getPath(std::string(SUBPROJECT_SOURCE_DIR) + "/backpack/backpack.obj"));
+  // a square grid on the xz plane, behind the camera's start
+  vector<glm::mat4> crowdModels;
+  vector<float> crowdTimes;
+  if (crowd) {
+    if (ourModel.animations().empty()) {
+      cerr << "WARNING: the model has no animation for the crowd to play" << endl;
+    } else {
+      ourModel.bakeVertexAnimation(0);
+    }
+    const size_t side = (size_t)std::ceil(std::sqrt((double)crowd));
+    const float spacing = 2.5f * ourModel.boundsRadius();
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> offset(0.f, 10.f);
+    for (size_t i = 0; i < crowd; ++i) {
+      const glm::vec3 at((i % side - side * 0.5f) * spacing, 0.f, -(float)(i / side) * spacing - spacing);
+      crowdModels.push_back(glm::translate(glm::mat4(1.f), at));
+      crowdTimes.push_back(offset(rng));
+    }
+  }
 
 
   glm::vec3 lightColor;
@@ -103,47 +168,129 @@ int main() {
   modelShader.setVec3("spotLight.diffuse", diffuseColor);
   modelShader.setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
 
-  modelShader.setFloat("shinness", 32.0f);
 
-  while (!glfwWindowShouldClose(window)) {
-    processInput(window);
-
-    float currentFrame = (float)glfwGetTime();
-    deltaTime = currentFrame - lastFrame;
-    lastFrame = currentFrame;
+  unsigned captureFrames = 0;
+  std::unique_ptr<FrameReadback> readback = createReadbackFromEnv(captureFrames);
 
+  // the render side draws a copy of the model posed from each snapshot
+  Model renderModel = ourModel;
+  auto renderFrame = [&](const FrameSnapshot &frame) {
+    static const unsigned renderAllocations = AllocationTracker::subsystem("render");
+    AllocationScope allocationScope(renderAllocations);
+    DynamicBuffer::instance().beginFrame();
+    glViewport(0, 0, frame.fbWidth, frame.fbHeight);
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glm::mat4 view = glm::mat4(1.0f);
-    view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-    glm::mat4 projection = glm::perspective(
-        glm::radians(fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-
     modelShader.use();
-    modelShader.setMat4("view", view);
-    modelShader.setMat4("projection", projection);
+    modelShader.setMat4("view", frame.view);
+    modelShader.setMat4("projection", frame.projection);
+
+    modelShader.setVec3("viewPos", frame.cameraPos);
+    modelShader.setVec3("spotLight.direction", frame.cameraFront);
+    modelShader.setVec3("spotLight.position", frame.cameraPos);
+
+    renderModel.scene = frame.pose;
+    renderModel.requestTextureDetail(frame.model, frame.cameraPos, frame.fovY, frame.fbHeight);
+    if (crowd) {
+      modelShader.setFloat("vatTime", frame.time);
+      renderModel.Draw(modelShader, crowdModels.data(), crowdModels.size(), crowdTimes.data());
+    } else {
+      renderModel.Draw(modelShader, frame.model);
+    }
+    DynamicBuffer::instance().endFrame();
+    JobSystem::instance().runGLThreadJobs();
+    TextureCache::instance().update();
+
+    if (readback) {
+      readback->capture(frame.fbWidth, frame.fbHeight);
+      if (captureFrames && readback->framesCaptured() >= captureFrames) {
+        glfwSetWindowShouldClose(window, true);
+      }
+    }
+  };
+
+  auto simulate = [&](FrameSnapshot &frame) {
+    static const unsigned simulationAllocations = AllocationTracker::subsystem("simulation");
+    AllocationScope allocationScope(simulationAllocations);
+    float currentFrame = (float)glfwGetTime();
+    deltaTime = currentFrame - lastFrame;
+    lastFrame = currentFrame;
 
-    modelShader.setVec3("viewPos", cameraPos);
-    modelShader.setVec3("spotLight.direction", cameraFront);
-    modelShader.setVec3("spotLight.position", cameraPos);
+    frame.view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+    frame.projection = glm::perspective(
+        glm::radians(fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    frame.cameraPos = cameraPos;
+    frame.cameraFront = cameraFront;
+    frame.fovY = glm::radians(fov);
+    frame.time = currentFrame;
+    frame.fbWidth = fbWidth;
+    frame.fbHeight = fbHeight;
 
     glm::mat4 model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(0.f, 0.f, 0.f));
     model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));
-    modelShader.setMat4("model", model);
+    frame.model = model;
+
+    animator.advance(deltaTime);
+    ourModel.scene.update();
+    frame.pose = ourModel.scene;
+  };
+
+  // LEARNOPENGL_RENDER_THREAD=1 submits GL from a thread of its own, a
+  // frame behind the simulation
+  const char *renderThreadEnv = getenv("LEARNOPENGL_RENDER_THREAD");
+  if (renderThreadEnv && std::string(renderThreadEnv) == "1") {
+    FramePackets<FrameSnapshot> packets;
+    glfwMakeContextCurrent(nullptr);
+    {
+      RenderThread<FrameSnapshot> renderer(window, packets, renderFrame);
+      while (!glfwWindowShouldClose(window)) {
+        FrameArena::beginFrame();
+        processInput(window);
+        simulate(packets.beginWrite());
+        packets.publish();
+        glfwPollEvents();
+        AllocationTracker::endFrame();
+      }
+    }
+    glfwMakeContextCurrent(window);
+    JobSystem::instance().setGLThread();
+    cerr << "render thread: " << packets.frames() << " frames, simulation waited " << packets.producerWaitMs()
+         << " ms, render waited " << packets.consumerWaitMs() << " ms" << endl;
+  } else {
+    FrameSnapshot frame;
+    while (!glfwWindowShouldClose(window)) {
+      FrameArena::beginFrame();
+      processInput(window);
+      simulate(frame);
+      renderFrame(frame);
+      glfwSwapBuffers(window);
+      glfwPollEvents();
+      AllocationTracker::endFrame();
+    }
+  }
 
-    glm::mat4 normalMatrix = glm::transpose(glm::inverse(model));
-    modelShader.setMat4("normalMatrix", normalMatrix);
+  int exitCode = 0;
+  if (readback) {
+    readback->flush();
+    exitCode = readback->goldenFailures() ? 1 : 0;
+    readback.reset();
+  }
 
-    ourModel.Draw(modelShader);
+  const DynamicBuffer &dynamicBuffer = DynamicBuffer::instance();
+  cerr << "dynamic buffer: " << (dynamicBuffer.persistentlyMapped() ? "persistent" : "orphaned") << ", "
+       << dynamicBuffer.fenceStalls() << " fence stalls, " << dynamicBuffer.fenceWaitMs() << " ms waited" << endl;
 
-    glfwSwapBuffers(window);
-    glfwPollEvents();
-  }
+  // after the first frames have warmed the arenas and caches up, frames
+  // should not allocate at all
+  AllocationTracker::report(cerr);
 
+  DynamicBuffer::instance().releaseGL();
+  MaterialLibrary::instance().releaseGL();
+  TextureCache::instance().releaseGL();
   glfwTerminate();
-  return 0;
+  return exitCode;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback
@@ -152,7 +299,10 @@ int main() {
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
   // make sure the viewport matches the new window dimensions; note that width
   // and height will be significantly larger than specified on retina displays.
-  glViewport(0, 0, width, height);
+  // The viewport is set when the frame is drawn, which may be on the render
+  // thread.
+  fbWidth = width;
+  fbHeight = height;
 }
 
 void processInput(GLFWwindow *window) {
@@ -218,39 +368,3 @@ void scroll_callback(GLFWwindow *window, double xpos, double ypos) {
     fov = 45.0f;
   }
 }
-
-unsigned loadTexture(const std::string &imagePath) {
-  unsigned textureID;
-  glGenTextures(1, &textureID);
-
-
-  int width, height, nrChannels;
-  unsigned char *data = stbi_load(imagePath.c_str(), &width, &height, &nrChannels, 0);
-
-  if (data) {
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                    GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    GLenum format;
-    if (nrChannels == 1)
-        format = GL_RED;
-    else if (nrChannels == 3)
-        format = GL_RGB;
-    else if (nrChannels == 4)
-        format = GL_RGBA;
-    // copy data
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-  } else {
-    cerr << "ERROR: Failed to load texture: " << imagePath << endl;
-  }
-
-  stbi_image_free(data);
-
-  return textureID;
-}
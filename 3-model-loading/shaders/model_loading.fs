@@ -23,9 +23,39 @@ struct SpotLight {
 
 uniform SpotLight spotLight;
 
+// one entry per MaterialLibrary material, see material.h
+#define MAX_MATERIALS 256
+struct MaterialData {
+  vec4 diffuseUV;  // uv scale / offset inside the layer (atlas pages)
+  vec4 specularUV;
+  float diffuseLayer;
+  float specularLayer;
+  float shininess;
+};
+layout(std140) uniform Materials {
+  MaterialData materials[MAX_MATERIALS];
+};
+uniform int materialID;
+
+#ifdef PACKED_TEXTURES
+uniform sampler2DArray texture_diffuse1;
+uniform sampler2DArray texture_specular1;
+
+vec3 sampleDiffuseMap() {
+  MaterialData m = materials[materialID];
+  return texture(texture_diffuse1, vec3(TexCoords * m.diffuseUV.xy + m.diffuseUV.zw, m.diffuseLayer)).rgb;
+}
+vec3 sampleSpecularMap() {
+  MaterialData m = materials[materialID];
+  return texture(texture_specular1, vec3(TexCoords * m.specularUV.xy + m.specularUV.zw, m.specularLayer)).rgb;
+}
+#else
 uniform sampler2D texture_diffuse1;
 uniform sampler2D texture_specular1;
-uniform float shinness;
+
+vec3 sampleDiffuseMap() { return texture(texture_diffuse1, TexCoords).rgb; }
+vec3 sampleSpecularMap() { return texture(texture_specular1, TexCoords).rgb; }
+#endif
 
 uniform vec3 viewPos;
 
@@ -44,15 +74,15 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 viewDir, vec3 fragPos) {
   vec3 lightDir = normalize(light.position - fragPos);
   float theta = dot(lightDir, normalize(-light.direction));
 
-  vec3 sampleDiffuse = texture(texture_diffuse1, TexCoords).rgb;
+  vec3 sampleDiffuse = sampleDiffuseMap();
   vec3 ambient = sampleDiffuse * light.ambient;
 
   float diff = max(dot(normal, lightDir), 0.0);
   vec3 diffuse = sampleDiffuse * diff * light.diffuse;
 
   vec3 reflectDir = reflect(-lightDir, normal);
-  float spec = pow(max(dot(viewDir, reflectDir), 0.0), shinness);
-  vec3 specular = texture(texture_specular1, TexCoords).rgb * spec * light.specular;
+  float spec = pow(max(dot(viewDir, reflectDir), 0.0), materials[materialID].shininess);
+  vec3 specular = sampleSpecularMap() * spec * light.specular;
 
   float distance = length(light.position - fragPos);
   float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
@@ -2,20 +2,71 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// per instance
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in mat3x4 aNormalMatrix; // w unused
+// skinned meshes only
+layout (location = 10) in uvec4 aBoneIds;
+layout (location = 11) in vec4 aBoneWeights;
 
 out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
-uniform mat4 normalMatrix;
+
+uniform bool skinned;
+// three texels per bone, the rows of its affine matrix
+uniform samplerBuffer bones;
+
+#ifdef VERTEX_ANIMATION
+// baked frames, see vertex_animation.h; an instance is at vatTime plus its
+// offset, looping
+layout (location = 12) in float aTimeOffset;
+uniform bool vertexAnimated;
+uniform sampler2D vatPositions;
+uniform sampler2D vatNormals;
+uniform float vatTime;
+uniform float vatFrameRate;
+uniform int vatFrames;
+uniform int vatVertices;
+
+vec3 vatFetch(sampler2D frames, int frame) {
+    int texel = frame * vatVertices + gl_VertexID;
+    int width = textureSize(frames, 0).x;
+    return texelFetch(frames, ivec2(texel % width, texel / width), 0).xyz;
+}
+#endif
 
 void main()
 {
+    vec4 position = vec4(aPos, 1.0);
+    vec3 normal = aNormal;
+#ifdef VERTEX_ANIMATION
+    if (vertexAnimated) {
+        float frame = mod((vatTime + aTimeOffset) * vatFrameRate, float(vatFrames));
+        int frame0 = min(int(frame), vatFrames - 1);
+        int frame1 = (frame0 + 1) % vatFrames;
+        float t = frame - float(frame0);
+        position = vec4(mix(vatFetch(vatPositions, frame0), vatFetch(vatPositions, frame1), t), 1.0);
+        normal = mix(vatFetch(vatNormals, frame0), vatFetch(vatNormals, frame1), t);
+    } else
+#endif
+    if (skinned) {
+        vec4 row0 = vec4(0.0), row1 = vec4(0.0), row2 = vec4(0.0);
+        for (int i = 0; i < 4; ++i) {
+            int bone = int(aBoneIds[i]) * 3;
+            row0 += aBoneWeights[i] * texelFetch(bones, bone);
+            row1 += aBoneWeights[i] * texelFetch(bones, bone + 1);
+            row2 += aBoneWeights[i] * texelFetch(bones, bone + 2);
+        }
+        position = vec4(dot(row0, position), dot(row1, position), dot(row2, position), 1.0);
+        normal = vec3(dot(row0.xyz, aNormal), dot(row1.xyz, aNormal), dot(row2.xyz, aNormal));
+    }
+
     TexCoords = aTexCoords;    
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(normalMatrix) * aNormal;
+    gl_Position = projection * view * aModel * position;
+    FragPos = vec3(aModel * position);
+    Normal = vec3(aNormalMatrix * normal);
 }
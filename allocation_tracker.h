@@ -0,0 +1,202 @@
+#ifndef ALLOCATION_TRACKER_H
+#define ALLOCATION_TRACKER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+// Counts heap allocations (operator new): how many and how many bytes, in
+// total, per frame and per subsystem. Code tags what it allocates with an
+// AllocationScope; untagged allocations count as "other". Frees aren't
+// tracked.
+//
+// Counting needs the global operator new replaced: define
+// LEARNOPENGL_TRACK_ALLOCATIONS before including this header in exactly one
+// translation unit of the program. Without it every count stays 0.
+
+struct AllocationCounts {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+
+    AllocationCounts &operator+=(const AllocationCounts &other) {
+        count += other.count;
+        bytes += other.bytes;
+        return *this;
+    }
+};
+
+class AllocationTracker {
+public:
+    static constexpr unsigned maxSubsystems = 16;
+    static constexpr unsigned other = 0;
+
+    // id of `name`, which must outlive the program (e.g. a literal);
+    // registered on first use. Past maxSubsystems names share "other".
+    static unsigned subsystem(const char *name) {
+        std::lock_guard<std::mutex> lock(namesMutex);
+        const unsigned n = subsystems.load(std::memory_order_relaxed);
+        for (unsigned i = 0; i < n; ++i) {
+            if (strcmp(names[i], name) == 0) {
+                return i;
+            }
+        }
+        if (n == maxSubsystems) {
+            return other;
+        }
+        names[n] = name;
+        subsystems.store(n + 1, std::memory_order_release);
+        return n;
+    }
+
+    static unsigned subsystemCount() { return subsystems.load(std::memory_order_acquire); }
+    static const char *name(unsigned id) { return names[id]; }
+
+    // from operator new, any thread
+    static void record(size_t bytes) noexcept {
+        Counter &counter = counters[current];
+        counter.count.fetch_add(1, std::memory_order_relaxed);
+        counter.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    // since the program started
+    static AllocationCounts total(unsigned id) {
+        return {counters[id].count.load(std::memory_order_relaxed), counters[id].bytes.load(std::memory_order_relaxed)};
+    }
+    static AllocationCounts total() {
+        AllocationCounts sum;
+        for (unsigned i = 0; i < subsystemCount(); ++i) sum += total(i);
+        return sum;
+    }
+
+    // false unless the operator new of this header is in the program
+    static bool enabled() { return total().count > 0; }
+
+    // once a frame, on the frame loop thread: what was allocated since the
+    // last call becomes lastFrame(). Allocations of other threads land in
+    // whichever frame was open when they happened.
+    static void endFrame() {
+        uint64_t count = 0;
+        for (unsigned i = 0; i < maxSubsystems; ++i) {
+            const AllocationCounts now = total(i);
+            last[i] = {now.count - previous[i].count, now.bytes - previous[i].bytes};
+            previous[i] = now;
+            count += last[i].count;
+        }
+        ++frames;
+        if (count) {
+            ++allocatingFrames;
+        }
+    }
+
+    static AllocationCounts lastFrame(unsigned id) { return last[id]; }
+    static AllocationCounts lastFrame() {
+        AllocationCounts sum;
+        for (unsigned i = 0; i < maxSubsystems; ++i) sum += last[i];
+        return sum;
+    }
+
+    static uint64_t frameCount() { return frames; }
+    // frames that allocated anything at all
+    static uint64_t allocatingFrameCount() { return allocatingFrames; }
+
+    static void report(std::ostream &out) {
+        if (!enabled()) {
+            out << "allocations: not tracked" << std::endl;
+            return;
+        }
+        const AllocationCounts all = total();
+        out << "allocations: " << all.count << " (" << all.bytes << " bytes), " << allocatingFrames << " of " << frames
+            << " frames allocated, " << lastFrame().count << " in the last" << std::endl;
+        for (unsigned i = 0; i < subsystemCount(); ++i) {
+            const AllocationCounts counts = total(i);
+            out << "  " << names[i] << ": " << counts.count << " (" << counts.bytes << " bytes)" << std::endl;
+        }
+    }
+
+private:
+    friend class AllocationScope;
+
+    struct Counter {
+        std::atomic<uint64_t> count, bytes;
+    };
+
+    // zero and constant initialized, so operator new can count before
+    // main()
+    static inline Counter counters[maxSubsystems];
+    static inline const char *names[maxSubsystems] = {"other"};
+    static inline std::atomic<unsigned> subsystems{1};
+    static inline std::mutex namesMutex;
+    static inline thread_local unsigned current = other;
+
+    static inline AllocationCounts previous[maxSubsystems], last[maxSubsystems];
+    static inline uint64_t frames = 0, allocatingFrames = 0;
+};
+
+// attributes the calling thread's allocations to `subsystem` while alive
+class AllocationScope {
+public:
+    explicit AllocationScope(unsigned subsystem) : outer(AllocationTracker::current) {
+        AllocationTracker::current = subsystem;
+    }
+    explicit AllocationScope(const char *name) : AllocationScope(AllocationTracker::subsystem(name)) {}
+    ~AllocationScope() { AllocationTracker::current = outer; }
+
+    AllocationScope(const AllocationScope &) = delete;
+    AllocationScope &operator=(const AllocationScope &) = delete;
+
+private:
+    unsigned outer;
+};
+
+#endif
+
+#if defined(LEARNOPENGL_TRACK_ALLOCATIONS) && !defined(ALLOCATION_TRACKER_IMPLEMENTATION)
+#define ALLOCATION_TRACKER_IMPLEMENTATION
+
+#include <cstdlib>
+#include <new>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#define TRACKER_ALIGNED_ALLOC(alignment, bytes) _aligned_malloc(bytes, alignment)
+#define TRACKER_ALIGNED_FREE(p) _aligned_free(p)
+#define TRACKER_NOINLINE __declspec(noinline)
+#else
+#define TRACKER_ALIGNED_ALLOC(alignment, bytes) std::aligned_alloc(alignment, ((bytes) + (alignment) - 1) / (alignment) * (alignment))
+#define TRACKER_ALIGNED_FREE(p) std::free(p)
+#define TRACKER_NOINLINE __attribute__((noinline))
+#endif
+
+void *operator new(size_t bytes) {
+    AllocationTracker::record(bytes);
+    if (void *p = std::malloc(bytes ? bytes : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t bytes) { return operator new(bytes); }
+
+void *operator new(size_t bytes, std::align_val_t alignment) {
+    AllocationTracker::record(bytes);
+    if (void *p = TRACKER_ALIGNED_ALLOC((size_t)alignment, bytes ? bytes : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t bytes, std::align_val_t alignment) { return operator new(bytes, alignment); }
+
+// out of line, or GCC pairs the inlined free() with operator new and warns
+TRACKER_NOINLINE void operator delete(void *p) noexcept { std::free(p); }
+TRACKER_NOINLINE void operator delete[](void *p) noexcept { std::free(p); }
+TRACKER_NOINLINE void operator delete(void *p, size_t) noexcept { std::free(p); }
+TRACKER_NOINLINE void operator delete[](void *p, size_t) noexcept { std::free(p); }
+TRACKER_NOINLINE void operator delete(void *p, std::align_val_t) noexcept { TRACKER_ALIGNED_FREE(p); }
+TRACKER_NOINLINE void operator delete[](void *p, std::align_val_t) noexcept { TRACKER_ALIGNED_FREE(p); }
+TRACKER_NOINLINE void operator delete(void *p, size_t, std::align_val_t) noexcept { TRACKER_ALIGNED_FREE(p); }
+TRACKER_NOINLINE void operator delete[](void *p, size_t, std::align_val_t) noexcept { TRACKER_ALIGNED_FREE(p); }
+
+#endif
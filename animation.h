@@ -0,0 +1,248 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "batch_quat.h"
+#include "batch_skin.h"
+#include "parallel.h"
+#include "scene_graph.h"
+
+// Skeletal animation on top of SceneGraph.
+//
+// Bones are scene graph nodes. An AnimationClip holds keyframe tracks for
+// some of them, and an Animator samples a clip into the local transforms of
+// one SceneGraph - one character - after which scene.update() has the bone
+// world matrices. A Skin turns those into the bone palette a mesh is skinned
+// with, in the vertex shader (mesh.h) or on the CPU (batch::skinVertices).
+// None of this touches GL, so it runs headless as well.
+
+// Keep the four largest influences of a vertex, renormalized and quantized
+// to unorm8 weights that add up to exactly 255. Bone indices must fit a
+// byte.
+inline batch::SkinWeights packSkinWeights(const uint32_t *bones, const float *weights, int count) {
+    int order[4] = {0, 0, 0, 0};
+    int kept = 0;
+    for (int i = 0; i < count; ++i) {
+        // insertion into the four largest so far
+        int at = kept < 4 ? kept++ : 4;
+        while (at > 0 && weights[order[at - 1]] < weights[i]) {
+            if (at < 4) order[at] = order[at - 1];
+            --at;
+        }
+        if (at < 4) order[at] = i;
+    }
+
+    batch::SkinWeights packed = {};
+    float total = 0.f;
+    for (int j = 0; j < kept; ++j) {
+        total += weights[order[j]];
+    }
+    if (total <= 0.f) {
+        packed.Bones[0] = kept ? (uint8_t)bones[order[0]] : 0;
+        packed.Weights[0] = 255;
+        return packed;
+    }
+    int sum = 0;
+    for (int j = 0; j < kept; ++j) {
+        if (bones[order[j]] > 255) {
+            std::cerr << "ERROR: bone index " << bones[order[j]] << " doesn't fit the 8-bit skin weights" << std::endl;
+        }
+        packed.Bones[j] = (uint8_t)bones[order[j]];
+        packed.Weights[j] = (uint8_t)std::lround(weights[order[j]] / total * 255.f);
+        sum += packed.Weights[j];
+    }
+    // rounding leftovers go to the largest weight
+    packed.Weights[0] = (uint8_t)(packed.Weights[0] + 255 - sum);
+    return packed;
+}
+
+struct Skin {
+    std::vector<std::string> BoneNames;
+    std::vector<SceneGraph::NodeId> BoneNodes;  // BoneNames resolved in a scene graph
+    std::vector<glm::mat4> InverseBindMatrices; // mesh space to bone space in the bind pose
+    std::vector<batch::SkinWeights> Weights;    // per vertex, indices into the bones
+
+    bool empty() const { return BoneNames.empty(); }
+
+    // unknown bones stay with the mesh
+    void resolve(const SceneGraph &scene) {
+        BoneNodes.resize(BoneNames.size());
+        for (size_t b = 0; b < BoneNames.size(); ++b) {
+            BoneNodes[b] = scene.find(BoneNames[b]);
+            if (BoneNodes[b] == SceneGraph::none) {
+                std::cerr << "ERROR: no node for bone " << BoneNames[b] << std::endl;
+            }
+        }
+    }
+
+    // Bone matrices for the current pose of `scene`, relative to the node
+    // the mesh is placed at (world matrix `meshWorld`): inverse(meshWorld) *
+    // world(bone) * InverseBindMatrices[bone]. Stored as the rows of each
+    // affine matrix, which is what the shader and batch::skinVertices take.
+    void computePalette(const SceneGraph &scene, const glm::mat4 &meshWorld, std::vector<glm::mat3x4> &palette) const {
+        const glm::mat4 toMesh = batch::affineInverse(meshWorld);
+        palette.resize(BoneNodes.size());
+        for (size_t b = 0; b < BoneNodes.size(); ++b) {
+            const glm::mat4 &world = BoneNodes[b] == SceneGraph::none ? meshWorld : scene.world(BoneNodes[b]);
+            palette[b] = glm::mat3x4(glm::transpose(toMesh * world * InverseBindMatrices[b]));
+        }
+    }
+};
+
+// keyframes of one node, times in seconds and ascending
+struct NodeTrack {
+    std::string NodeName;
+    SceneGraph::NodeId Node = SceneGraph::none;
+    std::vector<float> PositionTimes, RotationTimes, ScaleTimes;
+    std::vector<glm::vec3> Positions, Scales;
+    std::vector<glm::quat> Rotations;
+};
+
+struct AnimationClip {
+    std::string Name;
+    float Duration = 0.f; // seconds
+    std::vector<NodeTrack> Tracks;
+
+    // tracks of nodes that aren't in `scene` are skipped when sampling
+    void resolve(const SceneGraph &scene) {
+        for (NodeTrack &track : Tracks) {
+            track.Node = scene.find(track.NodeName);
+        }
+    }
+};
+
+// Plays one clip on one scene graph. Clips are shared and read only;
+// everything per character lives here.
+class Animator {
+public:
+    explicit Animator(SceneGraph &scene) : scene(&scene) {}
+
+    void play(const AnimationClip &clip, bool loop = true) {
+        this->clip = &clip;
+        this->loop = loop;
+        time = 0.f;
+        cursors.assign(clip.Tracks.size() * 3, 0);
+        for (int c = 0; c < 4; ++c) {
+            from[c].resize(clip.Tracks.size());
+            to[c].resize(clip.Tracks.size());
+        }
+        factors.resize(clip.Tracks.size());
+        rotated.resize(clip.Tracks.size());
+    }
+
+    const AnimationClip *playing() const { return clip; }
+    float currentTime() const { return time; }
+
+    // move the clip forward and pose the nodes it animates
+    void advance(float seconds) {
+        if (!clip) {
+            return;
+        }
+        time += seconds;
+        if (clip->Duration > 0.f) {
+            time = loop ? time - clip->Duration * std::floor(time / clip->Duration) : std::min(time, clip->Duration);
+        }
+        sample(time);
+    }
+
+    // pose the nodes as they are `t` seconds into the clip
+    void sample(float t) {
+        if (!clip) {
+            return;
+        }
+        size_t rotations = 0;
+        for (size_t k = 0; k < clip->Tracks.size(); ++k) {
+            const NodeTrack &track = clip->Tracks[k];
+            if (track.Node == SceneGraph::none) {
+                continue;
+            }
+            uint32_t *cursor = &cursors[k * 3];
+            if (!track.Positions.empty()) {
+                const uint32_t i = findKey(track.PositionTimes, t, cursor[0]);
+                const uint32_t j = std::min<uint32_t>(i + 1, (uint32_t)track.Positions.size() - 1);
+                scene->setTranslation(track.Node, glm::mix(track.Positions[i], track.Positions[j], keyFactor(track.PositionTimes, i, t)));
+            }
+            if (!track.Scales.empty()) {
+                const uint32_t i = findKey(track.ScaleTimes, t, cursor[2]);
+                const uint32_t j = std::min<uint32_t>(i + 1, (uint32_t)track.Scales.size() - 1);
+                scene->setScale(track.Node, glm::mix(track.Scales[i], track.Scales[j], keyFactor(track.ScaleTimes, i, t)));
+            }
+            if (!track.Rotations.empty()) {
+                // gathered for one batch slerp below
+                const uint32_t i = findKey(track.RotationTimes, t, cursor[1]);
+                const uint32_t j = std::min<uint32_t>(i + 1, (uint32_t)track.Rotations.size() - 1);
+                for (int c = 0; c < 4; ++c) {
+                    from[c][rotations] = track.Rotations[i][c];
+                    to[c][rotations] = track.Rotations[j][c];
+                }
+                factors[rotations] = keyFactor(track.RotationTimes, i, t);
+                rotated[rotations++] = (uint32_t)k;
+            }
+        }
+        const batch::QuatArrays a = {from[0].data(), from[1].data(), from[2].data(), from[3].data()};
+        const batch::QuatArrays b = {to[0].data(), to[1].data(), to[2].data(), to[3].data()};
+        batch::slerp(a, b, factors.data(), rotations, a);
+        for (size_t r = 0; r < rotations; ++r) {
+            scene->setRotation(clip->Tracks[rotated[r]].Node, glm::quat(from[3][r], from[0][r], from[1][r], from[2][r]));
+        }
+    }
+
+    SceneGraph &graph() { return *scene; }
+
+    // advance every animator and update its scene graph, the characters
+    // spread over the hardware threads
+    static void updateAll(Animator *const *animators, size_t count, float seconds) {
+        parallelFor(count, 4, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                animators[i]->advance(seconds);
+                animators[i]->scene->update();
+            }
+        });
+    }
+
+private:
+    SceneGraph *scene;
+    const AnimationClip *clip = nullptr;
+    float time = 0.f;
+    bool loop = true;
+    // per track and channel the key found last time; playing forward
+    // moves it by at most one key per frame, so sampling rarely searches
+    std::vector<uint32_t> cursors;
+    // rotation keys as structure of arrays for batch::slerp
+    std::vector<float> from[4], to[4], factors;
+    std::vector<uint32_t> rotated;
+
+    // i with times[i] <= t < times[i + 1], clamped to the keys
+    static uint32_t findKey(const std::vector<float> &times, float t, uint32_t &cursor) {
+        const uint32_t last = (uint32_t)times.size() - 1;
+        uint32_t i = std::min(cursor, last);
+        if (i < last && times[i + 1] <= t) {
+            ++i;
+        }
+        if (times[i] > t || (i < last && times[i + 1] <= t)) {
+            const uint32_t upper = (uint32_t)(std::upper_bound(times.begin(), times.end(), t) - times.begin());
+            i = upper ? std::min(upper - 1, last) : 0;
+        }
+        cursor = i;
+        return i;
+    }
+
+    static float keyFactor(const std::vector<float> &times, uint32_t i, float t) {
+        if (i + 1 >= times.size()) {
+            return 0.f;
+        }
+        const float span = times[i + 1] - times[i];
+        return span > 0.f ? glm::clamp((t - times[i]) / span, 0.f, 1.f) : 0.f;
+    }
+};
+
+#endif
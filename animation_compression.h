@@ -0,0 +1,560 @@
+#ifndef ANIMATION_COMPRESSION_H
+#define ANIMATION_COMPRESSION_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "animation.h"
+
+// Compressed animation clips for large animation libraries.
+//
+// compressClip() resamples a clip at a fixed rate, quantizes every key to
+// 16 bits per component - rotations smallest-three in 48 bits, translations
+// and scales against the range of their track - and then drops every key
+// the pose can do without. Whether a key can go is judged in world space on
+// virtual vertices: each bone's origin and three points ShellDistance along
+// its axes. An error close to the root moves everything below it, so a
+// track is checked on the vertices of its whole subtree, and tracks are
+// compressed parents first against the already compressed parents; the
+// tolerance then bounds the error of the whole chain, not of each bone.
+// The error is measured against the uncompressed pose, so it includes the
+// quantization. Key dropping leaves QuantizationShare of the tolerance to
+// the tracks below, and a track whose 16-bit keys alone would still miss
+// it (15-bit rotation components err by up to about 4e-5 radians, which
+// chains of metre sized bones add up) keeps float keys instead. Keys are
+// interpolated as Animator does, and the error is checked at quarter
+// frames too, so it stays bounded between frames.
+//
+// The keys of a track are records of 16-bit words, one per kept frame: the
+// frame, then the animated rotation, translation and scale, quantized or
+// as the two halves of each float. The tracks' records follow each other
+// in one array, so playing forward (CompressedAnimator) reads each track
+// front to back, touching one record per key instead of one array per
+// channel.
+
+struct CompressionSettings {
+    float Tolerance = 1e-4f;         // max world space error, model units
+    float QuantizationShare = 0.2f;  // of the tolerance, kept from key dropping for the tracks below
+    float ShellDistance = 0.05f;     // distance of the virtual vertices from each bone
+    float SampleRate = 0.f;          // frames per second, 0 for the rate of the densest track
+};
+
+struct CompressedTrack {
+    enum Channel : uint8_t { Rotation = 1, Translation = 2, Scale = 4 };
+
+    SceneGraph::NodeId Node = SceneGraph::none;
+    uint8_t Animated = 0; // Channel bits that have keys; the others are constant
+    uint8_t Stride = 1;   // words per key record
+    bool Exact = false;   // keys are floats, two words per component
+    uint32_t Offset = 0;  // of the first record in CompressedClip::Keys
+    uint32_t KeyCount = 0;
+    // the values of constant channels
+    glm::quat ConstantRotation = glm::quat(1.f, 0.f, 0.f, 0.f);
+    glm::vec3 ConstantTranslation = glm::vec3(0.f), ConstantScale = glm::vec3(1.f);
+    // animated translations and scales are Min + key * Step per component
+    glm::vec3 TranslationMin = glm::vec3(0.f), TranslationStep = glm::vec3(0.f);
+    glm::vec3 ScaleMin = glm::vec3(0.f), ScaleStep = glm::vec3(0.f);
+};
+
+struct CompressedClip {
+    std::string Name;
+    float Duration = 0.f;
+    float SampleRate = 0.f; // frames per second
+    std::vector<std::string> NodeNames; // per track
+    std::vector<CompressedTrack> Tracks;
+    std::vector<uint16_t> Keys;
+
+    // tracks of nodes that aren't in `scene` are skipped when sampling
+    void resolve(const SceneGraph &scene) {
+        for (size_t k = 0; k < Tracks.size(); ++k) {
+            Tracks[k].Node = scene.find(NodeNames[k]);
+        }
+    }
+
+    // keys and track headers, without the names
+    size_t byteSize() const { return Keys.size() * sizeof(uint16_t) + Tracks.size() * sizeof(CompressedTrack); }
+};
+
+// key data of an uncompressed clip, to compare byteSize() with
+inline size_t rawByteSize(const AnimationClip &clip) {
+    size_t bytes = 0;
+    for (const NodeTrack &track : clip.Tracks) {
+        bytes += track.PositionTimes.size() * sizeof(float) + track.Positions.size() * sizeof(glm::vec3);
+        bytes += track.RotationTimes.size() * sizeof(float) + track.Rotations.size() * sizeof(glm::quat);
+        bytes += track.ScaleTimes.size() * sizeof(float) + track.Scales.size() * sizeof(glm::vec3);
+    }
+    return bytes;
+}
+
+// Smallest three: the largest component is left out and rebuilt from the
+// unit length. It's made positive by picking the sign of q, which leaves the
+// other three within +-1/sqrt(2), stored in 15 bits each; the index of the
+// left out component goes in the top bits of the first two words.
+inline void encodeRotation48(glm::quat q, uint16_t *out) {
+    int largest = 0;
+    for (int i = 1; i < 4; ++i) {
+        if (std::abs(q[i]) > std::abs(q[largest])) {
+            largest = i;
+        }
+    }
+    if (q[largest] < 0.f) {
+        q = -q;
+    }
+    uint16_t packed[3];
+    for (int i = 0, j = 0; i < 4; ++i) {
+        if (i != largest) {
+            const float v = glm::clamp(q[i] * 1.41421356f, -1.f, 1.f);
+            packed[j++] = (uint16_t)std::lround((v * 0.5f + 0.5f) * 32767.f);
+        }
+    }
+    out[0] = (uint16_t)(packed[0] | (largest >> 1) << 15);
+    out[1] = (uint16_t)(packed[1] | (largest & 1) << 15);
+    out[2] = packed[2];
+}
+
+inline glm::quat decodeRotation48(const uint16_t *in) {
+    const float scale = 2.f / 32767.f * 0.70710678f;
+    const float a = (in[0] & 0x7fff) * scale - 0.70710678f;
+    const float b = (in[1] & 0x7fff) * scale - 0.70710678f;
+    const float c = (in[2] & 0x7fff) * scale - 0.70710678f;
+    const float largest = std::sqrt(std::max(0.f, 1.f - a * a - b * b - c * c));
+    switch ((in[0] >> 15) << 1 | in[1] >> 15) {
+        case 0: return glm::quat(c, largest, a, b);
+        case 1: return glm::quat(c, a, largest, b);
+        case 2: return glm::quat(c, a, b, largest);
+        default: return glm::quat(largest, a, b, c);
+    }
+}
+
+inline void encodeFloat32(float value, uint16_t *out) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    out[0] = (uint16_t)bits;
+    out[1] = (uint16_t)(bits >> 16);
+}
+
+inline float decodeFloat32(const uint16_t *in) {
+    const uint32_t bits = in[0] | (uint32_t)in[1] << 16;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline CompressedClip compressClip(const AnimationClip &clip, const SceneGraph &scene,
+                                   const CompressionSettings &settings = CompressionSettings()) {
+    CompressedClip result;
+    result.Name = clip.Name;
+    result.Duration = clip.Duration;
+
+    float rate = settings.SampleRate;
+    if (rate <= 0.f) {
+        size_t keys = 2;
+        for (const NodeTrack &track : clip.Tracks) {
+            keys = std::max({keys, track.PositionTimes.size(), track.RotationTimes.size(), track.ScaleTimes.size()});
+        }
+        rate = clip.Duration > 0.f ? (keys - 1) / clip.Duration : 1.f;
+    }
+    size_t frames = clip.Duration > 0.f ? (size_t)std::ceil(clip.Duration * rate - 1e-3f) + 1 : 1;
+    if (frames > 65535) {
+        std::cerr << "WARNING: clip " << clip.Name << " has " << frames << " frames, keeping 65535" << std::endl;
+        frames = 65535;
+    }
+    result.SampleRate = frames > 1 ? (frames - 1) / clip.Duration : 1.f;
+
+    // the clip sampled at every frame, and the reference world matrices at
+    // every step: the frames and a few points between them, since between
+    // frames the error is interpolated too
+    const size_t substeps = 4, nodes = scene.size(), steps = substeps * (frames - 1) + 1;
+    std::vector<int> trackOf(nodes, -1);
+    for (size_t k = 0; k < clip.Tracks.size(); ++k) {
+        if (clip.Tracks[k].Node != SceneGraph::none) {
+            trackOf[clip.Tracks[k].Node] = (int)k;
+        }
+    }
+    auto compose = [](const glm::vec3 &t, const glm::quat &r, const glm::vec3 &s) {
+        return glm::scale(glm::translate(glm::mat4(1.f), t) * glm::mat4_cast(r), s);
+    };
+    std::vector<glm::mat4> restLocals(nodes);
+    for (SceneGraph::NodeId id = 0; id < nodes; ++id) {
+        restLocals[id] = compose(scene.translation(id), scene.rotation(id), scene.scale(id));
+    }
+    std::vector<glm::vec3> sampledT(clip.Tracks.size() * frames), sampledS(clip.Tracks.size() * frames);
+    std::vector<glm::quat> sampledR(clip.Tracks.size() * frames);
+    std::vector<glm::mat4> reference(nodes * steps);
+    SceneGraph posed = scene;
+    Animator animator(posed);
+    animator.play(clip, false);
+    for (size_t step = 0; step < steps; ++step) {
+        animator.sample(step / (substeps * result.SampleRate));
+        for (SceneGraph::NodeId id = 0; id < nodes; ++id) {
+            glm::mat4 local = restLocals[id];
+            if (trackOf[id] >= 0) {
+                local = compose(posed.translation(id), posed.rotation(id), posed.scale(id));
+                if (step % substeps == 0) {
+                    const size_t i = trackOf[id] * frames + step / substeps;
+                    sampledT[i] = posed.translation(id), sampledR[i] = posed.rotation(id), sampledS[i] = posed.scale(id);
+                }
+            }
+            const SceneGraph::NodeId parent = scene.parent(id);
+            reference[step * nodes + id] = parent == SceneGraph::none ? local : reference[step * nodes + parent] * local;
+        }
+    }
+
+    // the nodes whose virtual vertices a track moves
+    std::vector<std::vector<SceneGraph::NodeId>> children(nodes);
+    for (SceneGraph::NodeId id = 0; id < nodes; ++id) {
+        if (scene.parent(id) != SceneGraph::none) {
+            children[scene.parent(id)].push_back(id);
+        }
+    }
+
+    // parents first; node IDs are in creation order, so parents come first.
+    // approximate: the world matrices as played back from the kept keys
+    std::vector<glm::mat4> approximate(nodes * steps), referenceInverse(steps);
+    std::vector<glm::vec3> decodedT(frames), decodedS(frames);
+    std::vector<glm::quat> decodedR(frames);
+    std::vector<uint16_t> encoded(frames * 9);
+    std::vector<SceneGraph::NodeId> subtree;
+    std::vector<size_t> kept;
+    const float d = settings.ShellDistance;
+    result.Tracks.resize(clip.Tracks.size());
+    result.NodeNames.resize(clip.Tracks.size());
+    for (SceneGraph::NodeId id = 0; id < nodes; ++id) {
+        const SceneGraph::NodeId parent = scene.parent(id);
+        auto parentWorld = [&](size_t step) { return parent == SceneGraph::none ? glm::mat4(1.f) : approximate[step * nodes + parent]; };
+        if (trackOf[id] < 0) {
+            for (size_t step = 0; step < steps; ++step) {
+                approximate[step * nodes + id] = parentWorld(step) * restLocals[id];
+            }
+            continue;
+        }
+        const size_t k = trackOf[id];
+        CompressedTrack &track = result.Tracks[k];
+        result.NodeNames[k] = clip.Tracks[k].NodeName;
+        track.Node = id;
+
+        subtree.assign(1, id);
+        for (size_t i = 0; i < subtree.size(); ++i) {
+            subtree.insert(subtree.end(), children[subtree[i]].begin(), children[subtree[i]].end());
+        }
+        for (size_t step = 0; step < steps; ++step) {
+            referenceInverse[step] = batch::affineInverse(reference[step * nodes + id]);
+        }
+        // How far the virtual vertices of the subtree are from the reference
+        // pose at `step` with `local` for this node: the error of the
+        // compressed parents, this track and, below it, nothing yet.
+        auto withinTolerance = [&](size_t step, const glm::mat4 &local, float tolerance) {
+            glm::mat4 delta = parentWorld(step) * local * referenceInverse[step];
+            delta -= glm::mat4(1.f);
+            for (SceneGraph::NodeId node : subtree) {
+                const glm::mat4 &m = reference[step * nodes + node];
+                const glm::vec4 points[4] = {m[3], m[3] + d * m[0], m[3] + d * m[1], m[3] + d * m[2]};
+                for (const glm::vec4 &point : points) {
+                    if (glm::length(glm::vec3(delta * point)) > tolerance) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        };
+
+        // quantize; a channel is constant when all its keys quantize the same
+        const glm::vec3 *t = &sampledT[k * frames], *s = &sampledS[k * frames];
+        const glm::quat *r = &sampledR[k * frames];
+        glm::vec3 tMin = t[0], tMax = t[0], sMin = s[0], sMax = s[0];
+        for (size_t f = 1; f < frames; ++f) {
+            tMin = glm::min(tMin, t[f]), tMax = glm::max(tMax, t[f]);
+            sMin = glm::min(sMin, s[f]), sMax = glm::max(sMax, s[f]);
+        }
+        track.TranslationMin = tMin, track.TranslationStep = (tMax - tMin) / 65535.f;
+        track.ScaleMin = sMin, track.ScaleStep = (sMax - sMin) / 65535.f;
+        for (size_t f = 0; f < frames; ++f) {
+            uint16_t *words = &encoded[f * 9];
+            encodeRotation48(r[f], words);
+            for (int c = 0; c < 3; ++c) {
+                const float tStep = track.TranslationStep[c], sStep = track.ScaleStep[c];
+                words[3 + c] = tStep > 0.f ? (uint16_t)std::lround((t[f][c] - tMin[c]) / tStep) : 0;
+                words[6 + c] = sStep > 0.f ? (uint16_t)std::lround((s[f][c] - sMin[c]) / sStep) : 0;
+            }
+            decodedR[f] = decodeRotation48(words);
+            decodedT[f] = tMin + glm::vec3(words[3], words[4], words[5]) * track.TranslationStep;
+            decodedS[f] = sMin + glm::vec3(words[6], words[7], words[8]) * track.ScaleStep;
+            for (int c = 0; c < 3; ++c) {
+                if (words[c] != encoded[c]) track.Animated |= CompressedTrack::Rotation;
+                if (words[3 + c] != encoded[3 + c]) track.Animated |= CompressedTrack::Translation;
+                if (words[6 + c] != encoded[6 + c]) track.Animated |= CompressedTrack::Scale;
+            }
+        }
+        // the local matrix at `step` between kept frames a and b, as
+        // CompressedAnimator interpolates it
+        auto interpolate = [&](size_t a, size_t b, size_t step) {
+            const float x = b > a ? (float)(step - substeps * a) / (float)(substeps * (b - a)) : 0.f;
+            return compose(glm::mix(decodedT[a], decodedT[b], x), batch::scalar::nlerpOne(decodedR[a], decodedR[b], x, true),
+                           glm::mix(decodedS[a], decodedS[b], x));
+        };
+        // where the 16-bit keys alone, on top of what the parents already
+        // use, miss the tolerance, the track keeps float keys
+        for (size_t step = 0; step < steps && !track.Exact; ++step) {
+            const size_t f = step / substeps;
+            track.Exact = !withinTolerance(step, interpolate(f, std::min(f + 1, frames - 1), step), settings.Tolerance);
+        }
+        if (track.Exact) {
+            track.Animated = 0;
+            track.TranslationStep = track.ScaleStep = glm::vec3(0.f);
+            for (size_t f = 0; f < frames; ++f) {
+                decodedR[f] = r[f], decodedT[f] = t[f], decodedS[f] = s[f];
+                if (r[f] != r[0]) track.Animated |= CompressedTrack::Rotation;
+                if (t[f] != t[0]) track.Animated |= CompressedTrack::Translation;
+                if (s[f] != s[0]) track.Animated |= CompressedTrack::Scale;
+            }
+        }
+        track.ConstantRotation = decodedR[0];
+        track.ConstantTranslation = decodedT[0];
+        track.ConstantScale = decodedS[0];
+
+        // frames a + 1 .. b - 1 can be interpolated from a and b, leaving
+        // the tracks below room for their quantization
+        const float dropTolerance = settings.Tolerance * (1.f - settings.QuantizationShare);
+        auto canDrop = [&](size_t a, size_t b) {
+            for (size_t step = substeps * a + 1; step < substeps * b; ++step) {
+                if (!withinTolerance(step, interpolate(a, b, step), dropTolerance)) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        // greedy: stretch each segment as far as it stays within tolerance
+        kept.assign(1, 0);
+        if (track.Animated) {
+            for (size_t a = 0; a + 1 < frames;) {
+                size_t b = a + 1;
+                while (b + 1 < frames && canDrop(a, b + 1)) {
+                    ++b;
+                }
+                kept.push_back(b);
+                a = b;
+            }
+        }
+        for (size_t step = 0, i = 0; step < steps; ++step) {
+            while (i + 1 < kept.size() && substeps * kept[i + 1] < step) {
+                ++i;
+            }
+            const size_t a = kept[i], b = i + 1 < kept.size() ? kept[i + 1] : a;
+            approximate[step * nodes + id] = parentWorld(step) * interpolate(a, b, step);
+        }
+
+        const int words = track.Exact ? 2 : 1;
+        track.Stride = 1 + (track.Animated & CompressedTrack::Rotation ? (track.Exact ? 8 : 3) : 0) +
+                       (track.Animated & CompressedTrack::Translation ? 3 * words : 0) +
+                       (track.Animated & CompressedTrack::Scale ? 3 * words : 0);
+        track.Offset = (uint32_t)result.Keys.size();
+        track.KeyCount = track.Animated ? (uint32_t)kept.size() : 0;
+        for (size_t i = 0; i < track.KeyCount; ++i) {
+            const size_t f = kept[i];
+            result.Keys.push_back((uint16_t)f);
+            if (!track.Exact) {
+                for (int channel = 0; channel < 3; ++channel) {
+                    if (track.Animated & (1 << channel)) {
+                        result.Keys.insert(result.Keys.end(), &encoded[f * 9 + channel * 3], &encoded[f * 9 + channel * 3 + 3]);
+                    }
+                }
+                continue;
+            }
+            uint16_t floats[2];
+            auto append = [&](float value) {
+                encodeFloat32(value, floats);
+                result.Keys.insert(result.Keys.end(), floats, floats + 2);
+            };
+            if (track.Animated & CompressedTrack::Rotation) {
+                for (int c = 0; c < 4; ++c) append(r[f][c]);
+            }
+            if (track.Animated & CompressedTrack::Translation) {
+                for (int c = 0; c < 3; ++c) append(t[f][c]);
+            }
+            if (track.Animated & CompressedTrack::Scale) {
+                for (int c = 0; c < 3; ++c) append(s[f][c]);
+            }
+        }
+    }
+    // tracks of nodes that aren't in the scene have nothing to check against
+    std::vector<CompressedTrack> tracks;
+    std::vector<std::string> names;
+    for (size_t k = 0; k < clip.Tracks.size(); ++k) {
+        if (result.Tracks[k].Node != SceneGraph::none) {
+            tracks.push_back(result.Tracks[k]);
+            names.push_back(result.NodeNames[k]);
+        }
+    }
+    result.Tracks = std::move(tracks);
+    result.NodeNames = std::move(names);
+    return result;
+}
+
+// Animator for compressed clips: plays one clip on one scene graph.
+class CompressedAnimator {
+public:
+    explicit CompressedAnimator(SceneGraph &scene) : scene(&scene) {}
+
+    // constant channels are set here, once
+    void play(const CompressedClip &clip, bool loop = true) {
+        this->clip = &clip;
+        this->loop = loop;
+        time = 0.f;
+        cursors.assign(clip.Tracks.size(), 0);
+        for (int c = 0; c < 4; ++c) {
+            from[c].resize(clip.Tracks.size());
+            to[c].resize(clip.Tracks.size());
+        }
+        factors.resize(clip.Tracks.size());
+        rotated.resize(clip.Tracks.size());
+        for (const CompressedTrack &track : clip.Tracks) {
+            if (track.Node == SceneGraph::none) {
+                continue;
+            }
+            if (!(track.Animated & CompressedTrack::Rotation)) scene->setRotation(track.Node, track.ConstantRotation);
+            if (!(track.Animated & CompressedTrack::Translation)) scene->setTranslation(track.Node, track.ConstantTranslation);
+            if (!(track.Animated & CompressedTrack::Scale)) scene->setScale(track.Node, track.ConstantScale);
+        }
+    }
+
+    const CompressedClip *playing() const { return clip; }
+    float currentTime() const { return time; }
+
+    void advance(float seconds) {
+        if (!clip) {
+            return;
+        }
+        time += seconds;
+        if (clip->Duration > 0.f) {
+            time = loop ? time - clip->Duration * std::floor(time / clip->Duration) : std::min(time, clip->Duration);
+        }
+        sample(time);
+    }
+
+    void sample(float t) {
+        if (!clip) {
+            return;
+        }
+        const float frame = t * clip->SampleRate;
+        size_t rotations = 0;
+        for (size_t k = 0; k < clip->Tracks.size(); ++k) {
+            const CompressedTrack &track = clip->Tracks[k];
+            if (track.Node == SceneGraph::none || !track.KeyCount) {
+                continue;
+            }
+            const uint16_t *keys = &clip->Keys[track.Offset];
+            const uint32_t i = findKey(keys, track.Stride, track.KeyCount, frame, cursors[k]);
+            const uint32_t j = std::min(i + 1, track.KeyCount - 1);
+            const uint16_t *a = keys + i * track.Stride, *b = keys + j * track.Stride;
+            const float x = b[0] > a[0] ? glm::clamp((frame - a[0]) / (float)(b[0] - a[0]), 0.f, 1.f) : 0.f;
+            a += 1, b += 1;
+            if (track.Exact) {
+                sampleExact(track, a, b, x, k, rotations);
+                continue;
+            }
+            if (track.Animated & CompressedTrack::Rotation) {
+                // gathered for one batch slerp below
+                const glm::quat qa = decodeRotation48(a), qb = decodeRotation48(b);
+                for (int c = 0; c < 4; ++c) {
+                    from[c][rotations] = qa[c];
+                    to[c][rotations] = qb[c];
+                }
+                factors[rotations] = x;
+                rotated[rotations++] = (uint32_t)k;
+                a += 3, b += 3;
+            }
+            if (track.Animated & CompressedTrack::Translation) {
+                const glm::vec3 ta(a[0], a[1], a[2]), tb(b[0], b[1], b[2]);
+                scene->setTranslation(track.Node, track.TranslationMin + glm::mix(ta, tb, x) * track.TranslationStep);
+                a += 3, b += 3;
+            }
+            if (track.Animated & CompressedTrack::Scale) {
+                const glm::vec3 sa(a[0], a[1], a[2]), sb(b[0], b[1], b[2]);
+                scene->setScale(track.Node, track.ScaleMin + glm::mix(sa, sb, x) * track.ScaleStep);
+            }
+        }
+        const batch::QuatArrays qa = {from[0].data(), from[1].data(), from[2].data(), from[3].data()};
+        const batch::QuatArrays qb = {to[0].data(), to[1].data(), to[2].data(), to[3].data()};
+        batch::slerp(qa, qb, factors.data(), rotations, qa);
+        for (size_t r = 0; r < rotations; ++r) {
+            scene->setRotation(clip->Tracks[rotated[r]].Node, glm::quat(from[3][r], from[0][r], from[1][r], from[2][r]));
+        }
+    }
+
+    SceneGraph &graph() { return *scene; }
+
+    // as Animator::updateAll
+    static void updateAll(CompressedAnimator *const *animators, size_t count, float seconds) {
+        parallelFor(count, 4, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                animators[i]->advance(seconds);
+                animators[i]->scene->update();
+            }
+        });
+    }
+
+private:
+    SceneGraph *scene;
+    const CompressedClip *clip = nullptr;
+    float time = 0.f;
+    bool loop = true;
+    std::vector<uint32_t> cursors; // key found last time, per track
+    std::vector<float> from[4], to[4], factors;
+    std::vector<uint32_t> rotated;
+
+    // sample() for a track with float keys, a and b past the frame words
+    void sampleExact(const CompressedTrack &track, const uint16_t *a, const uint16_t *b, float x, size_t k,
+                     size_t &rotations) {
+        auto vec3At = [](const uint16_t *words) {
+            return glm::vec3(decodeFloat32(words), decodeFloat32(words + 2), decodeFloat32(words + 4));
+        };
+        if (track.Animated & CompressedTrack::Rotation) {
+            for (int c = 0; c < 4; ++c) {
+                from[c][rotations] = decodeFloat32(a + 2 * c);
+                to[c][rotations] = decodeFloat32(b + 2 * c);
+            }
+            factors[rotations] = x;
+            rotated[rotations++] = (uint32_t)k;
+            a += 8, b += 8;
+        }
+        if (track.Animated & CompressedTrack::Translation) {
+            scene->setTranslation(track.Node, glm::mix(vec3At(a), vec3At(b), x));
+            a += 6, b += 6;
+        }
+        if (track.Animated & CompressedTrack::Scale) {
+            scene->setScale(track.Node, glm::mix(vec3At(a), vec3At(b), x));
+        }
+    }
+
+    // i with frame(i) <= frame < frame(i + 1), clamped to the keys; the
+    // frame is the first word of each record
+    static uint32_t findKey(const uint16_t *keys, uint32_t stride, uint32_t count, float frame, uint32_t &cursor) {
+        const uint32_t last = count - 1;
+        uint32_t i = std::min(cursor, last);
+        if (i < last && keys[(i + 1) * stride] <= frame) {
+            ++i;
+        }
+        if (keys[i * stride] > frame || (i < last && keys[(i + 1) * stride] <= frame)) {
+            uint32_t lo = 0, hi = count; // first record after frame
+            while (lo < hi) {
+                const uint32_t mid = (lo + hi) / 2;
+                if (keys[mid * stride] <= frame) lo = mid + 1;
+                else hi = mid;
+            }
+            i = lo ? std::min(lo - 1, last) : 0;
+        }
+        cursor = i;
+        return i;
+    }
+};
+
+#endif
@@ -0,0 +1,1059 @@
+#ifndef BATCH_MATH_H
+#define BATCH_MATH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "cpu_features.h"
+
+#if CPU_X86
+#include <immintrin.h>
+#endif
+#if CPU_NEON
+#include <arm_neon.h>
+#endif
+
+// Transform math over arrays of glm values, for the loops that otherwise
+// build and multiply matrices one object at a time.
+//
+// Every kernel is compiled for SSE4.1, AVX2 (+FMA), AVX-512 and NEON next to
+// a scalar glm version, and the widest one the CPU supports is picked the
+// first time a kernel runs (see cpu_features.h); the AVX-512 set falls back
+// to AVX2 kernels where those are as fast. Results match glm to float
+// rounding. Matrices are plain glm::mat4 arrays, so they can be uploaded or
+// used with glm directly.
+//
+// glm's own SIMD code (glm/simd, GLM_FORCE_INTRINSICS) is selected by
+// GLM_ARCH at compile time from the compiler's arch flags. The samples are
+// built without any, so that code is never used and glm stays scalar; these
+// kernels are how the hot loops get vector code in a portable binary.
+
+namespace batch {
+
+static_assert(sizeof(glm::mat4) == 64 && sizeof(glm::mat3x4) == 48 && sizeof(glm::vec3) == 12,
+              "batch kernels expect packed glm types");
+static_assert(sizeof(glm::quat) == 16 && offsetof(glm::quat, x) == 0 && offsetof(glm::quat, w) == 12,
+              "batch kernels expect x, y, z, w quaternions");
+
+// output size from which kernels bound by memory traffic use streaming
+// stores: about what stays in a core's L2
+constexpr size_t streamingBytes = 1 << 20;
+
+// Single matrix versions of the inverses. Columns of the 3x3 inverse
+// transpose are cross products of the other two columns over the
+// determinant, which costs a fraction of the general 4x4 glm::inverse.
+
+inline glm::mat3 normalMatrix(const glm::mat4 &m) {
+    const glm::vec3 c0(m[0]), c1(m[1]), c2(m[2]);
+    glm::mat3 n(glm::cross(c1, c2), glm::cross(c2, c0), glm::cross(c0, c1));
+    const float det = glm::dot(c0, n[0]);
+    return det != 0.f ? n * (1.f / det) : n;
+}
+
+inline glm::mat4 affineInverse(const glm::mat4 &m) {
+    const glm::mat3 inverse = glm::transpose(normalMatrix(m));
+    glm::mat4 out(inverse);
+    out[3] = glm::vec4(-(inverse * glm::vec3(m[3])), 1.f);
+    return out;
+}
+
+inline glm::mat4 rigidInverse(const glm::mat4 &m) {
+    const glm::mat3 inverse = glm::transpose(glm::mat3(m));
+    glm::mat4 out(inverse);
+    out[3] = glm::vec4(-(inverse * glm::vec3(m[3])), 1.f);
+    return out;
+}
+
+// local transforms as structure of arrays
+struct TRSArrays {
+    const float *tx, *ty, *tz;
+    const float *rx, *ry, *rz, *rw; // unit quaternions
+    const float *sx, *sy, *sz;
+};
+
+struct Kernels {
+    // out[i] = translate(t[i]) * mat4_cast(r[i]) * scale(s[i]) for
+    // i = indices[k], or i = k without indices
+    void (*composeTRS)(const TRSArrays &trs, const uint32_t *indices, size_t count, glm::mat4 *out);
+    // out[k] = a[k] * b[k]
+    void (*multiply)(const glm::mat4 *a, const glm::mat4 *b, glm::mat4 *out, size_t count);
+    // worlds[i] = worlds[parents[i]] * locals[i], or locals[i] when
+    // parents[i] < 0, for i = indices[k] (or k) in order; a parent must come
+    // earlier in the batch or already be up to date
+    void (*multiplyHierarchy)(const int32_t *parents, const uint32_t *indices, size_t count, const glm::mat4 *locals,
+                              glm::mat4 *worlds);
+    // out[k] = m * vec4(in[k], 1); in and out may be the same array
+    void (*transformPoints)(const glm::mat4 &m, const glm::vec3 *in, glm::vec3 *out, size_t count);
+    // inverse transpose of the upper 3x3 of affine matrices, padded to 3x4
+    // for instance attributes and std140 blocks
+    void (*normalMatrices)(const glm::mat4 *models, glm::mat3x4 *out, size_t count);
+    // inverses of affine matrices (bottom row 0 0 0 1)
+    void (*affineInverses)(const glm::mat4 *in, glm::mat4 *out, size_t count);
+    // inverses of rotation + translation matrices
+    void (*rigidInverses)(const glm::mat4 *in, glm::mat4 *out, size_t count);
+    // inverses of any invertible matrices, as glm::inverse
+    void (*inverses)(const glm::mat4 *in, glm::mat4 *out, size_t count);
+    // out[k] = a[k] * b[k]
+    void (*multiplyQuats)(const glm::quat *a, const glm::quat *b, glm::quat *out, size_t count);
+};
+
+// the arrays from element `k` on
+inline TRSArrays offset(const TRSArrays &trs, size_t k) {
+    return {trs.tx + k, trs.ty + k, trs.tz + k, trs.rx + k, trs.ry + k, trs.rz + k, trs.rw + k, trs.sx + k, trs.sy + k, trs.sz + k};
+}
+
+namespace scalar {
+
+inline void composeOne(const TRSArrays &trs, uint32_t i, glm::mat4 &out) {
+    out = glm::mat4_cast(glm::quat(trs.rw[i], trs.rx[i], trs.ry[i], trs.rz[i]));
+    out[0] *= trs.sx[i];
+    out[1] *= trs.sy[i];
+    out[2] *= trs.sz[i];
+    out[3] = glm::vec4(trs.tx[i], trs.ty[i], trs.tz[i], 1.f);
+}
+
+inline void composeTRS(const TRSArrays &trs, const uint32_t *indices, size_t count, glm::mat4 *out) {
+    for (size_t k = 0; k < count; ++k) {
+        const uint32_t i = indices ? indices[k] : (uint32_t)k;
+        composeOne(trs, i, out[i]);
+    }
+}
+
+inline void multiply(const glm::mat4 *a, const glm::mat4 *b, glm::mat4 *out, size_t count) {
+    for (size_t k = 0; k < count; ++k) {
+        out[k] = a[k] * b[k];
+    }
+}
+
+inline void multiplyHierarchy(const int32_t *parents, const uint32_t *indices, size_t count, const glm::mat4 *locals,
+                              glm::mat4 *worlds) {
+    for (size_t k = 0; k < count; ++k) {
+        const uint32_t i = indices ? indices[k] : (uint32_t)k;
+        worlds[i] = parents[i] < 0 ? locals[i] : worlds[parents[i]] * locals[i];
+    }
+}
+
+inline void transformPoints(const glm::mat4 &m, const glm::vec3 *in, glm::vec3 *out, size_t count) {
+    for (size_t k = 0; k < count; ++k) {
+        out[k] = glm::vec3(m * glm::vec4(in[k], 1.f));
+    }
+}
+
+inline void normalMatrices(const glm::mat4 *models, glm::mat3x4 *out, size_t count) {
+    for (size_t k = 0; k < count; ++k) {
+        const glm::mat3 n = normalMatrix(models[k]);
+        out[k] = glm::mat3x4(glm::vec4(n[0], 0.f), glm::vec4(n[1], 0.f), glm::vec4(n[2], 0.f));
+    }
+}
+
+inline void affineInverses(const glm::mat4 *in, glm::mat4 *out, size_t count) {
+    for (size_t k = 0; k < count; ++k) {
+        out[k] = affineInverse(in[k]);
+    }
+}
+
+inline void rigidInverses(const glm::mat4 *in, glm::mat4 *out, size_t count) {
+    for (size_t k = 0; k < count; ++k) {
+        out[k] = rigidInverse(in[k]);
+    }
+}
+
+inline void inverses(const glm::mat4 *in, glm::mat4 *out, size_t count) {
+    for (size_t k = 0; k < count; ++k) {
+        out[k] = glm::inverse(in[k]);
+    }
+}
+
+inline void multiplyQuats(const glm::quat *a, const glm::quat *b, glm::quat *out, size_t count) {
+    for (size_t k = 0; k < count; ++k) {
+        out[k] = a[k] * b[k];
+    }
+}
+
+constexpr Kernels kernels = {composeTRS, multiply, multiplyHierarchy, transformPoints, normalMatrices,
+                             affineInverses, rigidInverses, inverses, multiplyQuats};
+
+} // namespace scalar
+
+#if CPU_X86
+
+namespace sse41 {
+
+CPU_TARGET("sse4.1") inline __m128 lanes(const float *v, const uint32_t *indices, size_t k) {
+    return indices ? _mm_set_ps(v[indices[k + 3]], v[indices[k + 2]], v[indices[k + 1]], v[indices[k]])
+                   : _mm_loadu_ps(v + k);
+}
+
+// column `column` of the four matrices at dst, from one component per register
+CPU_TARGET("sse4.1") inline void storeColumn(__m128 x, __m128 y, __m128 z, __m128 w, float *const *dst, int column) {
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_storeu_ps(dst[0] + column * 4, x);
+    _mm_storeu_ps(dst[1] + column * 4, y);
+    _mm_storeu_ps(dst[2] + column * 4, z);
+    _mm_storeu_ps(dst[3] + column * 4, w);
+}
+
+CPU_TARGET("sse4.1") inline void composeTRS(const TRSArrays &trs, const uint32_t *indices, size_t count, glm::mat4 *out) {
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        const __m128 x = lanes(trs.rx, indices, k), y = lanes(trs.ry, indices, k);
+        const __m128 z = lanes(trs.rz, indices, k), w = lanes(trs.rw, indices, k);
+        const __m128 one = _mm_set1_ps(1.f), two = _mm_set1_ps(2.f);
+        const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        const __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+        const __m128 sx = lanes(trs.sx, indices, k), sy = lanes(trs.sy, indices, k), sz = lanes(trs.sz, indices, k);
+
+        float *dst[4];
+        for (int n = 0; n < 4; ++n) {
+            dst[n] = &out[indices ? indices[k + n] : k + n][0][0];
+        }
+        const __m128 zero = _mm_setzero_ps();
+        storeColumn(_mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx),
+                    _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx),
+                    _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx), zero, dst, 0);
+        storeColumn(_mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy),
+                    _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy),
+                    _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy), zero, dst, 1);
+        storeColumn(_mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz),
+                    _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz),
+                    _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz), zero, dst, 2);
+        storeColumn(lanes(trs.tx, indices, k), lanes(trs.ty, indices, k), lanes(trs.tz, indices, k), one, dst, 3);
+    }
+    for (; k < count; ++k) {
+        const uint32_t i = indices ? indices[k] : (uint32_t)k;
+        scalar::composeOne(trs, i, out[i]);
+    }
+}
+
+// out = a * b, column by column
+CPU_TARGET("sse4.1") inline void multiplyOne(const float *a, const float *b, float *out) {
+    const __m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4), a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+    __m128 columns[4];
+    for (int c = 0; c < 4; ++c) {
+        const __m128 col = _mm_loadu_ps(b + c * 4);
+        __m128 r = _mm_mul_ps(a0, _mm_shuffle_ps(col, col, _MM_SHUFFLE(0, 0, 0, 0)));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_shuffle_ps(col, col, _MM_SHUFFLE(1, 1, 1, 1))));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_shuffle_ps(col, col, _MM_SHUFFLE(2, 2, 2, 2))));
+        columns[c] = _mm_add_ps(r, _mm_mul_ps(a3, _mm_shuffle_ps(col, col, _MM_SHUFFLE(3, 3, 3, 3))));
+    }
+    // stored last so out may alias a or b
+    for (int c = 0; c < 4; ++c) {
+        _mm_storeu_ps(out + c * 4, columns[c]);
+    }
+}
+
+CPU_TARGET("sse4.1") inline void multiply(const glm::mat4 *a, const glm::mat4 *b, glm::mat4 *out, size_t count) {
+    for (size_t k = 0; k < count; ++k) {
+        multiplyOne(&a[k][0][0], &b[k][0][0], &out[k][0][0]);
+    }
+}
+
+CPU_TARGET("sse4.1") inline void multiplyHierarchy(const int32_t *parents, const uint32_t *indices, size_t count,
+                                                   const glm::mat4 *locals, glm::mat4 *worlds) {
+    for (size_t k = 0; k < count; ++k) {
+        const uint32_t i = indices ? indices[k] : (uint32_t)k;
+        if (parents[i] < 0) {
+            worlds[i] = locals[i];
+        } else {
+            multiplyOne(&worlds[parents[i]][0][0], &locals[i][0][0], &worlds[i][0][0]);
+        }
+    }
+}
+
+// four points at a time: loaded as texels of 4 floats (the last one
+// shifted, so nothing past the array is read), transposed, transformed
+// and written back the same way
+CPU_TARGET("sse4.1") inline void transformPoints(const glm::mat4 &m, const glm::vec3 *in, glm::vec3 *out, size_t count) {
+    const __m128 m0 = _mm_loadu_ps(&m[0][0]), m1 = _mm_loadu_ps(&m[1][0]), m2 = _mm_loadu_ps(&m[2][0]),
+                 m3 = _mm_loadu_ps(&m[3][0]);
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        const float *src = &in[k].x;
+        float *dst = &out[k].x;
+        const __m128 p0 = _mm_loadu_ps(src), p1 = _mm_loadu_ps(src + 3), p2 = _mm_loadu_ps(src + 6);
+        const __m128 p3 = _mm_loadu_ps(src + 8);
+        __m128 r[4];
+        const __m128 points[4] = {p0, p1, p2, _mm_shuffle_ps(p3, p3, _MM_SHUFFLE(3, 3, 2, 1))};
+        for (int n = 0; n < 4; ++n) {
+            const __m128 p = points[n];
+            __m128 v = _mm_add_ps(m3, _mm_mul_ps(m0, _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0))));
+            v = _mm_add_ps(v, _mm_mul_ps(m1, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1))));
+            r[n] = _mm_add_ps(v, _mm_mul_ps(m2, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2))));
+        }
+        _mm_storeu_ps(dst, r[0]);
+        _mm_storeu_ps(dst + 3, r[1]);
+        _mm_storeu_ps(dst + 6, r[2]);
+        // [r2.z, r3.x, r3.y, r3.z] at dst + 8
+        const __m128 last = _mm_shuffle_ps(r[3], r[3], _MM_SHUFFLE(2, 1, 0, 0));
+        _mm_storeu_ps(dst + 8, _mm_blend_ps(last, _mm_shuffle_ps(r[2], r[2], _MM_SHUFFLE(2, 2, 2, 2)), 1));
+    }
+    for (; k < count; ++k) {
+        out[k] = glm::vec3(m * glm::vec4(in[k], 1.f));
+    }
+}
+
+CPU_TARGET("sse4.1") inline __m128 cross(__m128 a, __m128 b) {
+    const __m128 ayzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)), bzxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+    const __m128 azxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2)), byzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    return _mm_sub_ps(_mm_mul_ps(ayzx, bzxy), _mm_mul_ps(azxy, byzx));
+}
+
+// columns of the 3x3 inverse transpose of m, w = 0
+CPU_TARGET("sse4.1") inline void normalColumns(const float *m, __m128 &n0, __m128 &n1, __m128 &n2) {
+    const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    const __m128 c0 = _mm_and_ps(_mm_loadu_ps(m), xyz), c1 = _mm_and_ps(_mm_loadu_ps(m + 4), xyz);
+    const __m128 c2 = _mm_and_ps(_mm_loadu_ps(m + 8), xyz);
+    n0 = cross(c1, c2);
+    n1 = cross(c2, c0);
+    n2 = cross(c0, c1);
+    const float det = _mm_cvtss_f32(_mm_dp_ps(c0, n0, 0x71));
+    const __m128 scale = _mm_set1_ps(det != 0.f ? 1.f / det : 1.f);
+    n0 = _mm_mul_ps(n0, scale);
+    n1 = _mm_mul_ps(n1, scale);
+    n2 = _mm_mul_ps(n2, scale);
+}
+
+CPU_TARGET("sse4.1") inline void normalMatrices(const glm::mat4 *models, glm::mat3x4 *out, size_t count) {
+    for (size_t k = 0; k < count; ++k) {
+        __m128 n0, n1, n2;
+        normalColumns(&models[k][0][0], n0, n1, n2);
+        float *dst = &out[k][0][0];
+        _mm_storeu_ps(dst, n0);
+        _mm_storeu_ps(dst + 4, n1);
+        _mm_storeu_ps(dst + 8, n2);
+    }
+}
+
+// out = [r | -r * t] from the rows r0..r2 of the 3x3 inverse
+CPU_TARGET("sse4.1") inline void storeInverse(__m128 r0, __m128 r1, __m128 r2, const float *m, float *out) {
+    __m128 r3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    const __m128 t = _mm_loadu_ps(m + 12);
+    __m128 translation = _mm_mul_ps(r0, _mm_shuffle_ps(t, t, _MM_SHUFFLE(0, 0, 0, 0)));
+    translation = _mm_add_ps(translation, _mm_mul_ps(r1, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 1, 1, 1))));
+    translation = _mm_add_ps(translation, _mm_mul_ps(r2, _mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 2, 2, 2))));
+    translation = _mm_sub_ps(_mm_setr_ps(0.f, 0.f, 0.f, 1.f), translation);
+    _mm_storeu_ps(out, r0);
+    _mm_storeu_ps(out + 4, r1);
+    _mm_storeu_ps(out + 8, r2);
+    _mm_storeu_ps(out + 12, translation);
+}
+
+CPU_TARGET("sse4.1") inline void affineInverses(const glm::mat4 *in, glm::mat4 *out, size_t count) {
+    for (size_t k = 0; k < count; ++k) {
+        // the rows of the inverse are the columns of the inverse transpose
+        __m128 r0, r1, r2;
+        normalColumns(&in[k][0][0], r0, r1, r2);
+        storeInverse(r0, r1, r2, &in[k][0][0], &out[k][0][0]);
+    }
+}
+
+CPU_TARGET("sse4.1") inline void rigidInverses(const glm::mat4 *in, glm::mat4 *out, size_t count) {
+    const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    for (size_t k = 0; k < count; ++k) {
+        // the rows of the inverse are the columns of m
+        const float *m = &in[k][0][0];
+        storeInverse(_mm_and_ps(_mm_loadu_ps(m), xyz), _mm_and_ps(_mm_loadu_ps(m + 4), xyz),
+                     _mm_and_ps(_mm_loadu_ps(m + 8), xyz), m, &out[k][0][0]);
+    }
+}
+
+// 2x2 blocks held as (m00, m01, m10, m11)
+// a * b
+CPU_TARGET("sse4.1") inline __m128 mat2Mul(__m128 a, __m128 b) {
+    return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))),
+                      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+// adj(a) * b
+CPU_TARGET("sse4.1") inline __m128 mat2AdjMul(__m128 a, __m128 b) {
+    return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+                      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+}
+// a * adj(b)
+CPU_TARGET("sse4.1") inline __m128 mat2MulAdj(__m128 a, __m128 b) {
+    return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))),
+                      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+// Blockwise inverse of M = [A B; C D] with adjugates of the 2x2 blocks
+// (Eric Zhang, "Fast 4x4 Matrix Inverse with SSE SIMD"). The blocks are
+// taken from columns, i.e. from the transpose, and the result is written
+// back as columns, which transposes it again.
+CPU_TARGET("sse4.1") inline void inverseOne(const float *m, float *out) {
+    const __m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8), c3 = _mm_loadu_ps(m + 12);
+    const __m128 a = _mm_shuffle_ps(c0, c1, _MM_SHUFFLE(1, 0, 1, 0)), b = _mm_shuffle_ps(c0, c1, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m128 c = _mm_shuffle_ps(c2, c3, _MM_SHUFFLE(1, 0, 1, 0)), d = _mm_shuffle_ps(c2, c3, _MM_SHUFFLE(3, 2, 3, 2));
+    // (|A|, |B|, |C|, |D|)
+    const __m128 dets = _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(3, 1, 3, 1))),
+                                   _mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(2, 0, 2, 0))));
+    const __m128 detA = _mm_shuffle_ps(dets, dets, _MM_SHUFFLE(0, 0, 0, 0));
+    const __m128 detB = _mm_shuffle_ps(dets, dets, _MM_SHUFFLE(1, 1, 1, 1));
+    const __m128 detC = _mm_shuffle_ps(dets, dets, _MM_SHUFFLE(2, 2, 2, 2));
+    const __m128 detD = _mm_shuffle_ps(dets, dets, _MM_SHUFFLE(3, 3, 3, 3));
+
+    const __m128 dc = mat2AdjMul(d, c), ab = mat2AdjMul(a, b);
+    // adjugates of the blocks of the inverse times |M|
+    __m128 x = _mm_sub_ps(_mm_mul_ps(detD, a), mat2Mul(b, dc));
+    __m128 w = _mm_sub_ps(_mm_mul_ps(detA, d), mat2Mul(c, ab));
+    __m128 y = _mm_sub_ps(_mm_mul_ps(detB, c), mat2MulAdj(d, ab));
+    __m128 z = _mm_sub_ps(_mm_mul_ps(detC, b), mat2MulAdj(a, dc));
+
+    // |M| = |A||D| + |B||C| - tr(adj(A) B adj(D) C)
+    __m128 trace = _mm_mul_ps(ab, _mm_shuffle_ps(dc, dc, _MM_SHUFFLE(3, 1, 2, 0)));
+    trace = _mm_hadd_ps(trace, trace);
+    trace = _mm_hadd_ps(trace, trace);
+    const __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), trace);
+    const __m128 scale = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), det);
+    x = _mm_mul_ps(x, scale), y = _mm_mul_ps(y, scale), z = _mm_mul_ps(z, scale), w = _mm_mul_ps(w, scale);
+
+    // undo the adjugates while storing
+    _mm_storeu_ps(out, _mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3)));
+    _mm_storeu_ps(out + 4, _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2)));
+    _mm_storeu_ps(out + 8, _mm_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3)));
+    _mm_storeu_ps(out + 12, _mm_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2)));
+}
+
+CPU_TARGET("sse4.1") inline void inverses(const glm::mat4 *in, glm::mat4 *out, size_t count) {
+    for (size_t k = 0; k < count; ++k) {
+        inverseOne(&in[k][0][0], &out[k][0][0]);
+    }
+}
+
+// Hamilton product in x, y, z, w order: a.w * b plus each of a.x, a.y, a.z
+// times a signed permutation of b
+CPU_TARGET("sse4.1") inline __m128 multiplyQuat(__m128 a, __m128 b) {
+    __m128 r = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3)), b);
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0)), _mm_setr_ps(1.f, -1.f, 1.f, -1.f)),
+                                 _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 1, 2, 3))));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)), _mm_setr_ps(1.f, 1.f, -1.f, -1.f)),
+                                 _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+    return _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)), _mm_setr_ps(-1.f, 1.f, 1.f, -1.f)),
+                                    _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1))));
+}
+
+CPU_TARGET("sse4.1") inline void multiplyQuats(const glm::quat *a, const glm::quat *b, glm::quat *out, size_t count) {
+    for (size_t k = 0; k < count; ++k) {
+        _mm_storeu_ps(&out[k].x, multiplyQuat(_mm_loadu_ps(&a[k].x), _mm_loadu_ps(&b[k].x)));
+    }
+}
+
+constexpr Kernels kernels = {composeTRS, multiply, multiplyHierarchy, transformPoints, normalMatrices,
+                             affineInverses, rigidInverses, inverses, multiplyQuats};
+
+} // namespace sse41
+
+namespace avx2 {
+
+#define BATCH_AVX2 CPU_TARGET("avx2,fma")
+
+BATCH_AVX2 inline __m256 lanes(const float *v, const uint32_t *indices, size_t k) {
+    return indices ? _mm256_i32gather_ps(v, _mm256_loadu_si256((const __m256i *)(indices + k)), 4)
+                   : _mm256_loadu_ps(v + k);
+}
+
+// 4x4 transposes inside each 128-bit half: nodes n and n + 4 share a register
+BATCH_AVX2 inline void storeColumn(__m256 x, __m256 y, __m256 z, __m256 w, float *const *dst, int column) {
+    const __m256 t0 = _mm256_unpacklo_ps(x, y), t1 = _mm256_unpackhi_ps(x, y);
+    const __m256 t2 = _mm256_unpacklo_ps(z, w), t3 = _mm256_unpackhi_ps(z, w);
+    const __m256 r[4] = {_mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)), _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2)),
+                         _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)), _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2))};
+    for (int n = 0; n < 4; ++n) {
+        _mm_storeu_ps(dst[n] + column * 4, _mm256_castps256_ps128(r[n]));
+        _mm_storeu_ps(dst[n + 4] + column * 4, _mm256_extractf128_ps(r[n], 1));
+    }
+}
+
+BATCH_AVX2 inline void composeTRS(const TRSArrays &trs, const uint32_t *indices, size_t count, glm::mat4 *out) {
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        const __m256 x = lanes(trs.rx, indices, k), y = lanes(trs.ry, indices, k);
+        const __m256 z = lanes(trs.rz, indices, k), w = lanes(trs.rw, indices, k);
+        const __m256 one = _mm256_set1_ps(1.f), two = _mm256_set1_ps(2.f);
+        const __m256 x2 = _mm256_mul_ps(two, x), y2 = _mm256_mul_ps(two, y), z2 = _mm256_mul_ps(two, z);
+        const __m256 xx = _mm256_mul_ps(x2, x), yy = _mm256_mul_ps(y2, y), zz = _mm256_mul_ps(z2, z);
+        const __m256 xy = _mm256_mul_ps(x2, y), xz = _mm256_mul_ps(x2, z), yz = _mm256_mul_ps(y2, z);
+        const __m256 wx = _mm256_mul_ps(x2, w), wy = _mm256_mul_ps(y2, w), wz = _mm256_mul_ps(z2, w);
+        const __m256 sx = lanes(trs.sx, indices, k), sy = lanes(trs.sy, indices, k), sz = lanes(trs.sz, indices, k);
+
+        float *dst[8];
+        for (int n = 0; n < 8; ++n) {
+            dst[n] = &out[indices ? indices[k + n] : k + n][0][0];
+        }
+        const __m256 zero = _mm256_setzero_ps();
+        storeColumn(_mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx), _mm256_mul_ps(_mm256_add_ps(xy, wz), sx),
+                    _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx), zero, dst, 0);
+        storeColumn(_mm256_mul_ps(_mm256_sub_ps(xy, wz), sy), _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy),
+                    _mm256_mul_ps(_mm256_add_ps(yz, wx), sy), zero, dst, 1);
+        storeColumn(_mm256_mul_ps(_mm256_add_ps(xz, wy), sz), _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz),
+                    _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz), zero, dst, 2);
+        storeColumn(lanes(trs.tx, indices, k), lanes(trs.ty, indices, k), lanes(trs.tz, indices, k), one, dst, 3);
+    }
+    if (indices) {
+        sse41::composeTRS(trs, indices + k, count - k, out);
+    } else {
+        sse41::composeTRS(offset(trs, k), nullptr, count - k, out + k);
+    }
+}
+
+// two columns per register, each half multiplied by a broadcast copy of a
+BATCH_AVX2 inline void multiplyColumns(const float *a, const float *b, __m256 &r01, __m256 &r23) {
+    const __m256 a0 = _mm256_broadcast_ps((const __m128 *)a), a1 = _mm256_broadcast_ps((const __m128 *)(a + 4));
+    const __m256 a2 = _mm256_broadcast_ps((const __m128 *)(a + 8)), a3 = _mm256_broadcast_ps((const __m128 *)(a + 12));
+    const __m256 b01 = _mm256_loadu_ps(b), b23 = _mm256_loadu_ps(b + 8);
+    r01 = _mm256_mul_ps(a0, _mm256_permute_ps(b01, 0x00));
+    r23 = _mm256_mul_ps(a0, _mm256_permute_ps(b23, 0x00));
+    r01 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b01, 0x55), r01);
+    r23 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b23, 0x55), r23);
+    r01 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b01, 0xaa), r01);
+    r23 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b23, 0xaa), r23);
+    r01 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b01, 0xff), r01);
+    r23 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b23, 0xff), r23);
+}
+
+BATCH_AVX2 inline void multiplyOne(const float *a, const float *b, float *out) {
+    __m256 r01, r23;
+    multiplyColumns(a, b, r01, r23);
+    _mm256_storeu_ps(out, r01);
+    _mm256_storeu_ps(out + 8, r23);
+}
+
+// Past the caches this is bound by memory traffic, not arithmetic: the
+// products are then written with streaming stores, which skip reading in
+// the lines they overwrite.
+BATCH_AVX2 inline void multiply(const glm::mat4 *a, const glm::mat4 *b, glm::mat4 *out, size_t count) {
+    if (count * sizeof(glm::mat4) < streamingBytes || (uintptr_t)out % 16) {
+        for (size_t k = 0; k < count; ++k) {
+            multiplyOne(&a[k][0][0], &b[k][0][0], &out[k][0][0]);
+        }
+        return;
+    }
+    for (size_t k = 0; k < count; ++k) {
+        __m256 r01, r23;
+        multiplyColumns(&a[k][0][0], &b[k][0][0], r01, r23);
+        // 16-byte stores: vectors of glm::mat4 are only that aligned
+        _mm_stream_ps(&out[k][0][0], _mm256_castps256_ps128(r01));
+        _mm_stream_ps(&out[k][1][0], _mm256_extractf128_ps(r01, 1));
+        _mm_stream_ps(&out[k][2][0], _mm256_castps256_ps128(r23));
+        _mm_stream_ps(&out[k][3][0], _mm256_extractf128_ps(r23, 1));
+    }
+    _mm_sfence();
+}
+
+BATCH_AVX2 inline void multiplyHierarchy(const int32_t *parents, const uint32_t *indices, size_t count,
+                                         const glm::mat4 *locals, glm::mat4 *worlds) {
+    for (size_t k = 0; k < count; ++k) {
+        const uint32_t i = indices ? indices[k] : (uint32_t)k;
+        if (parents[i] < 0) {
+            worlds[i] = locals[i];
+        } else {
+            multiplyOne(&worlds[parents[i]][0][0], &locals[i][0][0], &worlds[i][0][0]);
+        }
+    }
+}
+
+// Eight points (24 floats, three registers) at a time. Blending the three
+// registers gathers one component of every point, in a fixed scrambled order
+// that one permute sorts out; writing back runs the same steps in reverse.
+BATCH_AVX2 inline void transformPoints(const glm::mat4 &m, const glm::vec3 *in, glm::vec3 *out, size_t count) {
+    const __m256i orderX = _mm256_setr_epi32(0, 3, 6, 1, 4, 7, 2, 5);
+    const __m256i gatherY = _mm256_setr_epi32(1, 4, 7, 2, 5, 0, 3, 6);
+    const __m256i scatterY = _mm256_setr_epi32(5, 0, 3, 6, 1, 4, 7, 2);
+    const __m256i orderZ = _mm256_setr_epi32(2, 5, 0, 3, 6, 1, 4, 7);
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        const float *src = &in[k].x;
+        float *dst = &out[k].x;
+        const __m256 a = _mm256_loadu_ps(src), b = _mm256_loadu_ps(src + 8), c = _mm256_loadu_ps(src + 16);
+        const __m256 x = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(a, b, 0x92), c, 0x24), orderX);
+        const __m256 y = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(a, b, 0x24), c, 0x49), gatherY);
+        const __m256 z = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(a, b, 0x49), c, 0x92), orderZ);
+
+        __m256 o[3];
+        for (int r = 0; r < 3; ++r) {
+            __m256 v = _mm256_fmadd_ps(_mm256_set1_ps(m[0][r]), x, _mm256_set1_ps(m[3][r]));
+            v = _mm256_fmadd_ps(_mm256_set1_ps(m[1][r]), y, v);
+            o[r] = _mm256_fmadd_ps(_mm256_set1_ps(m[2][r]), z, v);
+        }
+        const __m256 ox = _mm256_permutevar8x32_ps(o[0], orderX);
+        const __m256 oy = _mm256_permutevar8x32_ps(o[1], scatterY);
+        const __m256 oz = _mm256_permutevar8x32_ps(o[2], orderZ);
+        _mm256_storeu_ps(dst, _mm256_blend_ps(_mm256_blend_ps(ox, oy, 0x92), oz, 0x24));
+        _mm256_storeu_ps(dst + 8, _mm256_blend_ps(_mm256_blend_ps(ox, oy, 0x24), oz, 0x49));
+        _mm256_storeu_ps(dst + 16, _mm256_blend_ps(_mm256_blend_ps(ox, oy, 0x49), oz, 0x92));
+    }
+    sse41::transformPoints(m, in + k, out + k, count - k);
+}
+
+BATCH_AVX2 inline __m256 load2(const float *a, const float *b) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(a)), _mm_loadu_ps(b), 1);
+}
+
+BATCH_AVX2 inline void store2(__m256 v, float *a, float *b) {
+    _mm_storeu_ps(a, _mm256_castps256_ps128(v));
+    _mm_storeu_ps(b, _mm256_extractf128_ps(v, 1));
+}
+
+BATCH_AVX2 inline __m256 cross(__m256 a, __m256 b) {
+    const __m256 ayzx = _mm256_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)), bzxy = _mm256_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+    const __m256 azxy = _mm256_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2)), byzx = _mm256_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    return _mm256_fmsub_ps(ayzx, bzxy, _mm256_mul_ps(azxy, byzx));
+}
+
+// the SSE version with two matrices per register, one in each half
+BATCH_AVX2 inline void normalColumns2(const float *a, const float *b, __m256 &n0, __m256 &n1, __m256 &n2) {
+    const __m256 xyz = _mm256_castsi256_ps(_mm256_setr_epi32(-1, -1, -1, 0, -1, -1, -1, 0));
+    const __m256 c0 = _mm256_and_ps(load2(a, b), xyz), c1 = _mm256_and_ps(load2(a + 4, b + 4), xyz);
+    const __m256 c2 = _mm256_and_ps(load2(a + 8, b + 8), xyz);
+    n0 = cross(c1, c2);
+    n1 = cross(c2, c0);
+    n2 = cross(c0, c1);
+    const __m256 det = _mm256_dp_ps(c0, n0, 0x7f);
+    const __m256 nonzero = _mm256_cmp_ps(det, _mm256_setzero_ps(), _CMP_NEQ_OQ);
+    const __m256 scale = _mm256_blendv_ps(_mm256_set1_ps(1.f), _mm256_div_ps(_mm256_set1_ps(1.f), det), nonzero);
+    n0 = _mm256_mul_ps(n0, scale);
+    n1 = _mm256_mul_ps(n1, scale);
+    n2 = _mm256_mul_ps(n2, scale);
+}
+
+BATCH_AVX2 inline void normalMatrices(const glm::mat4 *models, glm::mat3x4 *out, size_t count) {
+    size_t k = 0;
+    for (; k + 2 <= count; k += 2) {
+        __m256 n0, n1, n2;
+        normalColumns2(&models[k][0][0], &models[k + 1][0][0], n0, n1, n2);
+        float *a = &out[k][0][0], *b = &out[k + 1][0][0];
+        store2(n0, a, b);
+        store2(n1, a + 4, b + 4);
+        store2(n2, a + 8, b + 8);
+    }
+    sse41::normalMatrices(models + k, out + k, count - k);
+}
+
+BATCH_AVX2 inline void storeInverse2(__m256 r0, __m256 r1, __m256 r2, const float *a, const float *b, float *outA, float *outB) {
+    // 4x4 transpose inside each half
+    __m256 r3 = _mm256_setzero_ps();
+    const __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+    const __m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+    r0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    r1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    r2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 t = load2(a + 12, b + 12);
+    __m256 translation = _mm256_mul_ps(r0, _mm256_permute_ps(t, 0x00));
+    translation = _mm256_fmadd_ps(r1, _mm256_permute_ps(t, 0x55), translation);
+    translation = _mm256_fmadd_ps(r2, _mm256_permute_ps(t, 0xaa), translation);
+    translation = _mm256_sub_ps(_mm256_setr_ps(0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f), translation);
+    store2(r0, outA, outB);
+    store2(r1, outA + 4, outB + 4);
+    store2(r2, outA + 8, outB + 8);
+    store2(translation, outA + 12, outB + 12);
+}
+
+BATCH_AVX2 inline void affineInverses(const glm::mat4 *in, glm::mat4 *out, size_t count) {
+    size_t k = 0;
+    for (; k + 2 <= count; k += 2) {
+        const float *a = &in[k][0][0], *b = &in[k + 1][0][0];
+        __m256 r0, r1, r2;
+        normalColumns2(a, b, r0, r1, r2);
+        storeInverse2(r0, r1, r2, a, b, &out[k][0][0], &out[k + 1][0][0]);
+    }
+    sse41::affineInverses(in + k, out + k, count - k);
+}
+
+BATCH_AVX2 inline void rigidInverses(const glm::mat4 *in, glm::mat4 *out, size_t count) {
+    const __m256 xyz = _mm256_castsi256_ps(_mm256_setr_epi32(-1, -1, -1, 0, -1, -1, -1, 0));
+    size_t k = 0;
+    for (; k + 2 <= count; k += 2) {
+        const float *a = &in[k][0][0], *b = &in[k + 1][0][0];
+        storeInverse2(_mm256_and_ps(load2(a, b), xyz), _mm256_and_ps(load2(a + 4, b + 4), xyz),
+                      _mm256_and_ps(load2(a + 8, b + 8), xyz), a, b, &out[k][0][0], &out[k + 1][0][0]);
+    }
+    sse41::rigidInverses(in + k, out + k, count - k);
+}
+
+// sse41::inverseOne on two matrices at once; every step stays within a
+// 128-bit half
+BATCH_AVX2 inline __m256 mat2Mul(__m256 a, __m256 b) {
+    return _mm256_fmadd_ps(a, _mm256_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0)),
+                           _mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm256_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+BATCH_AVX2 inline __m256 mat2AdjMul(__m256 a, __m256 b) {
+    return _mm256_fmsub_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b,
+                           _mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)), _mm256_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+}
+BATCH_AVX2 inline __m256 mat2MulAdj(__m256 a, __m256 b) {
+    return _mm256_fmsub_ps(a, _mm256_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3)),
+                           _mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm256_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+}
+
+BATCH_AVX2 inline void inverses(const glm::mat4 *in, glm::mat4 *out, size_t count) {
+    size_t k = 0;
+    for (; k + 2 <= count; k += 2) {
+        const float *ma = &in[k][0][0], *mb = &in[k + 1][0][0];
+        const __m256 c0 = load2(ma, mb), c1 = load2(ma + 4, mb + 4), c2 = load2(ma + 8, mb + 8), c3 = load2(ma + 12, mb + 12);
+        const __m256 a = _mm256_shuffle_ps(c0, c1, _MM_SHUFFLE(1, 0, 1, 0)), b = _mm256_shuffle_ps(c0, c1, _MM_SHUFFLE(3, 2, 3, 2));
+        const __m256 c = _mm256_shuffle_ps(c2, c3, _MM_SHUFFLE(1, 0, 1, 0)), d = _mm256_shuffle_ps(c2, c3, _MM_SHUFFLE(3, 2, 3, 2));
+        const __m256 dets = _mm256_fmsub_ps(_mm256_shuffle_ps(c0, c2, _MM_SHUFFLE(2, 0, 2, 0)), _mm256_shuffle_ps(c1, c3, _MM_SHUFFLE(3, 1, 3, 1)),
+                                            _mm256_mul_ps(_mm256_shuffle_ps(c0, c2, _MM_SHUFFLE(3, 1, 3, 1)), _mm256_shuffle_ps(c1, c3, _MM_SHUFFLE(2, 0, 2, 0))));
+        const __m256 detA = _mm256_shuffle_ps(dets, dets, _MM_SHUFFLE(0, 0, 0, 0));
+        const __m256 detB = _mm256_shuffle_ps(dets, dets, _MM_SHUFFLE(1, 1, 1, 1));
+        const __m256 detC = _mm256_shuffle_ps(dets, dets, _MM_SHUFFLE(2, 2, 2, 2));
+        const __m256 detD = _mm256_shuffle_ps(dets, dets, _MM_SHUFFLE(3, 3, 3, 3));
+
+        const __m256 dc = mat2AdjMul(d, c), ab = mat2AdjMul(a, b);
+        __m256 x = _mm256_fmsub_ps(detD, a, mat2Mul(b, dc));
+        __m256 w = _mm256_fmsub_ps(detA, d, mat2Mul(c, ab));
+        __m256 y = _mm256_fmsub_ps(detB, c, mat2MulAdj(d, ab));
+        __m256 z = _mm256_fmsub_ps(detC, b, mat2MulAdj(a, dc));
+
+        __m256 trace = _mm256_mul_ps(ab, _mm256_shuffle_ps(dc, dc, _MM_SHUFFLE(3, 1, 2, 0)));
+        trace = _mm256_hadd_ps(trace, trace);
+        trace = _mm256_hadd_ps(trace, trace);
+        const __m256 det = _mm256_sub_ps(_mm256_fmadd_ps(detA, detD, _mm256_mul_ps(detB, detC)), trace);
+        const __m256 scale = _mm256_div_ps(_mm256_setr_ps(1.f, -1.f, -1.f, 1.f, 1.f, -1.f, -1.f, 1.f), det);
+        x = _mm256_mul_ps(x, scale), y = _mm256_mul_ps(y, scale), z = _mm256_mul_ps(z, scale), w = _mm256_mul_ps(w, scale);
+
+        float *oa = &out[k][0][0], *ob = &out[k + 1][0][0];
+        store2(_mm256_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3)), oa, ob);
+        store2(_mm256_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2)), oa + 4, ob + 4);
+        store2(_mm256_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3)), oa + 8, ob + 8);
+        store2(_mm256_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2)), oa + 12, ob + 12);
+    }
+    sse41::inverses(in + k, out + k, count - k);
+}
+
+// sse41::multiplyQuat on two quaternions per register
+BATCH_AVX2 inline void multiplyQuats(const glm::quat *a, const glm::quat *b, glm::quat *out, size_t count) {
+    const __m256 signX = _mm256_setr_ps(1.f, -1.f, 1.f, -1.f, 1.f, -1.f, 1.f, -1.f);
+    const __m256 signY = _mm256_setr_ps(1.f, 1.f, -1.f, -1.f, 1.f, 1.f, -1.f, -1.f);
+    const __m256 signZ = _mm256_setr_ps(-1.f, 1.f, 1.f, -1.f, -1.f, 1.f, 1.f, -1.f);
+    size_t k = 0;
+    for (; k + 2 <= count; k += 2) {
+        const __m256 p = _mm256_loadu_ps(&a[k].x), q = _mm256_loadu_ps(&b[k].x);
+        __m256 r = _mm256_mul_ps(_mm256_permute_ps(p, _MM_SHUFFLE(3, 3, 3, 3)), q);
+        r = _mm256_fmadd_ps(_mm256_mul_ps(_mm256_permute_ps(p, _MM_SHUFFLE(0, 0, 0, 0)), signX),
+                            _mm256_permute_ps(q, _MM_SHUFFLE(0, 1, 2, 3)), r);
+        r = _mm256_fmadd_ps(_mm256_mul_ps(_mm256_permute_ps(p, _MM_SHUFFLE(1, 1, 1, 1)), signY),
+                            _mm256_permute_ps(q, _MM_SHUFFLE(1, 0, 3, 2)), r);
+        r = _mm256_fmadd_ps(_mm256_mul_ps(_mm256_permute_ps(p, _MM_SHUFFLE(2, 2, 2, 2)), signZ),
+                            _mm256_permute_ps(q, _MM_SHUFFLE(2, 3, 0, 1)), r);
+        _mm256_storeu_ps(&out[k].x, r);
+    }
+    sse41::multiplyQuats(a + k, b + k, out + k, count - k);
+}
+
+#undef BATCH_AVX2
+
+constexpr Kernels kernels = {composeTRS, multiply, multiplyHierarchy, transformPoints, normalMatrices,
+                             affineInverses, rigidInverses, inverses, multiplyQuats};
+
+} // namespace avx2
+
+namespace avx512 {
+
+#define BATCH_AVX512 CPU_TARGET("avx512f,avx512dq,avx512vl,avx2,fma")
+
+BATCH_AVX512 inline __m512 lanes(const float *v, const uint32_t *indices, size_t k) {
+    return indices ? _mm512_i32gather_ps(_mm512_loadu_si512(indices + k), v, 4) : _mm512_loadu_ps(v + k);
+}
+
+// 4x4 transposes inside each 128-bit quarter: nodes n, n + 4, n + 8 and
+// n + 12 share a register
+BATCH_AVX512 inline void storeColumn(__m512 x, __m512 y, __m512 z, __m512 w, float *const *dst, int column) {
+    const __m512 t0 = _mm512_unpacklo_ps(x, y), t1 = _mm512_unpackhi_ps(x, y);
+    const __m512 t2 = _mm512_unpacklo_ps(z, w), t3 = _mm512_unpackhi_ps(z, w);
+    const __m512 r[4] = {_mm512_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)), _mm512_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2)),
+                         _mm512_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)), _mm512_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2))};
+    for (int n = 0; n < 4; ++n) {
+        _mm_storeu_ps(dst[n] + column * 4, _mm512_castps512_ps128(r[n]));
+        _mm_storeu_ps(dst[n + 4] + column * 4, _mm512_extractf32x4_ps(r[n], 1));
+        _mm_storeu_ps(dst[n + 8] + column * 4, _mm512_extractf32x4_ps(r[n], 2));
+        _mm_storeu_ps(dst[n + 12] + column * 4, _mm512_extractf32x4_ps(r[n], 3));
+    }
+}
+
+BATCH_AVX512 inline void composeTRS(const TRSArrays &trs, const uint32_t *indices, size_t count, glm::mat4 *out) {
+    size_t k = 0;
+    for (; k + 16 <= count; k += 16) {
+        const __m512 x = lanes(trs.rx, indices, k), y = lanes(trs.ry, indices, k);
+        const __m512 z = lanes(trs.rz, indices, k), w = lanes(trs.rw, indices, k);
+        const __m512 one = _mm512_set1_ps(1.f), two = _mm512_set1_ps(2.f);
+        const __m512 x2 = _mm512_mul_ps(two, x), y2 = _mm512_mul_ps(two, y), z2 = _mm512_mul_ps(two, z);
+        const __m512 xx = _mm512_mul_ps(x2, x), yy = _mm512_mul_ps(y2, y), zz = _mm512_mul_ps(z2, z);
+        const __m512 xy = _mm512_mul_ps(x2, y), xz = _mm512_mul_ps(x2, z), yz = _mm512_mul_ps(y2, z);
+        const __m512 wx = _mm512_mul_ps(x2, w), wy = _mm512_mul_ps(y2, w), wz = _mm512_mul_ps(z2, w);
+        const __m512 sx = lanes(trs.sx, indices, k), sy = lanes(trs.sy, indices, k), sz = lanes(trs.sz, indices, k);
+
+        float *dst[16];
+        for (int n = 0; n < 16; ++n) {
+            dst[n] = &out[indices ? indices[k + n] : k + n][0][0];
+        }
+        const __m512 zero = _mm512_setzero_ps();
+        storeColumn(_mm512_mul_ps(_mm512_sub_ps(one, _mm512_add_ps(yy, zz)), sx), _mm512_mul_ps(_mm512_add_ps(xy, wz), sx),
+                    _mm512_mul_ps(_mm512_sub_ps(xz, wy), sx), zero, dst, 0);
+        storeColumn(_mm512_mul_ps(_mm512_sub_ps(xy, wz), sy), _mm512_mul_ps(_mm512_sub_ps(one, _mm512_add_ps(xx, zz)), sy),
+                    _mm512_mul_ps(_mm512_add_ps(yz, wx), sy), zero, dst, 1);
+        storeColumn(_mm512_mul_ps(_mm512_add_ps(xz, wy), sz), _mm512_mul_ps(_mm512_sub_ps(yz, wx), sz),
+                    _mm512_mul_ps(_mm512_sub_ps(one, _mm512_add_ps(xx, yy)), sz), zero, dst, 2);
+        storeColumn(lanes(trs.tx, indices, k), lanes(trs.ty, indices, k), lanes(trs.tz, indices, k), one, dst, 3);
+    }
+    if (indices) {
+        avx2::composeTRS(trs, indices + k, count - k, out);
+    } else {
+        avx2::composeTRS(offset(trs, k), nullptr, count - k, out + k);
+    }
+}
+
+// the whole matrix in one register, each quarter a column
+BATCH_AVX512 inline void multiplyOne(const float *a, const float *b, float *out) {
+    const __m512 a0 = _mm512_broadcast_f32x4(_mm_loadu_ps(a)), a1 = _mm512_broadcast_f32x4(_mm_loadu_ps(a + 4));
+    const __m512 a2 = _mm512_broadcast_f32x4(_mm_loadu_ps(a + 8)), a3 = _mm512_broadcast_f32x4(_mm_loadu_ps(a + 12));
+    const __m512 columns = _mm512_loadu_ps(b);
+    __m512 r = _mm512_mul_ps(a0, _mm512_permute_ps(columns, 0x00));
+    r = _mm512_fmadd_ps(a1, _mm512_permute_ps(columns, 0x55), r);
+    r = _mm512_fmadd_ps(a2, _mm512_permute_ps(columns, 0xaa), r);
+    r = _mm512_fmadd_ps(a3, _mm512_permute_ps(columns, 0xff), r);
+    _mm512_storeu_ps(out, r);
+}
+
+BATCH_AVX512 inline void multiplyHierarchy(const int32_t *parents, const uint32_t *indices, size_t count,
+                                           const glm::mat4 *locals, glm::mat4 *worlds) {
+    for (size_t k = 0; k < count; ++k) {
+        const uint32_t i = indices ? indices[k] : (uint32_t)k;
+        if (parents[i] < 0) {
+            worlds[i] = locals[i];
+        } else {
+            multiplyOne(&worlds[parents[i]][0][0], &locals[i][0][0], &worlds[i][0][0]);
+        }
+    }
+}
+
+// four quaternions per register
+BATCH_AVX512 inline void multiplyQuats(const glm::quat *a, const glm::quat *b, glm::quat *out, size_t count) {
+    const __m512 signX = _mm512_broadcast_f32x4(_mm_setr_ps(1.f, -1.f, 1.f, -1.f));
+    const __m512 signY = _mm512_broadcast_f32x4(_mm_setr_ps(1.f, 1.f, -1.f, -1.f));
+    const __m512 signZ = _mm512_broadcast_f32x4(_mm_setr_ps(-1.f, 1.f, 1.f, -1.f));
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        const __m512 p = _mm512_loadu_ps(&a[k].x), q = _mm512_loadu_ps(&b[k].x);
+        __m512 r = _mm512_mul_ps(_mm512_permute_ps(p, _MM_SHUFFLE(3, 3, 3, 3)), q);
+        r = _mm512_fmadd_ps(_mm512_mul_ps(_mm512_permute_ps(p, _MM_SHUFFLE(0, 0, 0, 0)), signX),
+                            _mm512_permute_ps(q, _MM_SHUFFLE(0, 1, 2, 3)), r);
+        r = _mm512_fmadd_ps(_mm512_mul_ps(_mm512_permute_ps(p, _MM_SHUFFLE(1, 1, 1, 1)), signY),
+                            _mm512_permute_ps(q, _MM_SHUFFLE(1, 0, 3, 2)), r);
+        r = _mm512_fmadd_ps(_mm512_mul_ps(_mm512_permute_ps(p, _MM_SHUFFLE(2, 2, 2, 2)), signZ),
+                            _mm512_permute_ps(q, _MM_SHUFFLE(2, 3, 0, 1)), r);
+        _mm512_storeu_ps(&out[k].x, r);
+    }
+    avx2::multiplyQuats(a + k, b + k, out + k, count - k);
+}
+
+#undef BATCH_AVX512
+
+// Products, points and inverses are bound by loads and stores; the AVX2
+// versions keep up with them, and measured faster than 512-bit versions
+// for multiply and transformPoints.
+constexpr Kernels kernels = {composeTRS, avx2::multiply, multiplyHierarchy, avx2::transformPoints,
+                             avx2::normalMatrices, avx2::affineInverses, avx2::rigidInverses, avx2::inverses,
+                             multiplyQuats};
+
+} // namespace avx512
+
+#endif // CPU_X86
+
+#if CPU_NEON
+
+namespace neon {
+
+inline float32x4_t lanes(const float *v, const uint32_t *indices, size_t k) {
+    if (!indices) {
+        return vld1q_f32(v + k);
+    }
+    const float gathered[4] = {v[indices[k]], v[indices[k + 1]], v[indices[k + 2]], v[indices[k + 3]]};
+    return vld1q_f32(gathered);
+}
+
+inline void storeColumn(float32x4_t x, float32x4_t y, float32x4_t z, float32x4_t w, float *const *dst, int column) {
+    const float32x4x2_t xy = vtrnq_f32(x, y), zw = vtrnq_f32(z, w);
+    vst1q_f32(dst[0] + column * 4, vcombine_f32(vget_low_f32(xy.val[0]), vget_low_f32(zw.val[0])));
+    vst1q_f32(dst[1] + column * 4, vcombine_f32(vget_low_f32(xy.val[1]), vget_low_f32(zw.val[1])));
+    vst1q_f32(dst[2] + column * 4, vcombine_f32(vget_high_f32(xy.val[0]), vget_high_f32(zw.val[0])));
+    vst1q_f32(dst[3] + column * 4, vcombine_f32(vget_high_f32(xy.val[1]), vget_high_f32(zw.val[1])));
+}
+
+inline void composeTRS(const TRSArrays &trs, const uint32_t *indices, size_t count, glm::mat4 *out) {
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        const float32x4_t x = lanes(trs.rx, indices, k), y = lanes(trs.ry, indices, k);
+        const float32x4_t z = lanes(trs.rz, indices, k), w = lanes(trs.rw, indices, k);
+        const float32x4_t one = vdupq_n_f32(1.f);
+        const float32x4_t x2 = vaddq_f32(x, x), y2 = vaddq_f32(y, y), z2 = vaddq_f32(z, z);
+        const float32x4_t xx = vmulq_f32(x2, x), yy = vmulq_f32(y2, y), zz = vmulq_f32(z2, z);
+        const float32x4_t xy = vmulq_f32(x2, y), xz = vmulq_f32(x2, z), yz = vmulq_f32(y2, z);
+        const float32x4_t wx = vmulq_f32(x2, w), wy = vmulq_f32(y2, w), wz = vmulq_f32(z2, w);
+        const float32x4_t sx = lanes(trs.sx, indices, k), sy = lanes(trs.sy, indices, k), sz = lanes(trs.sz, indices, k);
+
+        float *dst[4];
+        for (int n = 0; n < 4; ++n) {
+            dst[n] = &out[indices ? indices[k + n] : k + n][0][0];
+        }
+        const float32x4_t zero = vdupq_n_f32(0.f);
+        storeColumn(vmulq_f32(vsubq_f32(one, vaddq_f32(yy, zz)), sx), vmulq_f32(vaddq_f32(xy, wz), sx),
+                    vmulq_f32(vsubq_f32(xz, wy), sx), zero, dst, 0);
+        storeColumn(vmulq_f32(vsubq_f32(xy, wz), sy), vmulq_f32(vsubq_f32(one, vaddq_f32(xx, zz)), sy),
+                    vmulq_f32(vaddq_f32(yz, wx), sy), zero, dst, 1);
+        storeColumn(vmulq_f32(vaddq_f32(xz, wy), sz), vmulq_f32(vsubq_f32(yz, wx), sz),
+                    vmulq_f32(vsubq_f32(one, vaddq_f32(xx, yy)), sz), zero, dst, 2);
+        storeColumn(lanes(trs.tx, indices, k), lanes(trs.ty, indices, k), lanes(trs.tz, indices, k), one, dst, 3);
+    }
+    for (; k < count; ++k) {
+        const uint32_t i = indices ? indices[k] : (uint32_t)k;
+        scalar::composeOne(trs, i, out[i]);
+    }
+}
+
+inline void multiplyOne(const float *a, const float *b, float *out) {
+    const float32x4_t a0 = vld1q_f32(a), a1 = vld1q_f32(a + 4), a2 = vld1q_f32(a + 8), a3 = vld1q_f32(a + 12);
+    float32x4_t columns[4];
+    for (int c = 0; c < 4; ++c) {
+        const float32x4_t col = vld1q_f32(b + c * 4);
+        float32x4_t r = vmulq_laneq_f32(a0, col, 0);
+        r = vfmaq_laneq_f32(r, a1, col, 1);
+        r = vfmaq_laneq_f32(r, a2, col, 2);
+        columns[c] = vfmaq_laneq_f32(r, a3, col, 3);
+    }
+    for (int c = 0; c < 4; ++c) {
+        vst1q_f32(out + c * 4, columns[c]);
+    }
+}
+
+inline void multiply(const glm::mat4 *a, const glm::mat4 *b, glm::mat4 *out, size_t count) {
+    for (size_t k = 0; k < count; ++k) {
+        multiplyOne(&a[k][0][0], &b[k][0][0], &out[k][0][0]);
+    }
+}
+
+inline void multiplyHierarchy(const int32_t *parents, const uint32_t *indices, size_t count, const glm::mat4 *locals,
+                              glm::mat4 *worlds) {
+    for (size_t k = 0; k < count; ++k) {
+        const uint32_t i = indices ? indices[k] : (uint32_t)k;
+        if (parents[i] < 0) {
+            worlds[i] = locals[i];
+        } else {
+            multiplyOne(&worlds[parents[i]][0][0], &locals[i][0][0], &worlds[i][0][0]);
+        }
+    }
+}
+
+// vld3 / vst3 do the (de)interleaving
+inline void transformPoints(const glm::mat4 &m, const glm::vec3 *in, glm::vec3 *out, size_t count) {
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        const float32x4x3_t p = vld3q_f32(&in[k].x);
+        float32x4x3_t o;
+        for (int r = 0; r < 3; ++r) {
+            float32x4_t v = vfmaq_n_f32(vdupq_n_f32(m[3][r]), p.val[0], m[0][r]);
+            v = vfmaq_n_f32(v, p.val[1], m[1][r]);
+            o.val[r] = vfmaq_n_f32(v, p.val[2], m[2][r]);
+        }
+        vst3q_f32(&out[k].x, o);
+    }
+    for (; k < count; ++k) {
+        out[k] = glm::vec3(m * glm::vec4(in[k], 1.f));
+    }
+}
+
+// the permutations of b in sse41::multiplyQuat are a 64-bit reverse and
+// a rotation by two lanes
+inline void multiplyQuats(const glm::quat *a, const glm::quat *b, glm::quat *out, size_t count) {
+    const float signs[3][4] = {{1.f, -1.f, 1.f, -1.f}, {1.f, 1.f, -1.f, -1.f}, {-1.f, 1.f, 1.f, -1.f}};
+    const float32x4_t signX = vld1q_f32(signs[0]), signY = vld1q_f32(signs[1]), signZ = vld1q_f32(signs[2]);
+    for (size_t k = 0; k < count; ++k) {
+        const float32x4_t p = vld1q_f32(&a[k].x), q = vld1q_f32(&b[k].x);
+        const float32x4_t swapped = vrev64q_f32(q); // y x w z
+        float32x4_t r = vmulq_laneq_f32(q, p, 3);
+        r = vfmaq_laneq_f32(r, vmulq_f32(vextq_f32(swapped, swapped, 2), signX), p, 0);
+        r = vfmaq_laneq_f32(r, vmulq_f32(vextq_f32(q, q, 2), signY), p, 1);
+        r = vfmaq_laneq_f32(r, vmulq_f32(swapped, signZ), p, 2);
+        vst1q_f32(&out[k].x, r);
+    }
+}
+
+// NEON has no cheap yzx shuffle for the cross products, so the inverses
+// stay scalar there
+constexpr Kernels kernels = {composeTRS, multiply, multiplyHierarchy, transformPoints, scalar::normalMatrices,
+                             scalar::affineInverses, scalar::rigidInverses, scalar::inverses, multiplyQuats};
+
+} // namespace neon
+
+#endif // CPU_NEON
+
+// kernels for `level`, or the next narrower set this build has
+inline const Kernels &kernelsFor(SimdLevel level) {
+    switch (level) {
+#if CPU_X86
+        case SimdLevel::AVX512: return avx512::kernels;
+        case SimdLevel::AVX2: return avx2::kernels;
+        case SimdLevel::SSE41: return sse41::kernels;
+#endif
+#if CPU_NEON
+        case SimdLevel::NEON: return neon::kernels;
+#endif
+        default: return scalar::kernels;
+    }
+}
+
+inline const Kernels &kernels() {
+    static const Kernels &best = kernelsFor(simdLevel());
+    return best;
+}
+
+inline void composeTRS(const TRSArrays &trs, const uint32_t *indices, size_t count, glm::mat4 *out) {
+    kernels().composeTRS(trs, indices, count, out);
+}
+
+inline void multiply(const glm::mat4 *a, const glm::mat4 *b, glm::mat4 *out, size_t count) {
+    kernels().multiply(a, b, out, count);
+}
+
+inline void multiplyHierarchy(const int32_t *parents, const uint32_t *indices, size_t count, const glm::mat4 *locals,
+                              glm::mat4 *worlds) {
+    kernels().multiplyHierarchy(parents, indices, count, locals, worlds);
+}
+
+inline void transformPoints(const glm::mat4 &m, const glm::vec3 *in, glm::vec3 *out, size_t count) {
+    kernels().transformPoints(m, in, out, count);
+}
+
+inline void normalMatrices(const glm::mat4 *models, glm::mat3x4 *out, size_t count) {
+    kernels().normalMatrices(models, out, count);
+}
+
+inline void affineInverses(const glm::mat4 *in, glm::mat4 *out, size_t count) {
+    kernels().affineInverses(in, out, count);
+}
+
+inline void rigidInverses(const glm::mat4 *in, glm::mat4 *out, size_t count) {
+    kernels().rigidInverses(in, out, count);
+}
+
+inline void inverses(const glm::mat4 *in, glm::mat4 *out, size_t count) {
+    kernels().inverses(in, out, count);
+}
+
+// out[k] = mat3(m) * in[k], for directions; in and out may be the same array
+inline void transformVectors(const glm::mat4 &m, const glm::vec3 *in, glm::vec3 *out, size_t count) {
+    glm::mat4 linear = m;
+    linear[3] = glm::vec4(0.f, 0.f, 0.f, 1.f);
+    kernels().transformPoints(linear, in, out, count);
+}
+
+inline void multiplyQuats(const glm::quat *a, const glm::quat *b, glm::quat *out, size_t count) {
+    kernels().multiplyQuats(a, b, out, count);
+}
+
+} // namespace batch
+
+#endif
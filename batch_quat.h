@@ -0,0 +1,511 @@
+#ifndef BATCH_QUAT_H
+#define BATCH_QUAT_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "batch_math.h"
+
+// Quaternion math for animation, over structure-of-arrays quaternions: one
+// float array per component, so eight rotations fill an AVX2 register with
+// no shuffling. Dispatched like batch_math.h (scalar, SSE4.1, AVX2, NEON;
+// AVX-512 CPUs use the AVX2 kernels, which already run at memory speed).
+//
+// slerp uses a polynomial fit for the interpolation factor in place of the
+// acos / sin of the exact formula (Arseny Kapoulkine, "Approximating
+// slerp"); it stays within 4e-4 of glm::slerp, about 0.04 degrees. Every
+// level computes the same formulas, so results only differ by float
+// rounding. quat_benchmark checks all of them against glm.
+
+namespace batch {
+
+struct QuatArrays {
+    float *x, *y, *z, *w;
+};
+
+// real part is the rotation, dual part 0.5 * (translation, 0) * real
+struct DualQuatArrays {
+    QuatArrays real, dual;
+};
+
+inline QuatArrays offset(const QuatArrays &q, size_t k) { return {q.x + k, q.y + k, q.z + k, q.w + k}; }
+
+inline DualQuatArrays offset(const DualQuatArrays &dq, size_t k) { return {offset(dq.real, k), offset(dq.dual, k)}; }
+
+struct QuatKernels {
+    // out[k] = normalize(lerp(a[k], b[k], t[k])) along the shorter arc;
+    // out may be a or b
+    void (*nlerp)(const QuatArrays &a, const QuatArrays &b, const float *t, size_t count, const QuatArrays &out);
+    // out[k] ~ slerp(a[k], b[k], t[k]) along the shorter arc; out may be a or b
+    void (*slerp)(const QuatArrays &a, const QuatArrays &b, const float *t, size_t count, const QuatArrays &out);
+    // rotation matrices of unit quaternions, columns padded to vec4 like
+    // normalMatrices()
+    void (*rotationMatrices)(const QuatArrays &q, size_t count, glm::mat3x4 *out);
+    // dual quaternion linear blending: out[k] = normalize(sum over j of
+    // weights[j][k] * dq[indices[j][k]]), each term flipped into the
+    // hemisphere of the first one
+    void (*blendDualQuats)(const DualQuatArrays &dq, const uint32_t *const *indices, const float *const *weights,
+                           int influences, size_t count, const DualQuatArrays &out);
+};
+
+namespace scalar {
+
+inline glm::quat loadQuat(const QuatArrays &q, size_t i) { return glm::quat(q.w[i], q.x[i], q.y[i], q.z[i]); }
+
+inline void storeQuat(const QuatArrays &q, size_t i, const glm::quat &v) {
+    q.x[i] = v.x, q.y[i] = v.y, q.z[i] = v.z, q.w[i] = v.w;
+}
+
+// the slerp interpolation factor for |cos| d, fitted over [0, 1]
+inline float slerpFactor(float d, float t) {
+    const float a = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+    const float b = 0.848013f + d * (-1.06021f + d * 0.215638f);
+    const float k = a * (t - 0.5f) * (t - 0.5f) + b;
+    return t + t * (t - 0.5f) * (t - 1.f) * k;
+}
+
+inline glm::quat nlerpOne(const glm::quat &a, glm::quat b, float t, bool corrected) {
+    float d = glm::dot(a, b);
+    if (d < 0.f) {
+        b = -b, d = -d;
+    }
+    if (corrected) {
+        t = slerpFactor(d, t);
+    }
+    return glm::normalize(a + (b - a) * t);
+}
+
+inline void nlerp(const QuatArrays &a, const QuatArrays &b, const float *t, size_t count, const QuatArrays &out) {
+    for (size_t k = 0; k < count; ++k) {
+        storeQuat(out, k, nlerpOne(loadQuat(a, k), loadQuat(b, k), t[k], false));
+    }
+}
+
+inline void slerp(const QuatArrays &a, const QuatArrays &b, const float *t, size_t count, const QuatArrays &out) {
+    for (size_t k = 0; k < count; ++k) {
+        storeQuat(out, k, nlerpOne(loadQuat(a, k), loadQuat(b, k), t[k], true));
+    }
+}
+
+inline void rotationMatrices(const QuatArrays &q, size_t count, glm::mat3x4 *out) {
+    for (size_t k = 0; k < count; ++k) {
+        const glm::mat3 m = glm::mat3_cast(loadQuat(q, k));
+        out[k] = glm::mat3x4(glm::vec4(m[0], 0.f), glm::vec4(m[1], 0.f), glm::vec4(m[2], 0.f));
+    }
+}
+
+// items begin .. end - 1, for the tails of the wider versions
+inline void blendDualQuatRange(const DualQuatArrays &dq, const uint32_t *const *indices, const float *const *weights,
+                               int influences, size_t begin, size_t end, const DualQuatArrays &out) {
+    for (size_t k = begin; k < end; ++k) {
+        glm::quat real(0.f, 0.f, 0.f, 0.f), dual(0.f, 0.f, 0.f, 0.f), first(1.f, 0.f, 0.f, 0.f);
+        for (int j = 0; j < influences; ++j) {
+            const uint32_t i = indices[j][k];
+            const glm::quat r = loadQuat(dq.real, i);
+            if (j == 0) {
+                first = r;
+            }
+            const float w = glm::dot(first, r) < 0.f ? -weights[j][k] : weights[j][k];
+            real = real + r * w;
+            dual = dual + loadQuat(dq.dual, i) * w;
+        }
+        const float scale = 1.f / glm::length(real);
+        storeQuat(out.real, k, real * scale);
+        storeQuat(out.dual, k, dual * scale);
+    }
+}
+
+inline void blendDualQuats(const DualQuatArrays &dq, const uint32_t *const *indices, const float *const *weights,
+                           int influences, size_t count, const DualQuatArrays &out) {
+    blendDualQuatRange(dq, indices, weights, influences, 0, count, out);
+}
+
+constexpr QuatKernels quatKernels = {nlerp, slerp, rotationMatrices, blendDualQuats};
+
+} // namespace scalar
+
+#if CPU_X86
+
+namespace sse41 {
+
+CPU_TARGET("sse4.1") inline __m128 dot4(__m128 ax, __m128 ay, __m128 az, __m128 aw, __m128 bx, __m128 by, __m128 bz, __m128 bw) {
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+}
+
+// 1 / sqrt(x) to float precision: the estimate plus one Newton step
+CPU_TARGET("sse4.1") inline __m128 invSqrt(__m128 x) {
+    const __m128 r = _mm_rsqrt_ps(x);
+    return _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), r), _mm_sub_ps(_mm_set1_ps(3.f), _mm_mul_ps(_mm_mul_ps(x, r), r)));
+}
+
+CPU_TARGET("sse4.1") inline __m128 slerpFactor(__m128 d, __m128 t) {
+    const __m128 a = _mm_add_ps(_mm_set1_ps(1.0904f),
+                                _mm_mul_ps(d, _mm_add_ps(_mm_set1_ps(-3.2452f),
+                                                         _mm_mul_ps(d, _mm_sub_ps(_mm_set1_ps(3.55645f), _mm_mul_ps(d, _mm_set1_ps(1.43519f)))))));
+    const __m128 b = _mm_add_ps(_mm_set1_ps(0.848013f),
+                                _mm_mul_ps(d, _mm_add_ps(_mm_set1_ps(-1.06021f), _mm_mul_ps(d, _mm_set1_ps(0.215638f)))));
+    const __m128 centered = _mm_sub_ps(t, _mm_set1_ps(0.5f));
+    const __m128 k = _mm_add_ps(_mm_mul_ps(a, _mm_mul_ps(centered, centered)), b);
+    return _mm_add_ps(t, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, centered), _mm_sub_ps(t, _mm_set1_ps(1.f))), k));
+}
+
+CPU_TARGET("sse4.1") inline void nlerp4(const QuatArrays &a, const QuatArrays &b, const float *t, size_t count,
+                                        const QuatArrays &out, bool corrected) {
+    const __m128 signBit = _mm_set1_ps(-0.f);
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        const __m128 ax = _mm_loadu_ps(a.x + k), ay = _mm_loadu_ps(a.y + k), az = _mm_loadu_ps(a.z + k), aw = _mm_loadu_ps(a.w + k);
+        __m128 bx = _mm_loadu_ps(b.x + k), by = _mm_loadu_ps(b.y + k), bz = _mm_loadu_ps(b.z + k), bw = _mm_loadu_ps(b.w + k);
+        const __m128 d = dot4(ax, ay, az, aw, bx, by, bz, bw);
+        // the shorter arc: flip b where the dot product is negative
+        const __m128 flip = _mm_and_ps(d, signBit);
+        bx = _mm_xor_ps(bx, flip), by = _mm_xor_ps(by, flip), bz = _mm_xor_ps(bz, flip), bw = _mm_xor_ps(bw, flip);
+        __m128 s = _mm_loadu_ps(t + k);
+        if (corrected) {
+            s = slerpFactor(_mm_andnot_ps(signBit, d), s);
+        }
+        const __m128 x = _mm_add_ps(ax, _mm_mul_ps(s, _mm_sub_ps(bx, ax)));
+        const __m128 y = _mm_add_ps(ay, _mm_mul_ps(s, _mm_sub_ps(by, ay)));
+        const __m128 z = _mm_add_ps(az, _mm_mul_ps(s, _mm_sub_ps(bz, az)));
+        const __m128 w = _mm_add_ps(aw, _mm_mul_ps(s, _mm_sub_ps(bw, aw)));
+        const __m128 scale = invSqrt(dot4(x, y, z, w, x, y, z, w));
+        _mm_storeu_ps(out.x + k, _mm_mul_ps(x, scale));
+        _mm_storeu_ps(out.y + k, _mm_mul_ps(y, scale));
+        _mm_storeu_ps(out.z + k, _mm_mul_ps(z, scale));
+        _mm_storeu_ps(out.w + k, _mm_mul_ps(w, scale));
+    }
+    if (corrected) {
+        scalar::slerp(offset(a, k), offset(b, k), t + k, count - k, offset(out, k));
+    } else {
+        scalar::nlerp(offset(a, k), offset(b, k), t + k, count - k, offset(out, k));
+    }
+}
+
+CPU_TARGET("sse4.1") inline void nlerp(const QuatArrays &a, const QuatArrays &b, const float *t, size_t count, const QuatArrays &out) {
+    nlerp4(a, b, t, count, out, false);
+}
+
+CPU_TARGET("sse4.1") inline void slerp(const QuatArrays &a, const QuatArrays &b, const float *t, size_t count, const QuatArrays &out) {
+    nlerp4(a, b, t, count, out, true);
+}
+
+CPU_TARGET("sse4.1") inline void rotationMatrices(const QuatArrays &q, size_t count, glm::mat3x4 *out) {
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        const __m128 x = _mm_loadu_ps(q.x + k), y = _mm_loadu_ps(q.y + k), z = _mm_loadu_ps(q.z + k), w = _mm_loadu_ps(q.w + k);
+        const __m128 one = _mm_set1_ps(1.f);
+        const __m128 x2 = _mm_add_ps(x, x), y2 = _mm_add_ps(y, y), z2 = _mm_add_ps(z, z);
+        const __m128 xx = _mm_mul_ps(x2, x), yy = _mm_mul_ps(y2, y), zz = _mm_mul_ps(z2, z);
+        const __m128 xy = _mm_mul_ps(x2, y), xz = _mm_mul_ps(x2, z), yz = _mm_mul_ps(y2, z);
+        const __m128 wx = _mm_mul_ps(x2, w), wy = _mm_mul_ps(y2, w), wz = _mm_mul_ps(z2, w);
+
+        float *dst[4];
+        for (int n = 0; n < 4; ++n) {
+            dst[n] = &out[k + n][0][0];
+        }
+        const __m128 zero = _mm_setzero_ps();
+        storeColumn(_mm_sub_ps(one, _mm_add_ps(yy, zz)), _mm_add_ps(xy, wz), _mm_sub_ps(xz, wy), zero, dst, 0);
+        storeColumn(_mm_sub_ps(xy, wz), _mm_sub_ps(one, _mm_add_ps(xx, zz)), _mm_add_ps(yz, wx), zero, dst, 1);
+        storeColumn(_mm_add_ps(xz, wy), _mm_sub_ps(yz, wx), _mm_sub_ps(one, _mm_add_ps(xx, yy)), zero, dst, 2);
+    }
+    scalar::rotationMatrices(offset(q, k), count - k, out + k);
+}
+
+CPU_TARGET("sse4.1") inline void blendDualQuats(const DualQuatArrays &dq, const uint32_t *const *indices, const float *const *weights,
+                                                int influences, size_t count, const DualQuatArrays &out) {
+    const __m128 signBit = _mm_set1_ps(-0.f);
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        __m128 real[4], dual[4], first[4];
+        for (int c = 0; c < 4; ++c) {
+            real[c] = dual[c] = _mm_setzero_ps();
+        }
+        for (int j = 0; j < influences; ++j) {
+            const __m128 r[4] = {lanes(dq.real.x, indices[j], k), lanes(dq.real.y, indices[j], k),
+                                 lanes(dq.real.z, indices[j], k), lanes(dq.real.w, indices[j], k)};
+            const __m128 d[4] = {lanes(dq.dual.x, indices[j], k), lanes(dq.dual.y, indices[j], k),
+                                 lanes(dq.dual.z, indices[j], k), lanes(dq.dual.w, indices[j], k)};
+            if (j == 0) {
+                first[0] = r[0], first[1] = r[1], first[2] = r[2], first[3] = r[3];
+            }
+            const __m128 flip = _mm_and_ps(dot4(first[0], first[1], first[2], first[3], r[0], r[1], r[2], r[3]), signBit);
+            const __m128 w = _mm_xor_ps(_mm_loadu_ps(weights[j] + k), flip);
+            for (int c = 0; c < 4; ++c) {
+                real[c] = _mm_add_ps(real[c], _mm_mul_ps(r[c], w));
+                dual[c] = _mm_add_ps(dual[c], _mm_mul_ps(d[c], w));
+            }
+        }
+        const __m128 scale = invSqrt(dot4(real[0], real[1], real[2], real[3], real[0], real[1], real[2], real[3]));
+        float *const dst[8] = {out.real.x, out.real.y, out.real.z, out.real.w, out.dual.x, out.dual.y, out.dual.z, out.dual.w};
+        for (int c = 0; c < 4; ++c) {
+            _mm_storeu_ps(dst[c] + k, _mm_mul_ps(real[c], scale));
+            _mm_storeu_ps(dst[c + 4] + k, _mm_mul_ps(dual[c], scale));
+        }
+    }
+    scalar::blendDualQuatRange(dq, indices, weights, influences, k, count, out);
+}
+
+constexpr QuatKernels quatKernels = {nlerp, slerp, rotationMatrices, blendDualQuats};
+
+} // namespace sse41
+
+namespace avx2 {
+
+#define BATCH_AVX2 CPU_TARGET("avx2,fma")
+
+BATCH_AVX2 inline __m256 dot4(__m256 ax, __m256 ay, __m256 az, __m256 aw, __m256 bx, __m256 by, __m256 bz, __m256 bw) {
+    return _mm256_fmadd_ps(ax, bx, _mm256_fmadd_ps(ay, by, _mm256_fmadd_ps(az, bz, _mm256_mul_ps(aw, bw))));
+}
+
+BATCH_AVX2 inline __m256 invSqrt(__m256 x) {
+    const __m256 r = _mm256_rsqrt_ps(x);
+    return _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), r), _mm256_fnmadd_ps(_mm256_mul_ps(x, r), r, _mm256_set1_ps(3.f)));
+}
+
+BATCH_AVX2 inline __m256 slerpFactor(__m256 d, __m256 t) {
+    const __m256 a = _mm256_fmadd_ps(d, _mm256_fmadd_ps(d, _mm256_fnmadd_ps(d, _mm256_set1_ps(1.43519f), _mm256_set1_ps(3.55645f)),
+                                                        _mm256_set1_ps(-3.2452f)),
+                                     _mm256_set1_ps(1.0904f));
+    const __m256 b = _mm256_fmadd_ps(d, _mm256_fmadd_ps(d, _mm256_set1_ps(0.215638f), _mm256_set1_ps(-1.06021f)), _mm256_set1_ps(0.848013f));
+    const __m256 centered = _mm256_sub_ps(t, _mm256_set1_ps(0.5f));
+    const __m256 k = _mm256_fmadd_ps(a, _mm256_mul_ps(centered, centered), b);
+    return _mm256_fmadd_ps(_mm256_mul_ps(_mm256_mul_ps(t, centered), _mm256_sub_ps(t, _mm256_set1_ps(1.f))), k, t);
+}
+
+BATCH_AVX2 inline void nlerp8(const QuatArrays &a, const QuatArrays &b, const float *t, size_t count, const QuatArrays &out,
+                              bool corrected) {
+    const __m256 signBit = _mm256_set1_ps(-0.f);
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        const __m256 ax = _mm256_loadu_ps(a.x + k), ay = _mm256_loadu_ps(a.y + k);
+        const __m256 az = _mm256_loadu_ps(a.z + k), aw = _mm256_loadu_ps(a.w + k);
+        __m256 bx = _mm256_loadu_ps(b.x + k), by = _mm256_loadu_ps(b.y + k), bz = _mm256_loadu_ps(b.z + k), bw = _mm256_loadu_ps(b.w + k);
+        const __m256 d = dot4(ax, ay, az, aw, bx, by, bz, bw);
+        const __m256 flip = _mm256_and_ps(d, signBit);
+        bx = _mm256_xor_ps(bx, flip), by = _mm256_xor_ps(by, flip), bz = _mm256_xor_ps(bz, flip), bw = _mm256_xor_ps(bw, flip);
+        __m256 s = _mm256_loadu_ps(t + k);
+        if (corrected) {
+            s = slerpFactor(_mm256_andnot_ps(signBit, d), s);
+        }
+        const __m256 x = _mm256_fmadd_ps(s, _mm256_sub_ps(bx, ax), ax);
+        const __m256 y = _mm256_fmadd_ps(s, _mm256_sub_ps(by, ay), ay);
+        const __m256 z = _mm256_fmadd_ps(s, _mm256_sub_ps(bz, az), az);
+        const __m256 w = _mm256_fmadd_ps(s, _mm256_sub_ps(bw, aw), aw);
+        const __m256 scale = invSqrt(dot4(x, y, z, w, x, y, z, w));
+        _mm256_storeu_ps(out.x + k, _mm256_mul_ps(x, scale));
+        _mm256_storeu_ps(out.y + k, _mm256_mul_ps(y, scale));
+        _mm256_storeu_ps(out.z + k, _mm256_mul_ps(z, scale));
+        _mm256_storeu_ps(out.w + k, _mm256_mul_ps(w, scale));
+    }
+    sse41::nlerp4(offset(a, k), offset(b, k), t + k, count - k, offset(out, k), corrected);
+}
+
+BATCH_AVX2 inline void nlerp(const QuatArrays &a, const QuatArrays &b, const float *t, size_t count, const QuatArrays &out) {
+    nlerp8(a, b, t, count, out, false);
+}
+
+BATCH_AVX2 inline void slerp(const QuatArrays &a, const QuatArrays &b, const float *t, size_t count, const QuatArrays &out) {
+    nlerp8(a, b, t, count, out, true);
+}
+
+BATCH_AVX2 inline void rotationMatrices(const QuatArrays &q, size_t count, glm::mat3x4 *out) {
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        const __m256 x = _mm256_loadu_ps(q.x + k), y = _mm256_loadu_ps(q.y + k), z = _mm256_loadu_ps(q.z + k), w = _mm256_loadu_ps(q.w + k);
+        const __m256 one = _mm256_set1_ps(1.f);
+        const __m256 x2 = _mm256_add_ps(x, x), y2 = _mm256_add_ps(y, y), z2 = _mm256_add_ps(z, z);
+        const __m256 xx = _mm256_mul_ps(x2, x), yy = _mm256_mul_ps(y2, y), zz = _mm256_mul_ps(z2, z);
+        const __m256 xy = _mm256_mul_ps(x2, y), xz = _mm256_mul_ps(x2, z), yz = _mm256_mul_ps(y2, z);
+        const __m256 wx = _mm256_mul_ps(x2, w), wy = _mm256_mul_ps(y2, w), wz = _mm256_mul_ps(z2, w);
+
+        float *dst[8];
+        for (int n = 0; n < 8; ++n) {
+            dst[n] = &out[k + n][0][0];
+        }
+        const __m256 zero = _mm256_setzero_ps();
+        storeColumn(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), _mm256_add_ps(xy, wz), _mm256_sub_ps(xz, wy), zero, dst, 0);
+        storeColumn(_mm256_sub_ps(xy, wz), _mm256_sub_ps(one, _mm256_add_ps(xx, zz)), _mm256_add_ps(yz, wx), zero, dst, 1);
+        storeColumn(_mm256_add_ps(xz, wy), _mm256_sub_ps(yz, wx), _mm256_sub_ps(one, _mm256_add_ps(xx, yy)), zero, dst, 2);
+    }
+    sse41::rotationMatrices(offset(q, k), count - k, out + k);
+}
+
+// the bone lookups are gathers
+BATCH_AVX2 inline void blendDualQuats(const DualQuatArrays &dq, const uint32_t *const *indices, const float *const *weights,
+                                      int influences, size_t count, const DualQuatArrays &out) {
+    const __m256 signBit = _mm256_set1_ps(-0.f);
+    size_t k = 0;
+    for (; k + 8 <= count; k += 8) {
+        __m256 real[4], dual[4], first[4];
+        for (int c = 0; c < 4; ++c) {
+            real[c] = dual[c] = _mm256_setzero_ps();
+        }
+        for (int j = 0; j < influences; ++j) {
+            const __m256 r[4] = {lanes(dq.real.x, indices[j], k), lanes(dq.real.y, indices[j], k),
+                                 lanes(dq.real.z, indices[j], k), lanes(dq.real.w, indices[j], k)};
+            const __m256 d[4] = {lanes(dq.dual.x, indices[j], k), lanes(dq.dual.y, indices[j], k),
+                                 lanes(dq.dual.z, indices[j], k), lanes(dq.dual.w, indices[j], k)};
+            if (j == 0) {
+                first[0] = r[0], first[1] = r[1], first[2] = r[2], first[3] = r[3];
+            }
+            const __m256 flip = _mm256_and_ps(dot4(first[0], first[1], first[2], first[3], r[0], r[1], r[2], r[3]), signBit);
+            const __m256 w = _mm256_xor_ps(_mm256_loadu_ps(weights[j] + k), flip);
+            for (int c = 0; c < 4; ++c) {
+                real[c] = _mm256_fmadd_ps(r[c], w, real[c]);
+                dual[c] = _mm256_fmadd_ps(d[c], w, dual[c]);
+            }
+        }
+        const __m256 scale = invSqrt(dot4(real[0], real[1], real[2], real[3], real[0], real[1], real[2], real[3]));
+        float *const dst[8] = {out.real.x, out.real.y, out.real.z, out.real.w, out.dual.x, out.dual.y, out.dual.z, out.dual.w};
+        for (int c = 0; c < 4; ++c) {
+            _mm256_storeu_ps(dst[c] + k, _mm256_mul_ps(real[c], scale));
+            _mm256_storeu_ps(dst[c + 4] + k, _mm256_mul_ps(dual[c], scale));
+        }
+    }
+    scalar::blendDualQuatRange(dq, indices, weights, influences, k, count, out);
+}
+
+#undef BATCH_AVX2
+
+constexpr QuatKernels quatKernels = {nlerp, slerp, rotationMatrices, blendDualQuats};
+
+} // namespace avx2
+
+#endif // CPU_X86
+
+#if CPU_NEON
+
+namespace neon {
+
+inline float32x4_t dot4(float32x4_t ax, float32x4_t ay, float32x4_t az, float32x4_t aw, float32x4_t bx, float32x4_t by,
+                        float32x4_t bz, float32x4_t bw) {
+    return vfmaq_f32(vfmaq_f32(vfmaq_f32(vmulq_f32(aw, bw), az, bz), ay, by), ax, bx);
+}
+
+// estimate plus two Newton steps (vrsqrts does one)
+inline float32x4_t invSqrt(float32x4_t x) {
+    float32x4_t r = vrsqrteq_f32(x);
+    r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(x, r), r));
+    return vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(x, r), r));
+}
+
+inline float32x4_t slerpFactor(float32x4_t d, float32x4_t t) {
+    const float32x4_t a = vfmaq_f32(vdupq_n_f32(1.0904f), d,
+                                    vfmaq_f32(vdupq_n_f32(-3.2452f), d, vfmsq_f32(vdupq_n_f32(3.55645f), d, vdupq_n_f32(1.43519f))));
+    const float32x4_t b = vfmaq_f32(vdupq_n_f32(0.848013f), d, vfmaq_f32(vdupq_n_f32(-1.06021f), d, vdupq_n_f32(0.215638f)));
+    const float32x4_t centered = vsubq_f32(t, vdupq_n_f32(0.5f));
+    const float32x4_t k = vfmaq_f32(b, a, vmulq_f32(centered, centered));
+    return vfmaq_f32(t, vmulq_f32(vmulq_f32(t, centered), vsubq_f32(t, vdupq_n_f32(1.f))), k);
+}
+
+inline void nlerp4(const QuatArrays &a, const QuatArrays &b, const float *t, size_t count, const QuatArrays &out, bool corrected) {
+    const uint32x4_t signBit = vdupq_n_u32(0x80000000u);
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        const float32x4_t ax = vld1q_f32(a.x + k), ay = vld1q_f32(a.y + k), az = vld1q_f32(a.z + k), aw = vld1q_f32(a.w + k);
+        float32x4_t bx = vld1q_f32(b.x + k), by = vld1q_f32(b.y + k), bz = vld1q_f32(b.z + k), bw = vld1q_f32(b.w + k);
+        const float32x4_t d = dot4(ax, ay, az, aw, bx, by, bz, bw);
+        const uint32x4_t flip = vandq_u32(vreinterpretq_u32_f32(d), signBit);
+        bx = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(bx), flip));
+        by = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(by), flip));
+        bz = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(bz), flip));
+        bw = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(bw), flip));
+        float32x4_t s = vld1q_f32(t + k);
+        if (corrected) {
+            s = slerpFactor(vabsq_f32(d), s);
+        }
+        const float32x4_t x = vfmaq_f32(ax, s, vsubq_f32(bx, ax)), y = vfmaq_f32(ay, s, vsubq_f32(by, ay));
+        const float32x4_t z = vfmaq_f32(az, s, vsubq_f32(bz, az)), w = vfmaq_f32(aw, s, vsubq_f32(bw, aw));
+        const float32x4_t scale = invSqrt(dot4(x, y, z, w, x, y, z, w));
+        vst1q_f32(out.x + k, vmulq_f32(x, scale));
+        vst1q_f32(out.y + k, vmulq_f32(y, scale));
+        vst1q_f32(out.z + k, vmulq_f32(z, scale));
+        vst1q_f32(out.w + k, vmulq_f32(w, scale));
+    }
+    if (corrected) {
+        scalar::slerp(offset(a, k), offset(b, k), t + k, count - k, offset(out, k));
+    } else {
+        scalar::nlerp(offset(a, k), offset(b, k), t + k, count - k, offset(out, k));
+    }
+}
+
+inline void nlerp(const QuatArrays &a, const QuatArrays &b, const float *t, size_t count, const QuatArrays &out) {
+    nlerp4(a, b, t, count, out, false);
+}
+
+inline void slerp(const QuatArrays &a, const QuatArrays &b, const float *t, size_t count, const QuatArrays &out) {
+    nlerp4(a, b, t, count, out, true);
+}
+
+inline void rotationMatrices(const QuatArrays &q, size_t count, glm::mat3x4 *out) {
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        const float32x4_t x = vld1q_f32(q.x + k), y = vld1q_f32(q.y + k), z = vld1q_f32(q.z + k), w = vld1q_f32(q.w + k);
+        const float32x4_t one = vdupq_n_f32(1.f);
+        const float32x4_t x2 = vaddq_f32(x, x), y2 = vaddq_f32(y, y), z2 = vaddq_f32(z, z);
+        const float32x4_t xx = vmulq_f32(x2, x), yy = vmulq_f32(y2, y), zz = vmulq_f32(z2, z);
+        const float32x4_t xy = vmulq_f32(x2, y), xz = vmulq_f32(x2, z), yz = vmulq_f32(y2, z);
+        const float32x4_t wx = vmulq_f32(x2, w), wy = vmulq_f32(y2, w), wz = vmulq_f32(z2, w);
+
+        float *dst[4];
+        for (int n = 0; n < 4; ++n) {
+            dst[n] = &out[k + n][0][0];
+        }
+        const float32x4_t zero = vdupq_n_f32(0.f);
+        storeColumn(vsubq_f32(one, vaddq_f32(yy, zz)), vaddq_f32(xy, wz), vsubq_f32(xz, wy), zero, dst, 0);
+        storeColumn(vsubq_f32(xy, wz), vsubq_f32(one, vaddq_f32(xx, zz)), vaddq_f32(yz, wx), zero, dst, 1);
+        storeColumn(vaddq_f32(xz, wy), vsubq_f32(yz, wx), vsubq_f32(one, vaddq_f32(xx, yy)), zero, dst, 2);
+    }
+    scalar::rotationMatrices(offset(q, k), count - k, out + k);
+}
+
+// the blend is bound by the bone lookups, which NEON can't gather
+constexpr QuatKernels quatKernels = {nlerp, slerp, rotationMatrices, scalar::blendDualQuats};
+
+} // namespace neon
+
+#endif // CPU_NEON
+
+inline const QuatKernels &quatKernelsFor(SimdLevel level) {
+    switch (level) {
+#if CPU_X86
+        case SimdLevel::AVX512:
+        case SimdLevel::AVX2: return avx2::quatKernels;
+        case SimdLevel::SSE41: return sse41::quatKernels;
+#endif
+#if CPU_NEON
+        case SimdLevel::NEON: return neon::quatKernels;
+#endif
+        default: return scalar::quatKernels;
+    }
+}
+
+inline const QuatKernels &quatKernels() {
+    static const QuatKernels &best = quatKernelsFor(simdLevel());
+    return best;
+}
+
+inline void nlerp(const QuatArrays &a, const QuatArrays &b, const float *t, size_t count, const QuatArrays &out) {
+    quatKernels().nlerp(a, b, t, count, out);
+}
+
+inline void slerp(const QuatArrays &a, const QuatArrays &b, const float *t, size_t count, const QuatArrays &out) {
+    quatKernels().slerp(a, b, t, count, out);
+}
+
+inline void rotationMatrices(const QuatArrays &q, size_t count, glm::mat3x4 *out) {
+    quatKernels().rotationMatrices(q, count, out);
+}
+
+inline void blendDualQuats(const DualQuatArrays &dq, const uint32_t *const *indices, const float *const *weights,
+                           int influences, size_t count, const DualQuatArrays &out) {
+    quatKernels().blendDualQuats(dq, indices, weights, influences, count, out);
+}
+
+} // namespace batch
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef BATCH_SKIN_H
+#define BATCH_SKIN_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "batch_math.h"
+
+// Linear blend skinning on the CPU, for headless use and software paths;
+// the vertex shader does the same from a texture buffer (see mesh.h).
+// Dispatched like batch_math.h.
+//
+// Bone matrices are affine and kept as their top three rows (a mat3x4
+// whose columns are the rows, see Skin::computePalette), 48 bytes per
+// bone. The four bones are blended as rows and transposed back to columns
+// once per vertex.
+// Normals go through the blended 3x3 without an inverse transpose, which
+// is exact for rotations and uniform scale, and come out unnormalized.
+
+namespace batch {
+
+// per vertex: four bone indices and unorm8 weights that sum to 255
+struct SkinWeights {
+    uint8_t Bones[4];
+    uint8_t Weights[4];
+};
+
+struct SkinKernels {
+    // outPositions[k] / outNormals[k]: positions[k] / normals[k] moved by
+    // the weighted bones of weights[k]
+    void (*skinVertices)(const glm::mat3x4 *palette, const SkinWeights *weights, const glm::vec3 *positions,
+                         const glm::vec3 *normals, size_t count, glm::vec3 *outPositions, glm::vec3 *outNormals);
+};
+
+namespace scalar {
+
+inline void skinVertices(const glm::mat3x4 *palette, const SkinWeights *weights, const glm::vec3 *positions,
+                         const glm::vec3 *normals, size_t count, glm::vec3 *outPositions, glm::vec3 *outNormals) {
+    for (size_t k = 0; k < count; ++k) {
+        const SkinWeights &w = weights[k];
+        glm::mat3x4 rows = palette[w.Bones[0]] * (w.Weights[0] * (1.f / 255.f));
+        for (int j = 1; j < 4; ++j) {
+            rows += palette[w.Bones[j]] * (w.Weights[j] * (1.f / 255.f));
+        }
+        // v * m dots v with every column
+        outPositions[k] = glm::vec4(positions[k], 1.f) * rows;
+        outNormals[k] = glm::vec4(normals[k], 0.f) * rows;
+    }
+}
+
+constexpr SkinKernels skinKernels = {skinVertices};
+
+} // namespace scalar
+
+#if CPU_X86
+
+namespace sse41 {
+
+// x, y, z of v to dst without touching dst[3]
+CPU_TARGET("sse4.1") inline void storeVec3(float *dst, __m128 v) {
+    _mm_storel_pi((__m64 *)dst, v);
+    _mm_store_ss(dst + 2, _mm_movehl_ps(v, v));
+}
+
+CPU_TARGET("sse4.1") inline void skinVertices(const glm::mat3x4 *palette, const SkinWeights *weights, const glm::vec3 *positions,
+                                              const glm::vec3 *normals, size_t count, glm::vec3 *outPositions,
+                                              glm::vec3 *outNormals) {
+    const __m128 unorm = _mm_set1_ps(1.f / 255.f);
+    for (size_t k = 0; k < count; ++k) {
+        const SkinWeights &sw = weights[k];
+        int packed;
+        memcpy(&packed, sw.Weights, 4);
+        const __m128 w = _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed))), unorm);
+        const __m128 ws[4] = {_mm_shuffle_ps(w, w, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(w, w, _MM_SHUFFLE(1, 1, 1, 1)),
+                              _mm_shuffle_ps(w, w, _MM_SHUFFLE(2, 2, 2, 2)), _mm_shuffle_ps(w, w, _MM_SHUFFLE(3, 3, 3, 3))};
+        __m128 r0 = _mm_setzero_ps(), r1 = _mm_setzero_ps(), r2 = _mm_setzero_ps();
+        for (int j = 0; j < 4; ++j) {
+            const float *bone = &palette[sw.Bones[j]][0][0];
+            r0 = _mm_add_ps(r0, _mm_mul_ps(ws[j], _mm_loadu_ps(bone)));
+            r1 = _mm_add_ps(r1, _mm_mul_ps(ws[j], _mm_loadu_ps(bone + 4)));
+            r2 = _mm_add_ps(r2, _mm_mul_ps(ws[j], _mm_loadu_ps(bone + 8)));
+        }
+        // back to columns, which beats six dot products
+        __m128 r3 = _mm_setzero_ps();
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        const __m128 p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, _mm_set1_ps(positions[k].x)), _mm_mul_ps(r1, _mm_set1_ps(positions[k].y))),
+                                    _mm_add_ps(_mm_mul_ps(r2, _mm_set1_ps(positions[k].z)), r3));
+        const __m128 n = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, _mm_set1_ps(normals[k].x)), _mm_mul_ps(r1, _mm_set1_ps(normals[k].y))),
+                                    _mm_mul_ps(r2, _mm_set1_ps(normals[k].z)));
+        storeVec3(&outPositions[k].x, p);
+        storeVec3(&outNormals[k].x, n);
+    }
+}
+
+constexpr SkinKernels skinKernels = {skinVertices};
+
+} // namespace sse41
+
+namespace avx2 {
+
+#define BATCH_AVX2 CPU_TARGET("avx2,fma")
+
+// two vertices per register, one in each 128-bit half
+BATCH_AVX2 inline void skinVertices(const glm::mat3x4 *palette, const SkinWeights *weights, const glm::vec3 *positions,
+                                    const glm::vec3 *normals, size_t count, glm::vec3 *outPositions, glm::vec3 *outNormals) {
+    const __m256 unorm = _mm256_set1_ps(1.f / 255.f);
+    size_t k = 0;
+    for (; k + 2 <= count; k += 2) {
+        const SkinWeights &a = weights[k], &b = weights[k + 1];
+        int wa, wb;
+        memcpy(&wa, a.Weights, 4);
+        memcpy(&wb, b.Weights, 4);
+        // a's weights in the low half, b's in the high half
+        const __m256 w = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_setr_epi32(wa, wb, 0, 0))), unorm);
+        __m256 r0 = _mm256_setzero_ps(), r1 = _mm256_setzero_ps(), r2 = _mm256_setzero_ps();
+        for (int j = 0; j < 4; ++j) {
+            const float *boneA = &palette[a.Bones[j]][0][0], *boneB = &palette[b.Bones[j]][0][0];
+            const __m256 wj = _mm256_permutevar_ps(w, _mm256_set1_epi32(j));
+            r0 = _mm256_fmadd_ps(wj, load2(boneA, boneB), r0);
+            r1 = _mm256_fmadd_ps(wj, load2(boneA + 4, boneB + 4), r1);
+            r2 = _mm256_fmadd_ps(wj, load2(boneA + 8, boneB + 8), r2);
+        }
+        // back to columns within each half, as in sse41
+        const __m256 r3 = _mm256_setzero_ps();
+        const __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpacklo_ps(r2, r3);
+        const __m256 t2 = _mm256_unpackhi_ps(r0, r1), t3 = _mm256_unpackhi_ps(r2, r3);
+        const __m256 c0 = _mm256_shuffle_ps(t0, t1, 0x44), c1 = _mm256_shuffle_ps(t0, t1, 0xee);
+        const __m256 c2 = _mm256_shuffle_ps(t2, t3, 0x44), c3 = _mm256_shuffle_ps(t2, t3, 0xee);
+        const glm::vec3 &pa = positions[k], &pb = positions[k + 1], &na = normals[k], &nb = normals[k + 1];
+        const __m256 op = _mm256_fmadd_ps(c0, _mm256_setr_ps(pa.x, pa.x, pa.x, pa.x, pb.x, pb.x, pb.x, pb.x),
+                          _mm256_fmadd_ps(c1, _mm256_setr_ps(pa.y, pa.y, pa.y, pa.y, pb.y, pb.y, pb.y, pb.y),
+                          _mm256_fmadd_ps(c2, _mm256_setr_ps(pa.z, pa.z, pa.z, pa.z, pb.z, pb.z, pb.z, pb.z), c3)));
+        const __m256 on = _mm256_fmadd_ps(c0, _mm256_setr_ps(na.x, na.x, na.x, na.x, nb.x, nb.x, nb.x, nb.x),
+                          _mm256_fmadd_ps(c1, _mm256_setr_ps(na.y, na.y, na.y, na.y, nb.y, nb.y, nb.y, nb.y),
+                          _mm256_mul_ps(c2, _mm256_setr_ps(na.z, na.z, na.z, na.z, nb.z, nb.z, nb.z, nb.z))));
+        sse41::storeVec3(&outPositions[k].x, _mm256_castps256_ps128(op));
+        sse41::storeVec3(&outPositions[k + 1].x, _mm256_extractf128_ps(op, 1));
+        sse41::storeVec3(&outNormals[k].x, _mm256_castps256_ps128(on));
+        sse41::storeVec3(&outNormals[k + 1].x, _mm256_extractf128_ps(on, 1));
+    }
+    sse41::skinVertices(palette, weights + k, positions + k, normals + k, count - k, outPositions + k, outNormals + k);
+}
+
+#undef BATCH_AVX2
+
+constexpr SkinKernels skinKernels = {skinVertices};
+
+} // namespace avx2
+
+#endif // CPU_X86
+
+#if CPU_NEON
+
+namespace neon {
+
+inline void skinVertices(const glm::mat3x4 *palette, const SkinWeights *weights, const glm::vec3 *positions,
+                         const glm::vec3 *normals, size_t count, glm::vec3 *outPositions, glm::vec3 *outNormals) {
+    for (size_t k = 0; k < count; ++k) {
+        const SkinWeights &sw = weights[k];
+        float32x4_t r[3] = {vdupq_n_f32(0.f), vdupq_n_f32(0.f), vdupq_n_f32(0.f)};
+        for (int j = 0; j < 4; ++j) {
+            const float *bone = &palette[sw.Bones[j]][0][0];
+            const float w = sw.Weights[j] * (1.f / 255.f);
+            for (int c = 0; c < 3; ++c) {
+                r[c] = vfmaq_n_f32(r[c], vld1q_f32(bone + 4 * c), w);
+            }
+        }
+        const float pv[4] = {positions[k].x, positions[k].y, positions[k].z, 1.f};
+        const float nv[4] = {normals[k].x, normals[k].y, normals[k].z, 0.f};
+        const float32x4_t p = vld1q_f32(pv), n = vld1q_f32(nv);
+        for (int c = 0; c < 3; ++c) {
+            (&outPositions[k].x)[c] = vaddvq_f32(vmulq_f32(r[c], p));
+            (&outNormals[k].x)[c] = vaddvq_f32(vmulq_f32(r[c], n));
+        }
+    }
+}
+
+constexpr SkinKernels skinKernels = {skinVertices};
+
+} // namespace neon
+
+#endif // CPU_NEON
+
+inline const SkinKernels &skinKernelsFor(SimdLevel level) {
+    switch (level) {
+#if CPU_X86
+        case SimdLevel::AVX512:
+        case SimdLevel::AVX2: return avx2::skinKernels;
+        case SimdLevel::SSE41: return sse41::skinKernels;
+#endif
+#if CPU_NEON
+        case SimdLevel::NEON: return neon::skinKernels;
+#endif
+        default: return scalar::skinKernels;
+    }
+}
+
+inline const SkinKernels &skinKernels() {
+    static const SkinKernels &best = skinKernelsFor(simdLevel());
+    return best;
+}
+
+inline void skinVertices(const glm::mat3x4 *palette, const SkinWeights *weights, const glm::vec3 *positions,
+                         const glm::vec3 *normals, size_t count, glm::vec3 *outPositions, glm::vec3 *outNormals) {
+    skinKernels().skinVertices(palette, weights, positions, normals, count, outPositions, outNormals);
+}
+
+} // namespace batch
+
+#endif
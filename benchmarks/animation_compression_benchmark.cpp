@@ -0,0 +1,159 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "animation_compression.h"
+#include "benchmark.h"
+
+// compressClip() on a smooth synthetic clip: compression ratio and measured
+// world space error for a few tolerances, then sampling throughput of the
+// compressed clip against the raw one for a crowd of characters. Fails when
+// the error goes over the tolerance.
+
+using std::vector;
+
+// origin and shell points of every node, in world space
+static float poseError(const SceneGraph &a, const SceneGraph &b, float shell) {
+  float error = 0.f;
+  for (SceneGraph::NodeId id = 0; id < a.size(); ++id) {
+    const glm::mat4 &m = a.world(id), &n = b.world(id);
+    error = std::max(error, glm::length(glm::vec3(m[3] - n[3])));
+    for (int axis = 0; axis < 3; ++axis) {
+      error = std::max(error, glm::length(glm::vec3(m[3] + shell * m[axis] - n[3] - shell * n[axis])));
+    }
+  }
+  return error;
+}
+
+int main(int argc, char **argv) {
+  const size_t characters = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200;
+  const size_t bones = 64;
+  const float duration = 4.f, rate = 60.f;
+  const size_t keys = (size_t)(duration * rate) + 1;
+
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<float> dist(-1.f, 1.f), unit(0.f, 1.f);
+
+  // a humanoid sized tree in metres: chains at most 8 bones deep, bones 5
+  // to 15 cm long
+  SceneGraph skeleton;
+  vector<int> depth(bones, 0);
+  for (size_t b = 0; b < bones; ++b) {
+    SceneGraph::NodeId parent = SceneGraph::none;
+    if (b > 0) {
+      parent = (SceneGraph::NodeId)(b - 1 - rng() % std::min<size_t>(b, 4));
+      while (depth[parent] >= 7) {
+        parent = skeleton.parent(parent);
+      }
+      depth[b] = depth[parent] + 1;
+    }
+    const glm::vec3 offset = b == 0 ? glm::vec3(0.f, 1.f, 0.f) : glm::normalize(glm::vec3(dist(rng), dist(rng), dist(rng))) * (0.05f + 0.1f * unit(rng));
+    skeleton.add(parent, offset, glm::quat(1.f, 0.f, 0.f, 0.f), glm::vec3(1.f), "bone" + std::to_string(b));
+  }
+  skeleton.update();
+
+  // sine waves up to 0.4 radians at 60 keys per second; a quarter of the
+  // bones hold still, only the root moves, scale keys are all 1 as
+  // exporters write them
+  AnimationClip clip;
+  clip.Name = "walk";
+  clip.Duration = duration;
+  for (size_t b = 0; b < bones; ++b) {
+    NodeTrack track;
+    track.NodeName = "bone" + std::to_string(b);
+    const glm::vec3 axis = glm::normalize(glm::vec3(dist(rng), dist(rng), dist(rng)));
+    const float amplitude = b % 4 == 3 ? 0.f : 0.4f * unit(rng), frequency = 0.5f + unit(rng), phase = 6.f * unit(rng);
+    const glm::vec3 rest = skeleton.translation((SceneGraph::NodeId)b);
+    for (size_t k = 0; k < keys; ++k) {
+      const float t = duration * k / (keys - 1);
+      track.RotationTimes.push_back(t);
+      track.Rotations.push_back(glm::angleAxis(amplitude * std::sin(6.2831853f * frequency * t + phase), axis));
+      track.PositionTimes.push_back(t);
+      track.Positions.push_back(b == 0 ? rest + glm::vec3(t, 0.05f * std::sin(12.566f * t), 0.f) : rest);
+      track.ScaleTimes.push_back(t);
+      track.Scales.push_back(glm::vec3(1.f));
+    }
+    clip.Tracks.push_back(track);
+  }
+  clip.resolve(skeleton);
+
+  printf("%zu bones, %zu keys per channel, raw %zu bytes\n", bones, keys, rawByteSize(clip));
+  printf("  %-10s %10s %7s %7s %7s %10s %12s\n", "tolerance", "bytes", "ratio", "keys", "float", "max error", "compress ms");
+  CompressedClip compressed;
+  CompressionSettings settings;
+  bool failed = false;
+  for (float tolerance : {1e-3f, 1e-4f, 1e-5f}) {
+    settings.Tolerance = tolerance;
+    const auto start = std::chrono::steady_clock::now();
+    CompressedClip c = compressClip(clip, skeleton, settings);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    size_t kept = 0, exact = 0;
+    for (const CompressedTrack &track : c.Tracks) {
+      kept += track.KeyCount;
+      exact += track.Exact;
+    }
+
+    // measured between the frames too
+    SceneGraph rawPose = skeleton, compressedPose = skeleton;
+    Animator raw(rawPose);
+    CompressedAnimator sampler(compressedPose);
+    raw.play(clip);
+    sampler.play(c);
+    float error = 0.f;
+    for (int i = 0; i <= 1000; ++i) {
+      const float t = duration * i / 1000.f;
+      raw.sample(t), sampler.sample(t);
+      rawPose.update(), compressedPose.update();
+      error = std::max(error, poseError(rawPose, compressedPose, settings.ShellDistance));
+    }
+    printf("  %-10g %10zu %6.1fx %6.1f%% %7zu %10.3g %12.1f\n", tolerance, c.byteSize(), (double)rawByteSize(clip) / c.byteSize(),
+           100.0 * kept / (bones * keys), exact, error, ms);
+    if (error > tolerance) {
+      fprintf(stderr, "ERROR: max error %g over the tolerance %g\n", error, tolerance);
+      failed = true;
+    }
+    if (tolerance == 1e-4f) {
+      compressed = c;
+    }
+  }
+
+  printf("sampling %zu characters, tolerance 1e-4\n", characters);
+  vector<std::unique_ptr<SceneGraph>> scenes;
+  vector<std::unique_ptr<Animator>> raw;
+  vector<std::unique_ptr<CompressedAnimator>> samplers;
+  for (size_t c = 0; c < characters; ++c) {
+    scenes.push_back(std::make_unique<SceneGraph>(skeleton));
+    raw.push_back(std::make_unique<Animator>(*scenes.back()));
+    raw.back()->play(clip);
+    samplers.push_back(std::make_unique<CompressedAnimator>(*scenes.back()));
+    samplers.back()->play(compressed);
+    const float start = unit(rng) * duration;
+    raw.back()->advance(start), samplers.back()->advance(start);
+  }
+  // a second of playback, sampling only
+  const int steps = 60;
+  const double rawMs = benchmarkMs([&] {
+    for (int step = 0; step < steps; ++step) {
+      for (auto &animator : raw) animator->advance(1.f / steps);
+    }
+  }, 3);
+  const double compressedMs = benchmarkMs([&] {
+    for (int step = 0; step < steps; ++step) {
+      for (auto &sampler : samplers) sampler->advance(1.f / steps);
+    }
+  }, 3);
+  const double trackSamples = (double)steps * characters * bones;
+  reportBenchmark("Animator, raw", rawMs);
+  printf("    %.1f M track samples/s\n", trackSamples / rawMs * 1e-3);
+  reportBenchmark("CompressedAnimator", compressedMs, rawMs);
+  printf("    %.1f M track samples/s\n", trackSamples / compressedMs * 1e-3);
+  return failed ? 1 : 0;
+}
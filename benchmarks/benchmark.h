@@ -0,0 +1,44 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// Minimal timing for the benchmarks: run fn a few times, report the fastest
+// run (the one least disturbed by the rest of the machine).
+
+template <typename Fn>
+double benchmarkMs(Fn &&fn, int repeats = 7) {
+    double best = 1e30;
+    for (int i = 0; i < repeats; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return best;
+}
+
+// one result line; `baselineMs` 0 for the baseline itself
+inline void reportBenchmark(const char *name, double ms, double baselineMs = 0.0) {
+    if (baselineMs > 0.0) {
+        printf("  %-28s %9.3f ms  %5.2fx\n", name, ms, baselineMs / ms);
+    } else {
+        printf("  %-28s %9.3f ms\n", name, ms);
+    }
+}
+
+// keeps the optimizer from dropping work whose result isn't otherwise used
+template <typename T>
+inline void doNotOptimize(const T &value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static volatile const void *sink;
+    sink = &value;
+#endif
+}
+
+#endif
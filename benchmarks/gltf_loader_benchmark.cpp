@@ -0,0 +1,171 @@
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "gltf_loader.h"
+#include "vertex_convert.h"
+
+// Loading a GLB up to where its vertices are ready for glBufferData:
+// assimp's importer with the flags Model uses plus the conversion
+// processMesh() does into Vertex arrays, against readGltf(), whose
+// accessors point into the mapped file. Takes a file, or writes a torus of
+// n x n quads (default 1000, ~55 MB) split over `meshes` meshes.
+
+// the torus as one GLB: per mesh float positions, normals and texture
+// coordinates and uint32 indices, each in a buffer view of its own
+static bool writeTorus(const char *path, int n, int meshes) {
+  const float pi = 3.14159265f;
+  std::vector<unsigned char> bin;
+  auto append = [&](const void *data, size_t bytes) {
+    const size_t offset = bin.size();
+    bin.insert(bin.end(), (const unsigned char *)data, (const unsigned char *)data + bytes);
+    return offset;
+  };
+  std::string views, accessors, meshList, nodes, sceneNodes;
+  const int rows = n / meshes;
+  for (int m = 0; m < meshes; ++m) {
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> texCoords;
+    std::vector<uint32_t> indices;
+    for (int i = m * rows; i <= (m + 1) * rows; ++i) {
+      for (int j = 0; j <= n; ++j) {
+        const float u = 2.f * pi * i / n, v = 2.f * pi * j / n;
+        positions.emplace_back((1.f + 0.3f * std::cos(v)) * std::cos(u), 0.3f * std::sin(v), (1.f + 0.3f * std::cos(v)) * std::sin(u));
+        normals.emplace_back(std::cos(v) * std::cos(u), std::sin(v), std::cos(v) * std::sin(u));
+        texCoords.emplace_back((float)i / n, (float)j / n);
+      }
+    }
+    for (int i = 0; i < rows; ++i) {
+      for (int j = 0; j < n; ++j) {
+        const uint32_t a = i * (n + 1) + j, b = a + n + 1;
+        for (uint32_t index : {a, b, b + 1, a, b + 1, a + 1}) indices.push_back(index);
+      }
+    }
+    glm::vec3 lo(1e30f), hi(-1e30f);
+    for (const glm::vec3 &p : positions) {
+      lo = glm::min(lo, p);
+      hi = glm::max(hi, p);
+    }
+    const size_t count = positions.size(), view = 4 * m;
+    const size_t offsets[4] = {append(positions.data(), count * 12), append(normals.data(), count * 12),
+                               append(texCoords.data(), count * 8), append(indices.data(), indices.size() * 4)};
+    const size_t lengths[4] = {count * 12, count * 12, count * 8, indices.size() * 4};
+    for (int k = 0; k < 4; ++k) {
+      views += std::string(views.empty() ? "" : ",") + "{\"buffer\":0,\"byteOffset\":" + std::to_string(offsets[k]) +
+               ",\"byteLength\":" + std::to_string(lengths[k]) + ",\"target\":" + (k < 3 ? "34962" : "34963") + "}";
+    }
+    char bounds[160];
+    snprintf(bounds, sizeof(bounds), ",\"min\":[%g,%g,%g],\"max\":[%g,%g,%g]", lo.x, lo.y, lo.z, hi.x, hi.y, hi.z);
+    const char *types[4] = {"VEC3", "VEC3", "VEC2", "SCALAR"};
+    for (int k = 0; k < 4; ++k) {
+      accessors += std::string(accessors.empty() ? "" : ",") + "{\"bufferView\":" + std::to_string(view + k) +
+                   ",\"componentType\":" + (k < 3 ? "5126" : "5125") + ",\"count\":" +
+                   std::to_string(k < 3 ? count : indices.size()) + ",\"type\":\"" + types[k] + "\"" + (k == 0 ? bounds : "") + "}";
+    }
+    meshList += std::string(meshList.empty() ? "" : ",") + "{\"name\":\"Torus" + std::to_string(m) +
+                "\",\"primitives\":[{\"attributes\":{\"POSITION\":" + std::to_string(view) + ",\"NORMAL\":" +
+                std::to_string(view + 1) + ",\"TEXCOORD_0\":" + std::to_string(view + 2) + "},\"indices\":" +
+                std::to_string(view + 3) + "}]}";
+    nodes += std::string(nodes.empty() ? "" : ",") + "{\"name\":\"Torus" + std::to_string(m) + "\",\"mesh\":" + std::to_string(m) + "}";
+    sceneNodes += std::string(sceneNodes.empty() ? "" : ",") + std::to_string(m);
+  }
+  std::string json = "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[" + sceneNodes + "]}],\"nodes\":[" +
+                     nodes + "],\"meshes\":[" + meshList + "],\"accessors\":[" + accessors + "],\"bufferViews\":[" + views +
+                     "],\"buffers\":[{\"byteLength\":" + std::to_string(bin.size()) + "}]}";
+  json.resize((json.size() + 3) & ~(size_t)3, ' ');
+  bin.resize((bin.size() + 3) & ~(size_t)3, 0);
+
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    return false;
+  }
+  auto u32 = [&](uint32_t value) { fwrite(&value, 4, 1, file); };
+  u32(0x46546C67);
+  u32(2);
+  u32((uint32_t)(12 + 8 + json.size() + 8 + bin.size()));
+  u32((uint32_t)json.size());
+  u32(0x4E4F534A);
+  fwrite(json.data(), 1, json.size(), file);
+  u32((uint32_t)bin.size());
+  u32(0x004E4942);
+  fwrite(bin.data(), 1, bin.size(), file);
+  return fclose(file) == 0;
+}
+
+int main(int argc, char **argv) {
+  std::string path;
+  bool generated = false;
+  if (argc > 1 && atoi(argv[1]) == 0) {
+    path = argv[1];
+  } else {
+    path = "gltf_loader_benchmark.glb";
+    const int n = argc > 1 ? atoi(argv[1]) : 1000;
+    const int meshes = argc > 2 ? atoi(argv[2]) : 8;
+    if (!writeTorus(path.c_str(), n, meshes)) {
+      fprintf(stderr, "ERROR: can't write %s\n", path.c_str());
+      return 1;
+    }
+    generated = true;
+  }
+
+  GltfFile check;
+  if (!readGltf(path, check)) {
+    fprintf(stderr, "ERROR: %s\n", check.Error.c_str());
+    return 1;
+  }
+  size_t vertices = 0, triangles = 0, primitives = 0;
+  for (const GltfMesh &mesh : check.Meshes) {
+    for (const GltfPrimitive &primitive : mesh.Primitives) {
+      vertices += primitive.Position.Count;
+      triangles += primitive.Indices.Count / 3;
+      ++primitives;
+    }
+  }
+  printf("%s: %.1f MB, %zu primitives, %zu vertices, %zu triangles\n", path.c_str(), check.Mapped[0]->size() / 1e6,
+         primitives, vertices, triangles);
+
+  const int repeats = 3;
+  const double assimpMs = benchmarkMs([&] {
+    Assimp::Importer import;
+    const aiScene *scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_LimitBoneWeights);
+    // what processMesh() then builds for the upload
+    for (unsigned m = 0; scene && m < scene->mNumMeshes; ++m) {
+      const aiMesh *mesh = scene->mMeshes[m];
+      std::vector<Vertex> converted(mesh->mNumVertices);
+      batch::interleaveVertices((const glm::vec3 *)mesh->mVertices, (const glm::vec3 *)mesh->mNormals,
+                                (const glm::vec3 *)mesh->mTextureCoords[0], mesh->mNumVertices, converted.data());
+      std::vector<unsigned> indices;
+      indices.reserve(mesh->mNumFaces * 3);
+      for (unsigned f = 0; f < mesh->mNumFaces; ++f) {
+        indices.insert(indices.end(), mesh->mFaces[f].mIndices, mesh->mFaces[f].mIndices + mesh->mFaces[f].mNumIndices);
+      }
+      doNotOptimize(converted);
+      doNotOptimize(indices);
+    }
+  }, repeats);
+  reportBenchmark("assimp + Vertex arrays", assimpMs);
+
+  const double nativeMs = benchmarkMs([&] {
+    GltfFile file;
+    readGltf(path, file);
+    // the upload reads every byte of the views; so does this
+    uint64_t sum = 0;
+    for (const GltfView &view : file.Views) {
+      for (size_t i = 0; i < view.Size; i += 64) sum += view.Data[i];
+    }
+    doNotOptimize(sum);
+  }, repeats);
+  reportBenchmark("readGltf, buffer views", nativeMs, assimpMs);
+
+  if (generated) {
+    remove(path.c_str());
+  }
+  return 0;
+}
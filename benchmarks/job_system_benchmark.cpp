@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#define LEARNOPENGL_TRACK_ALLOCATIONS
+#include "benchmark.h"
+#include "job_system.h"
+
+// JobSystem from 1 to 64 threads on three workloads: a coarse parallelFor,
+// a tree of tiny recursively spawned jobs, and a graph of dependent stages.
+// Past the hardware threads the numbers show oversubscription, not scaling.
+// Then the heap allocations of parallelFor once the job pool has grown; it
+// fails if there are any.
+
+using std::vector;
+
+// some arithmetic per item
+static float work(size_t i) {
+  float x = (float)i * 1e-3f;
+  for (int k = 0; k < 16; ++k) x = std::sin(x) * 0.9f + 0.1f;
+  return x;
+}
+
+// sums [begin, end) by splitting it down to `leaf` items
+static void treeSum(JobSystem &jobs, size_t begin, size_t end, size_t leaf, std::atomic<double> &total) {
+  if (end - begin <= leaf) {
+    double sum = 0.0;
+    for (size_t i = begin; i < end; ++i) sum += work(i);
+    double expected = total.load();
+    while (!total.compare_exchange_weak(expected, expected + sum)) {
+    }
+    return;
+  }
+  const size_t mid = begin + (end - begin) / 2;
+  JobCounter counter;
+  jobs.run([&, mid, end] { treeSum(jobs, mid, end, leaf, total); }, &counter);
+  treeSum(jobs, begin, mid, leaf, total);
+  jobs.wait(counter);
+}
+
+int main(int argc, char **argv) {
+  const unsigned maxThreads = argc > 1 ? (unsigned)strtoul(argv[1], nullptr, 10) : 64;
+  const size_t items = 1 << 20;
+  vector<float> out(items);
+
+  printf("%u hardware threads\n", std::max(1u, std::thread::hardware_concurrency()));
+  printf("  %-7s %-10s %10s %8s %10s %10s %7s\n", "threads", "workload", "ms", "speedup", "steals", "failed", "idle");
+  double baseline[3] = {};
+  for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+    JobSystem jobs(threads);
+    for (int workload = 0; workload < 3; ++workload) {
+      jobs.resetStats();
+      const auto start = std::chrono::steady_clock::now();
+      double ms = 0.0;
+      if (workload == 0) {
+        // parallelFor, 256 chunks
+        ms = benchmarkMs([&] {
+          jobs.parallelFor(items, items / 256, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) out[i] = work(i);
+          });
+          doNotOptimize(out);
+        }, 5);
+      } else if (workload == 1) {
+        // 8192 leaves of 128 items
+        ms = benchmarkMs([&] {
+          std::atomic<double> total{0.0};
+          treeSum(jobs, 0, items, 128, total);
+          doNotOptimize(total);
+        }, 5);
+      } else {
+        // 16 stages of 64 jobs, each stage waiting for the one before
+        ms = benchmarkMs([&] {
+          vector<JobCounter> stages(16);
+          for (size_t s = 0; s < stages.size(); ++s) {
+            for (size_t j = 0; j < 64; ++j) {
+              const size_t begin = (s * 64 + j) * (items / 1024);
+              jobs.run([&, begin] {
+                for (size_t i = begin; i < begin + items / 1024; ++i) out[i] = work(i);
+              }, &stages[s], s ? &stages[s - 1] : nullptr);
+            }
+          }
+          jobs.wait(stages.back());
+          // earlier stages finished before the last began, but their
+          // counters may still be in use by the jobs that signalled them
+          for (JobCounter &stage : stages) jobs.wait(stage);
+          doNotOptimize(out);
+        }, 5);
+      }
+      const double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      const char *names[] = {"for", "tree", "graph"};
+      if (threads == 1) baseline[workload] = ms;
+
+      uint64_t steals = 0, failed = 0;
+      double idleMs = 0.0;
+      for (const JobWorkerStats &s : jobs.stats()) {
+        steals += s.steals, failed += s.failedSteals, idleMs += s.idleMs;
+      }
+      // idle share of the workers' time over all the repeats
+      const double workerMs = wallMs * (threads - 1);
+      printf("  %-7u %-10s %10.3f %7.2fx %10llu %10llu %6.1f%%\n", threads, names[workload], ms, baseline[workload] / ms,
+             (unsigned long long)steals, (unsigned long long)failed, workerMs > 0.0 ? 100.0 * idleMs / workerMs : 0.0);
+    }
+  }
+
+  JobSystem jobs(std::min(maxThreads, 4u));
+  auto frame = [&] {
+    // as the lighting demo splits its draws, then finer
+    jobs.parallelFor(10, 4, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) out[i] = work(i);
+    });
+    jobs.parallelFor(items / 16, 64, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) out[i] = work(i);
+    });
+  };
+  for (int i = 0; i < 10; ++i) frame();
+  const uint64_t before = AllocationTracker::total().count;
+  for (int i = 0; i < 100; ++i) frame();
+  const uint64_t allocations = AllocationTracker::total().count - before;
+  printf("heap allocations in 100 frames of parallelFor on %u threads: %llu\n", jobs.threadCount(),
+         (unsigned long long)allocations);
+  if (allocations) {
+    fprintf(stderr, "ERROR: parallelFor allocated once warmed up\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,114 @@
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "obj_loader.h"
+
+// Reading an OBJ file: assimp's importer with the flags Model uses against
+// readObj() on 1, 2, 4, ... threads up to the hardware's, in megabytes of
+// file per second. Takes a file, or writes a torus of n x n quads with
+// positions, texture coordinates and normals (default 1000, ~160 MB).
+
+// a torus of n x n quads, every corner v/vt/vn, written the way Blender does
+static bool writeTorus(const char *path, int n) {
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    return false;
+  }
+  fprintf(file, "# obj_loader_benchmark torus\no Torus\n");
+  const float pi = 3.14159265f;
+  for (int i = 0; i <= n; ++i) {
+    for (int j = 0; j <= n; ++j) {
+      const float u = 2.f * pi * i / n, v = 2.f * pi * j / n;
+      const float ring = 1.f + 0.3f * std::cos(v);
+      fprintf(file, "v %.6f %.6f %.6f\n", ring * std::cos(u), 0.3f * std::sin(v), ring * std::sin(u));
+    }
+  }
+  for (int i = 0; i <= n; ++i) {
+    for (int j = 0; j <= n; ++j) {
+      fprintf(file, "vt %.6f %.6f\n", (float)i / n, (float)j / n);
+    }
+  }
+  for (int i = 0; i <= n; ++i) {
+    for (int j = 0; j <= n; ++j) {
+      const float u = 2.f * pi * i / n, v = 2.f * pi * j / n;
+      fprintf(file, "vn %.4f %.4f %.4f\n", std::cos(v) * std::cos(u), std::sin(v), std::cos(v) * std::sin(u));
+    }
+  }
+  fprintf(file, "s 1\n");
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < n; ++j) {
+      const int a = i * (n + 1) + j + 1, b = a + n + 1;
+      fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, b + 1, b + 1, b + 1, a + 1, a + 1, a + 1);
+    }
+  }
+  return fclose(file) == 0;
+}
+
+int main(int argc, char **argv) {
+  std::string path;
+  bool generated = false;
+  if (argc > 1 && atoi(argv[1]) == 0) {
+    path = argv[1];
+  } else {
+    path = "obj_loader_benchmark.obj";
+    const int n = argc > 1 ? atoi(argv[1]) : 1000;
+    if (!writeTorus(path.c_str(), n)) {
+      fprintf(stderr, "ERROR: can't write %s\n", path.c_str());
+      return 1;
+    }
+    generated = true;
+  }
+  const double megabytes = MappedFile(path).size() / 1e6;
+
+  ObjFile check;
+  if (!readObj(path, check)) {
+    fprintf(stderr, "ERROR: %s\n", check.Error.c_str());
+    return 1;
+  }
+  size_t vertices = 0, triangles = 0;
+  for (const ObjMesh &mesh : check.Meshes) {
+    vertices += mesh.Vertices.size();
+    triangles += mesh.Indices.size() / 3;
+  }
+  printf("%s: %.1f MB, %zu meshes, %zu vertices, %zu triangles\n", path.c_str(), megabytes, check.Meshes.size(),
+         vertices, triangles);
+
+  // a few runs each: these are seconds, not microseconds
+  const int repeats = 3;
+  const double assimpMs = benchmarkMs([&] {
+    Assimp::Importer import;
+    const aiScene *scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_LimitBoneWeights);
+    doNotOptimize(scene);
+  }, repeats);
+  reportBenchmark("assimp ReadFile", assimpMs);
+  printf("  %-28s %9.1f MB/s\n", "", megabytes / assimpMs * 1e3);
+
+  const unsigned hardware = JobSystem::defaultThreadCount();
+  for (unsigned threads = 1;; threads = std::min(threads * 2, hardware)) {
+    JobSystem jobs(threads);
+    const double ms = benchmarkMs([&] {
+      ObjFile file;
+      readObj(path, file, true, jobs);
+      doNotOptimize(file);
+    }, repeats);
+    const std::string name = "readObj, " + std::to_string(threads) + (threads == 1 ? " thread" : " threads");
+    reportBenchmark(name.c_str(), ms, assimpMs);
+    printf("  %-28s %9.1f MB/s\n", "", megabytes / ms * 1e3);
+    if (threads == hardware) {
+      break;
+    }
+  }
+
+  if (generated) {
+    remove(path.c_str());
+  }
+  return 0;
+}
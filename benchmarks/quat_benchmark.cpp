@@ -0,0 +1,193 @@
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtx/dual_quaternion.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "batch_quat.h"
+#include "benchmark.h"
+
+// batch_quat.h kernels at every SIMD level this CPU runs, timed against
+// and checked against the glm::quat / glm::dualquat loops they replace
+
+using std::vector;
+
+// one component array per quaternion component
+struct SoaQuats {
+  vector<float> c[4];
+
+  explicit SoaQuats(size_t count) {
+    for (vector<float> &component : c) {
+      component.resize(count);
+    }
+  }
+  batch::QuatArrays arrays() { return {c[0].data(), c[1].data(), c[2].data(), c[3].data()}; }
+  glm::quat get(size_t i) const { return glm::quat(c[3][i], c[0][i], c[1][i], c[2][i]); }
+  void set(size_t i, const glm::quat &q) {
+    for (int k = 0; k < 4; ++k) c[k][i] = q[k];
+  }
+};
+
+// q and -q are the same rotation
+static float quatError(const glm::quat &a, const glm::quat &b) {
+  return std::min(glm::length(a - b), glm::length(a + b));
+}
+
+int main(int argc, char **argv) {
+  const size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+  const size_t bones = 64;
+  const int influences = 4;
+
+  std::mt19937 rng(11);
+  std::uniform_real_distribution<float> dist(-1.f, 1.f), unit(0.f, 1.f);
+  auto randomQuat = [&] { return glm::normalize(glm::quat(dist(rng), dist(rng), dist(rng), dist(rng))); };
+
+  vector<glm::quat> from(count), to(count), result(count);
+  vector<float> t(count);
+  SoaQuats soaFrom(count), soaTo(count), soaOut(count);
+  for (size_t i = 0; i < count; ++i) {
+    from[i] = randomQuat(), to[i] = randomQuat(), t[i] = unit(rng);
+    soaFrom.set(i, from[i]), soaTo.set(i, to[i]);
+  }
+
+  vector<glm::dualquat> boneDQs(bones);
+  SoaQuats boneReal(bones), boneDual(bones);
+  for (size_t b = 0; b < bones; ++b) {
+    boneDQs[b] = glm::dualquat(randomQuat(), glm::vec3(dist(rng), dist(rng), dist(rng)) * 5.f);
+    boneReal.set(b, boneDQs[b].real), boneDual.set(b, boneDQs[b].dual);
+  }
+  vector<uint32_t> indices[influences];
+  vector<float> weights[influences];
+  for (int j = 0; j < influences; ++j) {
+    indices[j].resize(count), weights[j].resize(count);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    float sum = 0.f;
+    for (int j = 0; j < influences; ++j) {
+      indices[j][i] = rng() % bones;
+      sum += weights[j][i] = unit(rng);
+    }
+    for (int j = 0; j < influences; ++j) weights[j][i] /= sum;
+  }
+  const uint32_t *indexArrays[influences];
+  const float *weightArrays[influences];
+  for (int j = 0; j < influences; ++j) {
+    indexArrays[j] = indices[j].data(), weightArrays[j] = weights[j].data();
+  }
+  const batch::DualQuatArrays bonesSoa = {boneReal.arrays(), boneDual.arrays()};
+  SoaQuats blendedReal(count), blendedDual(count);
+  const batch::DualQuatArrays blended = {blendedReal.arrays(), blendedDual.arrays()};
+  vector<glm::dualquat> blendedGlm(count);
+  vector<glm::mat3> matricesGlm(count);
+  vector<glm::mat3x4> matrices(count);
+
+  vector<SimdLevel> levels = {SimdLevel::Scalar};
+#if CPU_X86
+  for (SimdLevel level : {SimdLevel::SSE41, SimdLevel::AVX2}) {
+    if (level <= simdLevel()) levels.push_back(level);
+  }
+#elif CPU_NEON
+  levels.push_back(SimdLevel::NEON);
+#endif
+
+  printf("%zu quaternions, detected %s\n", count, simdLevelName(simdLevel()));
+
+  printf("nlerp\n");
+  const double nlerpGlm = benchmarkMs([&] {
+    for (size_t i = 0; i < count; ++i) {
+      const glm::quat b = glm::dot(from[i], to[i]) < 0.f ? -to[i] : to[i];
+      result[i] = glm::normalize(from[i] + (b - from[i]) * t[i]);
+    }
+    doNotOptimize(result);
+  });
+  reportBenchmark("glm::quat", nlerpGlm);
+  for (SimdLevel level : levels) {
+    const batch::QuatKernels &kernels = batch::quatKernelsFor(level);
+    const double ms = benchmarkMs([&] {
+      kernels.nlerp(soaFrom.arrays(), soaTo.arrays(), t.data(), count, soaOut.arrays());
+      doNotOptimize(soaOut);
+    });
+    reportBenchmark(simdLevelName(level), ms, nlerpGlm);
+    float error = 0.f;
+    for (size_t i = 0; i < count; ++i) error = std::max(error, quatError(result[i], soaOut.get(i)));
+    printf("  max error vs glm %g\n", error);
+  }
+
+  printf("slerp\n");
+  const double slerpGlm = benchmarkMs([&] {
+    for (size_t i = 0; i < count; ++i) {
+      result[i] = glm::slerp(from[i], to[i], t[i]);
+    }
+    doNotOptimize(result);
+  });
+  reportBenchmark("glm::slerp", slerpGlm);
+  for (SimdLevel level : levels) {
+    const batch::QuatKernels &kernels = batch::quatKernelsFor(level);
+    const double ms = benchmarkMs([&] {
+      kernels.slerp(soaFrom.arrays(), soaTo.arrays(), t.data(), count, soaOut.arrays());
+      doNotOptimize(soaOut);
+    });
+    reportBenchmark(simdLevelName(level), ms, slerpGlm);
+    float error = 0.f;
+    for (size_t i = 0; i < count; ++i) error = std::max(error, quatError(result[i], soaOut.get(i)));
+    printf("  max error vs glm %g\n", error);
+  }
+
+  printf("quat to mat3\n");
+  const double matrixGlm = benchmarkMs([&] {
+    for (size_t i = 0; i < count; ++i) {
+      matricesGlm[i] = glm::mat3_cast(from[i]);
+    }
+    doNotOptimize(matricesGlm);
+  });
+  reportBenchmark("glm::mat3_cast", matrixGlm);
+  for (SimdLevel level : levels) {
+    const batch::QuatKernels &kernels = batch::quatKernelsFor(level);
+    const double ms = benchmarkMs([&] {
+      kernels.rotationMatrices(soaFrom.arrays(), count, matrices.data());
+      doNotOptimize(matrices);
+    });
+    reportBenchmark(simdLevelName(level), ms, matrixGlm);
+    float error = 0.f;
+    for (size_t i = 0; i < count; ++i) {
+      for (int c = 0; c < 3; ++c) error = std::max(error, glm::length(matricesGlm[i][c] - glm::vec3(matrices[i][c])));
+    }
+    printf("  max error vs glm %g\n", error);
+  }
+
+  printf("dual quaternion blend, %d influences\n", influences);
+  const double blendGlm = benchmarkMs([&] {
+    for (size_t i = 0; i < count; ++i) {
+      const glm::quat first = boneDQs[indices[0][i]].real;
+      glm::dualquat sum(glm::quat(0.f, 0.f, 0.f, 0.f), glm::quat(0.f, 0.f, 0.f, 0.f));
+      for (int j = 0; j < influences; ++j) {
+        const glm::dualquat &dq = boneDQs[indices[j][i]];
+        const float w = glm::dot(first, dq.real) < 0.f ? -weights[j][i] : weights[j][i];
+        sum.real = sum.real + dq.real * w;
+        sum.dual = sum.dual + dq.dual * w;
+      }
+      blendedGlm[i] = glm::normalize(sum);
+    }
+    doNotOptimize(blendedGlm);
+  });
+  reportBenchmark("glm::dualquat", blendGlm);
+  for (SimdLevel level : levels) {
+    const batch::QuatKernels &kernels = batch::quatKernelsFor(level);
+    const double ms = benchmarkMs([&] {
+      kernels.blendDualQuats(bonesSoa, indexArrays, weightArrays, influences, count, blended);
+      doNotOptimize(blendedReal);
+    });
+    reportBenchmark(simdLevelName(level), ms, blendGlm);
+    float error = 0.f;
+    for (size_t i = 0; i < count; ++i) {
+      error = std::max(error, glm::length(blendedGlm[i].real - blendedReal.get(i)));
+      error = std::max(error, glm::length(blendedGlm[i].dual - blendedDual.get(i)));
+    }
+    printf("  max error vs glm %g\n", error);
+  }
+  return 0;
+}
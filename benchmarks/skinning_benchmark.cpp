@@ -0,0 +1,155 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "animation.h"
+#include "benchmark.h"
+
+// A crowd of skinned characters sharing one skeleton, clip and mesh: clip
+// sampling serial and on all cores, bone palettes, and CPU skinning at every
+// SIMD level this CPU runs
+
+using std::vector;
+
+int main(int argc, char **argv) {
+  const size_t characters = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200;
+  const size_t bones = 64, keys = 30, vertexCount = 5000;
+  const float duration = 1.f;
+
+  std::mt19937 rng(5);
+  std::uniform_real_distribution<float> dist(-1.f, 1.f), unit(0.f, 1.f);
+  auto randomQuat = [&] { return glm::normalize(glm::quat(dist(rng), dist(rng), dist(rng), dist(rng))); };
+
+  // skeleton: a random tree, parents before children
+  SceneGraph skeleton;
+  for (size_t b = 0; b < bones; ++b) {
+    const SceneGraph::NodeId parent = b == 0 ? SceneGraph::none : (SceneGraph::NodeId)(rng() % b);
+    skeleton.add(parent, glm::vec3(dist(rng), dist(rng), dist(rng)), randomQuat(), glm::vec3(1.f), "bone" + std::to_string(b));
+  }
+  skeleton.update();
+
+  // every bone rotates through `keys` keys and moves between two
+  AnimationClip clip;
+  clip.Duration = duration;
+  for (size_t b = 0; b < bones; ++b) {
+    NodeTrack track;
+    track.NodeName = "bone" + std::to_string(b);
+    for (size_t k = 0; k < keys; ++k) {
+      track.RotationTimes.push_back(duration * k / (keys - 1));
+      track.Rotations.push_back(randomQuat());
+    }
+    track.PositionTimes = {0.f, duration};
+    track.Positions = {skeleton.translation((SceneGraph::NodeId)b), skeleton.translation((SceneGraph::NodeId)b) + glm::vec3(0.f, 0.1f, 0.f)};
+    clip.Tracks.push_back(track);
+  }
+  clip.resolve(skeleton);
+
+  // mesh bound in the skeleton's rest pose
+  Skin skin;
+  for (size_t b = 0; b < bones; ++b) {
+    skin.BoneNames.push_back("bone" + std::to_string(b));
+    skin.InverseBindMatrices.push_back(glm::inverse(skeleton.world((SceneGraph::NodeId)b)));
+  }
+  skin.resolve(skeleton);
+  vector<glm::vec3> positions(vertexCount), normals(vertexCount);
+  skin.Weights.resize(vertexCount);
+  for (size_t i = 0; i < vertexCount; ++i) {
+    positions[i] = glm::vec3(dist(rng), dist(rng), dist(rng)) * 2.f;
+    normals[i] = glm::normalize(glm::vec3(dist(rng), dist(rng), dist(rng)));
+    uint32_t influenceBones[4];
+    float influenceWeights[4];
+    for (int j = 0; j < 4; ++j) {
+      influenceBones[j] = rng() % bones;
+      influenceWeights[j] = unit(rng);
+    }
+    skin.Weights[i] = packSkinWeights(influenceBones, influenceWeights, 4);
+  }
+
+  // the rest pose must leave the mesh where it is
+  vector<glm::mat3x4> palette;
+  skin.computePalette(skeleton, glm::mat4(1.f), palette);
+  vector<glm::vec3> restPositions(vertexCount), restNormals(vertexCount);
+  batch::skinVertices(palette.data(), skin.Weights.data(), positions.data(), normals.data(), vertexCount,
+                      restPositions.data(), restNormals.data());
+  float restError = 0.f;
+  for (size_t i = 0; i < vertexCount; ++i) {
+    restError = std::max(restError, glm::length(restPositions[i] - positions[i]));
+  }
+
+  // one scene graph and animator per character, started at different times
+  vector<std::unique_ptr<SceneGraph>> scenes;
+  vector<std::unique_ptr<Animator>> animators;
+  vector<Animator *> crowd;
+  for (size_t c = 0; c < characters; ++c) {
+    scenes.push_back(std::make_unique<SceneGraph>(skeleton));
+    animators.push_back(std::make_unique<Animator>(*scenes.back()));
+    animators.back()->play(clip);
+    animators.back()->advance(unit(rng) * duration);
+    crowd.push_back(animators.back().get());
+  }
+  const float frame = 1.f / 60.f;
+
+  printf("%zu characters, %zu bones, %zu keys per track, %zu vertices; detected %s, %u threads\n", characters, bones,
+         keys, vertexCount, simdLevelName(simdLevel()), std::max(1u, std::thread::hardware_concurrency()));
+  printf("  rest pose skinning error %g\n", restError);
+
+  printf("sample clip + update scene graph\n");
+  const double serialMs = benchmarkMs([&] {
+    for (Animator *animator : crowd) {
+      animator->advance(frame);
+      animator->graph().update();
+    }
+  });
+  reportBenchmark("serial", serialMs);
+  reportBenchmark("Animator::updateAll", benchmarkMs([&] { Animator::updateAll(crowd.data(), crowd.size(), frame); }), serialMs);
+
+  printf("bone palettes\n");
+  vector<vector<glm::mat3x4>> palettes(characters);
+  reportBenchmark("Skin::computePalette", benchmarkMs([&] {
+    for (size_t c = 0; c < characters; ++c) {
+      skin.computePalette(*scenes[c], glm::mat4(1.f), palettes[c]);
+    }
+    doNotOptimize(palettes);
+  }));
+
+  vector<SimdLevel> levels = {SimdLevel::Scalar};
+#if CPU_X86
+  for (SimdLevel level : {SimdLevel::SSE41, SimdLevel::AVX2}) {
+    if (level <= simdLevel()) levels.push_back(level);
+  }
+#elif CPU_NEON
+  levels.push_back(SimdLevel::NEON);
+#endif
+
+  printf("CPU skinning, %zu vertices\n", characters * vertexCount);
+  vector<glm::vec3> outPositions(characters * vertexCount), outNormals(characters * vertexCount);
+  vector<glm::vec3> reference(characters * vertexCount);
+  double scalarMs = 0.0;
+  for (SimdLevel level : levels) {
+    const batch::SkinKernels &kernels = batch::skinKernelsFor(level);
+    const double ms = benchmarkMs([&] {
+      for (size_t c = 0; c < characters; ++c) {
+        kernels.skinVertices(palettes[c].data(), skin.Weights.data(), positions.data(), normals.data(), vertexCount,
+                             &outPositions[c * vertexCount], &outNormals[c * vertexCount]);
+      }
+      doNotOptimize(outPositions);
+    });
+    reportBenchmark(simdLevelName(level), ms, scalarMs);
+    if (level == SimdLevel::Scalar) {
+      scalarMs = ms;
+      reference = outPositions;
+    } else {
+      float error = 0.f;
+      for (size_t i = 0; i < reference.size(); ++i) error = std::max(error, glm::length(reference[i] - outPositions[i]));
+      printf("  max error vs scalar %g\n", error);
+    }
+  }
+  return 0;
+}
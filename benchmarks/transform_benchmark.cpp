@@ -0,0 +1,188 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "batch_math.h"
+#include "benchmark.h"
+
+// batch_math.h kernels at every SIMD level this CPU runs, against the
+// glm::mat4 loops they replace
+
+using std::vector;
+
+int main(int argc, char **argv) {
+  const size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> dist(-1.f, 1.f);
+  vector<glm::vec3> translations(count), scales(count), points(count);
+  vector<glm::quat> rotations(count);
+  vector<float> soa[10];
+  for (vector<float> &component : soa) {
+    component.resize(count);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    translations[i] = glm::vec3(dist(rng), dist(rng), dist(rng)) * 10.f;
+    rotations[i] = glm::normalize(glm::quat(dist(rng), dist(rng), dist(rng), dist(rng)));
+    scales[i] = glm::vec3(1.f) + glm::vec3(dist(rng), dist(rng), dist(rng)) * 0.5f;
+    points[i] = glm::vec3(dist(rng), dist(rng), dist(rng));
+    const float values[10] = {translations[i].x, translations[i].y, translations[i].z, rotations[i].x, rotations[i].y,
+                              rotations[i].z,    rotations[i].w,    scales[i].x,       scales[i].y,    scales[i].z};
+    for (int c = 0; c < 10; ++c) {
+      soa[c][i] = values[c];
+    }
+  }
+  const batch::TRSArrays trs = {soa[0].data(), soa[1].data(), soa[2].data(), soa[3].data(), soa[4].data(),
+                                soa[5].data(), soa[6].data(), soa[7].data(), soa[8].data(), soa[9].data()};
+  // a random forest, parents before children
+  vector<int32_t> parents(count);
+  for (size_t i = 0; i < count; ++i) {
+    parents[i] = i < 16 ? -1 : (int32_t)(rng() % i);
+  }
+
+  vector<glm::mat4> locals(count), worlds(count), products(count);
+  vector<glm::vec3> transformed(count);
+  const glm::mat4 view = glm::lookAt(glm::vec3(3.f, 4.f, 5.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+
+  vector<SimdLevel> levels = {SimdLevel::Scalar};
+#if CPU_X86
+  for (SimdLevel level : {SimdLevel::SSE41, SimdLevel::AVX2, SimdLevel::AVX512}) {
+    if (level <= simdLevel()) levels.push_back(level);
+  }
+#elif CPU_NEON
+  levels.push_back(SimdLevel::NEON);
+#endif
+
+  printf("%zu transforms, detected %s\n", count, simdLevelName(simdLevel()));
+
+  printf("compose TRS\n");
+  const double composeGlm = benchmarkMs([&] {
+    for (size_t i = 0; i < count; ++i) {
+      glm::mat4 model = glm::translate(glm::mat4(1.f), translations[i]);
+      model = model * glm::mat4_cast(rotations[i]);
+      locals[i] = glm::scale(model, scales[i]);
+    }
+    doNotOptimize(locals);
+  });
+  reportBenchmark("glm translate/rotate/scale", composeGlm);
+  for (SimdLevel level : levels) {
+    const batch::Kernels &kernels = batch::kernelsFor(level);
+    reportBenchmark(simdLevelName(level), benchmarkMs([&] {
+      kernels.composeTRS(trs, nullptr, count, locals.data());
+      doNotOptimize(locals);
+    }), composeGlm);
+  }
+
+  printf("parent x local\n");
+  const double hierarchyGlm = benchmarkMs([&] {
+    for (size_t i = 0; i < count; ++i) {
+      worlds[i] = parents[i] < 0 ? locals[i] : worlds[parents[i]] * locals[i];
+    }
+    doNotOptimize(worlds);
+  });
+  reportBenchmark("glm::mat4 operator*", hierarchyGlm);
+  for (SimdLevel level : levels) {
+    const batch::Kernels &kernels = batch::kernelsFor(level);
+    reportBenchmark(simdLevelName(level), benchmarkMs([&] {
+      kernels.multiplyHierarchy(parents.data(), nullptr, count, locals.data(), worlds.data());
+      doNotOptimize(worlds);
+    }), hierarchyGlm);
+  }
+
+  printf("mat4 multiply\n");
+  const double multiplyGlm = benchmarkMs([&] {
+    for (size_t i = 0; i < count; ++i) {
+      products[i] = worlds[i] * locals[i];
+    }
+    doNotOptimize(products);
+  });
+  reportBenchmark("glm::mat4 operator*", multiplyGlm);
+  for (SimdLevel level : levels) {
+    const batch::Kernels &kernels = batch::kernelsFor(level);
+    reportBenchmark(simdLevelName(level), benchmarkMs([&] {
+      kernels.multiply(worlds.data(), locals.data(), products.data(), count);
+      doNotOptimize(products);
+    }), multiplyGlm);
+  }
+
+  printf("transform points\n");
+  const double pointsGlm = benchmarkMs([&] {
+    for (size_t i = 0; i < count; ++i) {
+      transformed[i] = glm::vec3(view * glm::vec4(points[i], 1.f));
+    }
+    doNotOptimize(transformed);
+  });
+  reportBenchmark("glm::mat4 * vec4", pointsGlm);
+  for (SimdLevel level : levels) {
+    const batch::Kernels &kernels = batch::kernelsFor(level);
+    reportBenchmark(simdLevelName(level), benchmarkMs([&] {
+      kernels.transformPoints(view, points.data(), transformed.data(), count);
+      doNotOptimize(transformed);
+    }), pointsGlm);
+  }
+
+  printf("normal matrix\n");
+  vector<glm::mat4> inverses(count);
+  vector<glm::mat3x4> normals(count);
+  const double normalGlm = benchmarkMs([&] {
+    for (size_t i = 0; i < count; ++i) {
+      inverses[i] = glm::transpose(glm::inverse(worlds[i]));
+    }
+    doNotOptimize(inverses);
+  });
+  reportBenchmark("transpose(inverse(mat4))", normalGlm);
+  for (SimdLevel level : levels) {
+    const batch::Kernels &kernels = batch::kernelsFor(level);
+    reportBenchmark(simdLevelName(level), benchmarkMs([&] {
+      kernels.normalMatrices(worlds.data(), normals.data(), count);
+      doNotOptimize(normals);
+    }), normalGlm);
+  }
+
+  printf("affine inverse\n");
+  const double inverseGlm = benchmarkMs([&] {
+    for (size_t i = 0; i < count; ++i) {
+      inverses[i] = glm::inverse(worlds[i]);
+    }
+    doNotOptimize(inverses);
+  });
+  reportBenchmark("glm::inverse", inverseGlm);
+  for (SimdLevel level : levels) {
+    const batch::Kernels &kernels = batch::kernelsFor(level);
+    reportBenchmark(simdLevelName(level), benchmarkMs([&] {
+      kernels.affineInverses(worlds.data(), inverses.data(), count);
+      doNotOptimize(inverses);
+    }), inverseGlm);
+  }
+
+  printf("general inverse\n");
+  for (SimdLevel level : levels) {
+    const batch::Kernels &kernels = batch::kernelsFor(level);
+    reportBenchmark(simdLevelName(level), benchmarkMs([&] {
+      kernels.inverses(worlds.data(), inverses.data(), count);
+      doNotOptimize(inverses);
+    }), inverseGlm);
+  }
+
+  printf("quaternion multiply\n");
+  vector<glm::quat> deltas(rotations.rbegin(), rotations.rend()), quats(count);
+  const double quatGlm = benchmarkMs([&] {
+    for (size_t i = 0; i < count; ++i) {
+      quats[i] = rotations[i] * deltas[i];
+    }
+    doNotOptimize(quats);
+  });
+  reportBenchmark("glm::quat operator*", quatGlm);
+  for (SimdLevel level : levels) {
+    const batch::Kernels &kernels = batch::kernelsFor(level);
+    reportBenchmark(simdLevelName(level), benchmarkMs([&] {
+      kernels.multiplyQuats(rotations.data(), deltas.data(), quats.data(), count);
+      doNotOptimize(quats);
+    }), quatGlm);
+  }
+  return 0;
+}
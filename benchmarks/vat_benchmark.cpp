@@ -0,0 +1,181 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "batch_math.h"
+#include "benchmark.h"
+#include "vertex_animation.h"
+
+// bakeVertexAnimation() on a synthetic character: bake time, texture size and
+// the error of sampling the textures as model_loading.vs does against skinning
+// directly, then the CPU side of a frame for a crowd drawn from the textures
+// against the same crowd skinned on the GPU from bone palettes
+
+using std::vector;
+
+// the vertex shader's fetch: half floats, blended between the frames around t
+static glm::vec3 sampleVertexAnimation(const VertexAnimation &animation, size_t vertex, float t) {
+  const float frame = std::fmod(t * animation.FrameRate, (float)animation.FrameCount);
+  const uint32_t f0 = (uint32_t)frame, f1 = (f0 + 1) % animation.FrameCount;
+  auto fetch = [&](uint32_t f) {
+    const uint16_t *p = &animation.Positions[(f * animation.VertexCount + vertex) * 4];
+    return glm::vec3(glm::unpackHalf1x16(p[0]), glm::unpackHalf1x16(p[1]), glm::unpackHalf1x16(p[2]));
+  };
+  return glm::mix(fetch(f0), fetch(f1), frame - f0);
+}
+
+int main(int argc, char **argv) {
+  const size_t instances = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000;
+  const size_t bones = 64, vertexCount = 5000;
+  const float duration = 2.f, keyRate = 30.f;
+  const size_t keys = (size_t)(duration * keyRate) + 1;
+
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> dist(-1.f, 1.f), unit(0.f, 1.f);
+
+  // a humanoid sized tree in metres, as in animation_compression_benchmark
+  SceneGraph skeleton;
+  vector<int> depth(bones, 0);
+  for (size_t b = 0; b < bones; ++b) {
+    SceneGraph::NodeId parent = SceneGraph::none;
+    if (b > 0) {
+      parent = (SceneGraph::NodeId)(b - 1 - rng() % std::min<size_t>(b, 4));
+      while (depth[parent] >= 7) {
+        parent = skeleton.parent(parent);
+      }
+      depth[b] = depth[parent] + 1;
+    }
+    const glm::vec3 offset = b == 0 ? glm::vec3(0.f, 1.f, 0.f) : glm::normalize(glm::vec3(dist(rng), dist(rng), dist(rng))) * (0.05f + 0.1f * unit(rng));
+    skeleton.add(parent, offset, glm::quat(1.f, 0.f, 0.f, 0.f), glm::vec3(1.f), "bone" + std::to_string(b));
+  }
+  skeleton.update();
+
+  // one loop of sine waves up to 0.4 radians, whole cycles so it wraps
+  AnimationClip clip;
+  clip.Name = "walk";
+  clip.Duration = duration;
+  for (size_t b = 0; b < bones; ++b) {
+    NodeTrack track;
+    track.NodeName = "bone" + std::to_string(b);
+    const glm::vec3 axis = glm::normalize(glm::vec3(dist(rng), dist(rng), dist(rng)));
+    const float amplitude = 0.4f * unit(rng), cycles = (float)(1 + rng() % 2), phase = 6.f * unit(rng);
+    for (size_t k = 0; k < keys; ++k) {
+      const float t = duration * k / (keys - 1);
+      track.RotationTimes.push_back(t);
+      track.Rotations.push_back(glm::angleAxis(amplitude * std::sin(6.2831853f * cycles * t / duration + phase), axis));
+    }
+    track.PositionTimes = {0.f};
+    track.Positions = {skeleton.translation((SceneGraph::NodeId)b)};
+    clip.Tracks.push_back(track);
+  }
+  clip.resolve(skeleton);
+
+  // vertices within 10 cm of a bone, weighted to it and up to three others
+  Skin skin;
+  for (size_t b = 0; b < bones; ++b) {
+    skin.BoneNames.push_back("bone" + std::to_string(b));
+    skin.InverseBindMatrices.push_back(glm::inverse(skeleton.world((SceneGraph::NodeId)b)));
+  }
+  skin.resolve(skeleton);
+  vector<glm::vec3> positions(vertexCount), normals(vertexCount);
+  skin.Weights.resize(vertexCount);
+  for (size_t i = 0; i < vertexCount; ++i) {
+    const size_t home = rng() % bones;
+    positions[i] = glm::vec3(skeleton.world((SceneGraph::NodeId)home)[3]) + glm::vec3(dist(rng), dist(rng), dist(rng)) * 0.1f;
+    normals[i] = glm::normalize(glm::vec3(dist(rng), dist(rng), dist(rng)));
+    uint32_t influenceBones[4] = {(uint32_t)home};
+    float influenceWeights[4] = {1.f};
+    for (int j = 1; j < 4; ++j) {
+      influenceBones[j] = rng() % bones;
+      influenceWeights[j] = 0.3f * unit(rng);
+    }
+    skin.Weights[i] = packSkinWeights(influenceBones, influenceWeights, 4);
+  }
+
+  printf("%zu bones, %zu vertices, %g s clip\n", bones, vertexCount, duration);
+  printf("  %-6s %8s %10s %12s %10s\n", "fps", "frames", "texture", "bake ms", "max error");
+  VertexAnimation animation;
+  for (float frameRate : {15.f, 30.f, 60.f}) {
+    const auto start = std::chrono::steady_clock::now();
+    VertexAnimation baked = bakeVertexAnimation(skeleton, skin, 0, positions.data(), normals.data(), vertexCount, clip, frameRate);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // skinned directly at times between the frames
+    SceneGraph posed = skeleton;
+    Animator animator(posed);
+    animator.play(clip);
+    vector<glm::mat3x4> palette;
+    vector<glm::vec3> skinnedPositions(vertexCount), skinnedNormals(vertexCount);
+    float error = 0.f;
+    for (int i = 0; i < 50; ++i) {
+      const float t = unit(rng) * duration;
+      animator.sample(t);
+      posed.update();
+      skin.computePalette(posed, posed.world(0), palette);
+      batch::skinVertices(palette.data(), skin.Weights.data(), positions.data(), normals.data(), vertexCount,
+                          skinnedPositions.data(), skinnedNormals.data());
+      for (size_t v = 0; v < vertexCount; ++v) {
+        error = std::max(error, glm::length(sampleVertexAnimation(baked, v, t) - skinnedPositions[v]));
+      }
+    }
+    printf("  %-6g %8u %7.1f MB %12.1f %10.2g\n", frameRate, baked.FrameCount, baked.byteSize() / 1048576.0, ms, error);
+    if (frameRate == 30.f) {
+      animation = std::move(baked);
+    }
+  }
+
+  // a grid of instances, started at different times
+  const size_t side = (size_t)std::ceil(std::sqrt((double)instances));
+  vector<glm::mat4> models(instances);
+  vector<glm::mat3x4> normalMatrices(instances);
+  vector<float> timeOffsets(instances);
+  for (size_t i = 0; i < instances; ++i) {
+    models[i] = glm::translate(glm::mat4(1.f), glm::vec3((float)(i % side), 0.f, (float)(i / side)));
+    timeOffsets[i] = unit(rng) * duration;
+  }
+  const float frame = 1.f / 60.f;
+
+  printf("CPU per frame, %zu instances\n", instances);
+  // skeletal: every instance samples the clip and uploads a bone palette
+  vector<std::unique_ptr<SceneGraph>> scenes;
+  vector<std::unique_ptr<Animator>> animators;
+  vector<Animator *> crowd;
+  for (size_t i = 0; i < instances; ++i) {
+    scenes.push_back(std::make_unique<SceneGraph>(skeleton));
+    animators.push_back(std::make_unique<Animator>(*scenes.back()));
+    animators.back()->play(clip);
+    animators.back()->advance(timeOffsets[i]);
+    crowd.push_back(animators.back().get());
+  }
+  vector<glm::mat3x4> palettes(instances * bones), palette;
+  const double skeletalMs = benchmarkMs([&] {
+    Animator::updateAll(crowd.data(), crowd.size(), frame);
+    for (size_t i = 0; i < instances; ++i) {
+      skin.computePalette(*scenes[i], glm::mat4(1.f), palette);
+      std::copy(palette.begin(), palette.end(), palettes.begin() + i * bones);
+    }
+    batch::normalMatrices(models.data(), normalMatrices.data(), instances);
+    doNotOptimize(palettes);
+  }, 3);
+  // vertex animation: instance data only, the time offsets never change
+  const double vatMs = benchmarkMs([&] {
+    batch::normalMatrices(models.data(), normalMatrices.data(), instances);
+    doNotOptimize(normalMatrices);
+  });
+  reportBenchmark("skeletal", skeletalMs);
+  printf("    %.1f MB uploaded\n", instances * (sizeof(glm::mat4) + sizeof(glm::mat3x4) + bones * sizeof(glm::mat3x4)) / 1048576.0);
+  reportBenchmark("vertex animation", vatMs, skeletalMs);
+  printf("    %.1f MB uploaded, %.1f MB of textures shared\n",
+         instances * (sizeof(glm::mat4) + sizeof(glm::mat3x4) + sizeof(float)) / 1048576.0, animation.byteSize() / 1048576.0);
+  return 0;
+}
@@ -0,0 +1,105 @@
+#include <glm/glm.hpp>
+
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "benchmark.h"
+#include "frame_arena.h"
+#include "vertex_convert.h"
+
+// Turning importer attribute arrays (the layout of assimp's aiVector3D)
+// into GPU vertices: the per vertex push_back loop and copy the loader
+// used to do, against the vertex_convert.h kernels at every SIMD level this
+// CPU runs, in vertices per second
+
+using std::vector;
+
+// reportBenchmark() with the rate appended
+static void reportThroughput(const char *name, double ms, double baselineMs, size_t vertices) {
+  const double rate = vertices / (ms * 1e3);
+  if (baselineMs > 0.0) {
+    printf("  %-28s %9.3f ms  %5.2fx  %7.1f Mvertices/s\n", name, ms, baselineMs / ms, rate);
+  } else {
+    printf("  %-28s %9.3f ms         %7.1f Mvertices/s\n", name, ms, rate);
+  }
+}
+
+int main(int argc, char **argv) {
+  const size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<float> dist(-1.f, 1.f), unit(0.f, 1.f);
+  vector<glm::vec3> positions(count), normals(count), texCoords(count);
+  for (size_t i = 0; i < count; ++i) {
+    positions[i] = glm::vec3(dist(rng), dist(rng), dist(rng)) * 10.f;
+    normals[i] = glm::normalize(glm::vec3(dist(rng), dist(rng), dist(rng)));
+    texCoords[i] = glm::vec3(unit(rng), unit(rng), 0.f);
+  }
+
+  vector<SimdLevel> levels = {SimdLevel::Scalar};
+#if CPU_X86
+  if (SimdLevel::SSE41 <= simdLevel()) levels.push_back(SimdLevel::SSE41);
+#elif CPU_NEON
+  levels.push_back(SimdLevel::NEON);
+#endif
+
+  printf("%zu vertices, detected %s\n", count, simdLevelName(simdLevel()));
+
+  printf("interleave into a new vector\n");
+  const double perVertex = benchmarkMs([&] {
+    // as processMesh did: a Vertex at a time, then copied into the Mesh
+    vector<Vertex> built;
+    for (size_t i = 0; i < count; ++i) {
+      Vertex vertex;
+      vertex.Position = glm::vec3(positions[i].x, positions[i].y, positions[i].z);
+      vertex.Normal = glm::vec3(normals[i].x, normals[i].y, normals[i].z);
+      vertex.TexCoords = glm::vec2(texCoords[i].x, texCoords[i].y);
+      built.push_back(vertex);
+    }
+    vector<Vertex> owned(built);
+    doNotOptimize(owned);
+  });
+  reportThroughput("push_back + copy", perVertex, 0.0, count);
+  for (SimdLevel level : levels) {
+    const batch::VertexKernels &kernels = batch::vertexKernelsFor(level);
+    reportThroughput(simdLevelName(level), benchmarkMs([&] {
+      vector<Vertex> owned(count);
+      kernels.interleaveVertices(positions.data(), normals.data(), texCoords.data(), count, owned.data());
+      doNotOptimize(owned);
+    }), perVertex, count);
+  }
+
+  // the destination already exists, as a mapped buffer or arena would
+  printf("interleave into existing memory\n");
+  LinearArena arena(sizeof(Vertex) * count + 64);
+  Vertex *arenaVertices = (Vertex *)arena.allocate(sizeof(Vertex) * count, alignof(Vertex));
+  const double scalarInterleave = benchmarkMs([&] {
+    batch::scalar::interleaveVertices(positions.data(), normals.data(), texCoords.data(), count, arenaVertices);
+    doNotOptimize(arenaVertices);
+  });
+  reportThroughput("scalar", scalarInterleave, perVertex, count);
+  for (SimdLevel level : levels) {
+    if (level == SimdLevel::Scalar) continue;
+    const batch::VertexKernels &kernels = batch::vertexKernelsFor(level);
+    reportThroughput(simdLevelName(level), benchmarkMs([&] {
+      kernels.interleaveVertices(positions.data(), normals.data(), texCoords.data(), count, arenaVertices);
+      doNotOptimize(arenaVertices);
+    }), perVertex, count);
+  }
+
+  printf("quantize to PackedVertex (%zu of %zu bytes)\n", sizeof(PackedVertex), sizeof(Vertex));
+  std::unique_ptr<PackedVertex[]> packed(new PackedVertex[count]);
+  double scalarPack = 0.0;
+  for (SimdLevel level : levels) {
+    const batch::VertexKernels &kernels = batch::vertexKernelsFor(level);
+    const double ms = benchmarkMs([&] {
+      kernels.packVertices(arenaVertices, count, packed.get());
+      doNotOptimize(packed);
+    });
+    if (level == SimdLevel::Scalar) scalarPack = ms;
+    reportThroughput(simdLevelName(level), ms, level == SimdLevel::Scalar ? 0.0 : scalarPack, count);
+  }
+  return 0;
+}
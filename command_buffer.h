@@ -0,0 +1,212 @@
+#ifndef COMMAND_BUFFER_H
+#define COMMAND_BUFFER_H
+
+#include <glad/glad.h>
+// glad must be included before GLFW
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "frame_arena.h"
+
+// Draws recorded on any thread and replayed on the GL thread.
+//
+// Preparing a draw (instance data, normal matrices, bone palettes, uniform
+// values) is most of its cost and needs no GL, so it can happen on workers:
+// each records into its own CommandBuffer, and the context thread replays
+// them all in key order. A packet is a callable stored in the buffer's
+// linear arena together with whatever it points at; arenas are reused from
+// frame to frame, so recording allocates nothing once warm. Packets must be
+// trivially destructible - capture values and arena pointers, never
+// containers.
+//
+// Keys order the replay: the pass first, then program and material so
+// state changes group together, then depth. Packets with equal keys replay
+// in recording order within a buffer, in no particular order across them.
+
+inline uint64_t commandKey(unsigned pass, unsigned program, unsigned material = 0, unsigned depth = 0) {
+    return (uint64_t)(pass & 0xff) << 56 | (uint64_t)(program & 0xffff) << 40 | (uint64_t)(material & 0xffffff) << 16 |
+           (depth & 0xffff);
+}
+
+// GL state carried from packet to packet during a replay, to skip
+// redundant binds
+struct ReplayState {
+    GLuint program = 0;
+    GLuint vertexArray = 0;
+
+    void useProgram(GLuint id) {
+        if (program != id) {
+            glUseProgram(id);
+            program = id;
+        }
+    }
+
+    void bindVertexArray(GLuint id) {
+        if (vertexArray != id) {
+            glBindVertexArray(id);
+            vertexArray = id;
+        }
+    }
+};
+
+class CommandBuffer {
+public:
+    CommandBuffer() = default;
+    CommandBuffer(const CommandBuffer &) = delete;
+    CommandBuffer &operator=(const CommandBuffer &) = delete;
+
+    // arena memory that lives until clear()
+    void *allocate(size_t bytes, size_t alignment = 16) { return arena.allocate(bytes, alignment); }
+
+    template <typename T>
+    T *copy(const T *data, size_t count) {
+        static_assert(std::is_trivially_copyable_v<T>, "arena copies are bytewise");
+        T *out = (T *)allocate(sizeof(T) * count, alignof(T) < 16 ? 16 : alignof(T));
+        if (count) {
+            memcpy(out, data, sizeof(T) * count);
+        }
+        return out;
+    }
+
+    // fn(ReplayState &) runs at replay
+    template <typename Fn>
+    void record(uint64_t key, Fn &&fn) {
+        using F = std::decay_t<Fn>;
+        static_assert(std::is_trivially_destructible_v<F>, "packets are never destroyed");
+        void *storage = allocate(sizeof(F), alignof(F) < 16 ? 16 : alignof(F));
+        new (storage) F(std::forward<Fn>(fn));
+        packets.push_back({key, (uint32_t)packets.size(), [](const void *f, ReplayState &state) { (*(const F *)f)(state); }, storage});
+    }
+
+    // keeps the arena and packet storage for the next frame
+    void clear() {
+        packets.clear();
+        arena.reset();
+    }
+
+    size_t size() const { return packets.size(); }
+    size_t bytesUsed() const { return arena.bytesUsed(); }
+
+private:
+    friend void replayCommands(CommandBuffer *const *buffers, size_t count, ReplayState &state);
+
+    struct Packet {
+        uint64_t key;
+        uint32_t sequence;
+        void (*execute)(const void *fn, ReplayState &state);
+        const void *fn;
+    };
+
+    std::vector<Packet> packets;
+    LinearArena arena;
+};
+
+// run the packets of every buffer, merged in key order; GL thread only
+inline void replayCommands(CommandBuffer *const *buffers, size_t count, ReplayState &state) {
+    struct Entry {
+        uint64_t key;
+        uint32_t buffer, sequence;
+    };
+    thread_local std::vector<Entry> order;
+    order.clear();
+    for (size_t b = 0; b < count; ++b) {
+        for (const CommandBuffer::Packet &packet : buffers[b]->packets) {
+            order.push_back({packet.key, (uint32_t)b, packet.sequence});
+        }
+    }
+    std::sort(order.begin(), order.end(), [](const Entry &a, const Entry &b) {
+        return a.key != b.key ? a.key < b.key : a.buffer != b.buffer ? a.buffer < b.buffer : a.sequence < b.sequence;
+    });
+    for (const Entry &entry : order) {
+        const CommandBuffer::Packet &packet = buffers[entry.buffer]->packets[entry.sequence];
+        packet.execute(packet.fn, state);
+    }
+}
+
+inline void replayCommands(CommandBuffer &buffer) {
+    CommandBuffer *buffers[] = {&buffer};
+    ReplayState state;
+    replayCommands(buffers, 1, state);
+}
+
+// One CommandBuffer per recording thread for a frame: local() hands the
+// calling thread its own, so workers record without locks after their
+// first packet. A thread remembers one pool at a time; switching between
+// pools within a frame costs it a fresh buffer each time.
+class CommandBufferPool {
+public:
+    CommandBufferPool() = default;
+    CommandBufferPool(const CommandBufferPool &) = delete;
+    CommandBufferPool &operator=(const CommandBufferPool &) = delete;
+
+    CommandBuffer &local() {
+        thread_local LocalBuffer cached;
+        if (cached.generation != generation) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (used == buffers.size()) {
+                buffers.push_back(std::make_unique<CommandBuffer>());
+            }
+            cached.buffer = buffers[used++].get();
+            cached.generation = generation;
+        }
+        return *cached.buffer;
+    }
+
+    // everything recorded since clear(), in key order; GL thread only. The
+    // VAO is left unbound, the program of the last packet in use.
+    void replay() {
+        std::pmr::vector<CommandBuffer *> recorded(&FrameArena::local());
+        recorded.reserve(used);
+        for (size_t i = 0; i < used; ++i) {
+            recorded.push_back(buffers[i].get());
+        }
+        ReplayState state;
+        replayCommands(recorded.data(), recorded.size(), state);
+        glBindVertexArray(0);
+    }
+
+    // start a new frame; recording threads pick up a buffer again
+    void clear() {
+        for (size_t i = 0; i < used; ++i) {
+            buffers[i]->clear();
+        }
+        used = 0;
+        generation = nextGeneration();
+    }
+
+    size_t packetCount() const {
+        size_t count = 0;
+        for (size_t i = 0; i < used; ++i) count += buffers[i]->size();
+        return count;
+    }
+
+private:
+    struct LocalBuffer {
+        uint64_t generation = 0;
+        CommandBuffer *buffer = nullptr;
+    };
+
+    // unique across pools, so a thread's cached buffer is never mistaken
+    // for one of another pool
+    static uint64_t nextGeneration() {
+        static std::atomic<uint64_t> counter{0};
+        return ++counter;
+    }
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<CommandBuffer>> buffers;
+    size_t used = 0;
+    uint64_t generation = nextGeneration();
+};
+
+#endif
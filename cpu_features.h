@@ -0,0 +1,110 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+// What the CPU we're running on can execute, for kernels compiled several
+// times with different instruction sets and picked at startup. The build
+// itself needs no arch flags: x86 variants are compiled with per-function
+// target attributes, and NEON is part of every aarch64 CPU.
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CPU_X86 1
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define CPU_NEON 1
+#endif
+
+// lets GCC / Clang compile one function for an instruction set the rest of
+// the translation unit doesn't assume; MSVC allows intrinsics anywhere
+#if CPU_X86 && (defined(__GNUC__) || defined(__clang__))
+#define CPU_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CPU_TARGET(isa)
+#endif
+
+enum class SimdLevel { Scalar, SSE41, AVX2, AVX512, NEON };
+
+inline const char *simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::SSE41: return "sse4.1";
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::AVX512: return "avx512";
+        case SimdLevel::NEON: return "neon";
+        default: return "scalar";
+    }
+}
+
+// the best level this CPU (and OS, for the wider registers) supports
+inline SimdLevel detectSimdLevel() {
+#if CPU_NEON
+    return SimdLevel::NEON;
+#elif CPU_X86 && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl")) {
+        return SimdLevel::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return SimdLevel::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return SimdLevel::SSE41;
+    }
+    return SimdLevel::Scalar;
+#elif CPU_X86 && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    const bool sse41 = info[2] & (1 << 19);
+    const bool fma = info[2] & (1 << 12);
+    const bool osxsave = info[2] & (1 << 27);
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    const bool ymm = (xcr0 & 0x6) == 0x6, zmm = (xcr0 & 0xe6) == 0xe6;
+    __cpuidex(info, 7, 0);
+    const bool avx2 = info[1] & (1 << 5);
+    const bool avx512 = (info[1] & (1 << 16)) && (info[1] & (1 << 17)) && (info[1] & (1 << 31)); // F, DQ, VL
+    if (avx512 && zmm) return SimdLevel::AVX512;
+    if (avx2 && fma && ymm) return SimdLevel::AVX2;
+    if (sse41) return SimdLevel::SSE41;
+    return SimdLevel::Scalar;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+// Detected once. LEARNOPENGL_SIMD=scalar|sse4.1|avx2|avx512|neon asks for
+// a narrower level, to compare paths or rule one out; levels the CPU can't
+// run are ignored.
+inline SimdLevel simdLevel() {
+    static const SimdLevel level = [] {
+        const SimdLevel detected = detectSimdLevel();
+        const char *requested = getenv("LEARNOPENGL_SIMD");
+        if (!requested) {
+            return detected;
+        }
+        for (SimdLevel l : {SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2, SimdLevel::AVX512, SimdLevel::NEON}) {
+            if (strcmp(requested, simdLevelName(l)) != 0) {
+                continue;
+            }
+            // NEON and the x86 levels don't stack
+            const bool supported = l == SimdLevel::Scalar || l == detected ||
+                                   (l != SimdLevel::NEON && detected != SimdLevel::NEON && l < detected);
+            if (supported) {
+                return l;
+            }
+            std::cerr << "WARNING: LEARNOPENGL_SIMD=" << requested << " not supported here, using "
+                      << simdLevelName(detected) << std::endl;
+            return detected;
+        }
+        std::cerr << "WARNING: unknown LEARNOPENGL_SIMD=" << requested << ", using " << simdLevelName(detected) << std::endl;
+        return detected;
+    }();
+    return level;
+}
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef DDS_H
+#define DDS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// DDS container (always with the DX10 extension header) for baked textures:
+// a full mip chain in one of the formats our texture pipeline produces.
+// A few of the header's reserved words carry our own metadata, tagged so
+// files from other tools are still read correctly.
+
+enum DXGIFormat : uint32_t {
+    DXGI_FORMAT_R8G8B8A8_UNORM = 28,
+    DXGI_FORMAT_R8G8B8A8_UNORM_SRGB = 29,
+    DXGI_FORMAT_R8G8_UNORM = 49,
+    DXGI_FORMAT_R8_UNORM = 61,
+    DXGI_FORMAT_BC1_UNORM = 71,
+    DXGI_FORMAT_BC1_UNORM_SRGB = 72,
+    DXGI_FORMAT_BC3_UNORM = 77,
+    DXGI_FORMAT_BC3_UNORM_SRGB = 78,
+    DXGI_FORMAT_BC4_UNORM = 80,
+    DXGI_FORMAT_BC5_UNORM = 83,
+    DXGI_FORMAT_BC7_UNORM = 98,
+    DXGI_FORMAT_BC7_UNORM_SRGB = 99,
+};
+
+struct TextureFile {
+    uint32_t dxgiFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
+    int width = 0, height = 0;
+    uint32_t swizzle = 0;   // TextureSwizzle of the texture_format.h
+    float psnr = 0.f;       // 0 when lossless
+    unsigned levelCount = 0; // of the full chain in the file
+    unsigned firstLevel = 0; // levels[i] holds level firstLevel + i
+    std::vector<std::vector<uint8_t>> levels;
+};
+
+namespace dds {
+
+constexpr uint32_t magic = 0x20534444;    // "DDS "
+constexpr uint32_t fourccDX10 = 0x30315844; // "DX10"
+constexpr uint32_t ourTag = 0x4C474F4C;   // "LOGL"
+
+struct PixelFormat {
+    uint32_t size, flags, fourCC, rgbBitCount, rMask, gMask, bMask, aMask;
+};
+
+struct Header {
+    uint32_t size, flags, height, width, pitchOrLinearSize, depth, mipMapCount;
+    uint32_t reserved1[11];
+    PixelFormat pixelFormat;
+    uint32_t caps, caps2, caps3, caps4, reserved2;
+};
+
+struct HeaderDX10 {
+    uint32_t dxgiFormat, resourceDimension, miscFlag, arraySize, miscFlags2;
+};
+
+static_assert(sizeof(Header) == 124, "DDS header must be 124 bytes");
+
+inline bool isBlockCompressed(uint32_t format) {
+    return format >= DXGI_FORMAT_BC1_UNORM && format <= DXGI_FORMAT_BC7_UNORM_SRGB;
+}
+
+inline size_t levelSize(uint32_t format, int width, int height) {
+    switch (format) {
+        case DXGI_FORMAT_BC1_UNORM:
+        case DXGI_FORMAT_BC1_UNORM_SRGB:
+        case DXGI_FORMAT_BC4_UNORM:
+            return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8;
+        case DXGI_FORMAT_BC3_UNORM:
+        case DXGI_FORMAT_BC3_UNORM_SRGB:
+        case DXGI_FORMAT_BC5_UNORM:
+        case DXGI_FORMAT_BC7_UNORM:
+        case DXGI_FORMAT_BC7_UNORM_SRGB:
+            return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 16;
+        case DXGI_FORMAT_R8_UNORM:
+            return (size_t)width * height;
+        case DXGI_FORMAT_R8G8_UNORM:
+            return (size_t)width * height * 2;
+        default:
+            return (size_t)width * height * 4;
+    }
+}
+
+} // namespace dds
+
+inline bool writeDDS(const std::string &path, const TextureFile &texture) {
+    dds::Header header = {};
+    header.size = sizeof(dds::Header);
+    // CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT | LINEARSIZE
+    header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+    header.height = texture.height;
+    header.width = texture.width;
+    header.pitchOrLinearSize = (uint32_t)dds::levelSize(texture.dxgiFormat, texture.width, texture.height);
+    header.mipMapCount = (uint32_t)texture.levels.size(); // always written from level 0
+    header.reserved1[0] = dds::ourTag;
+    header.reserved1[1] = texture.swizzle;
+    memcpy(&header.reserved1[2], &texture.psnr, 4);
+    header.pixelFormat.size = sizeof(dds::PixelFormat);
+    header.pixelFormat.flags = 0x4; // FOURCC
+    header.pixelFormat.fourCC = dds::fourccDX10;
+    header.caps = 0x1000 | 0x400000 | 0x8; // TEXTURE | MIPMAP | COMPLEX
+
+    dds::HeaderDX10 dx10 = {};
+    dx10.dxgiFormat = texture.dxgiFormat;
+    dx10.resourceDimension = 3; // TEXTURE2D
+    dx10.arraySize = 1;
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Failed to open " << path << std::endl;
+        return false;
+    }
+    file.write((const char *)&dds::magic, 4);
+    file.write((const char *)&header, sizeof(header));
+    file.write((const char *)&dx10, sizeof(dx10));
+    for (const std::vector<uint8_t> &level : texture.levels) {
+        file.write((const char *)level.data(), level.size());
+    }
+    return (bool)file;
+}
+
+namespace dds {
+
+inline bool readHeader(std::ifstream &file, const std::string &path, TextureFile &texture) {
+    uint32_t magic = 0;
+    Header header;
+    HeaderDX10 dx10;
+    file.read((char *)&magic, 4);
+    file.read((char *)&header, sizeof(header));
+    if (!file || magic != dds::magic || header.size != sizeof(Header) || header.pixelFormat.fourCC != fourccDX10) {
+        std::cerr << "ERROR: " << path << " is not a DX10 DDS file" << std::endl;
+        return false;
+    }
+    file.read((char *)&dx10, sizeof(dx10));
+
+    texture.dxgiFormat = dx10.dxgiFormat;
+    texture.width = (int)header.width;
+    texture.height = (int)header.height;
+    texture.levelCount = std::max(1u, header.mipMapCount);
+    texture.firstLevel = 0;
+    texture.swizzle = 0;
+    texture.psnr = 0.f;
+    texture.levels.clear();
+    if (header.reserved1[0] == ourTag) {
+        texture.swizzle = header.reserved1[1];
+        memcpy(&texture.psnr, &header.reserved1[2], 4);
+    }
+    return (bool)file;
+}
+
+} // namespace dds
+
+// everything but the pixel data
+inline bool readDDSHeader(const std::string &path, TextureFile &texture) {
+    std::ifstream file(path, std::ios::binary);
+    return file.is_open() && dds::readHeader(file, path, texture);
+}
+
+// reads up to levelCount levels starting at firstLevel; the larger levels
+// before it are skipped without being read
+inline bool readDDS(const std::string &path, TextureFile &texture, unsigned firstLevel = 0, unsigned levelCount = ~0u) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open() || !dds::readHeader(file, path, texture)) {
+        return false;
+    }
+
+    texture.firstLevel = std::min(firstLevel, texture.levelCount - 1);
+    const unsigned lastLevel = texture.firstLevel + std::min(levelCount, texture.levelCount - texture.firstLevel);
+    int width = texture.width, height = texture.height;
+    for (unsigned level = 0; level < lastLevel; ++level) {
+        size_t size = dds::levelSize(texture.dxgiFormat, width, height);
+        if (level < texture.firstLevel) {
+            file.seekg(size, std::ios::cur);
+        } else {
+            texture.levels.emplace_back(size);
+            file.read((char *)texture.levels.back().data(), size);
+        }
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    if (!file) {
+        std::cerr << "ERROR: " << path << " is truncated" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef DYNAMIC_BUFFER_H
+#define DYNAMIC_BUFFER_H
+
+#include <glad/glad.h>
+// glad must be included before GLFW
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "gl_ext.h"
+
+// Ring buffer for data written every frame: instance matrices, uniform
+// blocks, debug lines.
+//
+// The buffer is split into one region per frame in flight. A frame
+// allocates from its region by bumping an atomic cursor, so any thread can
+// write into it without locks. With ARB_buffer_storage the whole buffer
+// is mapped once, persistently and coherently; endFrame() fences the
+// region and beginFrame() waits for that fence before the region comes
+// round again, so the GPU is never overwritten mid-read. Without it the
+// buffer is orphaned at the start of every lap and each region mapped
+// unsynchronized; since GL can't draw from a buffer that is mapped that
+// way, flush() unmaps it before drawing and allocations fail after it
+// until the next frame. Either way allocations fail outside
+// beginFrame()/endFrame(), and callers fall back to their own memory.
+//
+// The buffer can be bound to any target: GL_ARRAY_BUFFER for vertex data,
+// or glBindBufferRange(GL_UNIFORM_BUFFER, ...) with allocations aligned to
+// uniformAlignment().
+//
+// LEARNOPENGL_BUFFER_STORAGE=0 forces the fallback.
+
+struct DynamicAllocation {
+    unsigned char *data = nullptr; // write only; may be uncached memory
+    GLuint buffer = 0;
+    size_t offset = 0;             // into buffer
+
+    explicit operator bool() const { return data != nullptr; }
+};
+
+class DynamicBuffer {
+public:
+    static DynamicBuffer &instance() {
+        static DynamicBuffer buffer;
+        return buffer;
+    }
+
+    DynamicBuffer(const DynamicBuffer &) = delete;
+    DynamicBuffer &operator=(const DynamicBuffer &) = delete;
+
+    // bytes per frame; only before the first beginFrame()
+    void setRegionSize(size_t bytes) {
+        if (!id) {
+            regionSize = (bytes + 255) & ~size_t(255);
+            cursor.store(regionStart + regionSize, std::memory_order_relaxed);
+        }
+    }
+
+    // GL thread, before anything of the frame is allocated
+    void beginFrame() {
+        if (!id) {
+            create();
+        }
+        frame = (frame + 1) % regionCount;
+        regionStart = frame * regionSize;
+        if (persistent) {
+            if (fences[frame]) {
+                const auto start = std::chrono::steady_clock::now();
+                GLenum status = glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+                while (status == GL_TIMEOUT_EXPIRED) {
+                    ++stalls;
+                    status = glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+                }
+                waitTime += std::chrono::steady_clock::now() - start;
+                glDeleteSync(fences[frame]);
+                fences[frame] = 0;
+            }
+            base = mapped + regionStart;
+        } else {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+            if (frame == 0) {
+                glBufferData(GL_COPY_WRITE_BUFFER, regionSize * regionCount, NULL, GL_STREAM_DRAW);
+            }
+            base = (unsigned char *)glMapBufferRange(GL_COPY_WRITE_BUFFER, regionStart, regionSize,
+                                                     GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            if (!base) {
+                std::cerr << "ERROR: Failed to map the dynamic buffer" << std::endl;
+            }
+        }
+        cursor.store(base ? regionStart : regionStart + regionSize, std::memory_order_relaxed);
+    }
+
+    // any thread; `alignment` must be a power of two. Empty when the
+    // frame's region is full, or no frame has begun.
+    DynamicAllocation allocate(size_t bytes, size_t alignment = 16) {
+        const size_t end = regionStart + regionSize;
+        size_t head = cursor.load(std::memory_order_relaxed);
+        size_t start;
+        do {
+            start = (head + alignment - 1) & ~(alignment - 1);
+            if (start + bytes > end) {
+                return DynamicAllocation();
+            }
+        } while (!cursor.compare_exchange_weak(head, start + bytes, std::memory_order_relaxed));
+        return {base + (start - regionStart), id, start};
+    }
+
+    // GL thread, after the last allocation is written and before drawing
+    // from it. Persistent mappings stay open for the rest of the frame.
+    void flush() {
+        if (!persistent && base) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            base = nullptr;
+            // allocations would land in unmapped memory from here on
+            cursor.store(regionStart + regionSize, std::memory_order_relaxed);
+        }
+    }
+
+    // GL thread, once the frame's draws are issued
+    void endFrame() {
+        if (!id) {
+            return;
+        }
+        flush();
+        cursor.store(regionStart + regionSize, std::memory_order_relaxed);
+        if (persistent) {
+            // the region may still be read by the GPU until this passes
+            fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+    }
+
+    GLuint buffer() const { return id; }
+    bool persistentlyMapped() const { return persistent; }
+
+    // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, for uniform block allocations
+    size_t uniformAlignment() const { return uniformOffsetAlignment; }
+
+    // time beginFrame() spent waiting for the GPU to release a region
+    double fenceWaitMs() const { return std::chrono::duration<double, std::milli>(waitTime).count(); }
+    unsigned long long fenceStalls() const { return stalls; }
+
+    // delete GL objects; call before the context goes away
+    void releaseGL() {
+        for (GLsync &fence : fences) {
+            if (fence) {
+                glDeleteSync(fence);
+                fence = 0;
+            }
+        }
+        if (id) {
+            if (persistent || base) {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            }
+            glDeleteBuffers(1, &id);
+            id = 0;
+        }
+        mapped = base = nullptr;
+        cursor.store(regionStart + regionSize, std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr unsigned regionCount = 3;
+
+    GLuint id = 0;
+    bool persistent = false;
+    size_t regionSize = 8 << 20;
+    size_t uniformOffsetAlignment = 256;
+    unsigned frame = regionCount - 1;
+    size_t regionStart = 0;
+    unsigned char *mapped = nullptr; // whole buffer, when persistent
+    unsigned char *base = nullptr;   // the current region
+    std::atomic<size_t> cursor{0};
+    GLsync fences[regionCount] = {};
+    std::chrono::steady_clock::duration waitTime{0};
+    unsigned long long stalls = 0;
+
+    // closed until the first beginFrame()
+    DynamicBuffer() { cursor.store(regionSize, std::memory_order_relaxed); }
+
+    void create() {
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        uniformOffsetAlignment = alignment > 0 ? (size_t)alignment : 256;
+
+        const char *storageEnv = getenv("LEARNOPENGL_BUFFER_STORAGE");
+        persistent = GLAD_GL_ARB_buffer_storage && !(storageEnv && std::string(storageEnv) == "0");
+
+        glGenBuffers(1, &id);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+        const size_t size = regionSize * regionCount;
+        if (persistent) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+            mapped = (unsigned char *)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+            if (!mapped) {
+                std::cerr << "WARNING: persistent mapping failed, orphaning the dynamic buffer instead" << std::endl;
+                persistent = false;
+                glDeleteBuffers(1, &id);
+                glGenBuffers(1, &id);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+            }
+        }
+        if (!persistent) {
+            glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+};
+
+#endif
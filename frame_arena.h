@@ -0,0 +1,99 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+// Bump allocator for memory that dies all at once: a frame's transient
+// containers, a loader's scratch data. Allocating is a pointer bump into
+// the current chunk; deallocating does nothing. reset() rewinds to the
+// first chunk and keeps them all, so an arena that is reset every frame
+// stops touching the heap once it has grown to the largest frame.
+//
+// It is a std::pmr::memory_resource, so standard containers can live in
+// it: std::pmr::vector<int> v(&arena). Not thread safe; one arena per
+// thread.
+class LinearArena : public std::pmr::memory_resource {
+public:
+    explicit LinearArena(size_t chunkSize = 64 << 10) : chunkSize(chunkSize) {}
+
+    LinearArena(const LinearArena &) = delete;
+    LinearArena &operator=(const LinearArena &) = delete;
+
+    // everything allocated so far is dead; the chunks are kept
+    void reset() {
+        chunk = 0;
+        offset = 0;
+        used = 0;
+    }
+
+    // reset() and give the chunks back to the heap
+    void release() {
+        reset();
+        chunks.clear();
+    }
+
+    // bytes handed out since the last reset
+    size_t bytesUsed() const { return used; }
+    size_t capacity() const {
+        size_t bytes = 0;
+        for (const Chunk &c : chunks) bytes += c.size;
+        return bytes;
+    }
+
+private:
+    struct Chunk {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size;
+    };
+
+    size_t chunkSize;
+    std::vector<Chunk> chunks;
+    size_t chunk = 0, offset = 0, used = 0;
+
+    void *do_allocate(size_t bytes, size_t alignment) override {
+        for (;;) {
+            if (chunk < chunks.size()) {
+                Chunk &c = chunks[chunk];
+                const uintptr_t base = (uintptr_t)c.data.get();
+                const size_t start = ((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+                if (start + bytes <= c.size) {
+                    offset = start + bytes;
+                    used += bytes;
+                    return c.data.get() + start;
+                }
+                ++chunk;
+                offset = 0;
+                continue;
+            }
+            const size_t size = std::max(chunkSize, bytes + alignment);
+            chunks.push_back({std::unique_ptr<unsigned char[]>(new unsigned char[size]), size});
+        }
+    }
+
+    void do_deallocate(void *, size_t, size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+};
+
+// The frame loop thread's arena for containers that live no longer than
+// one frame, e.g. std::pmr::vector<T> v(&FrameArena::local()). The thread
+// calls beginFrame() at the top of each frame, which reclaims everything
+// allocated in the previous one. Other threads get arenas of their own
+// that are only reclaimed when they call beginFrame() themselves; job
+// code should keep to its CommandBuffer's arena instead.
+class FrameArena {
+public:
+    static LinearArena &local() {
+        thread_local LinearArena arena(256 << 10);
+        return arena;
+    }
+
+    static void beginFrame() { local().reset(); }
+};
+
+#endif
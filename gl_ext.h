@@ -0,0 +1,95 @@
+#ifndef GL_EXT_H
+#define GL_EXT_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// glad in this repo is generated for plain GL 3.3 without extensions. Entry
+// points from later versions / ARB extensions that we can use opportunistically
+// are declared here the same way glad does it and loaded by loadGLExtensions()
+// right after gladLoadGLLoader. A null pointer means "not available".
+
+#ifndef GL_TEXTURE_IMMUTABLE_FORMAT
+#define GL_TEXTURE_IMMUTABLE_FORMAT 0x912F
+#endif
+
+// EXT_texture_compression_s3tc (+ the sRGB variants from EXT_texture_sRGB)
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+// ARB_texture_compression_bptc, core in 4.2
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#define GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM 0x8E8D
+#endif
+
+// ARB_buffer_storage, core in 4.4
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#endif
+
+typedef void (APIENTRYP PFNGLTEXSTORAGE2DPROC)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+inline PFNGLTEXSTORAGE2DPROC glad_glTexStorage2D = nullptr;
+#define glTexStorage2D glad_glTexStorage2D
+
+typedef void (APIENTRYP PFNGLTEXSTORAGE3DPROC)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth);
+inline PFNGLTEXSTORAGE3DPROC glad_glTexStorage3D = nullptr;
+#define glTexStorage3D glad_glTexStorage3D
+
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+inline PFNGLBUFFERSTORAGEPROC glad_glBufferStorage = nullptr;
+#define glBufferStorage glad_glBufferStorage
+
+inline int GLAD_GL_ARB_texture_storage = 0;
+inline int GLAD_GL_ARB_buffer_storage = 0;
+inline int GLAD_GL_EXT_texture_compression_s3tc = 0;
+inline int GLAD_GL_EXT_texture_sRGB_s3tc = 0; // sRGB DXT formats
+inline int GLAD_GL_ARB_texture_compression_bptc = 0;
+
+inline bool hasGLExtension(const char *name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && strcmp(extension, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void loadGLExtensions(GLADloadproc load) {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    const int version = major * 10 + minor;
+
+    if (version >= 42 || hasGLExtension("GL_ARB_texture_storage")) {
+        glad_glTexStorage2D = (PFNGLTEXSTORAGE2DPROC)load("glTexStorage2D");
+        glad_glTexStorage3D = (PFNGLTEXSTORAGE3DPROC)load("glTexStorage3D");
+        GLAD_GL_ARB_texture_storage = glad_glTexStorage2D && glad_glTexStorage3D;
+    }
+
+    if (version >= 44 || hasGLExtension("GL_ARB_buffer_storage")) {
+        glad_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)load("glBufferStorage");
+        GLAD_GL_ARB_buffer_storage = glad_glBufferStorage != nullptr;
+    }
+
+    // RGTC (BC4 / BC5) is core since 3.0; the rest are extensions on 3.3
+    GLAD_GL_EXT_texture_compression_s3tc = hasGLExtension("GL_EXT_texture_compression_s3tc");
+    GLAD_GL_EXT_texture_sRGB_s3tc = GLAD_GL_EXT_texture_compression_s3tc &&
+        (hasGLExtension("GL_EXT_texture_sRGB") || hasGLExtension("GL_EXT_texture_compression_s3tc_srgb"));
+    GLAD_GL_ARB_texture_compression_bptc = version >= 42 || hasGLExtension("GL_ARB_texture_compression_bptc");
+}
+
+#endif
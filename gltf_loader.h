@@ -0,0 +1,666 @@
+#ifndef GLTF_LOADER_H
+#define GLTF_LOADER_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+// glTF 2.0 reader for static scenes, .glb or .gltf with external buffers:
+// triangle meshes, their materials' textures and the node hierarchy.
+// Nothing is converted. Accessors say where their elements lie in the
+// mapped buffers, in the component types glTF shares with GL, so buffer
+// views can be handed to the GPU as they are.
+//
+// Files that need more than that (skins, animations, morph targets, sparse
+// accessors, points and lines, required extensions, base64 data URIs) make
+// readGltf() fail, so the caller can hand them to assimp instead.
+
+// glTF component types are the GL enums
+enum GltfComponentType : unsigned {
+    GltfByte = 0x1400,
+    GltfUnsignedByte = 0x1401,
+    GltfShort = 0x1402,
+    GltfUnsignedShort = 0x1403,
+    GltfUnsignedInt = 0x1405,
+    GltfFloat = 0x1406,
+};
+
+// a buffer view: bytes of a mapped file
+struct GltfView {
+    const unsigned char *Data = nullptr;
+    size_t Size = 0;
+    std::string File;      // that holds them
+    size_t FileOffset = 0; // of Data in File
+};
+
+// `Count` elements of `Components` x `ComponentType` every `Stride` bytes,
+// from `Offset` into Views[View]; Count 0 for an absent attribute
+struct GltfAccessor {
+    int View = -1;
+    size_t Offset = 0;
+    size_t Count = 0;
+    size_t Stride = 0;
+    int Components = 0;
+    unsigned ComponentType = GltfFloat;
+    bool Normalized = false;
+    const unsigned char *Data = nullptr; // the first element
+};
+
+struct GltfPrimitive {
+    GltfAccessor Position, Normal, TexCoord; // TEXCOORD_0
+    GltfAccessor Indices;                    // Count 0 when not indexed
+    int Material = -1;
+};
+
+struct GltfMesh {
+    std::string Name;
+    std::vector<GltfPrimitive> Primitives;
+};
+
+// an image file, or Size bytes at Offset in one
+struct GltfImage {
+    std::string File;
+    size_t Offset = 0, Size = 0;
+};
+
+struct GltfMaterial {
+    std::string Name;
+    int Diffuse = -1;  // into GltfFile::Images: base color, or diffuse for specular-glossiness
+    int Specular = -1; // specular-glossiness only
+};
+
+struct GltfNode {
+    std::string Name;
+    glm::vec3 Translation = glm::vec3(0.f);
+    glm::quat Rotation = glm::quat(1.f, 0.f, 0.f, 0.f);
+    glm::vec3 Scale = glm::vec3(1.f);
+    int Mesh = -1;
+    std::vector<int> Children;
+};
+
+struct GltfFile {
+    std::vector<GltfView> Views;
+    std::vector<GltfMesh> Meshes;
+    std::vector<GltfMaterial> Materials;
+    std::vector<GltfImage> Images;
+    std::vector<GltfNode> Nodes;
+    std::vector<int> Roots; // of the default scene
+    std::string Error;      // why readGltf() failed
+
+    // what Views point into; they stay mapped as long as the file lives
+    std::vector<std::unique_ptr<MappedFile>> Mapped;
+};
+
+namespace gltf {
+
+// a parsed JSON value; an object keeps its members in file order
+struct Json {
+    enum Type { Null, Bool, Number, String, Array, Object };
+    Type type = Null;
+    double number = 0.0; // 0 or 1 for Bool
+    std::string string;
+    std::vector<Json> items;       // array elements, or member values
+    std::vector<std::string> keys; // member names
+
+    // a null value for what's absent
+    const Json &operator[](const char *key) const {
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (keys[i] == key) {
+                return items[i];
+            }
+        }
+        return null();
+    }
+    const Json &operator[](size_t i) const { return type == Array && i < items.size() ? items[i] : null(); }
+    const Json &operator[](int i) const { return (*this)[(size_t)i]; }
+
+    bool has(const char *key) const { return &(*this)[key] != &null(); }
+    size_t size() const { return type == Array ? items.size() : 0; }
+    double numberOr(double fallback) const { return type == Number ? number : fallback; }
+    // a non-negative integer, or -1
+    long long index() const { return type == Number && number >= 0.0 && number < 9e15 ? (long long)number : -1; }
+
+    static const Json &null() {
+        static const Json value;
+        return value;
+    }
+};
+
+class JsonParser {
+public:
+    JsonParser(const char *p, const char *end) : p(p), end(end) {}
+
+    bool parse(Json &out) {
+        if (!value(out, 0)) {
+            return false;
+        }
+        skipSpaces();
+        return p == end;
+    }
+
+private:
+    const char *p, *end;
+
+    void skipSpaces() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+    }
+
+    bool literal(const char *word) {
+        const size_t length = strlen(word);
+        if ((size_t)(end - p) < length || memcmp(p, word, length) != 0) {
+            return false;
+        }
+        p += length;
+        return true;
+    }
+
+    bool value(Json &out, int depth) {
+        skipSpaces();
+        if (p == end || depth > 64) {
+            return false;
+        }
+        switch (*p) {
+            case '{': {
+                out.type = Json::Object;
+                ++p;
+                skipSpaces();
+                if (p < end && *p == '}') {
+                    ++p;
+                    return true;
+                }
+                for (;;) {
+                    skipSpaces();
+                    out.keys.emplace_back();
+                    out.items.emplace_back();
+                    if (!string(out.keys.back())) {
+                        return false;
+                    }
+                    skipSpaces();
+                    if (p == end || *p++ != ':' || !value(out.items.back(), depth + 1)) {
+                        return false;
+                    }
+                    skipSpaces();
+                    if (p < end && *p == ',') {
+                        ++p;
+                        continue;
+                    }
+                    return p < end && *p++ == '}';
+                }
+            }
+            case '[': {
+                out.type = Json::Array;
+                ++p;
+                skipSpaces();
+                if (p < end && *p == ']') {
+                    ++p;
+                    return true;
+                }
+                for (;;) {
+                    out.items.emplace_back();
+                    if (!value(out.items.back(), depth + 1)) {
+                        return false;
+                    }
+                    skipSpaces();
+                    if (p < end && *p == ',') {
+                        ++p;
+                        continue;
+                    }
+                    return p < end && *p++ == ']';
+                }
+            }
+            case '"':
+                out.type = Json::String;
+                return string(out.string);
+            case 't':
+                out.type = Json::Bool;
+                out.number = 1.0;
+                return literal("true");
+            case 'f':
+                out.type = Json::Bool;
+                return literal("false");
+            case 'n':
+                return literal("null");
+            default:
+                out.type = Json::Number;
+                return number(out.number);
+        }
+    }
+
+    // strtod on a copy: the mapping isn't null terminated
+    bool number(double &out) {
+        char token[64];
+        size_t n = 0;
+        while (p + n < end && n + 1 < sizeof(token) && strchr("+-0123456789.eE", p[n]) && p[n]) {
+            token[n] = p[n];
+            ++n;
+        }
+        token[n] = 0;
+        char *stop;
+        out = strtod(token, &stop);
+        if (stop == token) {
+            return false;
+        }
+        p += stop - token;
+        return true;
+    }
+
+    static void appendUtf8(std::string &out, uint32_t c) {
+        if (c < 0x80) {
+            out += (char)c;
+        } else if (c < 0x800) {
+            out += (char)(0xC0 | (c >> 6));
+            out += (char)(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            out += (char)(0xE0 | (c >> 12));
+            out += (char)(0x80 | ((c >> 6) & 0x3F));
+            out += (char)(0x80 | (c & 0x3F));
+        } else {
+            out += (char)(0xF0 | (c >> 18));
+            out += (char)(0x80 | ((c >> 12) & 0x3F));
+            out += (char)(0x80 | ((c >> 6) & 0x3F));
+            out += (char)(0x80 | (c & 0x3F));
+        }
+    }
+
+    bool hex4(uint32_t &out) {
+        if (end - p < 4) {
+            return false;
+        }
+        out = 0;
+        for (int i = 0; i < 4; ++i, ++p) {
+            const char c = *p;
+            const int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (digit < 0) {
+                return false;
+            }
+            out = out * 16 + digit;
+        }
+        return true;
+    }
+
+    bool string(std::string &out) {
+        if (p == end || *p++ != '"') {
+            return false;
+        }
+        for (;;) {
+            const char *run = p;
+            while (p < end && *p != '"' && *p != '\\') ++p;
+            out.append(run, p);
+            if (p == end) {
+                return false;
+            }
+            if (*p++ == '"') {
+                return true;
+            }
+            if (p == end) {
+                return false;
+            }
+            const char escape = *p++;
+            switch (escape) {
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    uint32_t c;
+                    if (!hex4(c)) {
+                        return false;
+                    }
+                    // surrogate pairs
+                    uint32_t low;
+                    if (c >= 0xD800 && c < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                        p += 2;
+                        if (!hex4(low)) {
+                            return false;
+                        }
+                        c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(out, c);
+                    break;
+                }
+                default: out += escape; break; // " \ /
+            }
+        }
+    }
+};
+
+inline uint32_t readU32(const unsigned char *p) {
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return value;
+}
+
+// %20 and the like in URIs
+inline std::string decodeUri(const std::string &uri) {
+    std::string out;
+    for (size_t i = 0; i < uri.size(); ++i) {
+        if (uri[i] == '%' && i + 2 < uri.size()) {
+            out += (char)strtol(uri.substr(i + 1, 2).c_str(), nullptr, 16);
+            i += 2;
+        } else {
+            out += uri[i];
+        }
+    }
+    return out;
+}
+
+inline size_t componentSize(unsigned type) {
+    switch (type) {
+        case GltfByte:
+        case GltfUnsignedByte: return 1;
+        case GltfShort:
+        case GltfUnsignedShort: return 2;
+        case GltfUnsignedInt:
+        case GltfFloat: return 4;
+        default: return 0;
+    }
+}
+
+inline int componentCount(const std::string &type) {
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    return 0;
+}
+
+// accessors[index] checked against its view; `error` says what's wrong
+inline bool readAccessor(const Json &json, const GltfFile &file, long long index, GltfAccessor &out, std::string &error) {
+    const Json &accessor = json["accessors"][(size_t)index];
+    const long long view = accessor["bufferView"].index();
+    if (accessor.type != Json::Object || accessor.has("sparse") || view < 0 || view >= (long long)file.Views.size()) {
+        error = "accessor " + std::to_string(index) + " is sparse, missing or has no buffer view";
+        return false;
+    }
+    out.View = (int)view;
+    out.Offset = (size_t)std::max(0ll, accessor["byteOffset"].index());
+    out.Count = (size_t)std::max(0ll, accessor["count"].index());
+    out.Components = componentCount(accessor["type"].string);
+    out.ComponentType = (unsigned)accessor["componentType"].index();
+    out.Normalized = accessor["normalized"].number != 0.0;
+    const size_t elementSize = componentSize(out.ComponentType) * out.Components;
+    const GltfView &gltfView = file.Views[view];
+    const size_t viewStride = (size_t)std::max(0ll, json["bufferViews"][(size_t)view]["byteStride"].index());
+    out.Stride = viewStride ? viewStride : elementSize;
+    if (elementSize == 0 || out.Count == 0 ||
+        out.Offset + out.Stride * (out.Count - 1) + elementSize > gltfView.Size) {
+        error = "accessor " + std::to_string(index) + " doesn't fit its buffer view";
+        return false;
+    }
+    out.Data = gltfView.Data + out.Offset;
+    return true;
+}
+
+// T, R and S of a column major matrix without shear
+inline void decompose(const glm::mat4 &m, GltfNode &node) {
+    node.Translation = glm::vec3(m[3]);
+    node.Scale = glm::vec3(glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2])));
+    if (glm::determinant(glm::mat3(m)) < 0.f) {
+        node.Scale.x = -node.Scale.x;
+    }
+    const glm::vec3 scale = glm::max(glm::abs(node.Scale), glm::vec3(1e-12f)) * glm::sign(node.Scale);
+    node.Rotation = glm::normalize(glm::quat_cast(glm::mat3(glm::vec3(m[0]) / scale.x, glm::vec3(m[1]) / scale.y,
+                                                            glm::vec3(m[2]) / scale.z)));
+}
+
+} // namespace gltf
+
+// Reads `path` (.glb, or .gltf and its buffers) into `out`. False, with
+// out.Error set, for files this reader doesn't handle.
+inline bool readGltf(const std::string &path, GltfFile &out) {
+    using namespace gltf;
+    auto fail = [&](const std::string &why) {
+        out.Error = path + ": " + why;
+        return false;
+    };
+    out.Mapped.push_back(std::make_unique<MappedFile>(path));
+    const MappedFile &file = *out.Mapped.back();
+    const unsigned char *bytes = (const unsigned char *)file.data();
+    if (file.size() == 0) {
+        return fail("can't read it");
+    }
+
+    // a GLB is a 12 byte header and chunks: JSON, then optionally BIN
+    const char *jsonBegin = file.data(), *jsonEnd = file.data() + file.size();
+    const unsigned char *bin = nullptr;
+    size_t binSize = 0, binOffset = 0;
+    if (file.size() >= 12 && readU32(bytes) == 0x46546C67) { // "glTF"
+        if (readU32(bytes + 4) != 2) {
+            return fail("not glTF 2.0");
+        }
+        const size_t length = std::min<size_t>(readU32(bytes + 8), file.size());
+        size_t at = 12;
+        for (int chunk = 0; at + 8 <= length; ++chunk) {
+            const size_t chunkLength = readU32(bytes + at);
+            const uint32_t type = readU32(bytes + at + 4);
+            if (at + 8 + chunkLength > length) {
+                return fail("truncated chunk");
+            }
+            if (chunk == 0 && type == 0x4E4F534A) { // JSON
+                jsonBegin = (const char *)bytes + at + 8;
+                jsonEnd = jsonBegin + chunkLength;
+            } else if (chunk == 1 && type == 0x004E4942) { // BIN
+                bin = bytes + at + 8;
+                binSize = chunkLength;
+                binOffset = at + 8;
+            }
+            at += 8 + chunkLength;
+        }
+        if (jsonBegin == file.data()) {
+            return fail("no JSON chunk");
+        }
+    }
+
+    Json json;
+    if (!JsonParser(jsonBegin, jsonEnd).parse(json) || json.type != Json::Object) {
+        return fail("malformed JSON");
+    }
+    if (json["asset"]["version"].string.compare(0, 2, "2.") != 0) {
+        return fail("not glTF 2.0");
+    }
+    if (json["extensionsRequired"].size() > 0) {
+        return fail("requires extension " + json["extensionsRequired"][0].string);
+    }
+    if (json["skins"].size() > 0 || json["animations"].size() > 0) {
+        return fail("skins and animations");
+    }
+    const std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+
+    // buffers, mapped
+    struct Buffer {
+        const unsigned char *data;
+        size_t size;
+        std::string file;
+        size_t offset;
+    };
+    std::vector<Buffer> buffers;
+    for (size_t i = 0; i < json["buffers"].size(); ++i) {
+        const Json &buffer = json["buffers"][i];
+        const size_t length = (size_t)std::max(0ll, buffer["byteLength"].index());
+        if (!buffer.has("uri")) {
+            if (i != 0 || !bin || binSize < length) {
+                return fail("buffer " + std::to_string(i) + " has no data");
+            }
+            buffers.push_back({bin, binSize, path, binOffset});
+            continue;
+        }
+        const std::string &uri = buffer["uri"].string;
+        if (uri.compare(0, 5, "data:") == 0) {
+            return fail("data URI buffers");
+        }
+        const std::string bufferPath = directory + decodeUri(uri);
+        out.Mapped.push_back(std::make_unique<MappedFile>(bufferPath));
+        if (out.Mapped.back()->size() < length) {
+            return fail("can't read " + bufferPath);
+        }
+        buffers.push_back({(const unsigned char *)out.Mapped.back()->data(), out.Mapped.back()->size(), bufferPath, 0});
+    }
+
+    for (size_t i = 0; i < json["bufferViews"].size(); ++i) {
+        const Json &view = json["bufferViews"][i];
+        const long long buffer = view["buffer"].index();
+        const size_t offset = (size_t)std::max(0ll, view["byteOffset"].index());
+        const size_t length = (size_t)std::max(0ll, view["byteLength"].index());
+        if (buffer < 0 || buffer >= (long long)buffers.size() || offset + length > buffers[buffer].size) {
+            return fail("buffer view " + std::to_string(i) + " outside its buffer");
+        }
+        out.Views.push_back({buffers[buffer].data + offset, length, buffers[buffer].file, buffers[buffer].offset + offset});
+    }
+
+    for (size_t i = 0; i < json["images"].size(); ++i) {
+        const Json &image = json["images"][i];
+        GltfImage result;
+        if (image.has("uri")) {
+            if (image["uri"].string.compare(0, 5, "data:") == 0) {
+                return fail("data URI images");
+            }
+            result.File = directory + decodeUri(image["uri"].string);
+        } else {
+            const long long view = image["bufferView"].index();
+            if (view < 0 || view >= (long long)out.Views.size()) {
+                return fail("image " + std::to_string(i) + " has no data");
+            }
+            result.File = out.Views[view].File;
+            result.Offset = out.Views[view].FileOffset;
+            result.Size = out.Views[view].Size;
+        }
+        out.Images.push_back(result);
+    }
+
+    // texture index to image index
+    auto imageOf = [&](const Json &textureInfo) -> int {
+        const long long texture = textureInfo["index"].index();
+        const long long image = texture < 0 ? -1 : json["textures"][(size_t)texture]["source"].index();
+        return image < (long long)out.Images.size() ? (int)image : -1;
+    };
+    for (size_t i = 0; i < json["materials"].size(); ++i) {
+        const Json &material = json["materials"][i];
+        const Json &specularGlossiness = material["extensions"]["KHR_materials_pbrSpecularGlossiness"];
+        GltfMaterial result;
+        result.Name = material["name"].string;
+        result.Diffuse = imageOf(material["pbrMetallicRoughness"]["baseColorTexture"]);
+        if (result.Diffuse < 0) {
+            result.Diffuse = imageOf(specularGlossiness["diffuseTexture"]);
+        }
+        result.Specular = imageOf(specularGlossiness["specularGlossinessTexture"]);
+        out.Materials.push_back(result);
+    }
+
+    std::string error;
+    for (size_t m = 0; m < json["meshes"].size(); ++m) {
+        const Json &mesh = json["meshes"][m];
+        GltfMesh result;
+        result.Name = mesh["name"].string;
+        for (size_t p = 0; p < mesh["primitives"].size(); ++p) {
+            const Json &primitive = mesh["primitives"][p];
+            const Json &attributes = primitive["attributes"];
+            if (primitive["mode"].numberOr(4) != 4) {
+                return fail("primitives other than triangles");
+            }
+            if (primitive.has("targets")) {
+                return fail("morph targets");
+            }
+            GltfPrimitive prim;
+            if (!readAccessor(json, out, attributes["POSITION"].index(), prim.Position, error)) {
+                return fail(error);
+            }
+            if (prim.Position.ComponentType != GltfFloat || prim.Position.Components != 3) {
+                return fail("positions that aren't float vec3");
+            }
+            if (attributes.has("NORMAL") && !readAccessor(json, out, attributes["NORMAL"].index(), prim.Normal, error)) {
+                return fail(error);
+            }
+            if (attributes.has("TEXCOORD_0") &&
+                !readAccessor(json, out, attributes["TEXCOORD_0"].index(), prim.TexCoord, error)) {
+                return fail(error);
+            }
+            if ((prim.Normal.Count && (prim.Normal.Count != prim.Position.Count || prim.Normal.Components != 3)) ||
+                (prim.TexCoord.Count && (prim.TexCoord.Count != prim.Position.Count || prim.TexCoord.Components != 2))) {
+                return fail("mismatched vertex attributes");
+            }
+            if (primitive.has("indices")) {
+                if (!readAccessor(json, out, primitive["indices"].index(), prim.Indices, error)) {
+                    return fail(error);
+                }
+                if (prim.Indices.Components != 1 || prim.Indices.ComponentType == GltfFloat ||
+                    prim.Indices.ComponentType == GltfByte || prim.Indices.ComponentType == GltfShort ||
+                    prim.Indices.Stride != componentSize(prim.Indices.ComponentType)) {
+                    return fail("malformed indices");
+                }
+            }
+            const long long material = primitive["material"].index();
+            prim.Material = material < (long long)out.Materials.size() ? (int)material : -1;
+            result.Primitives.push_back(prim);
+        }
+        out.Meshes.push_back(std::move(result));
+    }
+
+    const size_t nodeCount = json["nodes"].size();
+    for (size_t i = 0; i < nodeCount; ++i) {
+        const Json &node = json["nodes"][i];
+        GltfNode result;
+        result.Name = node["name"].string;
+        if (node["matrix"].size() == 16) {
+            glm::mat4 matrix;
+            for (int k = 0; k < 16; ++k) {
+                matrix[k / 4][k % 4] = (float)node["matrix"][k].number;
+            }
+            decompose(matrix, result);
+        }
+        if (node["translation"].size() == 3) {
+            result.Translation = glm::vec3(node["translation"][0].number, node["translation"][1].number,
+                                           node["translation"][2].number);
+        }
+        if (node["rotation"].size() == 4) { // x, y, z, w
+            result.Rotation = glm::quat((float)node["rotation"][3].number, (float)node["rotation"][0].number,
+                                        (float)node["rotation"][1].number, (float)node["rotation"][2].number);
+        }
+        if (node["scale"].size() == 3) {
+            result.Scale = glm::vec3(node["scale"][0].number, node["scale"][1].number, node["scale"][2].number);
+        }
+        const long long mesh = node["mesh"].index();
+        result.Mesh = mesh < (long long)out.Meshes.size() ? (int)mesh : -1;
+        for (size_t c = 0; c < node["children"].size(); ++c) {
+            result.Children.push_back((int)node["children"][c].index());
+        }
+        out.Nodes.push_back(std::move(result));
+    }
+
+    // the default scene's roots, or every node nothing else holds
+    const Json &scene = json["scenes"][(size_t)std::max(0ll, json["scene"].index())];
+    for (size_t i = 0; i < scene["nodes"].size(); ++i) {
+        out.Roots.push_back((int)scene["nodes"][i].index());
+    }
+    std::vector<int> parents(nodeCount, 0);
+    for (const GltfNode &node : out.Nodes) {
+        for (int child : node.Children) {
+            if (child < 0 || (size_t)child >= nodeCount || ++parents[child] > 1) {
+                return fail("malformed node hierarchy");
+            }
+        }
+    }
+    if (scene.type == Json::Null) {
+        for (size_t i = 0; i < nodeCount; ++i) {
+            if (parents[i] == 0) {
+                out.Roots.push_back((int)i);
+            }
+        }
+    }
+    for (int root : out.Roots) {
+        if (root < 0 || (size_t)root >= nodeCount || parents[root] != 0) {
+            return fail("malformed node hierarchy");
+        }
+    }
+    return true;
+}
+
+#endif
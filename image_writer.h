@@ -0,0 +1,351 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Minimal PNG / Y4M encoders used by the frame readback path. The PNG writer
+// does its own deflate (fixed Huffman + LZ77) so we don't need zlib or
+// stb_image_write just to dump screenshots.
+
+namespace image_writer {
+
+using std::string, std::vector;
+
+inline uint32_t crc32(const unsigned char *data, size_t size, uint32_t crc = 0) {
+    static uint32_t table[256];
+    static bool initialized = false;
+    if (!initialized) {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        initialized = true;
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+inline uint32_t adler32(const unsigned char *data, size_t size) {
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        // 5552 is the largest n such that the sums can't overflow 32 bits
+        size_t n = size < 5552 ? size : 5552;
+        size -= n;
+        while (n--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+class BitWriter {
+public:
+    vector<unsigned char> bytes;
+
+    void write(uint32_t bits, unsigned count) {
+        buffer |= bits << used;
+        used += count;
+        while (used >= 8) {
+            bytes.push_back(buffer & 0xFF);
+            buffer >>= 8;
+            used -= 8;
+        }
+    }
+
+    // Huffman codes are stored most significant bit first
+    void writeCode(uint32_t code, unsigned length) {
+        uint32_t reversed = 0;
+        for (unsigned i = 0; i < length; ++i) {
+            reversed = (reversed << 1) | ((code >> i) & 1);
+        }
+        write(reversed, length);
+    }
+
+    void flush() {
+        if (used > 0) {
+            bytes.push_back(buffer & 0xFF);
+        }
+        buffer = 0;
+        used = 0;
+    }
+
+private:
+    uint32_t buffer = 0;
+    unsigned used = 0;
+};
+
+inline void writeLiteral(BitWriter &out, unsigned value) {
+    if (value < 144) {
+        out.writeCode(0x30 + value, 8);
+    } else if (value < 256) {
+        out.writeCode(0x190 + value - 144, 9);
+    } else if (value < 280) {
+        out.writeCode(value - 256, 7);
+    } else {
+        out.writeCode(0xC0 + value - 280, 8);
+    }
+}
+
+inline void writeMatch(BitWriter &out, unsigned length, unsigned distance) {
+    static const unsigned short lengthBase[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const unsigned char lengthExtra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const unsigned short distanceBase[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+        193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+        6145, 8193, 12289, 16385, 24577};
+    static const unsigned char distanceExtra[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+        6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    unsigned l = 28;
+    while (lengthBase[l] > length) --l;
+    writeLiteral(out, 257 + l);
+    out.write(length - lengthBase[l], lengthExtra[l]);
+
+    unsigned d = 29;
+    while (distanceBase[d] > distance) --d;
+    out.writeCode(d, 5);
+    out.write(distance - distanceBase[d], distanceExtra[d]);
+}
+
+// zlib stream with a single fixed-Huffman deflate block
+inline vector<unsigned char> zlibCompress(const vector<unsigned char> &data) {
+    constexpr unsigned hashBits = 15;
+    constexpr unsigned windowSize = 32768;
+    constexpr unsigned maxMatch = 258;
+
+    BitWriter out;
+    out.write(0x78, 8);
+    out.write(0x01, 8);
+    out.write(1, 1); // final block
+    out.write(1, 2); // fixed Huffman
+
+    constexpr unsigned maxChain = 16;
+
+    // hash chains over 3-byte prefixes, prev[] is indexed modulo the window
+    vector<int> head(1 << hashBits, -1);
+    vector<int> prev(windowSize, -1);
+    const size_t size = data.size();
+    size_t i = 0;
+    auto insert = [&](size_t pos) {
+        uint32_t h = (data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16)) * 2654435761u >> (32 - hashBits);
+        int candidate = head[h];
+        prev[pos % windowSize] = candidate;
+        head[h] = (int)pos;
+        return candidate;
+    };
+
+    while (i < size) {
+        unsigned bestLength = 0, bestDistance = 0;
+        if (i + 3 <= size) {
+            int candidate = insert(i);
+            size_t limit = std::min<size_t>(maxMatch, size - i);
+            for (unsigned chain = 0; chain < maxChain && candidate >= 0 && i - candidate <= windowSize; ++chain) {
+                unsigned length = 0;
+                while (length < limit && data[candidate + length] == data[i + length]) {
+                    ++length;
+                }
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestDistance = (unsigned)(i - candidate);
+                    if (length == limit) break;
+                }
+                int next = prev[candidate % windowSize];
+                if (next >= candidate) break;
+                candidate = next;
+            }
+            if (bestLength < 3) bestLength = 0;
+        }
+
+        if (bestLength) {
+            writeMatch(out, bestLength, bestDistance);
+            for (size_t end = i + bestLength, j = i + 1; j < end && j + 3 <= size; ++j) {
+                insert(j);
+            }
+            i += bestLength;
+        } else {
+            writeLiteral(out, data[i]);
+            ++i;
+        }
+    }
+    writeLiteral(out, 256);
+    out.flush();
+
+    uint32_t adler = adler32(data.data(), data.size());
+    out.bytes.push_back((adler >> 24) & 0xFF);
+    out.bytes.push_back((adler >> 16) & 0xFF);
+    out.bytes.push_back((adler >> 8) & 0xFF);
+    out.bytes.push_back(adler & 0xFF);
+    return std::move(out.bytes);
+}
+
+inline unsigned char paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return (unsigned char)a;
+    if (pb <= pc) return (unsigned char)b;
+    return (unsigned char)c;
+}
+
+// rows are given bottom-up (glReadPixels order) when flipY is set
+inline vector<unsigned char> encodePNG(const unsigned char *pixels, int width, int height, int channels, bool flipY) {
+    const size_t stride = (size_t)width * channels;
+    vector<unsigned char> raw;
+    raw.reserve((stride + 1) * height);
+
+    vector<unsigned char> filtered(stride), best(stride);
+    for (int y = 0; y < height; ++y) {
+        const unsigned char *row = pixels + stride * (flipY ? height - 1 - y : y);
+        const unsigned char *prev = nullptr;
+        if (y > 0) {
+            prev = pixels + stride * (flipY ? height - y : y - 1);
+        }
+
+        // pick the filter with the smallest sum of absolute residuals
+        unsigned char bestFilter = 0;
+        uint64_t bestScore = UINT64_MAX;
+        for (unsigned char filter = 0; filter < 5; ++filter) {
+            uint64_t score = 0;
+            for (size_t x = 0; x < stride; ++x) {
+                int a = x >= (size_t)channels ? row[x - channels] : 0;
+                int b = prev ? prev[x] : 0;
+                int c = (prev && x >= (size_t)channels) ? prev[x - channels] : 0;
+                unsigned char value = row[x];
+                switch (filter) {
+                    case 1: value -= a; break;
+                    case 2: value -= b; break;
+                    case 3: value -= (a + b) >> 1; break;
+                    case 4: value -= paeth(a, b, c); break;
+                    default: break;
+                }
+                filtered[x] = value;
+                score += value < 128 ? value : 256 - value;
+            }
+            if (score < bestScore) {
+                bestScore = score;
+                bestFilter = filter;
+                best.swap(filtered);
+            }
+        }
+        raw.push_back(bestFilter);
+        raw.insert(raw.end(), best.begin(), best.end());
+    }
+
+    vector<unsigned char> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    auto writeChunk = [&png](const char *type, const vector<unsigned char> &payload) {
+        uint32_t length = (uint32_t)payload.size();
+        unsigned char header[8] = {
+            (unsigned char)(length >> 24), (unsigned char)(length >> 16),
+            (unsigned char)(length >> 8), (unsigned char)length,
+            (unsigned char)type[0], (unsigned char)type[1],
+            (unsigned char)type[2], (unsigned char)type[3]};
+        png.insert(png.end(), header, header + 8);
+        png.insert(png.end(), payload.begin(), payload.end());
+        uint32_t crc = crc32(header + 4, 4);
+        crc = crc32(payload.data(), payload.size(), crc);
+        unsigned char footer[4] = {
+            (unsigned char)(crc >> 24), (unsigned char)(crc >> 16),
+            (unsigned char)(crc >> 8), (unsigned char)crc};
+        png.insert(png.end(), footer, footer + 4);
+    };
+
+    static const unsigned char colorTypes[5] = {0, 0, 4, 2, 6};
+    vector<unsigned char> ihdr = {
+        (unsigned char)(width >> 24), (unsigned char)(width >> 16),
+        (unsigned char)(width >> 8), (unsigned char)width,
+        (unsigned char)(height >> 24), (unsigned char)(height >> 16),
+        (unsigned char)(height >> 8), (unsigned char)height,
+        8, colorTypes[channels], 0, 0, 0};
+    writeChunk("IHDR", ihdr);
+    writeChunk("IDAT", zlibCompress(raw));
+    writeChunk("IEND", {});
+    return png;
+}
+
+inline bool writePNG(const string &path, const unsigned char *pixels, int width, int height, int channels, bool flipY) {
+    vector<unsigned char> png = encodePNG(pixels, width, height, channels, flipY);
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Failed to open " << path << std::endl;
+        return false;
+    }
+    file.write((const char *)png.data(), png.size());
+    return true;
+}
+
+// Raw YUV4MPEG2 stream, 4:4:4 BT.601 full range, one FRAME per call
+class Y4MWriter {
+public:
+    Y4MWriter(const string &path, int width, int height, int fps)
+        : width(width), height(height), file(path, std::ios::binary) {
+        if (!file.is_open()) {
+            std::cerr << "ERROR: Failed to open " << path << std::endl;
+            return;
+        }
+        file << "YUV4MPEG2 W" << width << " H" << height << " F" << fps
+             << ":1 Ip A1:1 C444 XCOLORRANGE=FULL\n";
+    }
+
+    bool isOpen() const { return file.is_open(); }
+
+    // expects RGBA8 rows
+    bool writeFrame(const unsigned char *rgba, int frameWidth, int frameHeight, bool flipY) {
+        if (frameWidth != width || frameHeight != height) {
+            std::cerr << "ERROR: Y4M frame size changed, dropping frame" << std::endl;
+            return false;
+        }
+
+        const size_t planeSize = (size_t)width * height;
+        planes.resize(planeSize * 3);
+        unsigned char *Y = planes.data(), *U = Y + planeSize, *V = U + planeSize;
+        for (int y = 0; y < height; ++y) {
+            const unsigned char *row = rgba + (size_t)width * 4 * (flipY ? height - 1 - y : y);
+            for (int x = 0; x < width; ++x) {
+                float r = row[x * 4], g = row[x * 4 + 1], b = row[x * 4 + 2];
+                size_t i = (size_t)y * width + x;
+                Y[i] = clampByte(0.299f * r + 0.587f * g + 0.114f * b);
+                U[i] = clampByte(128.f - 0.168736f * r - 0.331264f * g + 0.5f * b);
+                V[i] = clampByte(128.f + 0.5f * r - 0.418688f * g - 0.081312f * b);
+            }
+        }
+
+        file << "FRAME\n";
+        file.write((const char *)planes.data(), planes.size());
+        return true;
+    }
+
+private:
+    int width, height;
+    std::ofstream file;
+    vector<unsigned char> planes;
+
+    static unsigned char clampByte(float v) {
+        return (unsigned char)(v < 0.f ? 0.f : (v > 255.f ? 255.f : v + 0.5f));
+    }
+};
+
+} // namespace image_writer
+
+#endif
@@ -0,0 +1,536 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "allocation_tracker.h"
+#include "frame_arena.h"
+
+// Work-stealing job scheduler.
+//
+// Every worker owns a Chase-Lev deque: it pushes and pops jobs at the
+// bottom, and idle workers steal from the top of a random victim. Jobs
+// submitted from outside the pool go through a shared queue. A thread
+// waiting for jobs (wait(), parallelFor()) runs queued work until they are
+// done, so nested waits are fine and the caller always helps.
+//
+// A JobCounter counts unfinished jobs. Jobs may name one as a dependency
+// and only start once it reaches zero, which chains stages into a graph.
+// Jobs that touch GL go to runOnGLThread() and run only on the thread
+// named by setGLThread(), the one the context is current on: in
+// runGLThreadJobs() or while it wait()s. Workers must never wait for such
+// jobs, and none run until a GL thread is set.
+//
+// Job records come from a pool and keep callables of up to
+// JobRecord::inlineBytes in place, so once the pool has grown, running
+// such jobs - parallelFor() splits among them - doesn't touch the heap.
+//
+// LEARNOPENGL_JOB_THREADS=<n> sets how many threads instance() runs on,
+// the main thread included; it defaults to the hardware threads.
+
+class JobSystem;
+
+struct JobRecord {
+    static constexpr size_t inlineBytes = 64;
+
+    alignas(std::max_align_t) unsigned char storage[inlineBytes];
+    void (*invoke)(void *storage) = nullptr; // runs the callable and destroys it
+    class JobCounter *signal = nullptr;
+    JobRecord *next = nullptr; // in the pool
+
+    // larger callables are moved to the heap
+    template <typename Fn>
+    void set(Fn &&fn) {
+        using F = std::decay_t<Fn>;
+        if constexpr (sizeof(F) <= inlineBytes && alignof(F) <= alignof(std::max_align_t)) {
+            new (storage) F(std::forward<Fn>(fn));
+            invoke = [](void *p) {
+                F &f = *static_cast<F *>(p);
+                f();
+                f.~F();
+            };
+        } else {
+            F *boxed = new F(std::forward<Fn>(fn));
+            memcpy(storage, &boxed, sizeof(boxed));
+            invoke = [](void *p) {
+                F *f;
+                memcpy(&f, p, sizeof(f));
+                (*f)();
+                delete f;
+            };
+        }
+    }
+
+    void run() { invoke(storage); }
+};
+
+class JobCounter {
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter &) = delete;
+    JobCounter &operator=(const JobCounter &) = delete;
+
+    bool done() const { return count.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<int> count{0};
+    std::mutex mutex;
+    std::vector<JobRecord *> waiting; // jobs that run after this
+};
+
+struct JobWorkerStats {
+    uint64_t jobs = 0;
+    uint64_t steals = 0;
+    uint64_t failedSteals = 0; // empty victims and lost races
+    double idleMs = 0.0;
+};
+
+class JobSystem {
+public:
+    // `threads` counts the calling thread, so 1 runs everything inline
+    explicit JobSystem(unsigned threads) {
+        const unsigned workerCount = std::max(1u, threads) - 1;
+        for (unsigned i = 0; i <= workerCount; ++i) {
+            addRecords();
+        }
+        for (unsigned i = 0; i < workerCount; ++i) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for (unsigned i = 0; i < workerCount; ++i) {
+            workers[i]->thread = std::thread(&JobSystem::workerLoop, this, i);
+        }
+    }
+
+    // jobs still queued are dropped
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stop = true;
+        }
+        sleepWake.notify_all();
+        for (auto &worker : workers) {
+            worker->thread.join();
+        }
+    }
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    static JobSystem &instance() {
+        static JobSystem system(defaultThreadCount());
+        return system;
+    }
+
+    static unsigned defaultThreadCount() {
+        if (const char *threads = getenv("LEARNOPENGL_JOB_THREADS")) {
+            return std::max(1, atoi(threads));
+        }
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    unsigned threadCount() const { return (unsigned)workers.size() + 1; }
+
+    // queue fn; `signal` counts it until it finishes, and it starts only
+    // once `after` is done
+    template <typename Fn>
+    void run(Fn &&fn, JobCounter *signal = nullptr, JobCounter *after = nullptr) {
+        JobRecord *job = acquireRecord(std::forward<Fn>(fn), signal);
+        if (signal) {
+            signal->count.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (after && !after->done()) {
+            std::lock_guard<std::mutex> lock(after->mutex);
+            if (!after->done()) {
+                after->waiting.push_back(job);
+                return;
+            }
+        }
+        enqueue(job);
+    }
+
+    // the calling thread runs the GL jobs from now on; call it again when
+    // the context moves to another thread
+    void setGLThread() { glThread.store(std::this_thread::get_id()); }
+
+    template <typename Fn>
+    void runOnGLThread(Fn &&fn, JobCounter *signal = nullptr) {
+        JobRecord *job = acquireRecord(std::forward<Fn>(fn), signal);
+        if (signal) {
+            signal->count.fetch_add(1, std::memory_order_relaxed);
+        }
+        std::lock_guard<std::mutex> lock(glMutex);
+        glJobs.push(job);
+    }
+
+    // call once a frame on the GL thread; runs the jobs queued so far
+    void runGLThreadJobs() {
+        if (std::this_thread::get_id() != glThread.load()) {
+            std::cerr << "ERROR: GL jobs run off the GL thread; call setGLThread() where the context is current" << std::endl;
+            return;
+        }
+        std::unique_lock<std::mutex> lock(glMutex);
+        if (glJobs.empty()) {
+            return;
+        }
+        std::pmr::vector<JobRecord *> jobs(&FrameArena::local());
+        jobs.reserve(glJobs.size());
+        while (!glJobs.empty()) {
+            jobs.push_back(glJobs.pop());
+        }
+        lock.unlock();
+        for (JobRecord *job : jobs) {
+            execute(job);
+        }
+    }
+
+    // run jobs until `counter` is done
+    void wait(JobCounter &counter) {
+        const bool onGLThread = std::this_thread::get_id() == glThread.load();
+        unsigned spins = 0;
+        while (!counter.done()) {
+            if (JobRecord *job = findJob(currentWorker())) {
+                execute(job);
+                spins = 0;
+                continue;
+            }
+            if (onGLThread) {
+                runGLThreadJobs();
+            }
+            if (++spins > 64) {
+                std::this_thread::yield();
+            }
+        }
+        // the last job may still hold the lock; the counter must outlive it
+        std::lock_guard<std::mutex> lock(counter.mutex);
+    }
+
+    // Split [0, count) into chunks of `grain` items (the last may be
+    // shorter) and run fn(begin, end) on them. Ranges are halved as they are
+    // run, the upper half left for other workers to steal.
+    template <typename Fn>
+    void parallelFor(size_t count, size_t grain, Fn &&fn) {
+        if (count == 0) {
+            return;
+        }
+        grain = std::max<size_t>(1, grain);
+        if (workers.empty() || count <= grain) {
+            fn(size_t(0), count);
+            return;
+        }
+        JobCounter counter;
+        auto range = [this, &fn, &counter, grain](auto &self, size_t begin, size_t end) -> void {
+            while (end - begin > grain) {
+                const size_t chunks = (end - begin + grain - 1) / grain;
+                const size_t mid = begin + chunks / 2 * grain;
+                run([&self, mid, end] { self(self, mid, end); }, &counter);
+                end = mid;
+            }
+            fn(begin, end);
+        };
+        range(range, 0, count);
+        wait(counter);
+    }
+
+    // per worker, since the last reset
+    std::vector<JobWorkerStats> stats() const {
+        std::vector<JobWorkerStats> result;
+        for (const auto &worker : workers) {
+            JobWorkerStats s;
+            s.jobs = worker->jobs.load(std::memory_order_relaxed);
+            s.steals = worker->steals.load(std::memory_order_relaxed);
+            s.failedSteals = worker->failedSteals.load(std::memory_order_relaxed);
+            s.idleMs = worker->idleNs.load(std::memory_order_relaxed) * 1e-6;
+            result.push_back(s);
+        }
+        return result;
+    }
+
+    void resetStats() {
+        for (auto &worker : workers) {
+            worker->jobs = 0;
+            worker->steals = 0;
+            worker->failedSteals = 0;
+            worker->idleNs = 0;
+        }
+    }
+
+private:
+    // Chase-Lev deque of fixed capacity (Le et al., "Correct and Efficient
+    // Work-Stealing for Weak Memory Models"); push() fails when full
+    class WorkDeque {
+    public:
+        bool push(JobRecord *job) {
+            const int64_t b = bottom.load(std::memory_order_relaxed);
+            const int64_t t = top.load(std::memory_order_acquire);
+            if (b - t >= capacity) {
+                return false;
+            }
+            slots[b & (capacity - 1)].store(job, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        // owner only
+        JobRecord *pop() {
+            const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+            if (t > b) {
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            JobRecord *job = slots[b & (capacity - 1)].load(std::memory_order_relaxed);
+            if (t == b) {
+                // the last job: race the thieves for it
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    job = nullptr;
+                }
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return job;
+        }
+
+        // any thread
+        JobRecord *steal() {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b) {
+                return nullptr;
+            }
+            JobRecord *job = slots[t & (capacity - 1)].load(std::memory_order_relaxed);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return job;
+        }
+
+    private:
+        static constexpr int64_t capacity = 4096;
+        alignas(64) std::atomic<int64_t> top{0};
+        alignas(64) std::atomic<int64_t> bottom{0};
+        std::atomic<JobRecord *> slots[capacity] = {};
+    };
+
+    // FIFO of jobs behind a mutex; a ring, as a std::deque allocates as it
+    // moves along
+    class JobQueue {
+    public:
+        bool empty() const { return count == 0; }
+        size_t size() const { return count; }
+
+        void push(JobRecord *job) {
+            if (count == slots.size()) {
+                std::vector<JobRecord *> grown(std::max<size_t>(64, slots.size() * 2));
+                for (size_t i = 0; i < count; ++i) {
+                    grown[i] = slots[(head + i) & (slots.size() - 1)];
+                }
+                slots.swap(grown);
+                head = 0;
+            }
+            slots[(head + count++) & (slots.size() - 1)] = job;
+        }
+
+        JobRecord *pop() {
+            JobRecord *job = slots[head];
+            head = (head + 1) & (slots.size() - 1);
+            --count;
+            return job;
+        }
+
+    private:
+        std::vector<JobRecord *> slots; // a power of two of them
+        size_t head = 0, count = 0;
+    };
+
+    struct alignas(64) Worker {
+        WorkDeque deque;
+        std::thread thread;
+        std::atomic<uint64_t> jobs{0}, steals{0}, failedSteals{0}, idleNs{0};
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<std::thread::id> glThread{};
+
+    // jobs from threads outside the pool
+    std::mutex sharedMutex;
+    JobQueue sharedJobs;
+
+    std::mutex glMutex;
+    JobQueue glJobs;
+
+    // the pool: records are allocated in blocks and never freed, and the
+    // ones not in use are linked through JobRecord::next
+    static constexpr size_t recordBlockSize = 64;
+    std::mutex recordsMutex;
+    std::vector<std::unique_ptr<JobRecord[]>> recordBlocks;
+    JobRecord *freeRecords = nullptr;
+
+    // queued jobs not yet taken, to let idle workers sleep
+    std::atomic<int64_t> queued{0};
+    std::atomic<int> sleepers{0};
+    std::mutex sleepMutex;
+    std::condition_variable sleepWake;
+    bool stop = false;
+
+    // index into workers of the calling thread in this system, or -1
+    int currentWorker() const {
+        return workerSystem == this ? workerIndex : -1;
+    }
+    static inline thread_local const JobSystem *workerSystem = nullptr;
+    static inline thread_local int workerIndex = -1;
+
+    void enqueue(JobRecord *job) {
+        const int self = currentWorker();
+        queued.fetch_add(1);
+        if (self < 0 || !workers[self]->deque.push(job)) {
+            std::lock_guard<std::mutex> lock(sharedMutex);
+            sharedJobs.push(job);
+        }
+        if (sleepers.load() > 0) {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            sleepWake.notify_one();
+        }
+    }
+
+    JobRecord *findJob(int self) {
+        JobRecord *job = self >= 0 ? workers[self]->deque.pop() : nullptr;
+        if (!job) {
+            std::lock_guard<std::mutex> lock(sharedMutex);
+            if (!sharedJobs.empty()) {
+                job = sharedJobs.pop();
+            }
+        }
+        if (!job && !workers.empty()) {
+            // one pass over the other workers from a random start
+            thread_local uint32_t seed = (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+            seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+            const size_t start = seed % workers.size();
+            for (size_t i = 0; i < workers.size() && !job; ++i) {
+                const size_t victim = (start + i) % workers.size();
+                if ((int)victim == self) {
+                    continue;
+                }
+                job = workers[victim]->deque.steal();
+                if (self >= 0) {
+                    (job ? workers[self]->steals : workers[self]->failedSteals).fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+        if (job) {
+            queued.fetch_sub(1);
+        }
+        return job;
+    }
+
+    // with recordsMutex held, or before there are workers
+    void addRecords() {
+        recordBlocks.emplace_back(new JobRecord[recordBlockSize]);
+        JobRecord *block = recordBlocks.back().get();
+        for (size_t i = 0; i < recordBlockSize; ++i) {
+            block[i].next = i + 1 < recordBlockSize ? &block[i + 1] : freeRecords;
+        }
+        freeRecords = block;
+    }
+
+    template <typename Fn>
+    JobRecord *acquireRecord(Fn &&fn, JobCounter *signal) {
+        JobRecord *job;
+        {
+            std::lock_guard<std::mutex> lock(recordsMutex);
+            if (!freeRecords) {
+                addRecords();
+            }
+            job = freeRecords;
+            freeRecords = job->next;
+        }
+        job->set(std::forward<Fn>(fn));
+        job->signal = signal;
+        return job;
+    }
+
+    void releaseRecord(JobRecord *job) {
+        std::lock_guard<std::mutex> lock(recordsMutex);
+        job->next = freeRecords;
+        freeRecords = job;
+    }
+
+    void execute(JobRecord *job) {
+        // the callable is gone before the signal lets a waiter go on
+        job->run();
+        if (JobCounter *signal = job->signal) {
+            std::vector<JobRecord *> ready;
+            {
+                // taken before the count drops so a waiter can't free the
+                // counter under us
+                std::lock_guard<std::mutex> lock(signal->mutex);
+                if (signal->count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    ready.swap(signal->waiting);
+                }
+            }
+            for (JobRecord *next : ready) {
+                enqueue(next);
+            }
+        }
+        releaseRecord(job);
+        const int self = currentWorker();
+        if (self >= 0) {
+            workers[self]->jobs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void workerLoop(int index) {
+        AllocationScope allocationScope("jobs");
+        workerSystem = this;
+        workerIndex = index;
+        Worker &worker = *workers[index];
+        for (;;) {
+            if (JobRecord *job = findJob(index)) {
+                execute(job);
+                continue;
+            }
+            const auto idleStart = std::chrono::steady_clock::now();
+            JobRecord *job = nullptr;
+            for (int spin = 0; spin < 64 && !job; ++spin) {
+                std::this_thread::yield();
+                job = findJob(index);
+            }
+            if (!job) {
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                sleepers.fetch_add(1);
+                sleepWake.wait(lock, [this] { return stop || queued.load() > 0; });
+                sleepers.fetch_sub(1);
+                if (stop) {
+                    return;
+                }
+            }
+            worker.idleNs.fetch_add(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - idleStart).count(),
+                std::memory_order_relaxed);
+            if (job) {
+                execute(job);
+            }
+        }
+    }
+};
+
+#endif
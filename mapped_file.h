@@ -0,0 +1,66 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// the whole file, mapped where that's possible
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path) {
+#ifndef _WIN32
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void *p = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                // every chunk is read at once, not front to back
+                madvise(p, (size_t)info.st_size, MADV_WILLNEED);
+                bytes = (const char *)p;
+                length = (size_t)info.st_size;
+            }
+        }
+        close(fd);
+        if (bytes) {
+            return;
+        }
+#endif
+        std::ifstream file(path, std::ios::binary);
+        copy.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        bytes = copy.data();
+        length = copy.size();
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (copy.empty() && bytes) {
+            munmap((void *)bytes, length);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const char *bytes = nullptr;
+    size_t length = 0;
+    std::vector<char> copy; // when mapping isn't possible
+};
+
+#endif
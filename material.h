@@ -0,0 +1,254 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "texture_cache.h"
+#include "texture_pack.h"
+
+// Materials resolved once at load time.
+//
+// A Material names the texture for each sampler slot (a plain texture or a
+// layer of a TexturePack array) and its constants. MaterialLibrary
+// deduplicates them, hands out compact integer IDs and keeps the constants
+// of every material in one uniform buffer array, so a shader selects its
+// material with `materials[materialID]`. Sampler units, sampler objects and
+// the uniform block binding are set up once per program; switching material
+// is then the texture binds that actually change plus one glUniform1i.
+//
+// Shaders declare (see 3-model-loading/shaders/model_loading.fs):
+//   layout(std140) uniform Materials { MaterialData materials[MAX_MATERIALS]; };
+//   uniform int materialID;
+//   uniform sampler2D[Array] texture_diffuse1;  // unit 0
+//   uniform sampler2D[Array] texture_specular1; // unit 1
+
+struct MaterialSlot {
+    TextureHandle Texture;   // GL_TEXTURE_2D, or
+    PackedTexture Packed;    // a texture array layer when Packed.array != 0
+};
+
+struct Material {
+    enum { Diffuse, Specular, SlotCount };
+    MaterialSlot Slots[SlotCount];
+    float Shininess = 32.f;
+};
+
+class MaterialLibrary {
+public:
+    static constexpr unsigned maxMaterials = 256; // MAX_MATERIALS in the shaders
+    static constexpr GLuint uniformBinding = 1;
+    static constexpr unsigned none = ~0u;
+
+    static MaterialLibrary &instance() {
+        static MaterialLibrary library;
+        return library;
+    }
+
+    MaterialLibrary(const MaterialLibrary &) = delete;
+    MaterialLibrary &operator=(const MaterialLibrary &) = delete;
+
+    // returns the ID of an identical material if there is one
+    unsigned add(const Material &material) {
+        Key key = makeKey(material);
+        auto it = ids.find(key);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        if (materials.size() >= maxMaterials) {
+            std::cerr << "WARNING: more than " << maxMaterials << " materials, using material 0" << std::endl;
+            return 0;
+        }
+        unsigned id = (unsigned)materials.size();
+        materials.push_back(material);
+        ids.emplace(key, id);
+        dirty = true;
+        return id;
+    }
+
+    const Material &get(unsigned id) const { return materials[id]; }
+    size_t size() const { return materials.size(); }
+
+    // forget what's bound; call before drawing when other code may have
+    // changed texture or uniform buffer bindings since the last bind()
+    void resetBindings() {
+        memset(bound, 0, sizeof(bound));
+        boundProgram = 0;
+        if (buffer) {
+            glBindBufferBase(GL_UNIFORM_BUFFER, uniformBinding, buffer);
+        }
+    }
+
+    // make `id` the current material of `program`
+    void bind(unsigned id, GLuint program) {
+        if (dirty) {
+            upload();
+        }
+        ProgramState &state = prepare(program);
+
+        const Material &material = materials[id];
+        for (unsigned slot = 0; slot < Material::SlotCount; ++slot) {
+            const MaterialSlot &s = material.Slots[slot];
+            GLenum target = s.Packed.array ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+            GLuint texture = s.Packed.array ? s.Packed.array : s.Texture.id();
+            if (!texture) {
+                continue;
+            }
+            if (s.Texture) {
+                s.Texture.touch(); // keep it recent for the cache's LRU
+            }
+            if (bound[slot].target != target || bound[slot].texture != texture) {
+                glActiveTexture(GL_TEXTURE0 + slot);
+                glBindTexture(target, texture);
+                bound[slot] = {target, texture};
+            }
+        }
+        if (boundProgram != program || state.material != id) {
+            glUniform1i(state.materialLocation, (GLint)id);
+            state.material = id;
+            boundProgram = program;
+        }
+    }
+
+    // delete GL objects; call before the context goes away
+    void releaseGL() {
+        if (buffer) glDeleteBuffers(1, &buffer);
+        if (sampler) glDeleteSamplers(1, &sampler);
+        buffer = 0;
+        sampler = 0;
+        programs.clear();
+        materials.clear();
+        ids.clear();
+        resetBindings();
+    }
+
+private:
+    // std140 layout of one element of the Materials block
+    struct MaterialData {
+        glm::vec4 diffuseUV;
+        glm::vec4 specularUV;
+        float diffuseLayer, specularLayer, shininess, pad;
+    };
+    static_assert(sizeof(MaterialData) == 48, "std140 MaterialData is 48 bytes");
+
+    struct Key {
+        const TextureEntry *textures[Material::SlotCount];
+        GLuint arrays[Material::SlotCount];
+        int layers[Material::SlotCount];
+        glm::vec4 uv[Material::SlotCount];
+        float shininess;
+
+        bool operator==(const Key &other) const { return memcmp(this, &other, sizeof(Key)) == 0; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key &key) const {
+            const unsigned char *bytes = (const unsigned char *)&key;
+            size_t h = 0xcbf29ce484222325ull;
+            for (size_t i = 0; i < sizeof(Key); ++i) h = (h ^ bytes[i]) * 0x100000001b3ull;
+            return h;
+        }
+    };
+
+    struct ProgramState {
+        GLint materialLocation = -1;
+        unsigned material = none;
+    };
+
+    struct Binding {
+        GLenum target;
+        GLuint texture;
+    };
+
+    std::vector<Material> materials;
+    std::unordered_map<Key, unsigned, KeyHash> ids;
+    std::unordered_map<GLuint, ProgramState> programs;
+    GLuint buffer = 0;
+    GLuint sampler = 0; // shared by every slot
+    Binding bound[Material::SlotCount] = {};
+    GLuint boundProgram = 0;
+    bool dirty = false;
+
+    MaterialLibrary() = default;
+
+    static Key makeKey(const Material &material) {
+        Key key;
+        memset(&key, 0, sizeof(key)); // padding takes part in the comparison
+        for (unsigned slot = 0; slot < Material::SlotCount; ++slot) {
+            key.textures[slot] = material.Slots[slot].Texture.get();
+            key.arrays[slot] = material.Slots[slot].Packed.array;
+            key.layers[slot] = material.Slots[slot].Packed.layer;
+            key.uv[slot] = material.Slots[slot].Packed.uvTransform;
+        }
+        key.shininess = material.Shininess;
+        return key;
+    }
+
+    void upload() {
+        std::vector<MaterialData> data(maxMaterials);
+        for (size_t i = 0; i < materials.size(); ++i) {
+            const Material &m = materials[i];
+            data[i].diffuseUV = m.Slots[Material::Diffuse].Packed.uvTransform;
+            data[i].specularUV = m.Slots[Material::Specular].Packed.uvTransform;
+            data[i].diffuseLayer = (float)m.Slots[Material::Diffuse].Packed.layer;
+            data[i].specularLayer = (float)m.Slots[Material::Specular].Packed.layer;
+            data[i].shininess = m.Shininess;
+        }
+        if (!buffer) {
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(MaterialData) * maxMaterials, NULL, GL_STATIC_DRAW);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(MaterialData) * materials.size(), data.data());
+        glBindBufferBase(GL_UNIFORM_BUFFER, uniformBinding, buffer);
+        dirty = false;
+    }
+
+    // one time setup of a program: sampler units, block binding, uniform
+    // location and the sampler objects on our units
+    ProgramState &prepare(GLuint program) {
+        auto it = programs.find(program);
+        if (it != programs.end()) {
+            return it->second;
+        }
+
+        if (!sampler) {
+            glGenSamplers(1, &sampler);
+            glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+        // atlas entries are surrounded by gutters, so repeat is fine for
+        // packed textures too
+        for (GLuint unit = 0; unit < Material::SlotCount; ++unit) {
+            glBindSampler(unit, sampler);
+        }
+
+        GLint previous;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "texture_diffuse1"), Material::Diffuse);
+        glUniform1i(glGetUniformLocation(program, "texture_specular1"), Material::Specular);
+        GLuint block = glGetUniformBlockIndex(program, "Materials");
+        if (block != GL_INVALID_INDEX) {
+            glUniformBlockBinding(program, block, uniformBinding);
+        } else {
+            std::cerr << "ERROR: program " << program << " has no Materials uniform block" << std::endl;
+        }
+        glUseProgram((GLuint)previous);
+
+        ProgramState &state = programs[program];
+        state.materialLocation = glGetUniformLocation(program, "materialID");
+        return state;
+    }
+};
+
+#endif
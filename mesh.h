@@ -9,60 +9,515 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
 #include <vector>
 
+#include "animation.h"
+#include "command_buffer.h"
+#include "material.h"
 #include "shader.h"
+#include "texture_cache.h"
+#include "vertex_animation.h"
+#include "vertex_convert.h"
 
 using std::string, std::vector;
 
-struct Vertex {
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 TexCoords;
-};
-
 struct Texture {
-    unsigned ID;
+    TextureHandle Handle;
     string Type;
     string Path;
 };
 
-class Mesh {
+// a vertex attribute already in a GL buffer, in any layout
+// glVertexAttribPointer takes; `data` is the same bytes in memory, read for
+// the bounds. Without a buffer the attribute stays disabled and reads 0.
+struct VertexStream {
+    GLuint buffer = 0;
+    size_t offset = 0;
+    GLsizei stride = 0;
+    GLint components = 0;
+    GLenum type = GL_FLOAT;
+    GLboolean normalized = GL_FALSE;
+    const unsigned char *data = nullptr;
+};
+
+// indices in a GL buffer: `count` GL_UNSIGNED_BYTE, _SHORT or _INT
+struct IndexStream {
+    GLuint buffer = 0;
+    size_t offset = 0;
+    GLenum type = GL_UNSIGNED_INT;
+    size_t count = 0;
+    const unsigned char *data = nullptr;
+};
+
+// The GL objects of a Mesh: deleted with it, and handed over when it is
+// moved, leaving zeros behind. 0 is no object.
+class MeshGLObjects {
+public:
+    MeshGLObjects() = default;
+    MeshGLObjects(MeshGLObjects &&other) noexcept { take(other); }
+    MeshGLObjects &operator=(MeshGLObjects &&other) noexcept {
+        if (this != &other) {
+            release();
+            take(other);
+        }
+        return *this;
+    }
+    MeshGLObjects(const MeshGLObjects &) = delete;
+    MeshGLObjects &operator=(const MeshGLObjects &) = delete;
+    ~MeshGLObjects() { release(); }
+
+protected:
+    unsigned VAO = 0, VBO = 0, EBO = 0;
+    bool ownsEBO = true; // false for an index buffer of the model's
+    unsigned instanceVBO = 0;
+    unsigned skinVBO = 0;
+    unsigned boneBuffer = 0, boneTexture = 0;
+    unsigned vatTextures[2] = {0, 0};
+
+private:
+    void release() {
+        // objects outliving the context went with it
+        if (!glfwGetCurrentContext()) {
+            return;
+        }
+        if (VAO) glDeleteVertexArrays(1, &VAO);
+        const GLuint buffers[] = {VBO, ownsEBO ? EBO : 0, instanceVBO, skinVBO, boneBuffer};
+        glDeleteBuffers(5, buffers);
+        const GLuint textures[] = {boneTexture, vatTextures[0], vatTextures[1]};
+        glDeleteTextures(3, textures);
+    }
+
+    void take(MeshGLObjects &other) {
+        VAO = std::exchange(other.VAO, 0u);
+        VBO = std::exchange(other.VBO, 0u);
+        EBO = std::exchange(other.EBO, 0u);
+        ownsEBO = other.ownsEBO;
+        instanceVBO = std::exchange(other.instanceVBO, 0u);
+        skinVBO = std::exchange(other.skinVBO, 0u);
+        boneBuffer = std::exchange(other.boneBuffer, 0u);
+        boneTexture = std::exchange(other.boneTexture, 0u);
+        vatTextures[0] = std::exchange(other.vatTextures[0], 0u);
+        vatTextures[1] = std::exchange(other.vatTextures[1], 0u);
+    }
+};
+
+class Mesh : private MeshGLObjects {
 public:
     vector<Vertex> vertices;
     vector<Texture> textures;
     vector<unsigned> indices;
 
-    Mesh(const vector<Vertex> &vertices, const vector<Texture> &textures, const vector<unsigned> &indices) : vertices(vertices), textures(textures), indices(indices) {
+    // bounding sphere in model space
+    glm::vec3 boundsCenter = glm::vec3(0.f);
+    float boundsRadius = 0.f;
+    // texture coordinate units per model space unit, averaged over the surface
+    float uvDensity = 0.f;
+    // texture coordinates leave [0, 1], so textures repeat across the mesh
+    bool uvTiles = false;
+
+    // material constants; textures come from `textures`
+    float shininess = 32.f;
+    // MaterialLibrary ID, resolved from textures on first draw unless the
+    // owner assigned one
+    unsigned materialID = MaterialLibrary::none;
+
+    // bones and per vertex weights when the mesh is skinned; set with setSkin
+    Skin skin;
+
+    Mesh(vector<Vertex> vertices, vector<Texture> textures, vector<unsigned> indices)
+        : vertices(std::move(vertices)), textures(std::move(textures)), indices(std::move(indices)) {
+        vertexCount = this->vertices.size();
+        indexCount = (GLsizei)this->indices.size();
+        computeBounds(
+            vertexCount, this->indices.size(), [this](size_t i) { return this->vertices[i].Position; },
+            [this](size_t i) { return this->vertices[i].TexCoords; }, [this](size_t k) { return this->indices[k]; });
         setUp();
     }
 
-    void Draw(Shader &shader) {
-        unsigned nDiffuse = 1;
-        unsigned nSpecular = 1;
+    // a mesh drawn straight from buffers that already hold its attributes,
+    // e.g. uploaded from a file's bytes; `vertices` and `indices` stay
+    // empty. Positions must be float vec3s. Without an index buffer the
+    // vertices are drawn in order.
+    Mesh(size_t vertexCount, const VertexStream &position, const VertexStream &normal, const VertexStream &texCoords,
+         const IndexStream &indexStream, vector<Texture> textures)
+        : textures(std::move(textures)), vertexCount(vertexCount) {
+        if (!indexStream.buffer) {
+            indices.resize(vertexCount);
+            for (size_t i = 0; i < vertexCount; ++i) indices[i] = (unsigned)i;
+        }
+        const IndexStream ordered = {0, 0, GL_UNSIGNED_INT, indices.size(), (const unsigned char *)indices.data()};
+        const IndexStream &index = indexStream.buffer ? indexStream : ordered;
+        indexCount = (GLsizei)index.count;
+        indexType = index.type;
+        indexOffset = index.offset;
+        computeBounds(
+            vertexCount, index.count, [&](size_t i) { return readPosition(position, i); },
+            [&](size_t i) { return readTexCoords(texCoords, i); }, [&](size_t k) { return readIndex(index, k); });
+        setUp(position, normal, texCoords, indexStream.buffer);
+    }
+
+    // owns its GL objects (see MeshGLObjects), so it can be moved but not
+    // copied; index buffers passed in stay with the caller
+    Mesh(Mesh &&) = default;
+    Mesh &operator=(Mesh &&) = default;
+    Mesh(const Mesh &) = delete;
+    Mesh &operator=(const Mesh &) = delete;
 
-        for (int i = 0; i < textures.size(); ++i) {
-            glActiveTexture(GL_TEXTURE0 + i);
+    // tell the texture cache how much detail this mesh needs from its
+    // textures when drawn with `model` (for mip streaming)
+    void requestTextureDetail(const glm::mat4 &model, const glm::vec3 &cameraPos, float fovY, int viewportHeight) const {
+        float scale = std::max(glm::length(glm::vec3(model[0])),
+                               std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        glm::vec3 center = glm::vec3(model * glm::vec4(boundsCenter, 1.f));
+        float distance = glm::length(cameraPos - center) - boundsRadius * scale;
+        for (const Texture &texture : textures) {
+            TextureCache::instance().requestFootprint(texture.Handle, uvDensity / scale, distance, fovY, viewportHeight);
+        }
+    }
 
-            string number; 
-            string name = textures[i].Type;
-            if (name == "texture_diffuse") {
-                number = std::to_string(nDiffuse++);
-            } else if (name == "texture_specular") {
-                number = std::to_string(nSpecular++);
+    // first diffuse and first specular texture plus shininess
+    Material buildMaterial() const {
+        Material material;
+        material.Shininess = shininess;
+        bool hasDiffuse = false, hasSpecular = false;
+        for (const Texture &texture : textures) {
+            if (texture.Type == "texture_diffuse" && !hasDiffuse) {
+                material.Slots[Material::Diffuse].Texture = texture.Handle;
+                hasDiffuse = true;
+            } else if (texture.Type == "texture_specular" && !hasSpecular) {
+                material.Slots[Material::Specular].Texture = texture.Handle;
+                hasSpecular = true;
             }
+        }
+        return material;
+    }
+
+    // bone indices go to attribute location 10, weights to 11
+    void setSkin(Skin skin) {
+        this->skin = std::move(skin);
+        if (this->skin.Weights.size() != vertexCount) {
+            std::cerr << "ERROR: " << this->skin.Weights.size() << " skin weights for " << vertexCount << " vertices" << std::endl;
+            this->skin = Skin();
+            return;
+        }
+        glBindVertexArray(VAO);
+        if (!skinVBO) {
+            glGenBuffers(1, &skinVBO);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, skinVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(batch::SkinWeights) * vertexCount, this->skin.Weights.data(), GL_STATIC_DRAW);
+        glVertexAttribIPointer(10, 4, GL_UNSIGNED_BYTE, sizeof(batch::SkinWeights), (void*)offsetof(batch::SkinWeights, Bones));
+        glEnableVertexAttribArray(10);
+        glVertexAttribPointer(11, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(batch::SkinWeights), (void*)offsetof(batch::SkinWeights, Weights));
+        glEnableVertexAttribArray(11);
+        glBindVertexArray(0);
+    }
 
-            shader.setInt((name + number).c_str(), i);
-            glBindTexture(GL_TEXTURE_2D, textures[i].ID);
+    // bone matrices for the next draws, as from Skin::computePalette. They
+    // go to a texture buffer, three RGBA32F texels per bone, read by the
+    // vertex shader's `bones` sampler on texture unit boneTextureUnit.
+    void setBonePalette(const glm::mat3x4 *palette, size_t count) {
+        if (!boneTexture) {
+            glGenBuffers(1, &boneBuffer);
+            glGenTextures(1, &boneTexture);
         }
+        glBindBuffer(GL_TEXTURE_BUFFER, boneBuffer);
+        // orphaned like the instance buffer
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::mat3x4) * count, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(glm::mat3x4) * count, palette);
+        glBindTexture(GL_TEXTURE_BUFFER, boneTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, boneBuffer);
+    }
 
+    // vertex animation textures, drawn by shaders built with
+    // VERTEX_ANIMATION in place of the mesh's own vertices
+    void setVertexAnimation(const VertexAnimation &animation) {
+        if (animation.VertexCount != vertexCount) {
+            std::cerr << "ERROR: vertex animation of " << animation.VertexCount << " vertices for " << vertexCount << std::endl;
+            return;
+        }
+        if (!vatTextures[0]) {
+            glGenTextures(2, vatTextures);
+        }
+        const vector<uint16_t> *data[2] = {&animation.Positions, &animation.Normals};
+        for (int i = 0; i < 2; ++i) {
+            glBindTexture(GL_TEXTURE_2D, vatTextures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, animation.Width, animation.Height, 0, GL_RGBA, GL_HALF_FLOAT, data[i]->data());
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        vatFrames = animation.FrameCount;
+        vatFrameRate = animation.FrameRate;
+    }
+
+    bool vertexAnimated() const { return vatFrames > 0; }
+
+    // one instanced draw call of `count` instances; their model matrices go
+    // to attribute locations 3 to 6, normal matrices (3x4, see
+    // batch::normalMatrices) to 7 to 9 and, for vertex animation, the
+    // seconds each instance is ahead of the shader's vatTime to 12
+    void Draw(Shader &shader, const glm::mat4 *models, const glm::mat3x4 *normals, GLsizei count, const float *timeOffsets = nullptr) {
+        if (count == 0) {
+            return;
+        }
+        bindDrawState(shader);
+
+        // models, then normal matrices. Orphan the old contents rather than
+        // wait for draws still reading them.
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        if (count > instanceCapacity) {
+            instanceCapacity = std::max(count, instanceCapacity * 2);
+        }
+        const size_t normalsOffset = sizeof(glm::mat4) * instanceCapacity;
+        const size_t timesOffset = normalsOffset + sizeof(glm::mat3x4) * instanceCapacity;
+        glBufferData(GL_ARRAY_BUFFER, timesOffset + sizeof(float) * instanceCapacity, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::mat4) * count, models);
+        glBufferSubData(GL_ARRAY_BUFFER, normalsOffset, sizeof(glm::mat3x4) * count, normals);
+        if (timeOffsets) {
+            glBufferSubData(GL_ARRAY_BUFFER, timesOffset, sizeof(float) * count, timeOffsets);
+        }
+        pointInstanceAttributes(instanceVBO, 0, normalsOffset, timeOffsets ? timesOffset : 0);
+
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, indexType, (void*)indexOffset, count);
+        glBindVertexArray(0);
+    }
+
+    // instance data already in `buffer` (e.g. a DynamicBuffer) from
+    // `offset`: `count` models, then as many normal matrices and, when
+    // hasTimes, time offsets
+    void Draw(Shader &shader, GLuint buffer, size_t offset, GLsizei count, bool hasTimes) {
+        if (count == 0) {
+            return;
+        }
+        bindDrawState(shader);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        const size_t normalsOffset = offset + sizeof(glm::mat4) * count;
+        const size_t timesOffset = normalsOffset + sizeof(glm::mat3x4) * count;
+        pointInstanceAttributes(buffer, offset, normalsOffset, hasTimes ? timesOffset : 0);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, indexType, (void*)indexOffset, count);
         glBindVertexArray(0);
     }
 
+    // Draw() at replay of `commands`, with `palette` uploaded first for
+    // skinned meshes. Nothing is copied: every array must stay valid until
+    // then, e.g. by living in the buffer's arena.
+    void record(CommandBuffer &commands, Shader &shader, unsigned pass, const glm::mat4 *models,
+                const glm::mat3x4 *normals, GLsizei count, const float *timeOffsets = nullptr,
+                const glm::mat3x4 *palette = nullptr, size_t paletteSize = 0) {
+        if (count == 0) {
+            return;
+        }
+        const unsigned material = materialID == MaterialLibrary::none ? 0 : materialID + 1;
+        commands.record(commandKey(pass, shader.ID, material),
+                        [mesh = this, shader = &shader, models, normals, count, timeOffsets, palette, paletteSize](ReplayState &state) {
+                            state.useProgram(shader->ID);
+                            if (palette) {
+                                mesh->setBonePalette(palette, paletteSize);
+                            }
+                            mesh->Draw(*shader, models, normals, count, timeOffsets);
+                            state.vertexArray = 0; // Draw() unbinds it
+                        });
+    }
+
+    // the same for instance data already in `buffer`, laid out as Draw()
+    // reads it
+    void record(CommandBuffer &commands, Shader &shader, unsigned pass, GLuint buffer, size_t offset,
+                GLsizei count, bool hasTimes, const glm::mat3x4 *palette = nullptr, size_t paletteSize = 0) {
+        if (count == 0) {
+            return;
+        }
+        const unsigned material = materialID == MaterialLibrary::none ? 0 : materialID + 1;
+        commands.record(commandKey(pass, shader.ID, material),
+                        [mesh = this, shader = &shader, buffer, offset, count, hasTimes, palette, paletteSize](ReplayState &state) {
+                            state.useProgram(shader->ID);
+                            if (palette) {
+                                mesh->setBonePalette(palette, paletteSize);
+                            }
+                            mesh->Draw(*shader, buffer, offset, count, hasTimes);
+                            state.vertexArray = 0;
+                        });
+    }
+
+    // after the material slots
+    static constexpr GLint boneTextureUnit = Material::SlotCount;
+    static constexpr GLint vatTextureUnit = boneTextureUnit + 1; // positions, then normals
+
 private:
-    unsigned VAO, VBO, EBO;
+    size_t vertexCount = 0;
+    GLsizei indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    size_t indexOffset = 0; // into EBO
+    GLsizei instanceCapacity = 0;
+    struct InstanceSource {
+        GLuint buffer;
+        size_t models, normals, times;
+    } instanceSource = {0, 0, 0, 0}; // where the instance attributes point
+    uint32_t vatFrames = 0;
+    float vatFrameRate = 0.f;
+    // uniform locations in the program drawn with last
+    GLuint locationsProgram = 0;
+    GLint skinnedLocation = -1, vertexAnimatedLocation = -1;
+    GLint vatFramesLocation = -1, vatFrameRateLocation = -1, vatVerticesLocation = -1;
+
+    // with the VAO and `buffer` bound; re-pointed only when the source
+    // moves. timesOffset 0 leaves the time attribute disabled, reading its
+    // default 0.
+    void pointInstanceAttributes(GLuint buffer, size_t modelsOffset, size_t normalsOffset, size_t timesOffset) {
+        if (buffer != instanceSource.buffer || modelsOffset != instanceSource.models || normalsOffset != instanceSource.normals) {
+            for (unsigned i = 0; i < 4; ++i) {
+                glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(modelsOffset + sizeof(glm::vec4) * i));
+                glEnableVertexAttribArray(3 + i);
+                glVertexAttribDivisor(3 + i, 1);
+            }
+            for (unsigned i = 0; i < 3; ++i) {
+                glVertexAttribPointer(7 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat3x4), (void*)(normalsOffset + sizeof(glm::vec4) * i));
+                glEnableVertexAttribArray(7 + i);
+                glVertexAttribDivisor(7 + i, 1);
+            }
+            glVertexAttribDivisor(12, 1);
+        }
+        if (timesOffset) {
+            if (buffer != instanceSource.buffer || timesOffset != instanceSource.times) {
+                glVertexAttribPointer(12, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)timesOffset);
+            }
+            glEnableVertexAttribArray(12);
+        } else {
+            glDisableVertexAttribArray(12);
+        }
+        // attribute 12 keeps pointing at the old times while disabled, as
+        // long as the buffer stays the same
+        const size_t times = timesOffset ? timesOffset : buffer == instanceSource.buffer ? instanceSource.times : 0;
+        instanceSource = {buffer, modelsOffset, normalsOffset, times};
+    }
+
+    // material, bones and vertex animation of the current program
+    void bindDrawState(Shader &shader) {
+        MaterialLibrary &library = MaterialLibrary::instance();
+        if (materialID == MaterialLibrary::none) {
+            materialID = library.add(buildMaterial());
+        }
+        library.bind(materialID, shader.ID);
+
+        // `skinned` and `vertexAnimated` are per program, so every mesh sets
+        // them; -1 locations (shaders without either) ignore the calls
+        if (locationsProgram != shader.ID) {
+            locationsProgram = shader.ID;
+            skinnedLocation = glGetUniformLocation(shader.ID, "skinned");
+            vertexAnimatedLocation = glGetUniformLocation(shader.ID, "vertexAnimated");
+            vatFramesLocation = glGetUniformLocation(shader.ID, "vatFrames");
+            vatFrameRateLocation = glGetUniformLocation(shader.ID, "vatFrameRate");
+            vatVerticesLocation = glGetUniformLocation(shader.ID, "vatVertices");
+            glUniform1i(glGetUniformLocation(shader.ID, "bones"), boneTextureUnit);
+            glUniform1i(glGetUniformLocation(shader.ID, "vatPositions"), vatTextureUnit);
+            glUniform1i(glGetUniformLocation(shader.ID, "vatNormals"), vatTextureUnit + 1);
+        }
+        const bool skinned = !skin.empty() && boneTexture;
+        glUniform1i(skinnedLocation, skinned);
+        if (skinned) {
+            glActiveTexture(GL_TEXTURE0 + boneTextureUnit);
+            glBindTexture(GL_TEXTURE_BUFFER, boneTexture);
+            glActiveTexture(GL_TEXTURE0);
+        }
+        const bool animated = vertexAnimated() && vertexAnimatedLocation != -1;
+        glUniform1i(vertexAnimatedLocation, animated);
+        if (animated) {
+            glUniform1i(vatFramesLocation, (GLint)vatFrames);
+            glUniform1f(vatFrameRateLocation, vatFrameRate);
+            glUniform1i(vatVerticesLocation, (GLint)vertexCount);
+            for (int i = 0; i < 2; ++i) {
+                glActiveTexture(GL_TEXTURE0 + vatTextureUnit + i);
+                glBindTexture(GL_TEXTURE_2D, vatTextures[i]);
+            }
+            glActiveTexture(GL_TEXTURE0);
+        }
+    }
+
+    // PackedVertex on the GPU, unless the texture coordinates tile (unorm16
+    // can't hold them) or LEARNOPENGL_VERTEX_FORMAT=float asks for full
+    // precision
+    bool packVertices() const {
+        static const bool allowed = [] {
+            const char *format = getenv("LEARNOPENGL_VERTEX_FORMAT");
+            return !(format && std::string(format) == "float");
+        }();
+        return allowed && !uvTiles;
+    }
+
+    // from the positions, texture coordinates and indices however they're
+    // stored, as position(i), texCoords(i) and index(k)
+    template <typename Position, typename TexCoords, typename Index>
+    void computeBounds(size_t vertexCount, size_t indexCount, Position position, TexCoords texCoords, Index index) {
+        if (vertexCount == 0) {
+            return;
+        }
+        glm::vec3 lo = position(0), hi = lo;
+        for (size_t i = 0; i < vertexCount; ++i) {
+            const glm::vec3 p = position(i);
+            const glm::vec2 uv = texCoords(i);
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+            uvTiles |= uv.x < -1e-3f || uv.x > 1.001f || uv.y < -1e-3f || uv.y > 1.001f;
+        }
+        boundsCenter = (lo + hi) * 0.5f;
+        for (size_t i = 0; i < vertexCount; ++i) {
+            boundsRadius = std::max(boundsRadius, glm::length(position(i) - boundsCenter));
+        }
+
+        double uvArea = 0.0, area = 0.0;
+        for (size_t k = 0; k + 2 < indexCount; k += 3) {
+            const unsigned a = index(k), b = index(k + 1), c = index(k + 2);
+            if (a >= vertexCount || b >= vertexCount || c >= vertexCount) {
+                continue;
+            }
+            const glm::vec3 pa = position(a);
+            area += glm::length(glm::cross(position(b) - pa, position(c) - pa));
+            const glm::vec2 ta = texCoords(a), e1 = texCoords(b) - ta, e2 = texCoords(c) - ta;
+            uvArea += std::abs(e1.x * e2.y - e1.y * e2.x);
+        }
+        uvDensity = area > 0.0 ? (float)std::sqrt(uvArea / area) : 0.f;
+    }
+
+    static glm::vec3 readPosition(const VertexStream &stream, size_t i) {
+        glm::vec3 p;
+        memcpy(&p, stream.data + stream.stride * i, sizeof(p));
+        return p;
+    }
+
+    // float, or normalized integers as GL reads them
+    static glm::vec2 readTexCoords(const VertexStream &stream, size_t i) {
+        if (!stream.data) {
+            return glm::vec2(0.f);
+        }
+        const unsigned char *p = stream.data + stream.stride * i;
+        float uv[2];
+        for (int c = 0; c < 2; ++c) {
+            switch (stream.type) {
+                case GL_UNSIGNED_BYTE: uv[c] = p[c] / 255.f; break;
+                case GL_BYTE: uv[c] = std::max(-1.f, (int8_t)p[c] / 127.f); break;
+                case GL_UNSIGNED_SHORT: { uint16_t v; memcpy(&v, p + 2 * c, 2); uv[c] = v / 65535.f; break; }
+                case GL_SHORT: { int16_t v; memcpy(&v, p + 2 * c, 2); uv[c] = std::max(-1.f, v / 32767.f); break; }
+                default: memcpy(&uv[c], p + 4 * c, 4); break;
+            }
+        }
+        return glm::vec2(uv[0], uv[1]);
+    }
+
+    static unsigned readIndex(const IndexStream &stream, size_t k) {
+        switch (stream.type) {
+            case GL_UNSIGNED_BYTE: return stream.data[k];
+            case GL_UNSIGNED_SHORT: { uint16_t v; memcpy(&v, stream.data + 2 * k, 2); return v; }
+            default: { uint32_t v; memcpy(&v, stream.data + 4 * k, 4); return v; }
+        }
+    }
+
     void setUp() {
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
@@ -70,23 +525,74 @@ private:
 
         glBindVertexArray(VAO);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned) * indices.size(), &indices[0], GL_STATIC_DRAW);
-
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position));
+        if (packVertices()) {
+            // quantized straight into the buffer
+            const size_t bytes = sizeof(PackedVertex) * vertices.size();
+            glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STATIC_DRAW);
+            void *mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            bool written = false;
+            if (mapped) {
+                batch::packVertices(vertices.data(), vertices.size(), (PackedVertex *)mapped);
+                written = glUnmapBuffer(GL_ARRAY_BUFFER);
+            }
+            if (!written) {
+                vector<PackedVertex> packed(vertices.size());
+                batch::packVertices(vertices.data(), vertices.size(), packed.data());
+                glBufferData(GL_ARRAY_BUFFER, bytes, packed.data(), GL_STATIC_DRAW);
+            }
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+            glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+            glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+        } else {
+            glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position));
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        }
         glEnableVertexAttribArray(0);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
         glEnableVertexAttribArray(1);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
         glEnableVertexAttribArray(2);
 
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned) * indices.size(), indices.data(), GL_STATIC_DRAW);
+
+        // attributes are set up on the first draw, when the size is known
+        glGenBuffers(1, &instanceVBO);
+
         // glBindVertexArray(0);
         // glBindBuffer(GL_ARRAY_BUFFER, 0);
         // glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     }
-};
 
-#endif
+    // the attributes as they are in the streams' buffers; `indexBuffer` 0
+    // uploads `indices`
+    void setUp(const VertexStream &position, const VertexStream &normal, const VertexStream &texCoords, GLuint indexBuffer) {
+        glGenVertexArrays(1, &VAO);
+        glBindVertexArray(VAO);
+        const VertexStream *streams[3] = {&position, &normal, &texCoords};
+        for (GLuint location = 0; location < 3; ++location) {
+            const VertexStream &stream = *streams[location];
+            if (!stream.buffer) {
+                continue;
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+            glVertexAttribPointer(location, stream.components, stream.type, stream.normalized, stream.stride, (void*)stream.offset);
+            glEnableVertexAttribArray(location);
+        }
+
+        EBO = indexBuffer;
+        ownsEBO = !indexBuffer;
+        if (!EBO) {
+            glGenBuffers(1, &EBO);
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        if (!indexBuffer) {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned) * indices.size(), indices.data(), GL_STATIC_DRAW);
+        }
+
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(0);
+    }
+};
 
+#endif
\ No newline at end of file
@@ -0,0 +1,317 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIPMAP_SSE2 1
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#define MIPMAP_AVX 1
+#endif
+
+#include "parallel.h"
+
+// CPU mip chain generation, so mips can be baked into texture caches instead
+// of calling glGenerateMipmap on every launch.
+//
+// Levels are filtered in linear float RGBA (sRGB color channels are decoded
+// first) and each level is built from the float version of the previous one,
+// so 8-bit rounding never accumulates down the chain. Filters are separable:
+// a 2 tap box or a 6 tap Kaiser windowed sinc, which keeps the lower mips
+// noticeably sharper. Rows of a level are filtered in parallel; the column
+// pass uses AVX / SSE2 over whole rows and the row pass one texel per
+// SSE register.
+//
+// Alpha tested textures lose coverage as their mips blur the alpha channel,
+// so foliage thins out with distance. With an alpha cutoff set, every level's
+// alpha is rescaled to keep the fraction of texels passing the test equal to
+// the top level's.
+
+struct MipLevel {
+    int width = 0, height = 0;
+    std::vector<unsigned char> pixels; // tightly packed, `channels` bytes per texel
+};
+
+enum class MipFilter { Box, Kaiser };
+
+struct MipOptions {
+    MipFilter filter = MipFilter::Kaiser;
+    bool srgb = false;       // color channels are sRGB encoded
+    int alphaChannel = -1;   // channel holding alpha, -1 for none
+    float alphaCutoff = 0.f; // alpha test reference to preserve coverage for, 0 to disable
+};
+
+inline const char *mipFilterName(MipFilter filter) {
+    return filter == MipFilter::Box ? "box" : "kaiser";
+}
+
+namespace mip {
+
+// 4 floats per texel whatever the channel count, so every texel is one SSE
+// register
+struct FloatImage {
+    int width = 0, height = 0;
+    std::vector<float> texels;
+};
+
+inline const float *srgbToLinearTable() {
+    static const std::vector<float> table = [] {
+        std::vector<float> t(256);
+        for (int i = 0; i < 256; ++i) {
+            float c = i / 255.f;
+            t[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+// fine enough that the steepest part of the curve (near black) still
+// resolves every 8-bit step
+constexpr int linearTableSize = 16384;
+
+inline const uint8_t *linearToSRGBTable() {
+    static const std::vector<uint8_t> table = [] {
+        std::vector<uint8_t> t(linearTableSize);
+        for (int i = 0; i < linearTableSize; ++i) {
+            float c = (float)i / (linearTableSize - 1);
+            float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+            t[i] = (uint8_t)std::lround(std::min(1.f, std::max(0.f, s)) * 255.f);
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+inline bool isColorChannel(const MipOptions &options, int channel) {
+    return options.srgb && channel != options.alphaChannel;
+}
+
+inline FloatImage toFloat(const unsigned char *pixels, int width, int height, int channels, const MipOptions &options) {
+    FloatImage image;
+    image.width = width;
+    image.height = height;
+    image.texels.assign((size_t)width * height * 4, 0.f);
+    const float *toLinear = srgbToLinearTable();
+    parallelFor(height, 16, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            const unsigned char *src = pixels + y * width * channels;
+            float *dst = image.texels.data() + y * width * 4;
+            for (int x = 0; x < width; ++x) {
+                for (int c = 0; c < channels; ++c) {
+                    unsigned char v = src[x * channels + c];
+                    dst[x * 4 + c] = isColorChannel(options, c) ? toLinear[v] : v / 255.f;
+                }
+            }
+        }
+    });
+    return image;
+}
+
+inline MipLevel toBytes(const FloatImage &image, int channels, const MipOptions &options, float alphaScale = 1.f) {
+    MipLevel level;
+    level.width = image.width;
+    level.height = image.height;
+    level.pixels.resize((size_t)image.width * image.height * channels);
+    const uint8_t *toSRGB = linearToSRGBTable();
+    parallelFor(image.height, 16, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            const float *src = image.texels.data() + y * image.width * 4;
+            unsigned char *dst = level.pixels.data() + y * image.width * channels;
+            for (int x = 0; x < image.width; ++x) {
+                for (int c = 0; c < channels; ++c) {
+                    float v = src[x * 4 + c];
+                    if (c == options.alphaChannel) {
+                        v *= alphaScale;
+                    }
+                    v = std::min(1.f, std::max(0.f, v));
+                    dst[x * channels + c] = isColorChannel(options, c)
+                        ? toSRGB[(int)(v * (linearTableSize - 1) + 0.5f)]
+                        : (unsigned char)(v * 255.f + 0.5f);
+                }
+            }
+        }
+    });
+    return level;
+}
+
+// Taps for halving: destination texel x covers source texels 2x and 2x + 1,
+// tap k reads source texel 2x + first + k.
+struct Kernel {
+    int first = 0, count = 0;
+    float weights[6] = {};
+};
+
+inline Kernel makeKernel(MipFilter filter) {
+    Kernel kernel;
+    if (filter == MipFilter::Box) {
+        kernel.first = 0;
+        kernel.count = 2;
+        kernel.weights[0] = kernel.weights[1] = 0.5f;
+        return kernel;
+    }
+
+    // sinc at half the source rate, windowed by a Kaiser window three
+    // source texels wide on each side (alpha = 4)
+    auto besselI0 = [](double x) {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 20; ++k) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    };
+    const double alpha = 4.0, width = 3.0, pi = 3.14159265358979323846;
+    kernel.first = -2;
+    kernel.count = 6;
+    double total = 0.0;
+    for (int k = 0; k < 6; ++k) {
+        double d = (kernel.first + k) - 0.5; // distance from the destination center
+        double t = d / width;
+        double window = besselI0(alpha * std::sqrt(std::max(0.0, 1.0 - t * t))) / besselI0(alpha);
+        double x = pi * d / 2.0;
+        double sinc = std::sin(x) / x;
+        kernel.weights[k] = (float)(sinc * window);
+        total += kernel.weights[k];
+    }
+    for (int k = 0; k < 6; ++k) {
+        kernel.weights[k] = (float)(kernel.weights[k] / total);
+    }
+    return kernel;
+}
+
+// out[i] = sum of weights[k] * rows[k][i] over `count` floats
+inline void filterColumns(const float *const *rows, const float *weights, int taps, float *out, size_t count) {
+    size_t i = 0;
+#if MIPMAP_AVX
+    for (; i + 8 <= count; i += 8) {
+        __m256 acc = _mm256_setzero_ps();
+        for (int k = 0; k < taps; ++k) {
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + i)));
+        }
+        _mm256_storeu_ps(out + i, acc);
+    }
+#endif
+#if MIPMAP_SSE2
+    for (; i + 4 <= count; i += 4) {
+        __m128 acc = _mm_setzero_ps();
+        for (int k = 0; k < taps; ++k) {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+        }
+        _mm_storeu_ps(out + i, acc);
+    }
+#endif
+    for (; i < count; ++i) {
+        float acc = 0.f;
+        for (int k = 0; k < taps; ++k) {
+            acc += weights[k] * rows[k][i];
+        }
+        out[i] = acc;
+    }
+}
+
+// halves one row of RGBA float texels; results are clamped to [0, 1] so the
+// negative lobes of the Kaiser filter don't ring further down the chain
+inline void filterRow(const float *src, int srcWidth, const Kernel &kernel, float *out, int dstWidth) {
+    for (int x = 0; x < dstWidth; ++x) {
+        int base = 2 * x + kernel.first;
+#if MIPMAP_SSE2
+        __m128 acc = _mm_setzero_ps();
+        for (int k = 0; k < kernel.count; ++k) {
+            int sx = std::min(srcWidth - 1, std::max(0, base + k));
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(kernel.weights[k]), _mm_loadu_ps(src + sx * 4)));
+        }
+        acc = _mm_min_ps(_mm_set1_ps(1.f), _mm_max_ps(_mm_setzero_ps(), acc));
+        _mm_storeu_ps(out + x * 4, acc);
+#else
+        float acc[4] = {};
+        for (int k = 0; k < kernel.count; ++k) {
+            int sx = std::min(srcWidth - 1, std::max(0, base + k));
+            for (int c = 0; c < 4; ++c) {
+                acc[c] += kernel.weights[k] * src[sx * 4 + c];
+            }
+        }
+        for (int c = 0; c < 4; ++c) {
+            out[x * 4 + c] = std::min(1.f, std::max(0.f, acc[c]));
+        }
+#endif
+    }
+}
+
+inline FloatImage downsample(const FloatImage &src, const Kernel &kernel) {
+    FloatImage dst;
+    dst.width = std::max(1, src.width / 2);
+    dst.height = std::max(1, src.height / 2);
+    dst.texels.resize((size_t)dst.width * dst.height * 4);
+
+    parallelFor(dst.height, 8, [&](size_t begin, size_t end) {
+        std::vector<float> column((size_t)src.width * 4);
+        const float *rows[6];
+        for (size_t y = begin; y < end; ++y) {
+            int base = 2 * (int)y + kernel.first;
+            for (int k = 0; k < kernel.count; ++k) {
+                int sy = std::min(src.height - 1, std::max(0, base + k));
+                rows[k] = src.texels.data() + (size_t)sy * src.width * 4;
+            }
+            filterColumns(rows, kernel.weights, kernel.count, column.data(), column.size());
+            filterRow(column.data(), src.width, kernel, dst.texels.data() + y * dst.width * 4, dst.width);
+        }
+    });
+    return dst;
+}
+
+inline float alphaCoverage(const FloatImage &image, int alphaChannel, float cutoff, float scale) {
+    size_t passing = 0;
+    const size_t count = (size_t)image.width * image.height;
+    for (size_t i = 0; i < count; ++i) {
+        if (image.texels[i * 4 + alphaChannel] * scale > cutoff) {
+            ++passing;
+        }
+    }
+    return (float)passing / count;
+}
+
+// alpha scale that brings the coverage back to `target`
+inline float coverageScale(const FloatImage &image, int alphaChannel, float cutoff, float target) {
+    float lo = 0.f, hi = 4.f;
+    for (int i = 0; i < 12; ++i) {
+        float mid = 0.5f * (lo + hi);
+        if (alphaCoverage(image, alphaChannel, cutoff, mid) < target) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return 0.5f * (lo + hi);
+}
+
+} // namespace mip
+
+// full chain down to 1x1, level 0 being a copy of the input
+inline std::vector<MipLevel> buildMipChain(const unsigned char *pixels, int width, int height, int channels,
+                                           const MipOptions &options = MipOptions()) {
+    std::vector<MipLevel> levels(1);
+    levels[0].width = width;
+    levels[0].height = height;
+    levels[0].pixels.assign(pixels, pixels + (size_t)width * height * channels);
+
+    const bool coverage = options.alphaCutoff > 0.f && options.alphaChannel >= 0 && options.alphaChannel < channels;
+    const mip::Kernel kernel = mip::makeKernel(options.filter);
+    mip::FloatImage current = mip::toFloat(pixels, width, height, channels, options);
+    const float target = coverage ? mip::alphaCoverage(current, options.alphaChannel, options.alphaCutoff, 1.f) : 0.f;
+
+    while (current.width > 1 || current.height > 1) {
+        current = mip::downsample(current, kernel);
+        float scale = coverage ? mip::coverageScale(current, options.alphaChannel, options.alphaCutoff, target) : 1.f;
+        levels.push_back(mip::toBytes(current, channels, options, scale));
+    }
+    return levels;
+}
+
+#endif
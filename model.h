@@ -13,164 +13,638 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
-#include <unordered_map>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
 #include <filesystem>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
 namespace fs = std::filesystem;
 
-#include "mesh.h"
-
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-using std::cerr, std::endl, std::unordered_map;
+#include "allocation_tracker.h"
+#include "animation.h"
+#include "batch_math.h"
+#include "dynamic_buffer.h"
+#include "frame_arena.h"
+#include "gltf_loader.h"
+#include "mesh.h"
+#include "obj_loader.h"
+#include "scene_graph.h"
+
+using std::cerr, std::endl;
 
 static std::string getPath(const std::string& path) {
     fs::path fsPath(path);
     return fsPath.make_preferred().string();
 }
 
-unsigned loadTextureFromFile(const std::string &imagePath);
-
 class Model {
 public:
-    Model(const string &path) {
-        loadModel(path);
+    // packTextures moves all textures into a TexturePack; draw with a
+    // shader built with PACKED_TEXTURES then. Models loaded from the same
+    // path share their meshes and GPU buffers.
+    Model(const string &path, bool packTextures = false) {
+        std::weak_ptr<ModelData> &cached = loaded()[path + (packTextures ? "#packed" : "")];
+        data = cached.lock();
+        if (!data) {
+            data = std::make_shared<ModelData>();
+            loadModel(path);
+            if (packTextures) {
+                this->packTextures();
+            } else {
+                MaterialLibrary &library = MaterialLibrary::instance();
+                for (Mesh &mesh : data->meshes) {
+                    mesh.materialID = library.add(mesh.buildMaterial());
+                }
+            }
+            cached = data;
+        }
+        scene = data->scene;
+    }
+
+    // draws every mesh at `model` times the world matrix of each node
+    // referencing it
+    void Draw(Shader &shader, const glm::mat4 &model = glm::mat4(1.f)) { Draw(shader, &model, 1); }
+
+    // draws `count` copies of the model with one instanced call per mesh;
+    // skinned meshes are posed by the bones in `scene`, the same for every
+    // copy, unless they're vertex animated (see bakeVertexAnimation) and
+    // drawn with a VERTEX_ANIMATION shader: then copy m plays the baked
+    // clip timeOffsets[m] seconds ahead
+    void Draw(Shader &shader, const glm::mat4 *models, size_t count, const float *timeOffsets = nullptr) {
+        thread_local CommandBuffer commands;
+        record(commands, shader, models, count, timeOffsets);
+        DynamicBuffer::instance().flush();
+        MaterialLibrary::instance().resetBindings();
+        replayCommands(commands);
+        commands.clear();
     }
 
-    void Draw(Shader &shader) {
-        for (unsigned i = 0; i < meshes.size(); ++i) {
-            meshes[i].Draw(shader);
+    // what Draw() does, recorded into `commands` for replay on the GL
+    // thread: the instance data and bone palettes are prepared here, into
+    // the buffer's arena, or into this frame's DynamicBuffer region while
+    // one is open (flush() it before replaying). Different Models can
+    // record on different threads at once; replay after
+    // MaterialLibrary::resetBindings() if other code has bound textures
+    // since the last draw.
+    void record(CommandBuffer &commands, Shader &shader, const glm::mat4 *models, size_t count,
+                const float *timeOffsets = nullptr, unsigned pass = 0) {
+        scene.update();
+        for (unsigned i = 0; i < data->meshes.size(); ++i) {
+            Mesh &mesh = data->meshes[i];
+            const vector<SceneGraph::NodeId> &nodes = data->meshNodes[i];
+            const size_t instances = count * nodes.size();
+            if (instances == 0) {
+                continue;
+            }
+            glm::mat3x4 *palette = nullptr;
+            if (!mesh.skin.empty()) {
+                mesh.skin.computePalette(scene, scene.world(nodes[0]), bonePalette);
+                palette = commands.copy(bonePalette.data(), bonePalette.size());
+            }
+            // straight into this frame's DynamicBuffer region when there is
+            // one, else into the arena for Draw() to upload
+            const size_t bytes = (sizeof(glm::mat4) + sizeof(glm::mat3x4) + (timeOffsets ? sizeof(float) : 0)) * instances;
+            DynamicAllocation ring = DynamicBuffer::instance().allocate(bytes, 16);
+            glm::mat4 *instanceModels = (glm::mat4 *)commands.allocate(sizeof(glm::mat4) * instances);
+            glm::mat3x4 *instanceNormals = ring ? (glm::mat3x4 *)(ring.data + sizeof(glm::mat4) * instances)
+                                                : (glm::mat3x4 *)commands.allocate(sizeof(glm::mat3x4) * instances);
+            float *instanceTimes = nullptr;
+            if (timeOffsets) {
+                instanceTimes = ring ? (float *)(ring.data + (sizeof(glm::mat4) + sizeof(glm::mat3x4)) * instances)
+                                     : (float *)commands.allocate(sizeof(float) * instances);
+            }
+            size_t k = 0;
+            for (size_t m = 0; m < count; ++m) {
+                for (SceneGraph::NodeId node : nodes) {
+                    instanceModels[k] = models[m] * scene.world(node);
+                    if (timeOffsets) {
+                        instanceTimes[k] = timeOffsets[m];
+                    }
+                    ++k;
+                }
+            }
+            batch::normalMatrices(instanceModels, instanceNormals, instances);
+            if (ring) {
+                // the models are read back above, so they're built in cached
+                // memory and copied over once
+                memcpy(ring.data, instanceModels, sizeof(glm::mat4) * instances);
+                mesh.record(commands, shader, pass, ring.buffer, ring.offset, (GLsizei)instances, timeOffsets != nullptr,
+                            palette, bonePalette.size());
+            } else {
+                mesh.record(commands, shader, pass, instanceModels, instanceNormals, (GLsizei)instances, instanceTimes,
+                            palette, bonePalette.size());
+            }
         }
     }
 
+    // radius around the origin that holds every mesh in its bind pose
+    float boundsRadius() {
+        scene.update();
+        float radius = 0.f;
+        for (unsigned i = 0; i < data->meshes.size(); ++i) {
+            const Mesh &mesh = data->meshes[i];
+            for (SceneGraph::NodeId node : data->meshNodes[i]) {
+                const glm::mat4 &world = scene.world(node);
+                const float scale = std::max(glm::length(glm::vec3(world[0])),
+                                             std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+                radius = std::max(radius, glm::length(glm::vec3(world * glm::vec4(mesh.boundsCenter, 1.f))) + mesh.boundsRadius * scale);
+            }
+        }
+        return radius;
+    }
+
+    void requestTextureDetail(const glm::mat4 &model, const glm::vec3 &cameraPos, float fovY, int viewportHeight) {
+        scene.update();
+        for (unsigned i = 0; i < data->meshes.size(); ++i) {
+            for (SceneGraph::NodeId node : data->meshNodes[i]) {
+                data->meshes[i].requestTextureDetail(model * scene.world(node), cameraPos, fovY, viewportHeight);
+            }
+        }
+    }
+
+    // skeletal animations of the file, to play on `scene` with an Animator
+    const vector<AnimationClip> &animations() const { return data->animations; }
+
+    // bake animations()[clip] into vertex animation textures for every
+    // skinned mesh; shared by all Models of the file
+    void bakeVertexAnimation(size_t clip, float frameRate = 30.f) {
+        if (clip >= data->animations.size()) {
+            cerr << "ERROR: no animation " << clip << endl;
+            return;
+        }
+        vector<glm::vec3> positions, normals;
+        for (size_t i = 0; i < data->meshes.size(); ++i) {
+            Mesh &mesh = data->meshes[i];
+            if (mesh.skin.empty() || data->meshNodes[i].empty()) {
+                continue;
+            }
+            positions.resize(mesh.vertices.size());
+            normals.resize(mesh.vertices.size());
+            for (size_t v = 0; v < mesh.vertices.size(); ++v) {
+                positions[v] = mesh.vertices[v].Position;
+                normals[v] = mesh.vertices[v].Normal;
+            }
+            mesh.setVertexAnimation(::bakeVertexAnimation(data->scene, mesh.skin, data->meshNodes[i][0], positions.data(),
+                                                          normals.data(), positions.size(), data->animations[clip], frameRate));
+        }
+    }
+
+    // the aiNode hierarchy; nodes keep their names, so they can be found and
+    // animated with scene.find()
+    SceneGraph scene;
+
 private:
-    vector<Mesh> meshes;
-    string directory;
-    unordered_map<string, Texture> textures_loaded;
+    // what's shared between Models of the same file
+    struct ModelData {
+        vector<Mesh> meshes;                          // one per aiMesh, glTF primitive, or OBJ object and material
+        vector<vector<SceneGraph::NodeId>> meshNodes; // per mesh, the nodes it's placed at
+        SceneGraph scene;                             // as imported
+        vector<AnimationClip> animations;             // tracks resolved in scene
+        string directory;
+        std::unique_ptr<TexturePack> pack;
+        vector<GLuint> buffers; // glTF buffer views the meshes draw from
+
+        ~ModelData() {
+            // as Mesh, objects outliving the context went with it
+            if (!buffers.empty() && glfwGetCurrentContext()) {
+                glDeleteBuffers((GLsizei)buffers.size(), buffers.data());
+            }
+        }
+    };
+
+    std::shared_ptr<ModelData> data;
+    vector<glm::mat3x4> bonePalette;
+
+    static std::unordered_map<string, std::weak_ptr<ModelData>> &loaded() {
+        static std::unordered_map<string, std::weak_ptr<ModelData>> models;
+        return models;
+    }
+
+    void packTextures();
 
     void loadModel(const string &path);
-    void processNode(const aiNode *node, const aiScene *scene);
-    Mesh processMesh(const aiMesh *mesh, const aiScene *scene);
-    vector<Texture> loadMaterialTextures(const aiMaterial *mat, const aiTextureType type, const string &typeName);
+    bool loadObj(const string &path);
+    bool loadGltf(const string &path);
+    // `scratch` holds what only lives while the file is imported
+    void processNode(const aiNode *node, const aiScene *scene, SceneGraph::NodeId parent,
+                     std::pmr::unordered_map<unsigned, unsigned> &meshOf, LinearArena &scratch);
+    Mesh processMesh(const aiMesh *mesh, const aiScene *scene, LinearArena &scratch);
+    Skin processBones(const aiMesh *mesh, LinearArena &scratch);
+    void processAnimations(const aiScene *scene);
+    vector<Texture> loadMaterialTextures(const aiMaterial *mat, const aiTextureType type, const string &typeName, TextureUsage usage);
 };
 
 void Model::loadModel(const string &path) {
+    static const unsigned loaderAllocations = AllocationTracker::subsystem("loader");
+    AllocationScope allocationScope(loaderAllocations);
+    LinearArena scratch(1 << 20);
+
+    data->directory = path.substr(0, path.find_last_of("/\\"));
+    cerr << data->directory << endl;
+
+    // .obj and glTF files go through obj_loader.h and gltf_loader.h unless
+    // they can't read them or LEARNOPENGL_OBJ_LOADER / _GLTF_LOADER=assimp
+    const auto start = std::chrono::steady_clock::now();
+    auto loaded = [&](const char *loader) {
+        cerr << "loaded " << path << " with " << loader << " in "
+             << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << endl;
+    };
+    auto useNative = [](const char *variable) {
+        const char *loader = getenv(variable);
+        return !(loader && string(loader) == "assimp");
+    };
+    string extension = fs::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)tolower(c); });
+    if (extension == ".obj" && useNative("LEARNOPENGL_OBJ_LOADER") && loadObj(path)) {
+        loaded("obj_loader");
+        return;
+    }
+    if ((extension == ".glb" || extension == ".gltf") && useNative("LEARNOPENGL_GLTF_LOADER") && loadGltf(path)) {
+        loaded("gltf_loader");
+        return;
+    }
+
     Assimp::Importer import;
-    const aiScene *scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+    const aiScene *scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_LimitBoneWeights);
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
         cerr << "ERROR::ASSIMP::" << import.GetErrorString() << endl;
     }
 
-    directory = path.substr(0, path.find_last_of("/\\"));
-    cerr << directory << endl;
+    // decode every texture up front on the job system; processMesh() then
+    // finds them cached, `preloaded` keeping them from eviction until it has
+    vector<std::pair<string, TextureUsage>> textures;
+    for (unsigned i = 0; i < scene->mNumMaterials; ++i) {
+        for (auto [type, usage] : {std::pair(aiTextureType_DIFFUSE, TextureUsage::Color), std::pair(aiTextureType_SPECULAR, TextureUsage::Data)}) {
+            for (unsigned j = 0; j < scene->mMaterials[i]->GetTextureCount(type); ++j) {
+                aiString str;
+                scene->mMaterials[i]->GetTexture(type, j, &str);
+                textures.emplace_back(getPath(data->directory + "/" + str.data), usage);
+            }
+        }
+    }
+    vector<TextureHandle> preloaded = TextureCache::instance().preload(textures);
+
+    data->meshes.reserve(scene->mNumMeshes);
+    data->meshNodes.reserve(scene->mNumMeshes);
+    std::pmr::unordered_map<unsigned, unsigned> meshOf(&scratch);
+    processNode(scene->mRootNode, scene, SceneGraph::none, meshOf, scratch);
 
-    processNode(scene->mRootNode, scene);
+    // bones are nodes, so they can only be found once all nodes are in
+    for (Mesh &mesh : data->meshes) {
+        mesh.skin.resolve(data->scene);
+    }
+    processAnimations(scene);
+    loaded("assimp");
 }
 
-void Model::processNode(const aiNode *node, const aiScene *scene) {
-    // iterate throuth all the nodes
-    for (unsigned i = 0; i < node->mNumMeshes; ++i) {
-        meshes.push_back(processMesh(scene->mMeshes[node->mMeshes[i]], scene));
+// what loadModel() builds from an aiScene, from readObj(): a root node
+// named after the file with a child per object. False, with nothing
+// loaded, when the file needs assimp.
+bool Model::loadObj(const string &path) {
+    ObjFile obj;
+    if (!readObj(path, obj)) {
+        cerr << "WARNING: " << obj.Error << ", loading with assimp" << endl;
+        return false;
     }
 
-    for (unsigned i = 0; i < node->mNumChildren; ++i) {
-        processNode(node->mChildren[i], scene);
+    vector<std::pair<string, TextureUsage>> textures;
+    for (const ObjMaterial &material : obj.Materials) {
+        if (!material.DiffuseMap.empty()) {
+            textures.emplace_back(getPath(data->directory + "/" + material.DiffuseMap), TextureUsage::Color);
+        }
+        if (!material.SpecularMap.empty()) {
+            textures.emplace_back(getPath(data->directory + "/" + material.SpecularMap), TextureUsage::Data);
+        }
+    }
+    vector<TextureHandle> preloaded = TextureCache::instance().preload(textures);
+
+    const SceneGraph::NodeId root = data->scene.add(SceneGraph::none, glm::vec3(0.f), glm::quat(1.f, 0.f, 0.f, 0.f),
+                                                    glm::vec3(1.f), fs::path(path).filename().string());
+    std::unordered_map<string, SceneGraph::NodeId> nodeOf;
+    data->meshes.reserve(obj.Meshes.size());
+    data->meshNodes.reserve(obj.Meshes.size());
+    for (ObjMesh &mesh : obj.Meshes) {
+        auto [node, added] = nodeOf.emplace(mesh.Object, SceneGraph::none);
+        if (added) {
+            node->second = data->scene.add(root, glm::vec3(0.f), glm::quat(1.f, 0.f, 0.f, 0.f), glm::vec3(1.f), mesh.Object);
+        }
+        vector<Texture> meshTextures;
+        float shininess = 32.f;
+        if (mesh.Material >= 0) {
+            const ObjMaterial &material = obj.Materials[mesh.Material];
+            for (auto [file, type, usage] : {std::tuple(&material.DiffuseMap, "texture_diffuse", TextureUsage::Color),
+                                             std::tuple(&material.SpecularMap, "texture_specular", TextureUsage::Data)}) {
+                if (!file->empty()) {
+                    Texture texture;
+                    texture.Handle = TextureCache::instance().load(getPath(data->directory + "/" + *file), usage);
+                    texture.Type = type;
+                    texture.Path = *file;
+                    meshTextures.push_back(texture);
+                }
+            }
+            shininess = material.Shininess;
+        }
+        Mesh result(std::move(mesh.Vertices), std::move(meshTextures), std::move(mesh.Indices));
+        result.shininess = shininess;
+        data->meshes.push_back(std::move(result));
+        data->meshNodes.push_back({node->second});
     }
+    return true;
 }
 
-Mesh Model::processMesh(const aiMesh *mesh, const aiScene *scene) {
-    // Vertex
-    vector<Vertex> vertices;
-    for (unsigned i = 0; i < mesh->mNumVertices; ++i) {
-        Vertex vertex;
-        vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
-        vertex.Normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+// the same from readGltf(): a root node named after the file over the
+// scene's nodes, a Mesh per primitive. Buffer views holding vertices or
+// indices are uploaded as they are, once each, and the meshes point their
+// attributes into them.
+bool Model::loadGltf(const string &path) {
+    GltfFile gltf;
+    if (!readGltf(path, gltf)) {
+        cerr << "WARNING: " << gltf.Error << ", loading with assimp" << endl;
+        return false;
+    }
+
+    auto imagePath = [&](int image) {
+        const GltfImage &source = gltf.Images[image];
+        return getPath(source.Size ? embeddedImagePath(source.File, source.Offset, source.Size) : source.File);
+    };
+    vector<std::pair<string, TextureUsage>> textures;
+    for (const GltfMaterial &material : gltf.Materials) {
+        if (material.Diffuse >= 0) {
+            textures.emplace_back(imagePath(material.Diffuse), TextureUsage::Color);
+        }
+        if (material.Specular >= 0) {
+            textures.emplace_back(imagePath(material.Specular), TextureUsage::Data);
+        }
+    }
+    vector<TextureHandle> preloaded = TextureCache::instance().preload(textures);
 
-        if (mesh->mTextureCoords[0]) {
-            vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
-        } else {
-            vertex.TexCoords = glm::vec2(0.f, 0.f);
+    // no VAO is bound while uploading, so none picks up a binding
+    glBindVertexArray(0);
+    vector<GLuint> &buffers = data->buffers;
+    buffers.assign(gltf.Views.size(), 0);
+    auto bufferOf = [&](int view) {
+        if (!buffers[view]) {
+            glGenBuffers(1, &buffers[view]);
+            glBindBuffer(GL_ARRAY_BUFFER, buffers[view]);
+            glBufferData(GL_ARRAY_BUFFER, gltf.Views[view].Size, gltf.Views[view].Data, GL_STATIC_DRAW);
+        }
+        return buffers[view];
+    };
+    auto stream = [&](const GltfAccessor &accessor) {
+        VertexStream result;
+        if (accessor.Count) {
+            result = {bufferOf(accessor.View), accessor.Offset, (GLsizei)accessor.Stride, accessor.Components,
+                      (GLenum)accessor.ComponentType, (GLboolean)accessor.Normalized, accessor.Data};
+        }
+        return result;
+    };
+
+    // meshes are built as nodes first use them, like processNode()
+    vector<vector<unsigned>> meshesOf(gltf.Meshes.size());
+    auto addNode = [&](auto &self, int index, SceneGraph::NodeId parent) -> void {
+        const GltfNode &node = gltf.Nodes[index];
+        const SceneGraph::NodeId id = data->scene.add(parent, node.Translation, node.Rotation, node.Scale, node.Name);
+        if (node.Mesh >= 0) {
+            if (meshesOf[node.Mesh].empty()) {
+                for (const GltfPrimitive &primitive : gltf.Meshes[node.Mesh].Primitives) {
+                    vector<Texture> meshTextures;
+                    if (primitive.Material >= 0) {
+                        const GltfMaterial &material = gltf.Materials[primitive.Material];
+                        for (auto [image, type, usage] : {std::tuple(material.Diffuse, "texture_diffuse", TextureUsage::Color),
+                                                          std::tuple(material.Specular, "texture_specular", TextureUsage::Data)}) {
+                            if (image >= 0) {
+                                Texture texture;
+                                texture.Handle = TextureCache::instance().load(imagePath(image), usage);
+                                texture.Type = type;
+                                texture.Path = gltf.Images[image].File;
+                                meshTextures.push_back(texture);
+                            }
+                        }
+                    }
+                    IndexStream indices;
+                    if (primitive.Indices.Count) {
+                        indices = {bufferOf(primitive.Indices.View), primitive.Indices.Offset,
+                                   (GLenum)primitive.Indices.ComponentType, primitive.Indices.Count, primitive.Indices.Data};
+                    }
+                    meshesOf[node.Mesh].push_back((unsigned)data->meshes.size());
+                    data->meshes.emplace_back(primitive.Position.Count, stream(primitive.Position), stream(primitive.Normal),
+                                              stream(primitive.TexCoord), indices, std::move(meshTextures));
+                    data->meshNodes.emplace_back();
+                }
+            }
+            for (unsigned mesh : meshesOf[node.Mesh]) {
+                data->meshNodes[mesh].push_back(id);
+            }
+        }
+        for (int child : node.Children) {
+            self(self, child, id);
+        }
+    };
+    const SceneGraph::NodeId root = data->scene.add(SceneGraph::none, glm::vec3(0.f), glm::quat(1.f, 0.f, 0.f, 0.f),
+                                                    glm::vec3(1.f), fs::path(path).filename().string());
+    for (int node : gltf.Roots) {
+        addNode(addNode, node, root);
+    }
+    glBindVertexArray(0);
+    return true;
+}
+
+void Model::processNode(const aiNode *node, const aiScene *scene, SceneGraph::NodeId parent,
+                        std::pmr::unordered_map<unsigned, unsigned> &meshOf, LinearArena &scratch) {
+    aiVector3D scaling, position;
+    aiQuaternion rotation;
+    node->mTransformation.Decompose(scaling, rotation, position);
+    SceneGraph::NodeId id = data->scene.add(parent, glm::vec3(position.x, position.y, position.z),
+                                            glm::quat(rotation.w, rotation.x, rotation.y, rotation.z),
+                                            glm::vec3(scaling.x, scaling.y, scaling.z), node->mName.C_Str());
+
+    // iterate throuth all the nodes; an aiMesh referenced by several nodes
+    // is converted once and drawn instanced
+    for (unsigned i = 0; i < node->mNumMeshes; ++i) {
+        auto [it, added] = meshOf.emplace(node->mMeshes[i], (unsigned)data->meshes.size());
+        if (added) {
+            data->meshes.push_back(processMesh(scene->mMeshes[node->mMeshes[i]], scene, scratch));
+            data->meshNodes.emplace_back();
         }
-        vertices.push_back(vertex);
+        data->meshNodes[it->second].push_back(id);
     }
+
+    for (unsigned i = 0; i < node->mNumChildren; ++i) {
+        processNode(node->mChildren[i], scene, id, meshOf, scratch);
+    }
+}
+
+Mesh Model::processMesh(const aiMesh *mesh, const aiScene *scene, LinearArena &scratch) {
+    // Vertex: the attribute arrays interleaved in one pass, into the vector
+    // the Mesh takes over
+    static_assert(sizeof(aiVector3D) == sizeof(glm::vec3), "aiVector3D is read as glm::vec3");
+    vector<Vertex> vertices(mesh->mNumVertices);
+    batch::interleaveVertices((const glm::vec3 *)mesh->mVertices, (const glm::vec3 *)mesh->mNormals,
+                              (const glm::vec3 *)mesh->mTextureCoords[0], mesh->mNumVertices, vertices.data());
     // Indices
-    vector<unsigned> indices;
+    size_t indexCount = 0;
     for (unsigned i = 0; i < mesh->mNumFaces; ++i) {
-        aiFace face = mesh->mFaces[i];
-        for (unsigned j = 0; j < face.mNumIndices; ++j) {
-            indices.push_back(face.mIndices[j]);
-        }
+        indexCount += mesh->mFaces[i].mNumIndices;
+    }
+    vector<unsigned> indices(indexCount);
+    unsigned *index = indices.data();
+    for (unsigned i = 0; i < mesh->mNumFaces; ++i) {
+        const aiFace &face = mesh->mFaces[i];
+        memcpy(index, face.mIndices, sizeof(unsigned) * face.mNumIndices);
+        index += face.mNumIndices;
     }
     // Textures
     vector<Texture> textures;
+    float shininess = 32.f;
     if (mesh->mMaterialIndex >= 0) {
         aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", TextureUsage::Color);
         textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", TextureUsage::Data);
         textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        float value;
+        if (material->Get(AI_MATKEY_SHININESS, value) == AI_SUCCESS && value > 0.f) {
+            shininess = value;
+        }
     }
 
-    return Mesh(vertices, textures, indices);
+    Mesh result(std::move(vertices), std::move(textures), std::move(indices));
+    result.shininess = shininess;
+    if (mesh->HasBones()) {
+        result.setSkin(processBones(mesh, scratch));
+    }
+    return result;
 }
 
-vector<Texture> Model::loadMaterialTextures(const aiMaterial *mat, const aiTextureType type, const string &typeName) {
-    vector<Texture> textures;
-    for (unsigned i = 0; i < mat->GetTextureCount(type); ++i) {
-        aiString str;
-        mat->GetTexture(type, i, &str);
-        bool skip = false;
-        if (textures_loaded.find(str.data) != textures_loaded.end()) {
-            textures.push_back(textures_loaded[str.data]);
-            skip = true;
-            break;
+Skin Model::processBones(const aiMesh *mesh, LinearArena &scratch) {
+    // aiBones list their vertices; gather the four strongest per vertex
+    // (aiProcess_LimitBoneWeights already leaves no more than that)
+    std::pmr::vector<uint32_t> bones(mesh->mNumVertices * 4, &scratch);
+    std::pmr::vector<float> weights(mesh->mNumVertices * 4, &scratch);
+    std::pmr::vector<uint8_t> counts(mesh->mNumVertices, 0, &scratch);
+    Skin skin;
+    for (unsigned b = 0; b < mesh->mNumBones; ++b) {
+        const aiBone *bone = mesh->mBones[b];
+        skin.BoneNames.push_back(bone->mName.C_Str());
+        // aiMatrix4x4 is row major
+        skin.InverseBindMatrices.push_back(glm::transpose(glm::make_mat4(&bone->mOffsetMatrix.a1)));
+        for (unsigned k = 0; k < bone->mNumWeights; ++k) {
+            const aiVertexWeight &weight = bone->mWeights[k];
+            const size_t first = (size_t)weight.mVertexId * 4;
+            unsigned slot = counts[weight.mVertexId];
+            if (slot == 4) {
+                slot = (unsigned)(std::min_element(&weights[first], &weights[first] + 4) - &weights[first]);
+                if (weights[first + slot] >= weight.mWeight) {
+                    continue;
+                }
+            } else {
+                ++counts[weight.mVertexId];
+            }
+            bones[first + slot] = b;
+            weights[first + slot] = weight.mWeight;
+        }
+    }
+    if (mesh->mNumBones > 256) {
+        cerr << "ERROR: " << mesh->mNumBones << " bones in one mesh, only 256 can be skinned" << endl;
+    }
+    skin.Weights.resize(mesh->mNumVertices);
+    for (unsigned i = 0; i < mesh->mNumVertices; ++i) {
+        skin.Weights[i] = packSkinWeights(&bones[i * 4], &weights[i * 4], counts[i]);
+    }
+    return skin;
+}
+
+void Model::processAnimations(const aiScene *scene) {
+    for (unsigned a = 0; a < scene->mNumAnimations; ++a) {
+        const aiAnimation *animation = scene->mAnimations[a];
+        // key times are in ticks; files without a rate assume 25 per second
+        const double ticksPerSecond = animation->mTicksPerSecond > 0.0 ? animation->mTicksPerSecond : 25.0;
+        AnimationClip clip;
+        clip.Name = animation->mName.C_Str();
+        clip.Duration = (float)(animation->mDuration / ticksPerSecond);
+        for (unsigned c = 0; c < animation->mNumChannels; ++c) {
+            const aiNodeAnim *channel = animation->mChannels[c];
+            NodeTrack track;
+            track.NodeName = channel->mNodeName.C_Str();
+            for (unsigned k = 0; k < channel->mNumPositionKeys; ++k) {
+                const aiVectorKey &key = channel->mPositionKeys[k];
+                track.PositionTimes.push_back((float)(key.mTime / ticksPerSecond));
+                track.Positions.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+            for (unsigned k = 0; k < channel->mNumRotationKeys; ++k) {
+                const aiQuatKey &key = channel->mRotationKeys[k];
+                track.RotationTimes.push_back((float)(key.mTime / ticksPerSecond));
+                track.Rotations.push_back(glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+            for (unsigned k = 0; k < channel->mNumScalingKeys; ++k) {
+                const aiVectorKey &key = channel->mScalingKeys[k];
+                track.ScaleTimes.push_back((float)(key.mTime / ticksPerSecond));
+                track.Scales.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+            clip.Tracks.push_back(std::move(track));
         }
+        clip.resolve(data->scene);
+        data->animations.push_back(std::move(clip));
+    }
+}
 
-        if (!skip) {
-            Texture texture;
-            texture.ID = loadTextureFromFile(getPath(directory + "/" + str.data));
-            texture.Type = typeName;
-            texture.Path = str.data;
-            textures.push_back(texture);
-            textures_loaded[str.data] = texture;
+void Model::packTextures() {
+    data->pack = std::make_unique<TexturePack>();
+    vector<vector<unsigned>> slots(data->meshes.size());
+    for (size_t i = 0; i < data->meshes.size(); ++i) {
+        for (const Texture &texture : data->meshes[i].textures) {
+            slots[i].push_back(data->pack->add(texture.Handle, data->meshes[i].uvTiles));
         }
     }
-    return textures;
+    data->pack->build();
+
+    MaterialLibrary &library = MaterialLibrary::instance();
+    for (size_t i = 0; i < data->meshes.size(); ++i) {
+        Material material;
+        material.Shininess = data->meshes[i].shininess;
+        bool hasDiffuse = false, hasSpecular = false;
+        for (size_t t = 0; t < slots[i].size(); ++t) {
+            const string &type = data->meshes[i].textures[t].Type;
+            if (type == "texture_diffuse" && !hasDiffuse) {
+                material.Slots[Material::Diffuse].Packed = data->pack->get(slots[i][t]);
+                hasDiffuse = true;
+            } else if (type == "texture_specular" && !hasSpecular) {
+                material.Slots[Material::Specular].Packed = data->pack->get(slots[i][t]);
+                hasSpecular = true;
+            }
+        }
+        data->meshes[i].materialID = library.add(material);
+    }
+
+    // the pack has its own copies; let the cache evict the originals
+    data->pack->releaseSources();
+    for (Mesh &mesh : data->meshes) {
+        for (Texture &texture : mesh.textures) {
+            texture.Handle = TextureHandle();
+        }
+    }
+    TextureCache::instance().purgeUnused();
 }
 
-unsigned loadTextureFromFile(const std::string &imagePath) {
-  unsigned textureID;
-  glGenTextures(1, &textureID);
-
-  int width, height, nrChannels;
-  unsigned char *data = stbi_load(imagePath.c_str(), &width, &height, &nrChannels, 0);
-
-  if (data) {
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                    GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    GLenum format;
-    if (nrChannels == 1)
-        format = GL_RED;
-    else if (nrChannels == 3)
-        format = GL_RGB;
-    else if (nrChannels == 4)
-        format = GL_RGBA;
-    // copy data
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-  } else {
-    cerr << "ERROR: Failed to load texture: " << imagePath << endl;
-  }
-
-  stbi_image_free(data);
-
-  return textureID;
+vector<Texture> Model::loadMaterialTextures(const aiMaterial *mat, const aiTextureType type, const string &typeName, TextureUsage usage) {
+    vector<Texture> textures;
+    for (unsigned i = 0; i < mat->GetTextureCount(type); ++i) {
+        aiString str;
+        mat->GetTexture(type, i, &str);
+        // the global cache dedups by file content, also across models
+        Texture texture;
+        texture.Handle = TextureCache::instance().load(getPath(data->directory + "/" + str.data), usage);
+        texture.Type = typeName;
+        texture.Path = str.data;
+        textures.push_back(texture);
+    }
+    return textures;
 }
 
 #endif
@@ -0,0 +1,641 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "job_system.h"
+#include "mapped_file.h"
+#include "vertex_convert.h"
+
+// Wavefront OBJ/MTL reader for what exporters write for meshes: v, vt, vn,
+// polygonal f (fanned into triangles), o, g, s, usemtl and mtllib, and from
+// the MTL files newmtl, Ns, map_Kd and map_Ks. Anything else (lines,
+// points, curves, line continuations) makes readObj() fail, so the caller
+// can hand the file to assimp instead.
+//
+// The file is mapped and cut into line aligned chunks that are parsed in
+// parallel on the JobSystem. Faces keep their v/vt/vn tuples until every
+// chunk is done; then each mesh turns its distinct tuples into vertices
+// through a lock-free hash table. Vertices are numbered in the order the
+// file first uses them, so the result is the same on any thread count.
+
+struct ObjMaterial {
+    std::string Name;
+    std::string DiffuseMap;  // as written in the MTL, relative to it
+    std::string SpecularMap;
+    float Shininess = 32.f;  // Ns
+};
+
+// the faces of one object (o or g) that use one material
+struct ObjMesh {
+    std::string Object;
+    int Material = -1; // into ObjFile::Materials, -1 for none
+    std::vector<Vertex> Vertices;
+    std::vector<unsigned> Indices; // triangles
+};
+
+struct ObjFile {
+    std::vector<ObjMesh> Meshes; // in the order the file starts them
+    std::vector<ObjMaterial> Materials;
+    std::string Error; // why readObj() failed
+};
+
+namespace obj {
+
+inline bool isDigit(char c) { return (unsigned)(c - '0') < 10; }
+inline bool isBlank(char c) { return c == ' ' || c == '\t'; }
+
+inline const char *skipBlanks(const char *p, const char *end) {
+    while (p < end && isBlank(*p)) ++p;
+    return p;
+}
+
+// [p, end) without surrounding blanks
+inline std::string trimmed(const char *p, const char *end) {
+    p = skipBlanks(p, end);
+    while (end > p && isBlank(end[-1])) --end;
+    return std::string(p, end);
+}
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define OBJ_SWAR_DIGITS 1
+#else
+#define OBJ_SWAR_DIGITS 0
+#endif
+
+// eight ASCII digits in one little endian word: no byte outside 0x30-0x39
+inline bool eightDigits(uint64_t word) {
+    return ((word & 0xF0F0F0F0F0F0F0F0ull) | (((word + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) ==
+           0x3333333333333333ull;
+}
+
+// their value, in three multiplies: digit pairs, then fours, then the eight
+inline uint32_t eightDigitsValue(uint64_t word) {
+    word -= 0x3030303030303030ull;
+    word = word * 10 + (word >> 8);
+    word = (((word & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+            (((word >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+    return (uint32_t)word;
+}
+
+// appends the digits at p to mantissa, eight at a time where possible;
+// `digits` counts them, also those past the 19 a mantissa holds
+inline const char *readDigits(const char *p, const char *end, uint64_t &mantissa, int &digits) {
+#if OBJ_SWAR_DIGITS
+    while (end - p >= 8 && digits <= 11) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        if (!eightDigits(word)) {
+            break;
+        }
+        mantissa = mantissa * 100000000 + eightDigitsValue(word);
+        p += 8;
+        digits += 8;
+    }
+#endif
+    for (; p < end && isDigit(*p); ++p, ++digits) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        }
+    }
+    return p;
+}
+
+// a signed integer at p, or nullptr
+inline const char *parseInteger(const char *p, const char *end, int64_t &out) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    const char *first = p;
+    int64_t value = 0;
+    for (; p < end && isDigit(*p) && value < ((int64_t)1 << 40); ++p) {
+        value = value * 10 + (*p - '0');
+    }
+    if (p == first) {
+        return nullptr;
+    }
+    out = negative ? -value : value;
+    return p;
+}
+
+// strtof on a copy of the token: the mapping isn't null terminated
+inline const char *parseFloatSlow(const char *p, const char *end, float &out) {
+    char token[64];
+    size_t n = 0;
+    while (p + n < end && n + 1 < sizeof(token) && !isBlank(p[n]) && p[n] != '\r' && p[n] != '\n') {
+        token[n] = p[n];
+        ++n;
+    }
+    token[n] = 0;
+    char *stop;
+    out = strtof(token, &stop);
+    return stop == token ? nullptr : p + (stop - token);
+}
+
+// one float at p, or nullptr; exact for what fits a double mantissa with a
+// power of ten up to 22, strtof for the rest
+inline const char *parseFloat(const char *p, const char *end, float &out) {
+    static constexpr double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0;
+    p = readDigits(p, end, mantissa, digits);
+    int exponent = digits;
+    if (p < end && *p == '.') {
+        p = readDigits(p + 1, end, mantissa, digits);
+    }
+    if (digits == 0) {
+        return parseFloatSlow(start, end, out); // nan, inf
+    }
+    exponent -= digits;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        int64_t power;
+        if (!(p = parseInteger(p + 1, end, power))) {
+            return nullptr;
+        }
+        exponent += (int)std::clamp<int64_t>(power, -1000, 1000);
+    }
+    if (digits > 19 || exponent < -22 || exponent > 22 || mantissa > (1ull << 53)) {
+        return parseFloatSlow(start, end, out);
+    }
+    const double value = exponent < 0 ? (double)mantissa / powers[-exponent] : (double)mantissa * powers[exponent];
+    out = (float)(negative ? -value : value);
+    return p;
+}
+
+// a face corner's v/vt/vn, 0 based; -1 for an absent vt or vn
+struct Corner {
+    int32_t v, t, n;
+};
+
+// what one chunk of the file holds
+struct Chunk {
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> texCoords;
+    std::vector<Corner> corners; // three per triangle
+    // negative indices count back from the chunk's own attributes until the
+    // chunks before it are known: corner * 3 + 0, 1, 2 for v, vt, vn
+    std::vector<uint32_t> relative;
+
+    // o, g and usemtl, taking effect from corners[corner]
+    struct Change {
+        size_t corner;
+        bool material;
+        std::string name;
+    };
+    std::vector<Change> changes;
+    std::vector<std::string> libraries; // mtllib
+    std::string error;
+};
+
+inline bool isKeyword(const char *word, size_t length, const char *keyword) {
+    return strlen(keyword) == length && memcmp(word, keyword, length) == 0;
+}
+
+// the floats at p into out[0, count), `required` of them at least
+inline bool parseFloats(const char *p, const char *end, float *out, int count, int required) {
+    for (int i = 0; i < count; ++i) {
+        p = skipBlanks(p, end);
+        if (p == end) {
+            return i >= required;
+        }
+        if (!(p = parseFloat(p, end, out[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// one f statement, fanned into chunk.corners
+inline bool parseFace(const char *p, const char *end, Chunk &chunk, std::vector<Corner> &polygon,
+                      std::vector<uint8_t> &relative) {
+    polygon.clear();
+    relative.clear();
+    const int64_t counts[3] = {(int64_t)chunk.positions.size(), (int64_t)chunk.texCoords.size(),
+                               (int64_t)chunk.normals.size()};
+    for (;;) {
+        p = skipBlanks(p, end);
+        if (p == end) {
+            break;
+        }
+        int32_t indices[3] = {-1, -1, -1};
+        uint8_t mask = 0;
+        for (int a = 0; a < 3; ++a) {
+            if (a > 0) {
+                if (p == end || *p != '/') {
+                    break;
+                }
+                ++p;
+                if (a == 1 && p < end && *p == '/') {
+                    continue; // v//vn
+                }
+            }
+            int64_t index;
+            if (!(p = parseInteger(p, end, index)) || index == 0 || index > INT32_MAX) {
+                return false;
+            }
+            if (index > 0) {
+                indices[a] = (int32_t)(index - 1);
+            } else {
+                indices[a] = (int32_t)std::max<int64_t>(counts[a] + index, INT32_MIN);
+                mask |= 1 << a;
+            }
+        }
+        if (p < end && !isBlank(*p)) {
+            return false;
+        }
+        polygon.push_back({indices[0], indices[1], indices[2]});
+        relative.push_back(mask);
+    }
+    if (polygon.size() < 3) {
+        return false;
+    }
+    for (size_t i = 1; i + 1 < polygon.size(); ++i) {
+        for (size_t k : {(size_t)0, i, i + 1}) {
+            for (int a = 0; a < 3; ++a) {
+                if (relative[k] & (1 << a)) {
+                    chunk.relative.push_back((uint32_t)(chunk.corners.size() * 3 + a));
+                }
+            }
+            chunk.corners.push_back(polygon[k]);
+        }
+    }
+    return true;
+}
+
+inline void parseChunk(const char *p, const char *end, Chunk &chunk) {
+    std::vector<Corner> polygon;
+    std::vector<uint8_t> relative;
+    while (p < end) {
+        const char *lineEnd = (const char *)memchr(p, '\n', end - p);
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+        const char *stop = lineEnd > p && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd;
+        const char *word = skipBlanks(p, stop);
+        p = lineEnd + 1;
+        if (word == stop || *word == '#') {
+            continue;
+        }
+        if (stop[-1] == '\\') {
+            chunk.error = "line continuations";
+            return;
+        }
+        const char *rest = word;
+        while (rest < stop && !isBlank(*rest)) ++rest;
+        const size_t length = rest - word;
+
+        bool ok = true;
+        if (isKeyword(word, length, "v")) {
+            float xyz[3] = {0.f, 0.f, 0.f};
+            ok = parseFloats(rest, stop, xyz, 3, 3); // w and vertex colors are ignored
+            chunk.positions.emplace_back(xyz[0], xyz[1], xyz[2]);
+        } else if (isKeyword(word, length, "vt")) {
+            float uv[2] = {0.f, 0.f};
+            ok = parseFloats(rest, stop, uv, 2, 1);
+            chunk.texCoords.emplace_back(uv[0], uv[1]);
+        } else if (isKeyword(word, length, "vn")) {
+            float xyz[3] = {0.f, 0.f, 0.f};
+            ok = parseFloats(rest, stop, xyz, 3, 3);
+            chunk.normals.emplace_back(xyz[0], xyz[1], xyz[2]);
+        } else if (isKeyword(word, length, "f")) {
+            ok = parseFace(rest, stop, chunk, polygon, relative);
+        } else if (isKeyword(word, length, "o") || isKeyword(word, length, "g")) {
+            chunk.changes.push_back({chunk.corners.size(), false, trimmed(rest, stop)});
+        } else if (isKeyword(word, length, "usemtl")) {
+            chunk.changes.push_back({chunk.corners.size(), true, trimmed(rest, stop)});
+        } else if (isKeyword(word, length, "mtllib")) {
+            chunk.libraries.push_back(trimmed(rest, stop));
+        } else if (!isKeyword(word, length, "s")) {
+            chunk.error = "unsupported statement " + std::string(word, length);
+            return;
+        }
+        if (!ok) {
+            chunk.error = "malformed line: " + std::string(word, stop);
+            return;
+        }
+    }
+}
+
+// newmtl, Ns, map_Kd and map_Ks of an MTL file; texture options before the
+// file name are skipped
+inline void parseMaterials(const std::string &path, std::vector<ObjMaterial> &materials) {
+    MappedFile file(path);
+    const char *p = file.data(), *end = p + file.size();
+    while (p < end) {
+        const char *lineEnd = (const char *)memchr(p, '\n', end - p);
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+        const char *stop = lineEnd > p && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd;
+        const char *word = skipBlanks(p, stop);
+        p = lineEnd + 1;
+        const char *rest = word;
+        while (rest < stop && !isBlank(*rest)) ++rest;
+        const size_t length = rest - word;
+        if (isKeyword(word, length, "newmtl")) {
+            materials.emplace_back();
+            materials.back().Name = trimmed(rest, stop);
+        } else if (materials.empty()) {
+            continue;
+        } else if (isKeyword(word, length, "Ns")) {
+            float shininess;
+            if (parseFloats(rest, stop, &shininess, 1, 1) && shininess > 0.f) {
+                materials.back().Shininess = shininess;
+            }
+        } else if (isKeyword(word, length, "map_Kd") || isKeyword(word, length, "map_Ks")) {
+            std::string file = trimmed(rest, stop);
+            const size_t space = file.find_last_of(" \t");
+            if (!file.empty() && file[0] == '-' && space != std::string::npos) {
+                file = file.substr(space + 1);
+            }
+            (word[5] == 'd' ? materials.back().DiffuseMap : materials.back().SpecularMap) = file;
+        }
+    }
+}
+
+inline uint64_t hashCorner(const Corner &c) {
+    uint64_t h = (uint64_t)(uint32_t)c.v * 0x9E3779B97F4A7C15ull ^ (uint64_t)(uint32_t)c.t * 0xC2B2AE3D27D4EB4Full ^
+                 (uint64_t)(uint32_t)c.n * 0x165667B19E3779F9ull;
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ull;
+    return h ^ (h >> 32);
+}
+
+inline bool sameCorner(const Corner &a, const Corner &b) { return a.v == b.v && a.t == b.t && a.n == b.n; }
+
+// the attributes of the whole file
+struct Attributes {
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> texCoords;
+};
+
+// mesh.Vertices and Indices from `corners`, one vertex per distinct tuple.
+// The table holds, per tuple, the first corner that uses it: corners race
+// to claim an empty slot, and a corner finding its tuple lowers the slot to
+// its own index if that's smaller. Slots only ever name corners with the
+// same tuple, so probing compares against whichever one is there. Once
+// numbered, a slot holds its vertex id, tagged so no corner mistakes it
+// for its own index.
+inline void buildMesh(const Corner *corners, size_t count, const Attributes &attributes, bool flipUVs, ObjMesh &mesh,
+                      JobSystem &jobs) {
+    constexpr uint32_t empty = ~0u, numbered = 1u << 31;
+    constexpr size_t grain = 16 << 10;
+    size_t capacity = 64;
+    while (capacity < count + count / 2) capacity *= 2;
+    const size_t mask = capacity - 1;
+    std::unique_ptr<std::atomic<uint32_t>[]> table(new std::atomic<uint32_t>[capacity]);
+    std::vector<unsigned> slotOf(count);
+    jobs.parallelFor(capacity, grain * 4, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) table[i].store(empty, std::memory_order_relaxed);
+    });
+
+    jobs.parallelFor(count, grain, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+            size_t slot = hashCorner(corners[c]) & mask;
+            uint32_t held = table[slot].load(std::memory_order_relaxed);
+            for (;;) {
+                if (held == empty) {
+                    if (table[slot].compare_exchange_weak(held, (uint32_t)c, std::memory_order_relaxed)) {
+                        break;
+                    }
+                    continue;
+                }
+                if (sameCorner(corners[held], corners[c])) {
+                    while (c < held && !table[slot].compare_exchange_weak(held, (uint32_t)c, std::memory_order_relaxed)) {
+                    }
+                    break;
+                }
+                slot = (slot + 1) & mask;
+                held = table[slot].load(std::memory_order_relaxed);
+            }
+            slotOf[c] = (unsigned)slot;
+        }
+    });
+
+    // vertex ids in first use order: count the first uses per block, then
+    // number them from each block's offset
+    const size_t blocks = (count + grain - 1) / grain;
+    std::vector<uint32_t> firsts(blocks + 1, 0);
+    jobs.parallelFor(blocks, 1, [&](size_t begin, size_t end) {
+        for (size_t b = begin; b < end; ++b) {
+            uint32_t n = 0;
+            for (size_t c = b * grain; c < std::min(count, (b + 1) * grain); ++c) {
+                n += table[slotOf[c]].load(std::memory_order_relaxed) == c;
+            }
+            firsts[b + 1] = n;
+        }
+    });
+    for (size_t b = 0; b < blocks; ++b) {
+        firsts[b + 1] += firsts[b];
+    }
+
+    mesh.Vertices.resize(firsts[blocks]);
+    jobs.parallelFor(blocks, 1, [&](size_t begin, size_t end) {
+        for (size_t b = begin; b < end; ++b) {
+            uint32_t id = firsts[b];
+            for (size_t c = b * grain; c < std::min(count, (b + 1) * grain); ++c) {
+                std::atomic<uint32_t> &slot = table[slotOf[c]];
+                if (slot.load(std::memory_order_relaxed) != c) {
+                    continue;
+                }
+                const Corner &corner = corners[c];
+                Vertex &vertex = mesh.Vertices[id];
+                vertex.Position = attributes.positions[corner.v];
+                vertex.Normal = corner.n >= 0 ? attributes.normals[corner.n] : glm::vec3(0.f);
+                vertex.TexCoords = glm::vec2(0.f);
+                if (corner.t >= 0) {
+                    const glm::vec2 &uv = attributes.texCoords[corner.t];
+                    vertex.TexCoords = glm::vec2(uv.x, flipUVs ? 1.f - uv.y : uv.y);
+                }
+                slot.store(id++ | numbered, std::memory_order_relaxed);
+            }
+        }
+    });
+
+    // the slots become the indices in place
+    jobs.parallelFor(count, grain, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) slotOf[c] = table[slotOf[c]].load(std::memory_order_relaxed) & ~numbered;
+    });
+    mesh.Indices = std::move(slotOf);
+}
+
+} // namespace obj
+
+// Reads `path` into `out`, with texture coordinates flipped as
+// aiProcess_FlipUVs does. False, with out.Error set, for files this reader
+// doesn't handle.
+inline bool readObj(const std::string &path, ObjFile &out, bool flipUVs = true, JobSystem &jobs = JobSystem::instance()) {
+    using namespace obj;
+    MappedFile file(path);
+    const char *text = file.data();
+    const size_t size = file.size();
+    if (size == 0) {
+        out.Error = "can't read " + path;
+        return false;
+    }
+
+    // a few chunks per thread, so uneven ones even out
+    const size_t target = std::max<size_t>(256 << 10, size / (jobs.threadCount() * 4) + 1);
+    std::vector<size_t> starts = {0};
+    while (starts.back() + target < size) {
+        const char *lineEnd = (const char *)memchr(text + starts.back() + target, '\n', size - starts.back() - target);
+        if (!lineEnd || lineEnd + 1 == text + size) {
+            break;
+        }
+        starts.push_back(lineEnd + 1 - text);
+    }
+    starts.push_back(size);
+    std::vector<Chunk> chunks(starts.size() - 1);
+    jobs.parallelFor(chunks.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) parseChunk(text + starts[c], text + starts[c + 1], chunks[c]);
+    });
+    for (const Chunk &chunk : chunks) {
+        if (!chunk.error.empty()) {
+            out.Error = path + ": " + chunk.error;
+            return false;
+        }
+    }
+
+    // where each chunk's attributes start in the file's
+    std::vector<size_t> bases[3];
+    for (std::vector<size_t> &base : bases) base.assign(chunks.size() + 1, 0);
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        bases[0][c + 1] = bases[0][c] + chunks[c].positions.size();
+        bases[1][c + 1] = bases[1][c] + chunks[c].texCoords.size();
+        bases[2][c + 1] = bases[2][c] + chunks[c].normals.size();
+    }
+    const size_t counts[3] = {bases[0].back(), bases[1].back(), bases[2].back()};
+    if (counts[0] > INT32_MAX || counts[1] > INT32_MAX || counts[2] > INT32_MAX) {
+        out.Error = path + ": too many vertices";
+        return false;
+    }
+    Attributes attributes;
+    attributes.positions.resize(counts[0]);
+    attributes.texCoords.resize(counts[1]);
+    attributes.normals.resize(counts[2]);
+    std::atomic<bool> badIndex{false};
+    jobs.parallelFor(chunks.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+            Chunk &chunk = chunks[c];
+            std::copy(chunk.positions.begin(), chunk.positions.end(), attributes.positions.begin() + bases[0][c]);
+            std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), attributes.texCoords.begin() + bases[1][c]);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), attributes.normals.begin() + bases[2][c]);
+            for (uint32_t k : chunk.relative) {
+                Corner &corner = chunk.corners[k / 3];
+                int32_t &value = k % 3 == 0 ? corner.v : k % 3 == 1 ? corner.t : corner.n;
+                const int64_t index = (int64_t)bases[k % 3][c] + value;
+                value = (int32_t)index;
+                if (index < 0) {
+                    badIndex = true;
+                }
+            }
+            for (const Corner &corner : chunk.corners) {
+                if ((size_t)corner.v >= counts[0] || (corner.t >= 0 && (size_t)corner.t >= counts[1]) ||
+                    (corner.n >= 0 && (size_t)corner.n >= counts[2])) {
+                    badIndex = true;
+                }
+            }
+        }
+    });
+    if (badIndex) {
+        out.Error = path + ": index out of range";
+        return false;
+    }
+
+    const std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+    std::unordered_map<std::string, int> materialOf;
+    for (const Chunk &chunk : chunks) {
+        for (const std::string &library : chunk.libraries) {
+            parseMaterials(directory + library, out.Materials);
+        }
+    }
+    for (size_t m = 0; m < out.Materials.size(); ++m) {
+        materialOf.emplace(out.Materials[m].Name, (int)m);
+    }
+
+    // one mesh per object and material, made of the face runs using them
+    struct Run {
+        const Corner *corners;
+        size_t count;
+    };
+    std::vector<std::vector<Run>> runs;
+    std::unordered_map<std::string, size_t> meshOf;
+    std::string object, material;
+    auto addRun = [&](const Chunk &chunk, size_t begin, size_t end) {
+        if (begin == end) {
+            return;
+        }
+        auto [it, added] = meshOf.emplace(object + '\n' + material, out.Meshes.size());
+        if (added) {
+            out.Meshes.emplace_back();
+            out.Meshes.back().Object = object;
+            auto found = materialOf.find(material);
+            out.Meshes.back().Material = found != materialOf.end() ? found->second : -1;
+            runs.emplace_back();
+        }
+        // runs split only by statements that change nothing join up again
+        std::vector<Run> &meshRuns = runs[it->second];
+        if (!meshRuns.empty() && meshRuns.back().corners + meshRuns.back().count == chunk.corners.data() + begin) {
+            meshRuns.back().count += end - begin;
+        } else {
+            meshRuns.push_back({chunk.corners.data() + begin, end - begin});
+        }
+    };
+    for (const Chunk &chunk : chunks) {
+        size_t begin = 0;
+        for (const Chunk::Change &change : chunk.changes) {
+            addRun(chunk, begin, change.corner);
+            (change.material ? material : object) = change.name;
+            begin = change.corner;
+        }
+        addRun(chunk, begin, chunk.corners.size());
+    }
+    if (out.Meshes.empty()) {
+        out.Error = path + ": no faces";
+        return false;
+    }
+
+    std::vector<Corner> gathered;
+    for (size_t m = 0; m < out.Meshes.size(); ++m) {
+        const Corner *corners = runs[m][0].corners;
+        size_t count = runs[m][0].count;
+        if (runs[m].size() > 1) {
+            count = 0;
+            for (const Run &run : runs[m]) count += run.count;
+            gathered.resize(count);
+            size_t at = 0;
+            for (const Run &run : runs[m]) {
+                std::copy(run.corners, run.corners + run.count, gathered.begin() + at);
+                at += run.count;
+            }
+            corners = gathered.data();
+        }
+        if (count >= INT32_MAX) {
+            out.Error = path + ": mesh too large";
+            return false;
+        }
+        buildMesh(corners, count, attributes, flipUVs, out.Meshes[m], jobs);
+    }
+    return true;
+}
+
+#endif
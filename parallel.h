@@ -0,0 +1,16 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+
+#include "job_system.h"
+
+// Split [0, count) into chunks of at least `grain` items and run
+// fn(begin, end) on them on the shared job system. Returns once every
+// chunk is done. The calling thread works too.
+template <typename Fn>
+void parallelFor(size_t count, size_t grain, Fn &&fn) {
+    JobSystem::instance().parallelFor(count, grain, fn);
+}
+
+#endif
@@ -0,0 +1,360 @@
+#ifndef READBACK_H
+#define READBACK_H
+
+#include <glad/glad.h>
+// glad must be included before GLFW
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "image_writer.h"
+// the including file may already have pulled in the implementation
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image.h"
+#endif
+
+// Asynchronous framebuffer capture.
+//
+// Every captured frame is read into the next GL_PIXEL_PACK_BUFFER of a ring
+// and fenced. A slot is only mapped when the ring wraps around to it, i.e.
+// ringSize frames later, by which time the copy has normally finished and
+// mapping doesn't stall. Encoding, writing and golden-image comparison all
+// happen on a worker thread.
+
+struct CapturedFrame {
+    unsigned index;
+    int width, height;
+    std::vector<unsigned char> pixels; // RGBA8, bottom-up rows as GL returns them
+};
+
+class FrameReadback {
+public:
+    enum class Format { PNG, Y4M };
+
+    FrameReadback(const std::string &outputDir, Format format, unsigned ringSize = 3)
+        : outputDir(outputDir), format(format), slots(ringSize) {
+        if (!outputDir.empty()) {
+            std::filesystem::create_directories(outputDir);
+        }
+        for (Slot &slot : slots) {
+            glGenBuffers(1, &slot.pbo);
+        }
+        worker = std::thread(&FrameReadback::workerLoop, this);
+    }
+
+    ~FrameReadback() {
+        flush();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        worker.join();
+
+        for (Slot &slot : slots) {
+            if (slot.fence) glDeleteSync(slot.fence);
+            glDeleteBuffers(1, &slot.pbo);
+        }
+        if (!goldenDir.empty()) {
+            std::cerr << "golden: " << goldenCompared << " frames compared, "
+                      << goldenFailed << " failed" << std::endl;
+        }
+    }
+
+    FrameReadback(const FrameReadback &) = delete;
+    FrameReadback &operator=(const FrameReadback &) = delete;
+
+    // compare every frame against goldenDir/frame_NNNNN.png. A pixel differs
+    // when its CIE76 delta E exceeds deltaE (2.3 is roughly one JND); a frame
+    // fails when more than maxBadPixels (fraction) of its pixels differ.
+    void setGolden(const std::string &dir, float deltaE = 2.3f, float maxBadPixels = 0.001f) {
+        goldenDir = dir;
+        goldenDeltaE = deltaE;
+        goldenMaxBad = maxBadPixels;
+    }
+
+    // call after rendering and before swapping buffers
+    void capture(int width, int height) {
+        Slot &slot = slots[frameIndex % slots.size()];
+        if (slot.pending) {
+            retire(slot);
+        }
+
+        const size_t size = (size_t)width * height * 4;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        if (size != slot.capacity) {
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+            slot.capacity = size;
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.width = width;
+        slot.height = height;
+        slot.frame = frameIndex++;
+        slot.pending = true;
+    }
+
+    // retire every in-flight slot (oldest first) and wait for the worker
+    void flush() {
+        for (size_t i = 0; i < slots.size(); ++i) {
+            Slot &slot = slots[(frameIndex + i) % slots.size()];
+            if (slot.pending) {
+                retire(slot);
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return queue.empty() && !busy; });
+    }
+
+    unsigned framesCaptured() const { return frameIndex; }
+    unsigned goldenFailures() const { return goldenFailed; }
+
+private:
+    struct Slot {
+        GLuint pbo = 0;
+        GLsync fence = 0;
+        size_t capacity = 0;
+        int width = 0, height = 0;
+        unsigned frame = 0;
+        bool pending = false;
+    };
+
+    std::string outputDir;
+    Format format;
+    std::vector<Slot> slots;
+    unsigned frameIndex = 0;
+
+    std::string goldenDir;
+    float goldenDeltaE = 2.3f;
+    float goldenMaxBad = 0.001f;
+    std::atomic<unsigned> goldenCompared{0};
+    std::atomic<unsigned> goldenFailed{0};
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake, idle;
+    std::deque<CapturedFrame> queue;
+    bool busy = false;
+    bool quit = false;
+
+    std::unique_ptr<image_writer::Y4MWriter> y4m;
+
+    void retire(Slot &slot) {
+        // normally signaled already since the ring wrapped; only blocks if
+        // the GPU is more than ringSize frames behind
+        GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+        }
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+        slot.pending = false;
+
+        CapturedFrame frame;
+        frame.index = slot.frame;
+        frame.width = slot.width;
+        frame.height = slot.height;
+        frame.pixels.resize((size_t)slot.width * slot.height * 4);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame.pixels.size(), GL_MAP_READ_BIT);
+        if (mapped) {
+            memcpy(frame.pixels.data(), mapped, frame.pixels.size());
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        } else {
+            std::cerr << "ERROR: Failed to map readback buffer for frame " << frame.index << std::endl;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        if (mapped) {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(frame));
+        }
+        wake.notify_one();
+    }
+
+    void workerLoop() {
+        // goldens are stored top-down, flip them into GL row order
+        stbi_set_flip_vertically_on_load_thread(true);
+
+        for (;;) {
+            CapturedFrame frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return quit || !queue.empty(); });
+                if (queue.empty()) {
+                    return;
+                }
+                frame = std::move(queue.front());
+                queue.pop_front();
+                busy = true;
+            }
+
+            process(frame);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                busy = false;
+            }
+            idle.notify_all();
+        }
+    }
+
+    std::string framePath(const std::string &dir, unsigned index) const {
+        char name[32];
+        snprintf(name, sizeof(name), "frame_%05u.png", index);
+        return dir + "/" + name;
+    }
+
+    void process(const CapturedFrame &frame) {
+        if (!outputDir.empty()) {
+            if (format == Format::PNG) {
+                image_writer::writePNG(framePath(outputDir, frame.index), frame.pixels.data(),
+                                       frame.width, frame.height, 4, true);
+            } else {
+                if (!y4m) {
+                    y4m = std::make_unique<image_writer::Y4MWriter>(
+                        outputDir + "/capture.y4m", frame.width, frame.height, 60);
+                }
+                y4m->writeFrame(frame.pixels.data(), frame.width, frame.height, true);
+            }
+        }
+
+        if (!goldenDir.empty()) {
+            compareGolden(frame);
+        }
+    }
+
+    void compareGolden(const CapturedFrame &frame) {
+        const std::string path = framePath(goldenDir, frame.index);
+        int width, height, nrChannels;
+        unsigned char *golden = stbi_load(path.c_str(), &width, &height, &nrChannels, 4);
+        if (!golden) {
+            std::cerr << "golden: missing " << path << std::endl;
+            ++goldenFailed;
+            return;
+        }
+
+        ++goldenCompared;
+        if (width != frame.width || height != frame.height) {
+            std::cerr << "golden: frame " << frame.index << " is " << frame.width << "x" << frame.height
+                      << ", golden is " << width << "x" << height << std::endl;
+            ++goldenFailed;
+            stbi_image_free(golden);
+            return;
+        }
+
+        const size_t pixelCount = (size_t)width * height;
+        size_t bad = 0;
+        float worst = 0.f;
+        std::vector<unsigned char> diff(pixelCount * 4);
+        for (size_t i = 0; i < pixelCount; ++i) {
+            float d = deltaE(&frame.pixels[i * 4], &golden[i * 4]);
+            worst = std::max(worst, d);
+            bool differs = d > goldenDeltaE;
+            bad += differs;
+
+            // diff image: greyscale reference with mismatches in red
+            unsigned char grey = golden[i * 4 + 1] / 3;
+            diff[i * 4 + 0] = differs ? 255 : grey;
+            diff[i * 4 + 1] = differs ? 0 : grey;
+            diff[i * 4 + 2] = differs ? 0 : grey;
+            diff[i * 4 + 3] = 255;
+        }
+        stbi_image_free(golden);
+
+        float fraction = (float)bad / (float)pixelCount;
+        if (fraction > goldenMaxBad) {
+            ++goldenFailed;
+            std::cerr << "golden: frame " << frame.index << " FAILED, " << fraction * 100.f
+                      << "% of pixels differ (max delta E " << worst << ")" << std::endl;
+            if (!outputDir.empty()) {
+                char name[32];
+                snprintf(name, sizeof(name), "/diff_%05u.png", frame.index);
+                image_writer::writePNG(outputDir + name, diff.data(), width, height, 4, true);
+            }
+        }
+    }
+
+    // CIE76 distance between two sRGB8 colors in L*a*b*
+    static float deltaE(const unsigned char *a, const unsigned char *b) {
+        float labA[3], labB[3];
+        toLab(a, labA);
+        toLab(b, labB);
+        float dl = labA[0] - labB[0], da = labA[1] - labB[1], db = labA[2] - labB[2];
+        return std::sqrt(dl * dl + da * da + db * db);
+    }
+
+    static void toLab(const unsigned char *rgb, float *lab) {
+        static float linear[256];
+        static bool initialized = false;
+        if (!initialized) {
+            for (int i = 0; i < 256; ++i) {
+                float c = i / 255.f;
+                linear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            initialized = true;
+        }
+
+        float r = linear[rgb[0]], g = linear[rgb[1]], b = linear[rgb[2]];
+        // D65 white point
+        float x = (0.4124f * r + 0.3576f * g + 0.1805f * b) / 0.95047f;
+        float y = (0.2126f * r + 0.7152f * g + 0.0722f * b);
+        float z = (0.0193f * r + 0.1192f * g + 0.9505f * b) / 1.08883f;
+
+        auto f = [](float t) {
+            return t > 0.008856f ? std::cbrt(t) : 7.787f * t + 16.f / 116.f;
+        };
+        float fx = f(x), fy = f(y), fz = f(z);
+        lab[0] = 116.f * fy - 16.f;
+        lab[1] = 500.f * (fx - fy);
+        lab[2] = 200.f * (fy - fz);
+    }
+};
+
+// Capture is driven by environment variables so the samples stay runnable as is:
+//   LEARNOPENGL_CAPTURE=<dir>         write every frame into <dir>
+//   LEARNOPENGL_CAPTURE_FORMAT=y4m    one raw Y4M stream instead of PNGs
+//   LEARNOPENGL_GOLDEN=<dir>          compare frames against <dir>/frame_NNNNN.png
+//   LEARNOPENGL_GOLDEN_THRESHOLD=<dE> per-pixel delta E threshold (default 2.3)
+//   LEARNOPENGL_CAPTURE_FRAMES=<n>    close the window after n frames
+static std::unique_ptr<FrameReadback> createReadbackFromEnv(unsigned &frameLimit) {
+    const char *captureDir = getenv("LEARNOPENGL_CAPTURE");
+    const char *goldenDir = getenv("LEARNOPENGL_GOLDEN");
+    const char *frames = getenv("LEARNOPENGL_CAPTURE_FRAMES");
+    frameLimit = frames ? (unsigned)atoi(frames) : 0;
+
+    if (!captureDir && !goldenDir) {
+        return nullptr;
+    }
+
+    const char *format = getenv("LEARNOPENGL_CAPTURE_FORMAT");
+    bool y4m = format && std::string(format) == "y4m";
+    auto readback = std::make_unique<FrameReadback>(captureDir ? captureDir : "",
+                                                    y4m ? FrameReadback::Format::Y4M : FrameReadback::Format::PNG);
+    if (goldenDir) {
+        const char *threshold = getenv("LEARNOPENGL_GOLDEN_THRESHOLD");
+        readback->setGolden(goldenDir, threshold ? (float)atof(threshold) : 2.3f);
+    }
+    return readback;
+}
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include <glad/glad.h>
+// glad must be included before GLFW
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "frame_arena.h"
+#include "job_system.h"
+
+// Hands frames from the simulation thread to a render thread.
+//
+// The simulation writes everything a frame needs into a Packet (camera,
+// what to draw, instance data) and publishes it; from then on the packet
+// is immutable and the render thread reads it while the next one is being
+// written. Three slots are enough for one being written, one being drawn
+// and one waiting. At most `maxQueued` published packets wait for the
+// renderer; past that beginWrite() blocks, so the simulation runs at most
+// that many frames ahead of what's on screen.
+template <typename Packet>
+class FramePackets {
+public:
+    explicit FramePackets(unsigned maxQueued = 1) : maxQueued(std::clamp(maxQueued, 1u, 2u)) {}
+
+    FramePackets(const FramePackets &) = delete;
+    FramePackets &operator=(const FramePackets &) = delete;
+
+    // the slot to fill next; its previous contents are left in place so
+    // buffers can be reused
+    Packet &beginWrite() {
+        std::unique_lock<std::mutex> lock(mutex);
+        const auto start = std::chrono::steady_clock::now();
+        changed.wait(lock, [this] { return closed || readyCount < maxQueued; });
+        producerWait += std::chrono::steady_clock::now() - start;
+        for (writing = 0; writing == reading || std::find(ready, ready + readyCount, writing) != ready + readyCount; ++writing) {
+        }
+        return slots[writing];
+    }
+
+    void publish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready[readyCount++] = writing;
+            writing = -1;
+            ++published;
+        }
+        changed.notify_all();
+    }
+
+    // the oldest published packet, waiting for one if needed; nullptr once
+    // closed and drained
+    const Packet *acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        const auto start = std::chrono::steady_clock::now();
+        changed.wait(lock, [this] { return closed || readyCount > 0; });
+        consumerWait += std::chrono::steady_clock::now() - start;
+        if (readyCount == 0) {
+            return nullptr;
+        }
+        reading = ready[0];
+        std::copy(ready + 1, ready + readyCount, ready);
+        --readyCount;
+        return &slots[reading];
+    }
+
+    void release() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            reading = -1;
+        }
+        changed.notify_all();
+    }
+
+    // wakes both sides; acquire() still returns what was published
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        changed.notify_all();
+    }
+
+    // time each side spent blocked on the other
+    double producerWaitMs() const { return std::chrono::duration<double, std::milli>(producerWait).count(); }
+    double consumerWaitMs() const { return std::chrono::duration<double, std::milli>(consumerWait).count(); }
+    unsigned long long frames() const { return published; }
+
+private:
+    Packet slots[3];
+    const unsigned maxQueued;
+    std::mutex mutex;
+    std::condition_variable changed;
+    int ready[3]; // published slots, oldest first; a deque would allocate
+    unsigned readyCount = 0;
+    int writing = -1, reading = -1;
+    bool closed = false;
+    unsigned long long published = 0;
+    std::chrono::steady_clock::duration producerWait{0}, consumerWait{0};
+};
+
+// Owns the window's GL context on its own thread and draws every packet
+// with `render`, then presents it. The context must not be current on any
+// other thread while this runs, and GL jobs run on the render thread; the
+// destructor drains the packets, stops the thread and leaves the context
+// current on none.
+template <typename Packet>
+class RenderThread {
+public:
+    RenderThread(GLFWwindow *window, FramePackets<Packet> &packets, std::function<void(const Packet &)> render)
+        : window(window), packets(packets), render(std::move(render)) {
+        thread = std::thread(&RenderThread::loop, this);
+    }
+
+    ~RenderThread() {
+        packets.close();
+        thread.join();
+    }
+
+    RenderThread(const RenderThread &) = delete;
+    RenderThread &operator=(const RenderThread &) = delete;
+
+private:
+    GLFWwindow *window;
+    FramePackets<Packet> &packets;
+    std::function<void(const Packet &)> render;
+    std::thread thread;
+
+    void loop() {
+        glfwMakeContextCurrent(window);
+        JobSystem::instance().setGLThread();
+        while (const Packet *packet = packets.acquire()) {
+            FrameArena::beginFrame();
+            render(*packet);
+            glfwSwapBuffers(window);
+            packets.release();
+        }
+        glfwMakeContextCurrent(nullptr);
+    }
+};
+
+#endif
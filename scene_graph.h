@@ -0,0 +1,218 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "batch_math.h"
+#include "parallel.h"
+
+// Flat transform hierarchy.
+//
+// Nodes live in structure-of-arrays form (parent, local translation /
+// rotation / scale per component, world matrix), sorted by depth so every
+// parent comes before its children and each depth is one contiguous range.
+// Changing a local transform only flags the node; update() pushes the flags
+// down to the children and recomputes just the flagged nodes, one depth at a
+// time. Within a depth nothing depends on anything else, so the nodes go
+// through the batch_math.h kernels and, for large scenes, onto all cores.
+//
+// NodeIds are stable; the dense order behind them changes when nodes are
+// added above deeper ones.
+
+class SceneGraph {
+public:
+    using NodeId = uint32_t;
+    static constexpr NodeId none = ~0u;
+
+    NodeId add(NodeId parent, const glm::vec3 &translation = glm::vec3(0.f),
+               const glm::quat &rotation = glm::quat(1.f, 0.f, 0.f, 0.f), const glm::vec3 &scale = glm::vec3(1.f),
+               const std::string &name = "") {
+        const NodeId id = (NodeId)idOf.size();
+        const uint32_t dense = (uint32_t)parents.size();
+        const uint32_t depth = parent == none ? 0 : depths[indexOf[parent]] + 1;
+        if (!depths.empty() && depth < depths.back()) {
+            sorted = false;
+        }
+
+        idOf.push_back(id);
+        indexOf.push_back(dense);
+        names.push_back(name);
+        if (!name.empty()) {
+            byName.emplace(name, id);
+        }
+        parents.push_back(parent == none ? -1 : (int32_t)indexOf[parent]);
+        depths.push_back(depth);
+        tx.push_back(0.f), ty.push_back(0.f), tz.push_back(0.f);
+        rx.push_back(0.f), ry.push_back(0.f), rz.push_back(0.f), rw.push_back(1.f);
+        sx.push_back(1.f), sy.push_back(1.f), sz.push_back(1.f);
+        locals.emplace_back(1.f);
+        worlds.emplace_back(1.f);
+        dirty.push_back(1);
+        setLocal(id, translation, rotation, scale);
+        return id;
+    }
+
+    void setLocal(NodeId id, const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale) {
+        setTranslation(id, translation);
+        setRotation(id, rotation);
+        setScale(id, scale);
+    }
+
+    void setTranslation(NodeId id, const glm::vec3 &t) {
+        const uint32_t i = indexOf[id];
+        tx[i] = t.x, ty[i] = t.y, tz[i] = t.z;
+        dirty[i] = 1;
+    }
+
+    void setRotation(NodeId id, const glm::quat &rotation) {
+        const uint32_t i = indexOf[id];
+        const glm::quat r = glm::normalize(rotation);
+        rx[i] = r.x, ry[i] = r.y, rz[i] = r.z, rw[i] = r.w;
+        dirty[i] = 1;
+    }
+
+    void setScale(NodeId id, const glm::vec3 &s) {
+        const uint32_t i = indexOf[id];
+        sx[i] = s.x, sy[i] = s.y, sz[i] = s.z;
+        dirty[i] = 1;
+    }
+
+    glm::vec3 translation(NodeId id) const {
+        const uint32_t i = indexOf[id];
+        return glm::vec3(tx[i], ty[i], tz[i]);
+    }
+    glm::quat rotation(NodeId id) const {
+        const uint32_t i = indexOf[id];
+        return glm::quat(rw[i], rx[i], ry[i], rz[i]);
+    }
+    glm::vec3 scale(NodeId id) const {
+        const uint32_t i = indexOf[id];
+        return glm::vec3(sx[i], sy[i], sz[i]);
+    }
+
+    NodeId parent(NodeId id) const {
+        const int32_t p = parents[indexOf[id]];
+        return p < 0 ? none : idOf[p];
+    }
+
+    const std::string &name(NodeId id) const { return names[id]; }
+
+    NodeId find(const std::string &name) const {
+        auto it = byName.find(name);
+        return it == byName.end() ? none : it->second;
+    }
+
+    // valid after update()
+    const glm::mat4 &world(NodeId id) const { return worlds[indexOf[id]]; }
+
+    size_t size() const { return parents.size(); }
+
+    // recompute the world matrices of changed nodes and everything below
+    // them; returns how many were recomputed
+    size_t update() {
+        if (!sorted) {
+            sortByDepth();
+        }
+        size_t updated = 0;
+        uint32_t begin = 0;
+        while (begin < parents.size()) {
+            uint32_t end = begin;
+            while (end < parents.size() && depths[end] == depths[begin]) {
+                ++end;
+            }
+            // parents are in earlier levels and already final
+            work.clear();
+            for (uint32_t i = begin; i < end; ++i) {
+                if (parents[i] >= 0) {
+                    dirty[i] |= dirty[parents[i]];
+                }
+                if (dirty[i]) {
+                    work.push_back(i);
+                }
+            }
+            if (work.size() >= parallelThreshold) {
+                parallelFor(work.size(), parallelThreshold / 2, [&](size_t b, size_t e) { composeWorlds(work.data() + b, e - b); });
+            } else {
+                composeWorlds(work.data(), work.size());
+            }
+            updated += work.size();
+            begin = end;
+        }
+        std::fill(dirty.begin(), dirty.end(), 0);
+        return updated;
+    }
+
+private:
+    static constexpr size_t parallelThreshold = 16384;
+
+    // by NodeId
+    std::vector<uint32_t> indexOf;
+    std::vector<std::string> names;
+    std::unordered_map<std::string, NodeId> byName;
+    // dense, sorted by depth
+    std::vector<NodeId> idOf;
+    std::vector<int32_t> parents;
+    std::vector<uint32_t> depths;
+    std::vector<float> tx, ty, tz;
+    std::vector<float> rx, ry, rz, rw;
+    std::vector<float> sx, sy, sz;
+    std::vector<glm::mat4> locals, worlds;
+    std::vector<uint8_t> dirty;
+    bool sorted = true;
+
+    std::vector<uint32_t> work;
+
+    // stable counting sort of the dense arrays by depth
+    void sortByDepth() {
+        const size_t n = parents.size();
+        const uint32_t maxDepth = *std::max_element(depths.begin(), depths.end());
+        std::vector<uint32_t> start(maxDepth + 2, 0);
+        for (uint32_t d : depths) {
+            ++start[d + 1];
+        }
+        for (size_t d = 1; d < start.size(); ++d) {
+            start[d] += start[d - 1];
+        }
+        std::vector<uint32_t> to(n); // old dense index -> new
+        for (size_t i = 0; i < n; ++i) {
+            to[i] = start[depths[i]]++;
+        }
+
+        auto permute = [&](auto &values) {
+            std::remove_reference_t<decltype(values)> out(values.size());
+            for (size_t i = 0; i < n; ++i) {
+                out[to[i]] = values[i];
+            }
+            values.swap(out);
+        };
+        for (int32_t &p : parents) {
+            if (p >= 0) p = (int32_t)to[p];
+        }
+        permute(idOf), permute(parents), permute(depths);
+        permute(tx), permute(ty), permute(tz);
+        permute(rx), permute(ry), permute(rz), permute(rw);
+        permute(sx), permute(sy), permute(sz);
+        permute(locals), permute(worlds), permute(dirty);
+        for (size_t i = 0; i < n; ++i) {
+            indexOf[idOf[i]] = (uint32_t)i;
+        }
+        sorted = true;
+    }
+
+    void composeWorlds(const uint32_t *nodes, size_t count) {
+        const batch::TRSArrays trs = {tx.data(), ty.data(), tz.data(), rx.data(), ry.data(),
+                                      rz.data(), rw.data(), sx.data(), sy.data(), sz.data()};
+        batch::composeTRS(trs, nodes, count, locals.data());
+        batch::multiplyHierarchy(parents.data(), nodes, count, locals.data(), worlds.data());
+    }
+};
+
+#endif
@@ -17,13 +17,17 @@
 class Shader {
 public:
     unsigned ID;
-    Shader(const std::string &vsPath, const std::string &fsPath) {
+    // `defines` (e.g. "#define FOO\n") is inserted after the #version line
+    // of both stages
+    Shader(const std::string &vsPath, const std::string &fsPath, const std::string &defines = "") {
         std::string vsCode = getContentFromFile(vsPath);
         std::string fsCode = getContentFromFile(fsPath);
 
         if (vsCode.empty() || fsCode.empty()) {
             throw std::runtime_error("Failed to load shader files.");
         }
+        vsCode = insertDefines(vsCode, defines);
+        fsCode = insertDefines(fsCode, defines);
 
         unsigned vertex = glCreateShader(GL_VERTEX_SHADER);
         const char* vsCodeCStr = vsCode.c_str();
@@ -63,7 +67,7 @@ public:
         glUniform1f(getUniformLocation(uniform), value);
     }
 
-    void setVec2(const char *uniform, glm::vec2 &value) {
+    void setVec2(const char *uniform, const glm::vec2 &value) {
         glUniform2fv(getUniformLocation(uniform), 1, &value[0]);
     }
 
@@ -71,7 +75,7 @@ public:
         glUniform2f(getUniformLocation(uniform), x, y);
     }
 
-    void setVec3(const char *uniform, glm::vec3 &value) {
+    void setVec3(const char *uniform, const glm::vec3 &value) {
         glUniform3fv(getUniformLocation(uniform), 1, &value[0]);
     }
 
@@ -79,7 +83,7 @@ public:
         glUniform3f(getUniformLocation(uniform), x, y, z);
     }
 
-    void setVec4(const char *uniform, glm::vec4 &value) {
+    void setVec4(const char *uniform, const glm::vec4 &value) {
         glUniform4fv(getUniformLocation(uniform), 1, &value[0]);
     }
 
@@ -87,19 +91,30 @@ public:
         glUniform4f(getUniformLocation(uniform), x, y, z, w);
     }
 
-    void setMat2(const char *uniform, glm::mat2 &value) {
+    void setMat2(const char *uniform, const glm::mat2 &value) {
         glUniformMatrix2fv(getUniformLocation(uniform), 1, GL_FALSE, &value[0][0]);
     }
 
-    void setMat3(const char *uniform, glm::mat3 &value) {
+    void setMat3(const char *uniform, const glm::mat3 &value) {
         glUniformMatrix3fv(getUniformLocation(uniform), 1, GL_FALSE, &value[0][0]);
     }
 
-    void setMat4(const char *uniform, glm::mat4 &value) {
+    void setMat4(const char *uniform, const glm::mat4 &value) {
         glUniformMatrix4fv(getUniformLocation(uniform), 1, GL_FALSE, &value[0][0]);
     }
 
 private:
+    static std::string insertDefines(const std::string &code, const std::string &defines) {
+        if (defines.empty()) {
+            return code;
+        }
+        size_t lineEnd = code.find('\n');
+        if (code.compare(0, 8, "#version") != 0 || lineEnd == std::string::npos) {
+            return defines + code;
+        }
+        return code.substr(0, lineEnd + 1) + defines + code.substr(lineEnd + 1);
+    }
+
     int getUniformLocation(const char *uniform) {
         int loc = glGetUniformLocation(ID, uniform);
         if (loc == -1) {
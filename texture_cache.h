@@ -0,0 +1,999 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+// glad must be included before GLFW
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "allocation_tracker.h"
+#include "dds.h"
+#include "frame_arena.h"
+#include "mipmap.h"
+#include "parallel.h"
+#include "texture_compress.h"
+#include "texture_format.h"
+
+// the including file may already have pulled in the implementation
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image.h"
+#endif
+
+// Process-wide texture manager.
+//
+// Textures are keyed by a hash of the file contents, so the same image
+// referenced through different paths or by different models is uploaded
+// once. Users hold refcounted TextureHandles; unreferenced textures stay
+// cached until the VRAM budget needs the space (LRU). When referenced
+// textures alone exceed the budget their top mips are dropped, keeping the
+// lower mips resident as a fallback until the budget allows a reload.
+//
+// Images embedded in other files (a GLB's binary chunk) are loaded through
+// a path naming their bytes, see embeddedImagePath(); evicted ones are
+// re-read from the containing file like any other.
+//
+// Mip chains are generated on the CPU (mipmap.h), optionally block
+// compressed, and written to a DDS file in the disk cache directory, so
+// later runs only read and upload the levels.
+//
+// With streaming enabled, textures start out with only their tail mips (up
+// to a size threshold) resident. Each frame callers report how finely each
+// texture is needed (requestFootprint) and update() pages the missing
+// levels in from the baked file on a background thread, dropping levels
+// again once they've gone unused for a while. Streamed textures use mutable
+// storage so GL_TEXTURE_BASE_LEVEL can clamp sampling to what's resident.
+//
+// All calls must be made on the thread owning the GL context.
+
+struct TextureEntry {
+    GLuint id = 0;
+    uint64_t hash = 0;
+    std::string path;
+    int width = 0, height = 0, channels = 0;
+    TextureUsage usage = TextureUsage::Color;
+    TextureFormat format;
+    unsigned levels = 0;     // size of the full mip chain
+    unsigned baseLevel = 0;  // first resident level of the full chain
+    size_t bytes = 0;        // resident bytes
+    float psnr = 0.f;        // of the compressed top level, 0 if uncompressed
+    unsigned refs = 0;
+    uint64_t lastUse = 0;
+
+    // streaming
+    bool streamed = false;
+    std::string bakedPath;          // where missing levels are read from
+    float wantedLevel = FLT_MAX;    // finest level requested this frame
+    bool reading = false;           // levels in flight from the disk cache
+    unsigned idleFrames = 0;        // frames the top resident level went unused
+};
+
+// Mip level needed to texture a surface with `texelsPerUnit` texels per
+// world unit seen from `distance` away, given the vertical field of view
+// (radians) and viewport height in pixels.
+inline float footprintMipLevel(float texelsPerUnit, float distance, float fovY, int viewportHeight) {
+    float unitsPerPixel = 2.f * std::max(distance, 1e-3f) * std::tan(fovY * 0.5f) / std::max(1, viewportHeight);
+    return std::max(0.f, std::log2(std::max(1e-6f, texelsPerUnit * unitsPerPixel)));
+}
+
+// path for load() of the `size` bytes at `offset` in `file`
+inline std::string embeddedImagePath(const std::string &file, size_t offset, size_t size) {
+    return file + "#" + std::to_string(offset) + "," + std::to_string(size);
+}
+
+// the file and byte range of an embeddedImagePath(), false for plain paths
+inline bool splitEmbeddedImagePath(const std::string &path, std::string &file, size_t &offset, size_t &size) {
+    const size_t hash = path.find_last_of('#'), comma = path.find_last_of(',');
+    if (hash == std::string::npos || comma == std::string::npos || comma < hash + 2 || comma + 1 == path.size() ||
+        path.find_first_not_of("0123456789,", hash + 1) != std::string::npos) {
+        return false;
+    }
+    file = path.substr(0, hash);
+    offset = (size_t)std::stoull(path.substr(hash + 1, comma - hash - 1));
+    size = (size_t)std::stoull(path.substr(comma + 1));
+    return true;
+}
+
+class TextureHandle {
+public:
+    TextureHandle() = default;
+    explicit TextureHandle(TextureEntry *entry);
+    TextureHandle(const TextureHandle &other) : TextureHandle(other.entry) {}
+    TextureHandle(TextureHandle &&other) noexcept : entry(other.entry) { other.entry = nullptr; }
+    TextureHandle &operator=(TextureHandle other) noexcept {
+        std::swap(entry, other.entry);
+        return *this;
+    }
+    ~TextureHandle();
+
+    explicit operator bool() const { return entry && entry->id; }
+    GLuint id() const { return entry ? entry->id : 0; }
+    const TextureEntry *get() const { return entry; }
+
+    // bind to the active texture unit and mark as recently used
+    void bind() const;
+    void touch() const;
+
+private:
+    friend class TextureCache;
+
+    TextureEntry *entry = nullptr;
+};
+
+class TextureCache {
+public:
+    static TextureCache &instance() {
+        static TextureCache cache;
+        return cache;
+    }
+
+    TextureCache(const TextureCache &) = delete;
+    TextureCache &operator=(const TextureCache &) = delete;
+
+    TextureHandle load(const std::string &imagePath, TextureUsage usage = TextureUsage::Color) {
+        std::vector<unsigned char> file;
+        uint64_t hash;
+        if (!hashFile(imagePath, usage, hash, file)) {
+            std::cerr << "ERROR: Failed to load texture: " << imagePath << std::endl;
+            return TextureHandle();
+        }
+
+        auto it = entries.find(hash);
+        if (it != entries.end()) {
+            TextureEntry &entry = *it->second;
+            entry.lastUse = ++tick;
+            if ((entry.baseLevel > 0 && !entry.streamed) || !entry.id) {
+                restore(entry, file);
+            }
+            return TextureHandle(&entry);
+        }
+
+        auto entry = std::make_unique<TextureEntry>();
+        entry->hash = hash;
+        entry->path = imagePath;
+        entry->usage = usage;
+        entry->lastUse = ++tick;
+        if (file.empty() && !readFile(imagePath, file)) {
+            std::cerr << "ERROR: Failed to load texture: " << imagePath << std::endl;
+            return TextureHandle();
+        }
+        if (!upload(*entry, file)) {
+            std::cerr << "ERROR: Failed to load texture: " << imagePath << std::endl;
+            return TextureHandle();
+        }
+
+        TextureEntry *raw = entry.get();
+        entries.emplace(hash, std::move(entry));
+        used += raw->bytes;
+        // never evict what we've just been asked for
+        raw->refs++;
+        enforceBudget();
+        raw->refs--;
+        return TextureHandle(raw);
+    }
+
+    // load() a batch of textures not yet cached, decoding and baking them in
+    // parallel on the job system; only the uploads run here. Later load()
+    // calls for the same files then find them cached, as long as the
+    // returned handles are held: unreferenced textures are the first the
+    // budget evicts.
+    std::vector<TextureHandle> preload(const std::vector<std::pair<std::string, TextureUsage>> &textures) {
+        std::vector<TextureHandle> handles;
+        struct Pending {
+            std::unique_ptr<TextureEntry> entry;
+            std::vector<unsigned char> file;
+            TextureFormat format;
+            TextureFile baked;
+            bool ready = false;
+        };
+        std::vector<Pending> pending;
+        for (const auto &[path, usage] : textures) {
+            Pending p;
+            uint64_t hash;
+            if (!hashFile(path, usage, hash, p.file) ||
+                std::any_of(pending.begin(), pending.end(), [&](const Pending &q) { return q.entry->hash == hash; })) {
+                continue;
+            }
+            auto it = entries.find(hash);
+            if (it != entries.end()) {
+                handles.emplace_back(it->second.get());
+                continue;
+            }
+            if (p.file.empty() && !readFile(path, p.file)) {
+                continue;
+            }
+            p.entry = std::make_unique<TextureEntry>();
+            p.entry->hash = hash;
+            p.entry->path = path;
+            p.entry->usage = usage;
+            pending.push_back(std::move(p));
+        }
+
+        parallelFor(pending.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                Pending &p = pending[i];
+                p.ready = prepare(*p.entry, p.file, p.format, p.baked);
+                p.file = std::vector<unsigned char>();
+            }
+        });
+
+        for (Pending &p : pending) {
+            if (!p.ready || !uploadLevels(*p.entry, p.format, p.baked)) {
+                std::cerr << "ERROR: Failed to load texture: " << p.entry->path << std::endl;
+                continue;
+            }
+            p.entry->lastUse = ++tick;
+            used += p.entry->bytes;
+            const uint64_t hash = p.entry->hash;
+            handles.emplace_back(p.entry.get());
+            entries.emplace(hash, std::move(p.entry));
+        }
+        enforceBudget();
+        return handles;
+    }
+
+    // 0 means unlimited
+    void setBudget(size_t bytes) {
+        budget = bytes;
+        enforceBudget();
+    }
+
+    // store color textures as sRGB so sampling returns linear values. Only
+    // affects textures loaded afterwards; the framebuffer must then be sRGB
+    // (GL_FRAMEBUFFER_SRGB) for the output to look right.
+    void setSRGB(bool enabled) { srgb = enabled; }
+
+    // decode images bottom row first, as stbi_set_flip_vertically_on_load()
+    // does; that global isn't looked at. Only affects textures loaded
+    // afterwards.
+    void setFlipVertically(bool enabled) { flipVertically = enabled; }
+
+    // textures are never shrunk below this many texels on their longest side
+    void setFallbackSize(int texels) { fallbackSize = texels; }
+
+    // block compress textures loaded afterwards
+    void setCompression(bool enabled, CompressionPreset preset = CompressionPreset::Normal) {
+        compress = enabled;
+        compressPreset = preset;
+    }
+
+    void setMipFilter(MipFilter filter) { mipFilter = filter; }
+
+    // where baked mip chains are kept between runs; empty disables it
+    void setDiskCache(const std::string &directory) { diskCache = directory; }
+
+    // LEARNOPENGL_TEXTURE_COMPRESSION=off|fast|normal|high
+    // LEARNOPENGL_TEXTURE_BUDGET_MB=<megabytes>
+    // LEARNOPENGL_MIP_FILTER=box|kaiser
+    // LEARNOPENGL_TEXTURE_STREAMING=<tail size in texels>
+    void configureFromEnv() {
+        if (const char *mode = getenv("LEARNOPENGL_TEXTURE_COMPRESSION")) {
+            std::string value = mode;
+            if (value == "fast") {
+                setCompression(true, CompressionPreset::Fast);
+            } else if (value == "normal") {
+                setCompression(true, CompressionPreset::Normal);
+            } else if (value == "high") {
+                setCompression(true, CompressionPreset::High);
+            } else if (value == "off") {
+                setCompression(false);
+            } else {
+                std::cerr << "WARNING: unknown LEARNOPENGL_TEXTURE_COMPRESSION " << value << std::endl;
+            }
+        }
+        if (const char *megabytes = getenv("LEARNOPENGL_TEXTURE_BUDGET_MB")) {
+            setBudget((size_t)atoi(megabytes) * 1024 * 1024);
+        }
+        if (const char *filter = getenv("LEARNOPENGL_MIP_FILTER")) {
+            setMipFilter(std::string(filter) == "box" ? MipFilter::Box : MipFilter::Kaiser);
+        }
+        if (const char *tail = getenv("LEARNOPENGL_TEXTURE_STREAMING")) {
+            setStreaming(atoi(tail));
+        }
+    }
+
+    // keep only levels up to `tailSize` texels resident until requested;
+    // needs a disk cache. 0 turns streaming off for textures loaded afterwards.
+    void setStreaming(int tailSize) { streamTail = tailSize; }
+
+    // report that `texture` is drawn on a surface with `uvDensity` texture
+    // coordinate units per world unit, `distance` away from the camera
+    void requestFootprint(const TextureHandle &texture, float uvDensity, float distance, float fovY, int viewportHeight) {
+        TextureEntry *entry = texture.entry;
+        if (!entry || !entry->streamed) {
+            return;
+        }
+        float texelsPerUnit = uvDensity * std::max(entry->width, entry->height);
+        entry->wantedLevel = std::min(entry->wantedLevel, footprintMipLevel(texelsPerUnit, distance, fovY, viewportHeight));
+    }
+
+    // once per frame: upload streamed levels that finished loading, queue
+    // reads for newly needed levels and drop levels that went unused
+    void update() {
+        if (!streamTail) {
+            return;
+        }
+
+        // in the frame arena: even an empty std::deque allocates
+        std::pmr::deque<StreamResult> done(&FrameArena::local());
+        {
+            std::lock_guard<std::mutex> lock(streamMutex);
+            while (!streamResults.empty()) {
+                done.push_back(std::move(streamResults.front()));
+                streamResults.pop_front();
+            }
+        }
+        size_t uploaded = 0;
+        while (!done.empty() && uploaded < streamUploadBytes) {
+            uploaded += pageIn(done.front());
+            done.pop_front();
+        }
+        if (!done.empty()) {
+            // over this frame's upload allowance, the rest waits
+            std::lock_guard<std::mutex> lock(streamMutex);
+            streamResults.insert(streamResults.begin(), std::make_move_iterator(done.begin()),
+                                 std::make_move_iterator(done.end()));
+        }
+
+        for (auto &[hash, ptr] : entries) {
+            TextureEntry &entry = *ptr;
+            if (!entry.streamed || !entry.id) {
+                continue;
+            }
+            unsigned tail = tailLevel(entry);
+            unsigned target = entry.wantedLevel < (float)tail ? (unsigned)entry.wantedLevel : tail;
+            entry.wantedLevel = FLT_MAX;
+            if (target < entry.baseLevel) {
+                entry.idleFrames = 0;
+                if (!entry.reading) {
+                    requestLevels(entry, target);
+                }
+            } else if (target > entry.baseLevel && !entry.reading) {
+                if (++entry.idleFrames >= streamDropFrames) {
+                    dropTopLevel(entry);
+                    entry.idleFrames = 0;
+                }
+            } else {
+                entry.idleFrames = 0;
+            }
+        }
+    }
+
+    // the texture's mip chain from its resident top level down, read from
+    // the disk cache when it was baked there and back from GL otherwise
+    bool readLevels(const TextureHandle &texture, TextureFile &out) {
+        TextureEntry *entry = texture.entry;
+        if (!entry || !entry->id) {
+            return false;
+        }
+        if (!entry->bakedPath.empty() && readDDS(entry->bakedPath, out)) {
+            return true;
+        }
+
+        out.dxgiFormat = entry->format.dxgiFormat;
+        out.swizzle = (uint32_t)entry->format.swizzle;
+        out.psnr = entry->psnr;
+        out.width = std::max(1, entry->width >> entry->baseLevel);
+        out.height = std::max(1, entry->height >> entry->baseLevel);
+        out.levelCount = entry->levels - entry->baseLevel;
+        out.firstLevel = 0;
+        out.levels.resize(out.levelCount);
+        glBindTexture(GL_TEXTURE_2D, entry->id);
+        for (unsigned i = 0; i < out.levelCount; ++i) {
+            // demoted textures were moved to a smaller texture object, streamed
+            // ones keep their levels where they are
+            unsigned level = entry->streamed ? entry->baseLevel + i : i;
+            readTextureLevel(entry->format, level, std::max(1, out.width >> i), std::max(1, out.height >> i),
+                             out.levels[i]);
+        }
+        return true;
+    }
+
+    size_t usedBytes() const { return used; }
+    size_t budgetBytes() const { return budget; }
+
+    // free every texture nobody holds a handle to
+    void purgeUnused() {
+        for (auto it = entries.begin(); it != entries.end();) {
+            if (it->second->refs == 0) {
+                destroy(*it->second);
+                it = entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // delete all GL objects; call before the context goes away. Handles
+    // still alive afterwards resolve to texture 0.
+    void releaseGL() {
+        stopStreaming();
+        for (auto &[hash, entry] : entries) {
+            destroy(*entry);
+        }
+    }
+
+    // per texture format and size, compared with what the old loaders
+    // allocated (GL_RGB for everything, which drivers pad to 4 bytes)
+    void report(const std::string &scene, std::ostream &out = std::cerr) const {
+        size_t baseline = 0;
+        out << "texture memory (" << scene << "): " << entries.size() << " textures, "
+            << dedupHits << " duplicate loads avoided" << std::endl;
+        for (const auto &[hash, entry] : entries) {
+            size_t old = mipChainBytes(TextureFormat(), entry->width, entry->height, 0, entry->levels);
+            baseline += old;
+            out << "  " << entry->width << "x" << entry->height << " " << entry->format.name
+                << " refs=" << entry->refs << " base=" << entry->baseLevel << "  "
+                << entry->bytes / 1024 << " KiB (GL_RGB: " << old / 1024 << " KiB)  ";
+            if (entry->streamed) {
+                out << "streamed ";
+            }
+            if (entry->psnr > 0.f) {
+                out << "PSNR " << entry->psnr << " dB  ";
+            }
+            out << entry->path << std::endl;
+        }
+        out << "  total " << used / 1024 << " KiB";
+        if (budget) {
+            out << " / " << budget / 1024 << " KiB budget";
+        }
+        if (baseline > used) {
+            out << ", saved " << (baseline - used) / 1024 << " KiB ("
+                << (baseline - used) * 100 / baseline << "%) over GL_RGB";
+        }
+        out << std::endl;
+    }
+
+private:
+    friend class TextureHandle;
+
+    std::unordered_map<uint64_t, std::unique_ptr<TextureEntry>> entries;
+    size_t used = 0;
+    size_t budget = 0;
+    int fallbackSize = 64;
+    bool srgb = false;
+    bool flipVertically = false;
+    bool compress = false;
+    MipFilter mipFilter = MipFilter::Kaiser;
+    CompressionPreset compressPreset = CompressionPreset::Normal;
+    std::string diskCache;
+    uint64_t tick = 0;
+
+    struct StreamRequest {
+        uint64_t hash;
+        std::string path;
+        unsigned firstLevel, levelCount;
+    };
+    struct StreamResult {
+        uint64_t hash;
+        TextureFile texture; // empty levels if the read failed
+    };
+    int streamTail = 0;
+    unsigned streamDropFrames = 120;
+    size_t streamUploadBytes = 8 << 20; // per frame
+    std::thread streamThread;
+    std::mutex streamMutex;
+    std::condition_variable streamWake;
+    std::deque<StreamRequest> streamRequests;
+    std::deque<StreamResult> streamResults;
+    bool streamStop = false;
+    unsigned dedupHits = 0;
+
+    // memoize path -> content hash so repeated loads of an unchanged file
+    // don't have to read it again
+    struct PathInfo {
+        std::filesystem::file_time_type mtime;
+        uintmax_t size;
+        uint64_t hash;
+    };
+    std::unordered_map<std::string, PathInfo> pathHashes;
+
+    TextureCache() = default;
+    ~TextureCache() { stopStreaming(); }
+
+    static bool readFile(const std::string &path, std::vector<unsigned char> &data) {
+        std::string container;
+        size_t offset, size;
+        if (splitEmbeddedImagePath(path, container, offset, size)) {
+            std::ifstream file(container, std::ios::binary);
+            data.resize(size);
+            file.seekg((std::streamoff)offset);
+            file.read((char *)data.data(), size);
+            return (bool)file;
+        }
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) {
+            return false;
+        }
+        data.resize((size_t)file.tellg());
+        file.seekg(0);
+        file.read((char *)data.data(), data.size());
+        return (bool)file;
+    }
+
+    // 64-bit FNV-1a over 8-byte words with a final avalanche
+    static uint64_t hashBytes(const unsigned char *data, size_t size) {
+        uint64_t h = 0xcbf29ce484222325ull ^ size;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            h = (h ^ word) * 0x100000001b3ull;
+            h ^= h >> 29;
+        }
+        for (; i < size; ++i) {
+            h = (h ^ data[i]) * 0x100000001b3ull;
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // the same file loaded for another usage may get a different format, so
+    // it lives in its own entry
+    static uint64_t entryKey(uint64_t contentHash, TextureUsage usage) {
+        return usage == TextureUsage::Color ? contentHash : contentHash ^ 0x9e3779b97f4a7c15ull;
+    }
+
+    // fills data only when the file actually had to be read
+    bool hashFile(const std::string &path, TextureUsage usage, uint64_t &hash, std::vector<unsigned char> &data) {
+        // embedded images are as current as the file holding them
+        std::string file = path;
+        size_t offset, length;
+        splitEmbeddedImagePath(path, file, offset, length);
+        std::error_code ec;
+        auto mtime = std::filesystem::last_write_time(file, ec);
+        if (ec) {
+            return false;
+        }
+        uintmax_t size = std::filesystem::file_size(file, ec);
+
+        auto it = pathHashes.find(path);
+        if (it != pathHashes.end() && it->second.mtime == mtime && it->second.size == size) {
+            hash = entryKey(it->second.hash, usage);
+            if (entries.count(hash)) {
+                ++dedupHits;
+            }
+            return true;
+        }
+
+        if (!readFile(path, data)) {
+            return false;
+        }
+        uint64_t contentHash = hashBytes(data.data(), data.size());
+        pathHashes[path] = {mtime, size, contentHash};
+        hash = entryKey(contentHash, usage);
+        if (entries.count(hash)) {
+            ++dedupHits;
+        }
+        return true;
+    }
+
+    bool upload(TextureEntry &entry, const std::vector<unsigned char> &file) {
+        TextureFormat format;
+        TextureFile baked;
+        return prepare(entry, file, format, baked) && uploadLevels(entry, format, baked);
+    }
+
+    // everything upload() does short of GL: read the baked file, or decode,
+    // build mips, compress and bake. Touches only `entry`, so entries can be
+    // prepared on several threads.
+    bool prepare(TextureEntry &entry, const std::vector<unsigned char> &file, TextureFormat &format, TextureFile &baked) const {
+        const std::string bakedPath = bakedFilePath(entry);
+        entry.streamed = streamTail > 0 && !bakedPath.empty();
+        entry.bakedPath = bakedPath;
+        if (!bakedPath.empty() && readBaked(entry, bakedPath, format, baked)) {
+            return true;
+        }
+
+        int width, height, nrChannels;
+        // per thread: preload() decodes on the job system
+        stbi_set_flip_vertically_on_load_thread(flipVertically);
+        unsigned char *data = stbi_load_from_memory(file.data(), (int)file.size(), &width, &height, &nrChannels, 0);
+        if (!data) {
+            return false;
+        }
+
+        ImageContent content = analyzeImage(data, width, height, nrChannels);
+        format = chooseTextureFormat(content, entry.usage, srgb);
+        std::vector<unsigned char> converted;
+        const unsigned char *pixels = data;
+        if (format.channels != (unsigned)nrChannels) {
+            converted = convertImage(data, width, height, nrChannels, format);
+            pixels = converted.data();
+        }
+
+        entry.width = width;
+        entry.height = height;
+        entry.channels = nrChannels;
+        entry.levels = mipLevelCount(width, height);
+        entry.baseLevel = 0;
+        entry.psnr = 0.f;
+
+        // mips are built here rather than with glGenerateMipmap so they can be
+        // filtered properly and baked into the disk cache with the texture
+        MipOptions mipOptions;
+        mipOptions.filter = mipFilter;
+        mipOptions.srgb = entry.usage == TextureUsage::Color;
+        mipOptions.alphaChannel = format.channels == 4 ? 3 : format.channels == 2 ? 1 : -1;
+        mipOptions.alphaCutoff = content.cutout ? 0.5f : 0.f;
+        auto start = std::chrono::steady_clock::now();
+        std::vector<MipLevel> mips = buildMipChain(pixels, width, height, format.channels, mipOptions);
+        stbi_image_free(data);
+
+        BlockFormat block;
+        if (compress && chooseBlockFormat(format, content, compressPreset, block)) {
+            CompressedTexture compressed = compressMipChain(mips, block, compressPreset);
+            format = compressedTextureFormat(block, format.internalFormat == GL_SRGB8_ALPHA8, format.swizzle);
+            baked.psnr = compressed.psnr;
+            baked.levels = std::move(compressed.levels);
+        } else {
+            for (MipLevel &level : mips) {
+                baked.levels.push_back(std::move(level.pixels));
+            }
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        baked.dxgiFormat = format.dxgiFormat;
+        baked.width = width;
+        baked.height = height;
+        baked.swizzle = (uint32_t)format.swizzle;
+        baked.levelCount = (unsigned)baked.levels.size();
+
+        // one write, as entries may be baked in parallel
+        std::ostringstream log;
+        log << "baked " << entry.path << ": " << format.name << ", " << mipFilterName(mipFilter) << " mips";
+        if (format.compressed()) {
+            log << ", " << compressionPresetName(compressPreset) << " PSNR " << baked.psnr << " dB";
+        }
+        log << " in " << ms << " ms\n";
+        std::cerr << log.str() << std::flush;
+        if (!bakedPath.empty()) {
+            std::error_code ec;
+            std::filesystem::create_directories(diskCache, ec);
+            writeDDS(bakedPath, baked);
+        }
+        if (entry.streamed) {
+            baked.firstLevel = tailLevel(entry);
+            baked.levels.erase(baked.levels.begin(), baked.levels.begin() + baked.firstLevel);
+        }
+        return true;
+    }
+
+    // cache file for the entry under the current settings; the driver's
+    // format support is checked when it's read back
+    std::string bakedFilePath(const TextureEntry &entry) const {
+        if (diskCache.empty()) {
+            return std::string();
+        }
+        char name[96];
+        snprintf(name, sizeof(name), "%016llx_%s_%s%s%s.dds", (unsigned long long)entry.hash,
+                 compress ? compressionPresetName(compressPreset) : "raw", mipFilterName(mipFilter),
+                 srgb ? "_srgb" : "", flipVertically ? "_flip" : "");
+        return diskCache + "/" + name;
+    }
+
+    bool readBaked(TextureEntry &entry, const std::string &path, TextureFormat &format, TextureFile &baked) const {
+        if (!std::filesystem::exists(path)) {
+            return false;
+        }
+        if (!readDDSHeader(path, baked) ||
+            !textureFormatFromDXGI(baked.dxgiFormat, (TextureSwizzle)baked.swizzle, format)) {
+            return false;
+        }
+        entry.width = baked.width;
+        entry.height = baked.height;
+        entry.channels = format.channels;
+        entry.levels = baked.levelCount;
+        return readDDS(path, baked, entry.streamed ? tailLevel(entry) : 0) && !baked.levels.empty();
+    }
+
+    // uploads baked.levels, which start at baked.firstLevel
+    bool uploadLevels(TextureEntry &entry, const TextureFormat &format, const TextureFile &baked) {
+        entry.format = format;
+        entry.psnr = baked.psnr;
+        entry.levels = baked.levelCount;
+        entry.baseLevel = baked.firstLevel;
+        entry.bytes = mipChainBytes(format, entry.width, entry.height, entry.baseLevel, entry.levels);
+        if (!entry.id) {
+            glGenTextures(1, &entry.id);
+        }
+        glBindTexture(GL_TEXTURE_2D, entry.id);
+        setSamplerState();
+        if (entry.streamed) {
+            applySwizzle(format);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, entry.baseLevel);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, entry.levels - 1);
+        } else {
+            allocateTexture2D(format, entry.width, entry.height, entry.levels);
+        }
+        for (unsigned i = 0; i < baked.levels.size(); ++i) {
+            unsigned level = baked.firstLevel + i;
+            int width = std::max(1, entry.width >> level), height = std::max(1, entry.height >> level);
+            if (entry.streamed) {
+                defineTextureLevel(format, level, width, height, baked.levels[i].data());
+            } else {
+                writeTextureLevel(format, level, width, height, baked.levels[i].data());
+            }
+        }
+        return true;
+    }
+
+    // first level no larger than the streaming tail size
+    unsigned tailLevel(const TextureEntry &entry) const {
+        unsigned level = 0;
+        while (level + 1 < entry.levels && std::max(entry.width >> level, entry.height >> level) > streamTail) {
+            ++level;
+        }
+        return level;
+    }
+
+    // queue a read of levels [target, baseLevel), as many as fit the budget
+    void requestLevels(TextureEntry &entry, unsigned target) {
+        while (budget && target < entry.baseLevel &&
+               used + mipChainBytes(entry.format, entry.width, entry.height, target, entry.baseLevel) > budget) {
+            ++target;
+        }
+        if (target >= entry.baseLevel) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(streamMutex);
+        if (!streamThread.joinable()) {
+            streamStop = false;
+            streamThread = std::thread(&TextureCache::streamWorker, this);
+        }
+        streamRequests.push_back({entry.hash, entry.bakedPath, target, entry.baseLevel - target});
+        entry.reading = true;
+        streamWake.notify_one();
+    }
+
+    void streamWorker() {
+        AllocationScope allocationScope("texture streaming");
+        std::unique_lock<std::mutex> lock(streamMutex);
+        for (;;) {
+            streamWake.wait(lock, [this] { return streamStop || !streamRequests.empty(); });
+            if (streamStop) {
+                return;
+            }
+            StreamRequest request = std::move(streamRequests.front());
+            streamRequests.pop_front();
+            lock.unlock();
+
+            StreamResult result;
+            result.hash = request.hash;
+            if (!readDDS(request.path, result.texture, request.firstLevel, request.levelCount)) {
+                result.texture.levels.clear();
+            }
+
+            lock.lock();
+            streamResults.push_back(std::move(result));
+        }
+    }
+
+    void stopStreaming() {
+        {
+            std::lock_guard<std::mutex> lock(streamMutex);
+            streamStop = true;
+            streamRequests.clear();
+            streamResults.clear();
+        }
+        streamWake.notify_all();
+        if (streamThread.joinable()) {
+            streamThread.join();
+        }
+        for (auto &[hash, entry] : entries) {
+            entry->reading = false;
+        }
+    }
+
+    // upload levels read by the stream worker; returns the bytes uploaded
+    size_t pageIn(const StreamResult &result) {
+        auto it = entries.find(result.hash);
+        if (it == entries.end()) {
+            return 0;
+        }
+        TextureEntry &entry = *it->second;
+        entry.reading = false;
+        const TextureFile &texture = result.texture;
+        // the texture may have been released or demoted since the request
+        if (!entry.id || texture.levels.empty() || texture.firstLevel + texture.levels.size() != entry.baseLevel) {
+            return 0;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, entry.id);
+        size_t bytes = 0;
+        for (unsigned i = 0; i < texture.levels.size(); ++i) {
+            unsigned level = texture.firstLevel + i;
+            int width = std::max(1, entry.width >> level), height = std::max(1, entry.height >> level);
+            defineTextureLevel(entry.format, level, width, height, texture.levels[i].data());
+            bytes += texture.levels[i].size();
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.firstLevel);
+        entry.baseLevel = texture.firstLevel;
+        used -= entry.bytes;
+        entry.bytes = mipChainBytes(entry.format, entry.width, entry.height, entry.baseLevel, entry.levels);
+        used += entry.bytes;
+        return bytes;
+    }
+
+    // streamed textures shrink in place: clamp the base level and free the
+    // level below it
+    bool dropTopLevel(TextureEntry &entry) {
+        if (entry.baseLevel + 1 >= entry.levels) {
+            return false;
+        }
+        glBindTexture(GL_TEXTURE_2D, entry.id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, entry.baseLevel + 1);
+        defineTextureLevel(entry.format, entry.baseLevel, 0, 0, nullptr);
+        entry.baseLevel++;
+        used -= entry.bytes;
+        entry.bytes = mipChainBytes(entry.format, entry.width, entry.height, entry.baseLevel, entry.levels);
+        used += entry.bytes;
+        return true;
+    }
+
+    static void setSamplerState() {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    void destroy(TextureEntry &entry) {
+        if (entry.id) {
+            glDeleteTextures(1, &entry.id);
+            entry.id = 0;
+        }
+        used -= entry.bytes;
+        entry.bytes = 0;
+    }
+
+    // bring a demoted or released texture back to full resolution if the
+    // budget allows it
+    void restore(TextureEntry &entry, std::vector<unsigned char> &file) {
+        size_t full = mipChainBytes(entry.format, entry.width, entry.height, 0, entry.levels);
+        if (budget && used - entry.bytes + full > budget && entry.id) {
+            return;
+        }
+        if (file.empty() && !readFile(entry.path, file)) {
+            return;
+        }
+
+        used -= entry.bytes;
+        GLuint old = entry.id;
+        entry.id = 0;
+        if (upload(entry, file)) {
+            if (old) glDeleteTextures(1, &old);
+        } else {
+            entry.id = old;
+        }
+        used += entry.bytes;
+    }
+
+    // drop the top mip of a referenced texture, keeping the lower levels.
+    // A new texture object is created so this also works for immutable
+    // storage; handles pick up the new name through the entry.
+    bool demote(TextureEntry &entry) {
+        int width = std::max(1, entry.width >> (entry.baseLevel + 1));
+        int height = std::max(1, entry.height >> (entry.baseLevel + 1));
+        if (std::max(width, height) < fallbackSize || entry.baseLevel + 1 >= entry.levels) {
+            return false;
+        }
+        if (entry.streamed) {
+            return dropTopLevel(entry);
+        }
+
+        const TextureFormat &format = entry.format;
+        unsigned newLevels = entry.levels - entry.baseLevel - 1;
+        GLuint smaller;
+        glGenTextures(1, &smaller);
+        glBindTexture(GL_TEXTURE_2D, smaller);
+        setSamplerState();
+        allocateTexture2D(format, width, height, newLevels);
+
+        std::vector<unsigned char> level;
+        for (unsigned i = 0; i < newLevels; ++i) {
+            int w = std::max(1, width >> i), h = std::max(1, height >> i);
+            glBindTexture(GL_TEXTURE_2D, entry.id);
+            readTextureLevel(format, i + 1, w, h, level);
+            glBindTexture(GL_TEXTURE_2D, smaller);
+            writeTextureLevel(format, i, w, h, level.data());
+        }
+
+        glDeleteTextures(1, &entry.id);
+        entry.id = smaller;
+        entry.baseLevel++;
+        used -= entry.bytes;
+        entry.bytes = mipChainBytes(entry.format, entry.width, entry.height, entry.baseLevel, entry.levels);
+        used += entry.bytes;
+        return true;
+    }
+
+    void enforceBudget() {
+        if (!budget || used <= budget) {
+            return;
+        }
+
+        std::vector<TextureEntry *> lru;
+        for (auto &[hash, entry] : entries) {
+            lru.push_back(entry.get());
+        }
+        std::sort(lru.begin(), lru.end(), [](const TextureEntry *a, const TextureEntry *b) {
+            return a->lastUse < b->lastUse;
+        });
+
+        // first evict whatever nobody references, least recently used first
+        for (TextureEntry *entry : lru) {
+            if (used <= budget) return;
+            if (entry->refs == 0 && entry->id) {
+                destroy(*entry);
+            }
+        }
+
+        // then shrink referenced textures one mip at a time
+        bool progress = true;
+        while (used > budget && progress) {
+            progress = false;
+            for (TextureEntry *entry : lru) {
+                if (used <= budget) return;
+                if (entry->refs > 0 && entry->id) {
+                    progress |= demote(*entry);
+                }
+            }
+        }
+
+        if (used > budget) {
+            std::cerr << "WARNING: texture cache over budget (" << used / 1024 << " KiB > "
+                      << budget / 1024 << " KiB) with every texture at its fallback size" << std::endl;
+        }
+    }
+
+    void acquire(TextureEntry *entry) { entry->refs++; }
+
+    void release(TextureEntry *entry) {
+        entry->refs--;
+        if (entry->refs == 0) {
+            enforceBudget();
+        }
+    }
+
+    void touch(TextureEntry *entry) { entry->lastUse = ++tick; }
+};
+
+inline TextureHandle::TextureHandle(TextureEntry *entry) : entry(entry) {
+    if (entry) TextureCache::instance().acquire(entry);
+}
+
+inline TextureHandle::~TextureHandle() {
+    if (entry) TextureCache::instance().release(entry);
+}
+
+inline void TextureHandle::bind() const {
+    touch();
+    glBindTexture(GL_TEXTURE_2D, id());
+}
+
+inline void TextureHandle::touch() const {
+    if (entry) TextureCache::instance().touch(entry);
+}
+
+#endif
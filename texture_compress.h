@@ -0,0 +1,761 @@
+#ifndef TEXTURE_COMPRESS_H
+#define TEXTURE_COMPRESS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TEXTURE_COMPRESS_SSE2 1
+#endif
+
+#include "mipmap.h"
+#include "parallel.h"
+
+// CPU block compression for BC1 / BC3 / BC4 / BC5 / BC7.
+//
+// Inputs are tightly packed 8-bit images with as many channels as the format
+// needs: BC4 takes one channel, BC5 two, BC1 / BC3 / BC7 four (RGBA). BC7 is
+// encoded with mode 6 only (one subset, RGBA, 16 index levels), which is what
+// most fast BC7 encoders fall back to and is a large quality step up from
+// BC1 / BC3 at the same footprint as BC3.
+//
+// Presets trade speed for quality:
+//   Fast   - bounding box endpoints, indices by projection
+//   Normal - principal axis endpoints, exact nearest indices
+//   High   - Normal plus least squares endpoint refinement and p-bit search
+//
+// Blocks are encoded in parallel over block rows; the nearest palette entry
+// search is vectorized with SSE2 where available.
+
+enum class BlockFormat { BC1, BC3, BC4, BC5, BC7 };
+enum class CompressionPreset { Fast, Normal, High };
+
+inline unsigned blockFormatBytes(BlockFormat format) {
+    return (format == BlockFormat::BC1 || format == BlockFormat::BC4) ? 8 : 16;
+}
+
+inline unsigned blockFormatChannels(BlockFormat format) {
+    switch (format) {
+        case BlockFormat::BC4: return 1;
+        case BlockFormat::BC5: return 2;
+        default: return 4;
+    }
+}
+
+inline const char *blockFormatName(BlockFormat format) {
+    switch (format) {
+        case BlockFormat::BC1: return "BC1";
+        case BlockFormat::BC3: return "BC3";
+        case BlockFormat::BC4: return "BC4";
+        case BlockFormat::BC5: return "BC5";
+        case BlockFormat::BC7: return "BC7";
+    }
+    return "?";
+}
+
+inline const char *compressionPresetName(CompressionPreset preset) {
+    switch (preset) {
+        case CompressionPreset::Fast: return "fast";
+        case CompressionPreset::Normal: return "normal";
+        case CompressionPreset::High: return "high";
+    }
+    return "?";
+}
+
+namespace bc {
+
+// 16 texels in SoA order, up to 4 channels
+struct Block {
+    float c[4][16];
+};
+
+inline void fetchBlock(const MipLevel &level, int channels, int bx, int by, Block &block) {
+    for (int i = 0; i < 16; ++i) {
+        int x = std::min(level.width - 1, bx * 4 + (i & 3));
+        int y = std::min(level.height - 1, by * 4 + (i >> 2));
+        const unsigned char *p = level.pixels.data() + ((size_t)y * level.width + x) * channels;
+        for (int c = 0; c < 4; ++c) {
+            block.c[c][i] = c < channels ? (float)p[c] : 0.f;
+        }
+    }
+}
+
+// Picks the nearest of `count` palette entries for every texel, comparing
+// the first `dims` channels. Returns the summed squared error.
+inline float selectIndices(const Block &block, int dims, const float (*palette)[4], int count, uint8_t *indices) {
+    float total = 0.f;
+#ifdef TEXTURE_COMPRESS_SSE2
+    for (int g = 0; g < 16; g += 4) {
+        __m128 px[4];
+        for (int c = 0; c < dims; ++c) {
+            px[c] = _mm_loadu_ps(&block.c[c][g]);
+        }
+        __m128 best = _mm_set1_ps(3.4e38f);
+        __m128i bestIndex = _mm_setzero_si128();
+        for (int k = 0; k < count; ++k) {
+            __m128 d = _mm_setzero_ps();
+            for (int c = 0; c < dims; ++c) {
+                __m128 diff = _mm_sub_ps(px[c], _mm_set1_ps(palette[k][c]));
+                d = _mm_add_ps(d, _mm_mul_ps(diff, diff));
+            }
+            __m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+            best = _mm_min_ps(best, d);
+            bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)),
+                                     _mm_andnot_si128(closer, bestIndex));
+        }
+        alignas(16) int32_t idx[4];
+        alignas(16) float err[4];
+        _mm_store_si128((__m128i *)idx, bestIndex);
+        _mm_store_ps(err, best);
+        for (int j = 0; j < 4; ++j) {
+            indices[g + j] = (uint8_t)idx[j];
+            total += err[j];
+        }
+    }
+#else
+    for (int i = 0; i < 16; ++i) {
+        float best = 3.4e38f;
+        int bestIndex = 0;
+        for (int k = 0; k < count; ++k) {
+            float d = 0.f;
+            for (int c = 0; c < dims; ++c) {
+                float diff = block.c[c][i] - palette[k][c];
+                d += diff * diff;
+            }
+            if (d < best) {
+                best = d;
+                bestIndex = k;
+            }
+        }
+        indices[i] = (uint8_t)bestIndex;
+        total += best;
+    }
+#endif
+    return total;
+}
+
+// indices by projecting onto the endpoint axis; palette entries must be
+// evenly spaced from e0 (t = 0) to e1 (t = 1), `order` maps t steps to indices
+inline float projectIndices(const Block &block, int dims, const float *e0, const float *e1,
+                            int steps, const uint8_t *order, const float (*palette)[4], uint8_t *indices) {
+    float axis[4] = {0, 0, 0, 0};
+    float len2 = 0.f;
+    for (int c = 0; c < dims; ++c) {
+        axis[c] = e1[c] - e0[c];
+        len2 += axis[c] * axis[c];
+    }
+    float total = 0.f;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0.f;
+        if (len2 > 0.f) {
+            for (int c = 0; c < dims; ++c) {
+                t += (block.c[c][i] - e0[c]) * axis[c];
+            }
+            t /= len2;
+        }
+        int step = (int)std::lround(std::clamp(t, 0.f, 1.f) * (steps - 1));
+        indices[i] = order[step];
+        for (int c = 0; c < dims; ++c) {
+            float diff = block.c[c][i] - palette[indices[i]][c];
+            total += diff * diff;
+        }
+    }
+    return total;
+}
+
+// endpoints along the principal axis (power iteration on the covariance),
+// pulled in by `inset` of the range since the extremes are rarely optimal
+inline void principalEndpoints(const Block &block, int dims, float *lo, float *hi, float inset) {
+    float mean[4] = {0, 0, 0, 0};
+    for (int c = 0; c < dims; ++c) {
+        for (int i = 0; i < 16; ++i) mean[c] += block.c[c][i];
+        mean[c] /= 16.f;
+    }
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; ++i) {
+        for (int a = 0; a < dims; ++a) {
+            for (int b = a; b < dims; ++b) {
+                cov[a][b] += (block.c[a][i] - mean[a]) * (block.c[b][i] - mean[b]);
+            }
+        }
+    }
+    for (int a = 0; a < dims; ++a) {
+        for (int b = 0; b < a; ++b) cov[a][b] = cov[b][a];
+    }
+
+    float axis[4] = {1, 1, 1, 1};
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[4] = {0, 0, 0, 0};
+        float norm = 0.f;
+        for (int a = 0; a < dims; ++a) {
+            for (int b = 0; b < dims; ++b) next[a] += cov[a][b] * axis[b];
+            norm = std::max(norm, std::fabs(next[a]));
+        }
+        if (norm < 1e-6f) break;
+        for (int a = 0; a < dims; ++a) axis[a] = next[a] / norm;
+    }
+
+    float minT = 3.4e38f, maxT = -3.4e38f;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0.f;
+        for (int c = 0; c < dims; ++c) t += (block.c[c][i] - mean[c]) * axis[c];
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    float len2 = 0.f;
+    for (int c = 0; c < dims; ++c) len2 += axis[c] * axis[c];
+    if (len2 > 0.f) {
+        minT /= len2;
+        maxT /= len2;
+    }
+    float shrink = (maxT - minT) * inset;
+    minT += shrink;
+    maxT -= shrink;
+    for (int c = 0; c < dims; ++c) {
+        lo[c] = std::clamp(mean[c] + axis[c] * minT, 0.f, 255.f);
+        hi[c] = std::clamp(mean[c] + axis[c] * maxT, 0.f, 255.f);
+    }
+}
+
+// bounding box with the diagonal picked by the covariance sign against the
+// channel with the largest range, inset by 1/16 of the range
+inline void boxEndpoints(const Block &block, int dims, float *lo, float *hi) {
+    float mean[4] = {0, 0, 0, 0};
+    int major = 0;
+    float majorRange = -1.f;
+    for (int c = 0; c < dims; ++c) {
+        lo[c] = 255.f;
+        hi[c] = 0.f;
+        for (int i = 0; i < 16; ++i) {
+            lo[c] = std::min(lo[c], block.c[c][i]);
+            hi[c] = std::max(hi[c], block.c[c][i]);
+            mean[c] += block.c[c][i];
+        }
+        mean[c] /= 16.f;
+        if (hi[c] - lo[c] > majorRange) {
+            majorRange = hi[c] - lo[c];
+            major = c;
+        }
+    }
+    for (int c = 0; c < dims; ++c) {
+        if (c != major) {
+            float cov = 0.f;
+            for (int i = 0; i < 16; ++i) {
+                cov += (block.c[c][i] - mean[c]) * (block.c[major][i] - mean[major]);
+            }
+            if (cov < 0.f) std::swap(lo[c], hi[c]);
+        }
+        float inset = (hi[c] - lo[c]) / 16.f;
+        lo[c] += inset;
+        hi[c] -= inset;
+    }
+}
+
+// least squares endpoints for fixed interpolation weights w[i] in [0, 1]
+inline bool refineEndpoints(const Block &block, int dims, const float *weights, float *lo, float *hi) {
+    float aa = 0, bb = 0, ab = 0;
+    float ax[4] = {0, 0, 0, 0}, bx[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 16; ++i) {
+        float b = weights[i], a = 1.f - b;
+        aa += a * a;
+        bb += b * b;
+        ab += a * b;
+        for (int c = 0; c < dims; ++c) {
+            ax[c] += a * block.c[c][i];
+            bx[c] += b * block.c[c][i];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) < 1e-6f) {
+        return false;
+    }
+    for (int c = 0; c < dims; ++c) {
+        lo[c] = std::clamp((ax[c] * bb - bx[c] * ab) / det, 0.f, 255.f);
+        hi[c] = std::clamp((bx[c] * aa - ax[c] * ab) / det, 0.f, 255.f);
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------- BC1
+
+inline uint16_t pack565(const float *c) {
+    int r = (int)std::lround(std::clamp(c[0], 0.f, 255.f) * 31.f / 255.f);
+    int g = (int)std::lround(std::clamp(c[1], 0.f, 255.f) * 63.f / 255.f);
+    int b = (int)std::lround(std::clamp(c[2], 0.f, 255.f) * 31.f / 255.f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline void unpack565(uint16_t v, float *c) {
+    int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    c[0] = (float)((r << 3) | (r >> 2));
+    c[1] = (float)((g << 2) | (g >> 4));
+    c[2] = (float)((b << 3) | (b >> 2));
+    c[3] = 255.f;
+}
+
+inline void bc1Palette(uint16_t c0, uint16_t c1, float (*palette)[4]) {
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for (int c = 0; c < 4; ++c) {
+        palette[2][c] = std::floor((2.f * palette[0][c] + palette[1][c] + 1.f) / 3.f);
+        palette[3][c] = std::floor((palette[0][c] + 2.f * palette[1][c] + 1.f) / 3.f);
+    }
+}
+
+inline float encodeBC1Endpoints(const Block &block, const float *lo, const float *hi, bool exact, uint8_t *out) {
+    uint16_t c0 = pack565(hi), c1 = pack565(lo);
+    uint8_t indices[16] = {};
+    float error = 0.f;
+    float palette[4][4];
+
+    if (c0 == c1) {
+        // single color; index 0 is c0 in either mode
+        bc1Palette(c0, c1, palette);
+        error = selectIndices(block, 3, palette, 1, indices);
+    } else {
+        if (c0 < c1) {
+            std::swap(c0, c1);
+        }
+        bc1Palette(c0, c1, palette);
+        if (exact) {
+            error = selectIndices(block, 3, palette, 4, indices);
+        } else {
+            static const uint8_t order[4] = {0, 2, 3, 1};
+            error = projectIndices(block, 3, palette[0], palette[1], 4, order, palette, indices);
+        }
+    }
+
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; ++i) bits |= (uint32_t)indices[i] << (i * 2);
+    out[0] = c0 & 0xFF;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF;
+    out[3] = c1 >> 8;
+    memcpy(out + 4, &bits, 4);
+    return error;
+}
+
+inline void encodeBC1(const Block &block, CompressionPreset preset, uint8_t *out) {
+    float lo[4], hi[4];
+    if (preset == CompressionPreset::Fast) {
+        boxEndpoints(block, 3, lo, hi);
+        encodeBC1Endpoints(block, lo, hi, false, out);
+        return;
+    }
+
+    principalEndpoints(block, 3, lo, hi, 1.f / 16.f);
+    float best = encodeBC1Endpoints(block, lo, hi, true, out);
+    if (preset != CompressionPreset::High) {
+        return;
+    }
+
+    uint8_t candidate[8];
+    for (int iteration = 0; iteration < 2; ++iteration) {
+        // weights implied by the indices we ended up with
+        static const float weight[4] = {1.f, 0.f, 2.f / 3.f, 1.f / 3.f};
+        uint32_t bits;
+        memcpy(&bits, out + 4, 4);
+        float weights[16];
+        for (int i = 0; i < 16; ++i) weights[i] = 1.f - weight[(bits >> (i * 2)) & 3];
+        float newLo[4], newHi[4];
+        if (!refineEndpoints(block, 3, weights, newHi, newLo)) break;
+        float error = encodeBC1Endpoints(block, newLo, newHi, true, candidate);
+        if (error >= best) break;
+        best = error;
+        memcpy(out, candidate, 8);
+    }
+}
+
+inline void decodeBC1(const uint8_t *in, uint8_t *rgba) {
+    uint16_t c0 = in[0] | (in[1] << 8), c1 = in[2] | (in[3] << 8);
+    float palette[4][4];
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    if (c0 > c1) {
+        bc1Palette(c0, c1, palette);
+    } else {
+        for (int c = 0; c < 4; ++c) {
+            palette[2][c] = std::floor((palette[0][c] + palette[1][c]) / 2.f);
+            palette[3][c] = 0.f;
+        }
+        palette[2][3] = 255.f;
+    }
+    uint32_t bits;
+    memcpy(&bits, in + 4, 4);
+    for (int i = 0; i < 16; ++i) {
+        const float *p = palette[(bits >> (i * 2)) & 3];
+        for (int c = 0; c < 4; ++c) rgba[i * 4 + c] = (uint8_t)p[c];
+    }
+}
+
+// ---------------------------------------------------------------- BC4
+
+inline void bc4Palette(int a0, int a1, float (*palette)[4]) {
+    palette[0][0] = (float)a0;
+    palette[1][0] = (float)a1;
+    if (a0 > a1) {
+        for (int i = 1; i < 7; ++i) palette[i + 1][0] = (float)(((7 - i) * a0 + i * a1 + 3) / 7);
+    } else {
+        for (int i = 1; i < 5; ++i) palette[i + 1][0] = (float)(((5 - i) * a0 + i * a1 + 2) / 5);
+        palette[6][0] = 0.f;
+        palette[7][0] = 255.f;
+    }
+}
+
+inline float encodeBC4Endpoints(const Block &block, int channel, int a0, int a1, bool exact, uint8_t *out) {
+    Block single;
+    memcpy(single.c[0], block.c[channel], sizeof(single.c[0]));
+
+    uint8_t indices[16] = {};
+    float palette[8][4];
+    float error;
+    if (a0 == a1) {
+        bc4Palette(a0, a1, palette);
+        error = selectIndices(single, 1, palette, 1, indices);
+    } else {
+        if (a0 < a1) std::swap(a0, a1);
+        bc4Palette(a0, a1, palette);
+        if (exact) {
+            error = selectIndices(single, 1, palette, 8, indices);
+        } else {
+            // t = 0 is a1 (index 1), t = 1 is a0 (index 0)
+            static const uint8_t order[8] = {1, 7, 6, 5, 4, 3, 2, 0};
+            float lo = (float)a1, hi = (float)a0;
+            error = projectIndices(single, 1, &lo, &hi, 8, order, palette, indices);
+        }
+    }
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; ++i) bits |= (uint64_t)indices[i] << (i * 3);
+    out[0] = (uint8_t)a0;
+    out[1] = (uint8_t)a1;
+    for (int i = 0; i < 6; ++i) out[2 + i] = (uint8_t)(bits >> (i * 8));
+    return error;
+}
+
+inline void encodeBC4(const Block &block, int channel, CompressionPreset preset, uint8_t *out) {
+    float lo = 255.f, hi = 0.f;
+    for (int i = 0; i < 16; ++i) {
+        lo = std::min(lo, block.c[channel][i]);
+        hi = std::max(hi, block.c[channel][i]);
+    }
+    bool exact = preset != CompressionPreset::Fast;
+    float best = encodeBC4Endpoints(block, channel, (int)hi, (int)lo, exact, out);
+    if (preset != CompressionPreset::High || hi == lo) {
+        return;
+    }
+
+    uint8_t candidate[8];
+    for (int iteration = 0; iteration < 2; ++iteration) {
+        uint64_t bits = 0;
+        for (int i = 0; i < 6; ++i) bits |= (uint64_t)out[2 + i] << (i * 8);
+        float weights[16];
+        for (int i = 0; i < 16; ++i) {
+            int index = (bits >> (i * 3)) & 7;
+            // weight of a1 (the low endpoint)
+            weights[i] = index == 0 ? 0.f : index == 1 ? 1.f : (index - 1) / 7.f;
+        }
+        Block single;
+        memcpy(single.c[0], block.c[channel], sizeof(single.c[0]));
+        float newA0, newA1;
+        if (!refineEndpoints(single, 1, weights, &newA0, &newA1)) break;
+        float error = encodeBC4Endpoints(block, channel, (int)std::lround(newA0), (int)std::lround(newA1), true, candidate);
+        if (error >= best) break;
+        best = error;
+        memcpy(out, candidate, 8);
+    }
+}
+
+inline void decodeBC4(const uint8_t *in, uint8_t *values, int stride) {
+    float palette[8][4];
+    bc4Palette(in[0], in[1], palette);
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; ++i) bits |= (uint64_t)in[2 + i] << (i * 8);
+    for (int i = 0; i < 16; ++i) values[i * stride] = (uint8_t)palette[(bits >> (i * 3)) & 7][0];
+}
+
+// ---------------------------------------------------------------- BC7 (mode 6)
+
+static const int bc7Weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+struct BitStream128 {
+    uint64_t lo = 0, hi = 0;
+    unsigned pos = 0;
+
+    void write(uint64_t value, unsigned bits) {
+        for (unsigned i = 0; i < bits; ++i, ++pos) {
+            uint64_t bit = (value >> i) & 1;
+            if (pos < 64) lo |= bit << pos;
+            else hi |= bit << (pos - 64);
+        }
+    }
+
+    uint64_t read(unsigned bits) {
+        uint64_t value = 0;
+        for (unsigned i = 0; i < bits; ++i, ++pos) {
+            uint64_t bit = pos < 64 ? (lo >> pos) & 1 : (hi >> (pos - 64)) & 1;
+            value |= bit << i;
+        }
+        return value;
+    }
+};
+
+inline void bc7Palette(const int (*endpoints)[4], float (*palette)[4]) {
+    for (int k = 0; k < 16; ++k) {
+        int w = bc7Weights4[k];
+        for (int c = 0; c < 4; ++c) {
+            palette[k][c] = (float)(((64 - w) * endpoints[0][c] + w * endpoints[1][c] + 32) >> 6);
+        }
+    }
+}
+
+// quantize an endpoint to 7 bits + shared p-bit
+inline void bc7Quantize(const float *value, int pbit, int *quantized, int *expanded) {
+    for (int c = 0; c < 4; ++c) {
+        int q = (int)std::lround((std::clamp(value[c], 0.f, 255.f) - pbit) / 2.f);
+        quantized[c] = std::clamp(q, 0, 127);
+        expanded[c] = (quantized[c] << 1) | pbit;
+    }
+}
+
+inline float encodeBC7Endpoints(const Block &block, const float *lo, const float *hi, int p0, int p1,
+                                bool exact, uint8_t *out) {
+    int q[2][4], e[2][4];
+    bc7Quantize(lo, p0, q[0], e[0]);
+    bc7Quantize(hi, p1, q[1], e[1]);
+
+    float palette[16][4];
+    bc7Palette(e, palette);
+    uint8_t indices[16];
+    float error;
+    if (exact) {
+        error = selectIndices(block, 4, palette, 16, indices);
+    } else {
+        static const uint8_t order[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+        error = projectIndices(block, 4, palette[0], palette[15], 16, order, palette, indices);
+    }
+
+    // the anchor index is stored with an implicit zero MSB
+    if (indices[0] & 8) {
+        std::swap(q[0], q[1]);
+        std::swap(p0, p1);
+        for (int i = 0; i < 16; ++i) indices[i] = 15 - indices[i];
+    }
+
+    BitStream128 bits;
+    bits.write(1 << 6, 7);
+    for (int c = 0; c < 4; ++c) {
+        bits.write(q[0][c], 7);
+        bits.write(q[1][c], 7);
+    }
+    bits.write(p0, 1);
+    bits.write(p1, 1);
+    bits.write(indices[0], 3);
+    for (int i = 1; i < 16; ++i) bits.write(indices[i], 4);
+    memcpy(out, &bits.lo, 8);
+    memcpy(out + 8, &bits.hi, 8);
+    return error;
+}
+
+inline int bestPBit(const float *value) {
+    float error[2] = {0.f, 0.f};
+    for (int p = 0; p < 2; ++p) {
+        int q[4], e[4];
+        bc7Quantize(value, p, q, e);
+        for (int c = 0; c < 4; ++c) error[p] += (e[c] - value[c]) * (e[c] - value[c]);
+    }
+    return error[1] < error[0] ? 1 : 0;
+}
+
+inline void encodeBC7(const Block &block, CompressionPreset preset, uint8_t *out) {
+    float lo[4], hi[4];
+    if (preset == CompressionPreset::Fast) {
+        boxEndpoints(block, 4, lo, hi);
+        encodeBC7Endpoints(block, lo, hi, bestPBit(lo), bestPBit(hi), false, out);
+        return;
+    }
+
+    principalEndpoints(block, 4, lo, hi, 1.f / 32.f);
+    if (preset == CompressionPreset::Normal) {
+        encodeBC7Endpoints(block, lo, hi, bestPBit(lo), bestPBit(hi), true, out);
+        return;
+    }
+
+    float best = 3.4e38f;
+    uint8_t candidate[16];
+    for (int iteration = 0; iteration < 3; ++iteration) {
+        float bestHere = 3.4e38f;
+        uint8_t bestBlock[16];
+        for (int p = 0; p < 4; ++p) {
+            float error = encodeBC7Endpoints(block, lo, hi, p & 1, p >> 1, true, candidate);
+            if (error < bestHere) {
+                bestHere = error;
+                memcpy(bestBlock, candidate, 16);
+            }
+        }
+        if (bestHere >= best) break;
+        best = bestHere;
+        memcpy(out, bestBlock, 16);
+
+        // refine against the indices just chosen; the block may have its
+        // endpoints swapped for the anchor bit, which the weights follow
+        BitStream128 bits;
+        memcpy(&bits.lo, out, 8);
+        memcpy(&bits.hi, out + 8, 8);
+        bits.pos = 7 + 56 + 2;
+        float weights[16];
+        weights[0] = bc7Weights4[bits.read(3)] / 64.f;
+        for (int i = 1; i < 16; ++i) weights[i] = bc7Weights4[bits.read(4)] / 64.f;
+        if (!refineEndpoints(block, 4, weights, lo, hi)) break;
+    }
+}
+
+inline void decodeBC7Mode6(const uint8_t *in, uint8_t *rgba) {
+    BitStream128 bits;
+    memcpy(&bits.lo, in, 8);
+    memcpy(&bits.hi, in + 8, 8);
+    if (bits.read(7) != (1 << 6)) {
+        memset(rgba, 0, 64);
+        return;
+    }
+    int q[2][4];
+    for (int c = 0; c < 4; ++c) {
+        q[0][c] = (int)bits.read(7);
+        q[1][c] = (int)bits.read(7);
+    }
+    int p0 = (int)bits.read(1), p1 = (int)bits.read(1);
+    int e[2][4];
+    for (int c = 0; c < 4; ++c) {
+        e[0][c] = (q[0][c] << 1) | p0;
+        e[1][c] = (q[1][c] << 1) | p1;
+    }
+    float palette[16][4];
+    bc7Palette(e, palette);
+    for (int i = 0; i < 16; ++i) {
+        int index = (int)bits.read(i == 0 ? 3 : 4);
+        for (int c = 0; c < 4; ++c) rgba[i * 4 + c] = (uint8_t)palette[index][c];
+    }
+}
+
+} // namespace bc
+
+inline std::vector<uint8_t> compressLevel(const MipLevel &level, BlockFormat format, CompressionPreset preset) {
+    const int blocksX = (level.width + 3) / 4, blocksY = (level.height + 3) / 4;
+    const unsigned bytes = blockFormatBytes(format);
+    const int channels = blockFormatChannels(format);
+    std::vector<uint8_t> out((size_t)blocksX * blocksY * bytes);
+
+    parallelFor(blocksY, 4, [&](size_t begin, size_t end) {
+        bc::Block block;
+        for (size_t by = begin; by < end; ++by) {
+            for (int bx = 0; bx < blocksX; ++bx) {
+                uint8_t *dst = out.data() + ((size_t)by * blocksX + bx) * bytes;
+                bc::fetchBlock(level, channels, bx, (int)by, block);
+                switch (format) {
+                    case BlockFormat::BC1:
+                        bc::encodeBC1(block, preset, dst);
+                        break;
+                    case BlockFormat::BC3:
+                        bc::encodeBC4(block, 3, preset, dst);
+                        bc::encodeBC1(block, preset, dst + 8);
+                        break;
+                    case BlockFormat::BC4:
+                        bc::encodeBC4(block, 0, preset, dst);
+                        break;
+                    case BlockFormat::BC5:
+                        bc::encodeBC4(block, 0, preset, dst);
+                        bc::encodeBC4(block, 1, preset, dst + 8);
+                        break;
+                    case BlockFormat::BC7:
+                        bc::encodeBC7(block, preset, dst);
+                        break;
+                }
+            }
+        }
+    });
+    return out;
+}
+
+// decode back into a tightly packed image with blockFormatChannels(format)
+inline MipLevel decompressLevel(const uint8_t *data, int width, int height, BlockFormat format) {
+    const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    const unsigned bytes = blockFormatBytes(format);
+    const int channels = blockFormatChannels(format);
+    MipLevel level;
+    level.width = width;
+    level.height = height;
+    level.pixels.resize((size_t)width * height * channels);
+
+    uint8_t texels[64];
+    for (int by = 0; by < blocksY; ++by) {
+        for (int bx = 0; bx < blocksX; ++bx) {
+            const uint8_t *src = data + ((size_t)by * blocksX + bx) * bytes;
+            switch (format) {
+                case BlockFormat::BC1:
+                    bc::decodeBC1(src, texels);
+                    break;
+                case BlockFormat::BC3:
+                    bc::decodeBC1(src + 8, texels);
+                    bc::decodeBC4(src, texels + 3, 4);
+                    break;
+                case BlockFormat::BC4:
+                    bc::decodeBC4(src, texels, 1);
+                    break;
+                case BlockFormat::BC5:
+                    bc::decodeBC4(src, texels, 2);
+                    bc::decodeBC4(src + 8, texels + 1, 2);
+                    break;
+                case BlockFormat::BC7:
+                    bc::decodeBC7Mode6(src, texels);
+                    break;
+            }
+            for (int i = 0; i < 16; ++i) {
+                int x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+                if (x < width && y < height) {
+                    memcpy(&level.pixels[((size_t)y * width + x) * channels], texels + i * channels, channels);
+                }
+            }
+        }
+    }
+    return level;
+}
+
+// peak signal to noise ratio over all channels, in dB
+inline float computePSNR(const MipLevel &a, const MipLevel &b) {
+    double sum = 0.0;
+    for (size_t i = 0; i < a.pixels.size(); ++i) {
+        double d = (double)a.pixels[i] - (double)b.pixels[i];
+        sum += d * d;
+    }
+    double mse = sum / std::max<size_t>(1, a.pixels.size());
+    if (mse <= 0.0) {
+        return 99.f;
+    }
+    return (float)(10.0 * std::log10(255.0 * 255.0 / mse));
+}
+
+struct CompressedTexture {
+    BlockFormat format;
+    int width = 0, height = 0;
+    std::vector<std::vector<uint8_t>> levels;
+    float psnr = 0.f; // of the top level
+};
+
+inline CompressedTexture compressMipChain(const std::vector<MipLevel> &levels, BlockFormat format, CompressionPreset preset) {
+    CompressedTexture texture;
+    texture.format = format;
+    texture.width = levels[0].width;
+    texture.height = levels[0].height;
+    for (const MipLevel &level : levels) {
+        texture.levels.push_back(compressLevel(level, format, preset));
+    }
+    MipLevel decoded = decompressLevel(texture.levels[0].data(), texture.width, texture.height, format);
+    texture.psnr = computePSNR(levels[0], decoded);
+    return texture;
+}
+
+#endif
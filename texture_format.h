@@ -0,0 +1,356 @@
+#ifndef TEXTURE_FORMAT_H
+#define TEXTURE_FORMAT_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "dds.h"
+#include "gl_ext.h"
+#include "texture_compress.h"
+
+// Picks the smallest internal format that holds what an image actually
+// contains, instead of allocating everything as GL_RGB. Greyscale images
+// stored as RGB(A) (like most specular maps) are repacked to one or two
+// channels and swizzled back so shaders keep sampling .rgb. Formats may also
+// be block compressed (see texture_compress.h).
+
+enum class TextureUsage {
+    Color, // albedo / diffuse, sRGB encoded when sRGB decoding is enabled
+    Data,  // specular, masks and everything else read as linear values
+};
+
+// how stored channels map back to rgba; persisted in baked texture files
+enum class TextureSwizzle : uint32_t {
+    RGBA,
+    Grey,      // rrr1
+    GreyAlpha, // rrrg
+};
+
+struct TextureFormat {
+    GLenum internalFormat = GL_RGBA8;
+    GLenum format = GL_RGBA;      // upload / readback format
+    unsigned channels = 4;        // channels per texel in client memory
+    unsigned bytesPerTexel = 4;   // GPU side, uncompressed formats
+    unsigned blockBytes = 0;      // bytes per 4x4 block, compressed formats
+    TextureSwizzle swizzle = TextureSwizzle::RGBA;
+    uint32_t dxgiFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
+    const char *name = "RGBA8";
+
+    bool compressed() const { return blockBytes != 0; }
+};
+
+// what the image contains, found by looking at the pixels
+struct ImageContent {
+    bool grey = true;   // r == g == b everywhere
+    bool opaque = true; // alpha == 255 everywhere
+    bool cutout = false; // has alpha that is almost only fully on or off
+};
+
+inline ImageContent analyzeImage(const unsigned char *pixels, int width, int height, int channels) {
+    ImageContent content;
+    const size_t count = (size_t)width * height;
+    const bool hasAlpha = channels == 2 || channels == 4;
+    size_t partial = 0; // texels with alpha neither (nearly) 0 nor 255
+    for (size_t i = 0; i < count && (content.grey || hasAlpha); ++i) {
+        const unsigned char *p = pixels + i * channels;
+        if (channels >= 3 && (p[0] != p[1] || p[1] != p[2])) {
+            content.grey = false;
+        }
+        if (hasAlpha) {
+            unsigned char alpha = p[channels - 1];
+            content.opaque &= alpha == 255;
+            partial += alpha > 16 && alpha < 240;
+        }
+    }
+    content.cutout = !content.opaque && partial * 10 < count;
+    return content;
+}
+
+inline TextureFormat chooseTextureFormat(const ImageContent &content, TextureUsage usage, bool srgb) {
+    TextureFormat f;
+    // single channel sRGB formats aren't core, so grey color maps only get
+    // repacked when we aren't decoding sRGB
+    const bool linear = usage == TextureUsage::Data || !srgb;
+    if (content.grey && content.opaque && linear) {
+        f.internalFormat = GL_R8;
+        f.format = GL_RED;
+        f.channels = 1;
+        f.bytesPerTexel = 1;
+        f.swizzle = TextureSwizzle::Grey;
+        f.dxgiFormat = DXGI_FORMAT_R8_UNORM;
+        f.name = "R8";
+    } else if (content.grey && linear) {
+        f.internalFormat = GL_RG8;
+        f.format = GL_RG;
+        f.channels = 2;
+        f.bytesPerTexel = 2;
+        f.swizzle = TextureSwizzle::GreyAlpha;
+        f.dxgiFormat = DXGI_FORMAT_R8G8_UNORM;
+        f.name = "RG8";
+    } else if (usage == TextureUsage::Color && srgb) {
+        // there is no renderable/filterable 3 byte sRGB format worth using,
+        // RGB8 is padded to 4 bytes by drivers anyway
+        f.internalFormat = GL_SRGB8_ALPHA8;
+        f.dxgiFormat = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+        f.name = "SRGB8_ALPHA8";
+    } else {
+        f.internalFormat = GL_RGBA8;
+        f.name = "RGBA8";
+    }
+    return f;
+}
+
+// The block compressed counterpart of an uncompressed format: one channel
+// goes to BC4, two to BC5, RGBA to BC1 when opaque and BC3 otherwise; the
+// High preset uses BC7 for RGBA. Returns false when the driver can't sample
+// the result, in which case the texture stays uncompressed.
+inline bool chooseBlockFormat(const TextureFormat &base, const ImageContent &content, CompressionPreset preset,
+                              BlockFormat &block) {
+    const bool srgb = base.internalFormat == GL_SRGB8_ALPHA8;
+    switch (base.channels) {
+        case 1:
+            block = BlockFormat::BC4;
+            return true;
+        case 2:
+            block = BlockFormat::BC5;
+            return true;
+        default:
+            break;
+    }
+    if (preset == CompressionPreset::High && GLAD_GL_ARB_texture_compression_bptc) {
+        block = BlockFormat::BC7;
+        return true;
+    }
+    block = content.opaque ? BlockFormat::BC1 : BlockFormat::BC3;
+    return srgb ? GLAD_GL_EXT_texture_sRGB_s3tc : GLAD_GL_EXT_texture_compression_s3tc;
+}
+
+inline TextureFormat compressedTextureFormat(BlockFormat block, bool srgb, TextureSwizzle swizzle) {
+    TextureFormat f;
+    f.format = block == BlockFormat::BC4 ? GL_RED : block == BlockFormat::BC5 ? GL_RG : GL_RGBA;
+    f.channels = blockFormatChannels(block);
+    f.bytesPerTexel = 0;
+    f.blockBytes = blockFormatBytes(block);
+    f.swizzle = swizzle;
+    switch (block) {
+        case BlockFormat::BC1:
+            f.internalFormat = srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            f.dxgiFormat = srgb ? DXGI_FORMAT_BC1_UNORM_SRGB : DXGI_FORMAT_BC1_UNORM;
+            f.name = srgb ? "BC1_SRGB" : "BC1";
+            break;
+        case BlockFormat::BC3:
+            f.internalFormat = srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            f.dxgiFormat = srgb ? DXGI_FORMAT_BC3_UNORM_SRGB : DXGI_FORMAT_BC3_UNORM;
+            f.name = srgb ? "BC3_SRGB" : "BC3";
+            break;
+        case BlockFormat::BC4:
+            f.internalFormat = GL_COMPRESSED_RED_RGTC1;
+            f.dxgiFormat = DXGI_FORMAT_BC4_UNORM;
+            f.name = "BC4";
+            break;
+        case BlockFormat::BC5:
+            f.internalFormat = GL_COMPRESSED_RG_RGTC2;
+            f.dxgiFormat = DXGI_FORMAT_BC5_UNORM;
+            f.name = "BC5";
+            break;
+        case BlockFormat::BC7:
+            f.internalFormat = srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+            f.dxgiFormat = srgb ? DXGI_FORMAT_BC7_UNORM_SRGB : DXGI_FORMAT_BC7_UNORM;
+            f.name = srgb ? "BC7_SRGB" : "BC7";
+            break;
+    }
+    return f;
+}
+
+// format of a baked texture file; false if this driver can't sample it
+inline bool textureFormatFromDXGI(uint32_t dxgiFormat, TextureSwizzle swizzle, TextureFormat &f) {
+    switch (dxgiFormat) {
+        case DXGI_FORMAT_BC1_UNORM:
+        case DXGI_FORMAT_BC3_UNORM:
+            f = compressedTextureFormat(dxgiFormat == DXGI_FORMAT_BC1_UNORM ? BlockFormat::BC1 : BlockFormat::BC3,
+                                        false, swizzle);
+            return GLAD_GL_EXT_texture_compression_s3tc;
+        case DXGI_FORMAT_BC1_UNORM_SRGB:
+        case DXGI_FORMAT_BC3_UNORM_SRGB:
+            f = compressedTextureFormat(dxgiFormat == DXGI_FORMAT_BC1_UNORM_SRGB ? BlockFormat::BC1 : BlockFormat::BC3,
+                                        true, swizzle);
+            return GLAD_GL_EXT_texture_sRGB_s3tc;
+        case DXGI_FORMAT_BC4_UNORM:
+            f = compressedTextureFormat(BlockFormat::BC4, false, swizzle);
+            return true;
+        case DXGI_FORMAT_BC5_UNORM:
+            f = compressedTextureFormat(BlockFormat::BC5, false, swizzle);
+            return true;
+        case DXGI_FORMAT_BC7_UNORM:
+        case DXGI_FORMAT_BC7_UNORM_SRGB:
+            f = compressedTextureFormat(BlockFormat::BC7, dxgiFormat == DXGI_FORMAT_BC7_UNORM_SRGB, swizzle);
+            return GLAD_GL_ARB_texture_compression_bptc;
+        case DXGI_FORMAT_R8_UNORM:
+            f = chooseTextureFormat({true, true}, TextureUsage::Data, false);
+            break;
+        case DXGI_FORMAT_R8G8_UNORM:
+            f = chooseTextureFormat({true, false}, TextureUsage::Data, false);
+            break;
+        case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+            f = chooseTextureFormat({false, false}, TextureUsage::Color, true);
+            break;
+        case DXGI_FORMAT_R8G8B8A8_UNORM:
+            f = TextureFormat();
+            break;
+        default:
+            return false;
+    }
+    f.swizzle = swizzle;
+    return true;
+}
+
+// repack an image with srcChannels into format.channels, dropping or
+// expanding channels (grey images keep their first channel as luminance)
+inline std::vector<unsigned char> convertImage(const unsigned char *pixels, int width, int height,
+                                               int srcChannels, const TextureFormat &format) {
+    const size_t count = (size_t)width * height;
+    std::vector<unsigned char> out(count * format.channels);
+    for (size_t i = 0; i < count; ++i) {
+        const unsigned char *src = pixels + i * srcChannels;
+        unsigned char *dst = out.data() + i * format.channels;
+        unsigned char alpha = (srcChannels == 2 || srcChannels == 4) ? src[srcChannels - 1] : 255;
+        switch (format.channels) {
+            case 1:
+                dst[0] = src[0];
+                break;
+            case 2:
+                dst[0] = src[0];
+                dst[1] = alpha;
+                break;
+            default:
+                dst[0] = src[0];
+                dst[1] = srcChannels >= 3 ? src[1] : src[0];
+                dst[2] = srcChannels >= 3 ? src[2] : src[0];
+                dst[3] = alpha;
+                break;
+        }
+    }
+    return out;
+}
+
+inline unsigned mipLevelCount(int width, int height) {
+    unsigned levels = 1;
+    while (width > 1 || height > 1) {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        ++levels;
+    }
+    return levels;
+}
+
+inline size_t textureLevelBytes(const TextureFormat &format, int width, int height) {
+    if (format.compressed()) {
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * format.blockBytes;
+    }
+    return (size_t)width * height * format.bytesPerTexel;
+}
+
+inline size_t mipChainBytes(const TextureFormat &format, int width, int height, unsigned firstLevel, unsigned levels) {
+    size_t bytes = 0;
+    for (unsigned level = 0; level < levels; ++level) {
+        if (level >= firstLevel) {
+            bytes += textureLevelBytes(format, width, height);
+        }
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return bytes;
+}
+
+inline void applySwizzle(const TextureFormat &format, GLenum target = GL_TEXTURE_2D) {
+    static const GLint swizzles[3][4] = {
+        {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA},
+        {GL_RED, GL_RED, GL_RED, GL_ONE},
+        {GL_RED, GL_RED, GL_RED, GL_GREEN},
+    };
+    glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzles[(int)format.swizzle]);
+}
+
+// Allocates storage for the bound GL_TEXTURE_2D. Uses immutable storage when
+// the driver has it, otherwise specifies every level with glTexImage2D.
+inline void allocateTexture2D(const TextureFormat &format, int width, int height, unsigned levels) {
+    if (GLAD_GL_ARB_texture_storage) {
+        glTexStorage2D(GL_TEXTURE_2D, levels, format.internalFormat, width, height);
+    } else {
+        for (unsigned level = 0; level < levels; ++level) {
+            glTexImage2D(GL_TEXTURE_2D, level, format.internalFormat, width, height, 0,
+                         format.format, GL_UNSIGNED_BYTE, NULL);
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    }
+    applySwizzle(format);
+}
+
+// (Re)specify one level of the bound GL_TEXTURE_2D, which must have mutable
+// storage. Specifying a 0x0 level frees its memory.
+inline void defineTextureLevel(const TextureFormat &format, unsigned level, int width, int height, const void *data) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (format.compressed()) {
+        GLsizei size = width && height ? (GLsizei)textureLevelBytes(format, width, height) : 0;
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, format.internalFormat, width, height, 0, size, data);
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, level, format.internalFormat, width, height, 0,
+                     format.format, GL_UNSIGNED_BYTE, data);
+    }
+}
+
+// same for the bound GL_TEXTURE_2D_ARRAY
+inline void allocateTexture2DArray(const TextureFormat &format, int width, int height, int layers, unsigned levels) {
+    if (GLAD_GL_ARB_texture_storage) {
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, format.internalFormat, width, height, layers);
+    } else {
+        for (unsigned level = 0; level < levels; ++level) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, format.internalFormat, width, height, layers, 0,
+                         format.format, GL_UNSIGNED_BYTE, NULL);
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    }
+    applySwizzle(format, GL_TEXTURE_2D_ARRAY);
+}
+
+inline void writeTextureLayer(const TextureFormat &format, unsigned level, int layer, int width, int height,
+                              const void *data) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (format.compressed()) {
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, format.internalFormat,
+                                  (GLsizei)textureLevelBytes(format, width, height), data);
+    } else {
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, format.format,
+                        GL_UNSIGNED_BYTE, data);
+    }
+}
+
+// upload / read back one tightly packed level of the bound GL_TEXTURE_2D
+inline void writeTextureLevel(const TextureFormat &format, unsigned level, int width, int height, const void *data) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (format.compressed()) {
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, format.internalFormat,
+                                  (GLsizei)textureLevelBytes(format, width, height), data);
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, format.format, GL_UNSIGNED_BYTE, data);
+    }
+}
+
+inline void readTextureLevel(const TextureFormat &format, unsigned level, int width, int height,
+                             std::vector<unsigned char> &data) {
+    data.resize(textureLevelBytes(format, width, height));
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    if (format.compressed()) {
+        glGetCompressedTexImage(GL_TEXTURE_2D, level, data.data());
+    } else {
+        glGetTexImage(GL_TEXTURE_2D, level, format.format, GL_UNSIGNED_BYTE, data.data());
+    }
+}
+
+#endif
@@ -0,0 +1,267 @@
+#ifndef TEXTURE_PACK_H
+#define TEXTURE_PACK_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "mipmap.h"
+#include "texture_cache.h"
+#include "texture_format.h"
+
+// Import-time packing of a model's textures into GL_TEXTURE_2D_ARRAYs, so
+// a whole model can be drawn without switching texture bindings.
+//
+// Textures with the same size, format and mip count become layers of one
+// array. Small uncompressed textures whose meshes don't tile them are packed
+// into atlas pages first (pages of one format are again layers of an
+// array). Atlas entries are aligned to 2^atlasLevels texels and surrounded
+// by a gutter of replicated edge texels, so the atlas' atlasLevels mips never
+// blend neighbours into each other.
+//
+// Sources are read through TextureCache::readLevels; the pack owns its GL
+// objects and doesn't count against the cache's budget.
+
+// where a source texture ended up
+struct PackedTexture {
+    GLuint array = 0;                           // GL_TEXTURE_2D_ARRAY
+    int layer = 0;
+    glm::vec4 uvTransform = glm::vec4(1, 1, 0, 0); // uv * xy + zw
+};
+
+class TexturePack {
+public:
+    static constexpr int atlasGutter = 8;
+    static constexpr unsigned atlasLevels = 4;
+
+    // textures up to atlasMaxSize texels go into atlas pages of at most
+    // pageMaxSize texels
+    explicit TexturePack(int atlasMaxSize = 256, int pageMaxSize = 2048)
+        : atlasMaxSize(atlasMaxSize), pageMaxSize(pageMaxSize) {}
+
+    TexturePack(const TexturePack &) = delete;
+    TexturePack &operator=(const TexturePack &) = delete;
+
+    ~TexturePack() {
+        if (!arrays.empty()) {
+            glDeleteTextures((GLsizei)arrays.size(), arrays.data());
+        }
+    }
+
+    // queue a texture; `tiles` if texture coordinates leave [0, 1] so it
+    // can't be placed in an atlas. Returns the slot to look up after build().
+    unsigned add(const TextureHandle &texture, bool tiles) {
+        const TextureEntry *entry = texture.get();
+        auto it = slotOf.find(entry);
+        if (it != slotOf.end()) {
+            sources[it->second].tiles |= tiles;
+            return it->second;
+        }
+        unsigned slot = (unsigned)sources.size();
+        slotOf.emplace(entry, slot);
+        sources.push_back({texture, tiles});
+        packed.emplace_back();
+        return slot;
+    }
+
+    const PackedTexture &get(unsigned slot) const { return packed[slot]; }
+
+    // upload everything added so far
+    void build() {
+        struct Item {
+            unsigned slot;
+            TextureFile file;
+            TextureFormat format;
+            TextureUsage usage;
+        };
+        std::vector<Item> items;
+        for (unsigned slot = 0; slot < sources.size(); ++slot) {
+            Item item;
+            item.slot = slot;
+            const TextureEntry *entry = sources[slot].texture.get();
+            if (!entry || !TextureCache::instance().readLevels(sources[slot].texture, item.file) ||
+                !textureFormatFromDXGI(item.file.dxgiFormat, (TextureSwizzle)item.file.swizzle, item.format)) {
+                std::cerr << "ERROR: Failed to pack texture " << (entry ? entry->path : "") << std::endl;
+                continue;
+            }
+            item.usage = entry->usage;
+            items.push_back(std::move(item));
+        }
+
+        // atlas candidates, grouped by format
+        std::map<std::tuple<GLenum, int, int>, std::vector<Item *>> atlasGroups;
+        // everything else, grouped by what a texture array requires to match
+        std::map<std::tuple<int, int, unsigned, GLenum, int>, std::vector<Item *>> arrayGroups;
+        for (Item &item : items) {
+            const TextureFile &file = item.file;
+            if (!sources[item.slot].tiles && !item.format.compressed() &&
+                std::max(file.width, file.height) <= atlasMaxSize) {
+                atlasGroups[{item.format.internalFormat, (int)item.format.swizzle, (int)item.usage}].push_back(&item);
+            } else {
+                arrayGroups[{file.width, file.height, (unsigned)file.levels.size(), item.format.internalFormat,
+                             (int)item.format.swizzle}].push_back(&item);
+            }
+        }
+
+        for (auto &[key, group] : arrayGroups) {
+            const TextureFile &first = group[0]->file;
+            GLuint array = createArray(group[0]->format, first.width, first.height, (int)group.size(),
+                                       (unsigned)first.levels.size(), GL_REPEAT);
+            for (int layer = 0; layer < (int)group.size(); ++layer) {
+                const TextureFile &file = group[layer]->file;
+                for (unsigned level = 0; level < file.levels.size(); ++level) {
+                    writeTextureLayer(group[layer]->format, level, layer, std::max(1, file.width >> level),
+                                      std::max(1, file.height >> level), file.levels[level].data());
+                }
+                packed[group[layer]->slot].array = array;
+                packed[group[layer]->slot].layer = layer;
+            }
+            bytes += mipChainBytes(group[0]->format, first.width, first.height, 0, (unsigned)first.levels.size()) *
+                     group.size();
+        }
+
+        for (auto &[key, group] : atlasGroups) {
+            buildAtlas(group[0]->format, group[0]->usage, group);
+        }
+
+        std::cerr << "texture pack: " << sources.size() << " textures in " << arrays.size() << " arrays ("
+                  << atlasPages << " atlas pages), " << bytes / 1024 << " KiB" << std::endl;
+    }
+
+    // drop the handles to the source textures once built
+    void releaseSources() {
+        for (Source &source : sources) {
+            source.texture = TextureHandle();
+        }
+        slotOf.clear();
+    }
+
+    size_t packedBytes() const { return bytes; }
+    size_t arrayCount() const { return arrays.size(); }
+
+private:
+    struct Source {
+        TextureHandle texture;
+        bool tiles;
+    };
+
+    int atlasMaxSize, pageMaxSize;
+    std::vector<Source> sources;
+    std::unordered_map<const TextureEntry *, unsigned> slotOf;
+    std::vector<PackedTexture> packed;
+    std::vector<GLuint> arrays;
+    unsigned atlasPages = 0;
+    size_t bytes = 0;
+
+    GLuint createArray(const TextureFormat &format, int width, int height, int layers, unsigned levels, GLint wrap) {
+        GLuint array;
+        glGenTextures(1, &array);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        allocateTexture2DArray(format, width, height, layers, levels);
+        arrays.push_back(array);
+        return array;
+    }
+
+    struct Placement {
+        int page, x, y; // of the texture itself, inside its gutter
+    };
+
+    // shelf packing, tallest first; returns the number of pages used
+    static int shelfPack(const std::vector<glm::ivec2> &sizes, int pageSize, std::vector<Placement> &placements) {
+        const int align = 1 << atlasLevels;
+        auto cell = [&](int size) { return (size + 2 * atlasGutter + align - 1) / align * align; };
+        std::vector<size_t> order(sizes.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sizes[a].y > sizes[b].y; });
+
+        placements.assign(sizes.size(), Placement());
+        int page = 0, x = 0, y = 0, shelfHeight = 0;
+        for (size_t i : order) {
+            int w = cell(sizes[i].x), h = cell(sizes[i].y);
+            if (x + w > pageSize) {
+                x = 0;
+                y += shelfHeight;
+                shelfHeight = 0;
+            }
+            if (y + h > pageSize) {
+                ++page;
+                x = y = shelfHeight = 0;
+            }
+            placements[i] = {page, x + atlasGutter, y + atlasGutter};
+            x += w;
+            shelfHeight = std::max(shelfHeight, h);
+        }
+        return page + 1;
+    }
+
+    template <typename Item>
+    void buildAtlas(const TextureFormat &format, TextureUsage usage, const std::vector<Item *> &group) {
+        std::vector<glm::ivec2> sizes;
+        for (const Item *item : group) {
+            sizes.emplace_back(item->file.width, item->file.height);
+        }
+        // smallest page size that fits everything on one page, if any does
+        std::vector<Placement> placements;
+        int pageSize = 1 << atlasLevels;
+        int pages = 0;
+        for (;;) {
+            pages = shelfPack(sizes, pageSize, placements);
+            if (pages == 1 || pageSize >= pageMaxSize) break;
+            pageSize *= 2;
+        }
+
+        const int channels = (int)format.channels;
+        std::vector<std::vector<unsigned char>> pixels(pages, std::vector<unsigned char>((size_t)pageSize * pageSize * channels, 0));
+        for (size_t i = 0; i < group.size(); ++i) {
+            const TextureFile &file = group[i]->file;
+            const unsigned char *src = file.levels[0].data();
+            const Placement &p = placements[i];
+            unsigned char *dst = pixels[p.page].data();
+            // the texture plus its gutter of clamped edge texels
+            for (int y = -atlasGutter; y < file.height + atlasGutter; ++y) {
+                int sy = std::min(file.height - 1, std::max(0, y));
+                for (int x = -atlasGutter; x < file.width + atlasGutter; ++x) {
+                    int sx = std::min(file.width - 1, std::max(0, x));
+                    std::copy_n(src + ((size_t)sy * file.width + sx) * channels, channels,
+                                dst + ((size_t)(p.y + y) * pageSize + p.x + x) * channels);
+                }
+            }
+            PackedTexture &out = packed[group[i]->slot];
+            out.layer = p.page;
+            out.uvTransform = glm::vec4((float)file.width / pageSize, (float)file.height / pageSize,
+                                        (float)p.x / pageSize, (float)p.y / pageSize);
+        }
+
+        // box filtered, a wider kernel would reach across the gutters
+        MipOptions options;
+        options.filter = MipFilter::Box;
+        options.srgb = usage == TextureUsage::Color;
+        options.alphaChannel = channels == 4 ? 3 : channels == 2 ? 1 : -1;
+        const unsigned levels = std::min(atlasLevels, mipLevelCount(pageSize, pageSize));
+        GLuint array = createArray(format, pageSize, pageSize, pages, levels, GL_CLAMP_TO_EDGE);
+        for (int page = 0; page < pages; ++page) {
+            std::vector<MipLevel> mips = buildMipChain(pixels[page].data(), pageSize, pageSize, channels, options);
+            for (unsigned level = 0; level < levels; ++level) {
+                writeTextureLayer(format, level, page, mips[level].width, mips[level].height, mips[level].pixels.data());
+            }
+        }
+        for (const Item *item : group) {
+            packed[item->slot].array = array;
+        }
+        atlasPages += pages;
+        bytes += mipChainBytes(format, pageSize, pageSize, 0, levels) * pages;
+    }
+};
+
+#endif
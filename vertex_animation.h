@@ -0,0 +1,86 @@
+#ifndef VERTEX_ANIMATION_H
+#define VERTEX_ANIMATION_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "animation.h"
+#include "batch_skin.h"
+#include "parallel.h"
+
+// Vertex animation textures: one loop of a skinned clip baked into the
+// skinned positions and normals of every frame, so animated instances draw
+// with no bones at all - each costs its model matrix and a time offset, and
+// the vertex shader (model_loading.vs built with VERTEX_ANIMATION) blends
+// the two frames around its time.
+//
+// Frame f of vertex v is texel f * VertexCount + v, rows of Width texels
+// wrapping, as meshes can have more vertices than a texture is wide. Both
+// textures are RGBA16F. Frames are taken at FrameRate from the start of the
+// clip; after the last one playback blends back into the first.
+
+struct VertexAnimation {
+    uint32_t VertexCount = 0, FrameCount = 0;
+    uint32_t Width = 0, Height = 0; // texels, of both textures
+    float FrameRate = 0.f;          // frames per second
+    std::vector<uint16_t> Positions; // RGBA16F, w = 1
+    std::vector<uint16_t> Normals;   // RGBA16F, w = 0
+
+    float duration() const { return FrameCount / FrameRate; }
+    size_t byteSize() const { return (Positions.size() + Normals.size()) * sizeof(uint16_t); }
+};
+
+// Bakes `clip` played on `scene` into the mesh skinned by `skin`, which is
+// placed at node `meshNode`; positions and normals come out in mesh space.
+// The frames are spread over the hardware threads, each posing its own
+// copy of the scene.
+inline VertexAnimation bakeVertexAnimation(const SceneGraph &scene, const Skin &skin, SceneGraph::NodeId meshNode,
+                                           const glm::vec3 *positions, const glm::vec3 *normals, size_t vertexCount,
+                                           const AnimationClip &clip, float frameRate = 30.f, uint32_t width = 2048) {
+    VertexAnimation animation;
+    animation.VertexCount = (uint32_t)vertexCount;
+    animation.FrameCount = std::max(1u, (uint32_t)std::lround(clip.Duration * frameRate));
+    animation.FrameRate = clip.Duration > 0.f ? animation.FrameCount / clip.Duration : frameRate;
+    animation.Width = (uint32_t)std::min<size_t>(width, std::max<size_t>(vertexCount, 1));
+    const size_t texels = vertexCount * animation.FrameCount;
+    animation.Height = (uint32_t)((texels + animation.Width - 1) / animation.Width);
+    animation.Positions.assign(animation.Width * animation.Height * 4, 0);
+    animation.Normals.assign(animation.Width * animation.Height * 4, 0);
+    if (skin.Weights.size() != vertexCount) {
+        std::cerr << "ERROR: " << skin.Weights.size() << " skin weights for " << vertexCount << " vertices" << std::endl;
+        return animation;
+    }
+
+    parallelFor(animation.FrameCount, 4, [&](size_t begin, size_t end) {
+        SceneGraph posed = scene;
+        Animator animator(posed);
+        animator.play(clip, false);
+        std::vector<glm::mat3x4> palette;
+        std::vector<glm::vec3> skinnedPositions(vertexCount), skinnedNormals(vertexCount);
+        for (size_t f = begin; f < end; ++f) {
+            animator.sample(f / animation.FrameRate);
+            posed.update();
+            skin.computePalette(posed, posed.world(meshNode), palette);
+            batch::skinVertices(palette.data(), skin.Weights.data(), positions, normals, vertexCount,
+                                skinnedPositions.data(), skinnedNormals.data());
+            uint16_t *p = &animation.Positions[f * vertexCount * 4], *n = &animation.Normals[f * vertexCount * 4];
+            for (size_t v = 0; v < vertexCount; ++v) {
+                const glm::vec3 normal = glm::normalize(skinnedNormals[v]);
+                for (int c = 0; c < 3; ++c) {
+                    p[v * 4 + c] = glm::packHalf1x16(skinnedPositions[v][c]);
+                    n[v * 4 + c] = glm::packHalf1x16(normal[c]);
+                }
+                p[v * 4 + 3] = glm::packHalf1x16(1.f);
+            }
+        }
+    });
+    return animation;
+}
+
+#endif
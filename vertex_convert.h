@@ -0,0 +1,246 @@
+#ifndef VERTEX_CONVERT_H
+#define VERTEX_CONVERT_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "batch_math.h"
+
+// Bulk conversion of vertex attributes into the layouts the GPU reads,
+// dispatched like batch_math.h.
+//
+// Importers hand out one array per attribute (assimp's aiVector3D arrays,
+// which share glm::vec3's layout); the kernels interleave whole meshes of
+// them at a time instead of building vertices one by one. Destinations
+// are plain memory, so they can be an arena, a vector that then moves into
+// a Mesh, or a mapped GL buffer.
+
+// the full precision layout, 32 bytes
+struct Vertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+};
+
+// 20 bytes: float positions, normals as snorm 2_10_10_10 (x in the low
+// bits, GL_INT_2_10_10_10_REV) and texture coordinates as unorm16. Only
+// for texture coordinates within [0, 1]; tiling ones need Vertex.
+struct PackedVertex {
+    float Position[3];
+    uint32_t Normal;
+    uint16_t TexCoords[2];
+};
+
+namespace batch {
+
+struct VertexKernels {
+    // out[k] from positions[k], normals[k] and the x, y of texCoords[k];
+    // null normals or texCoords give zeros
+    void (*interleaveVertices)(const glm::vec3 *positions, const glm::vec3 *normals, const glm::vec3 *texCoords,
+                               size_t count, Vertex *out);
+    // out[k] = in[k] quantized, texture coordinates clamped to [0, 1]
+    void (*packVertices)(const Vertex *in, size_t count, PackedVertex *out);
+};
+
+namespace scalar {
+
+inline uint32_t packNormal(const glm::vec3 &n) {
+    uint32_t packed = 0;
+    for (int c = 0; c < 3; ++c) {
+        const int32_t v = (int32_t)std::lround(std::clamp(n[c], -1.f, 1.f) * 511.f);
+        packed |= ((uint32_t)v & 0x3ff) << (10 * c);
+    }
+    return packed;
+}
+
+inline uint16_t packUnorm16(float v) { return (uint16_t)std::lround(std::clamp(v, 0.f, 1.f) * 65535.f); }
+
+inline void interleaveVertices(const glm::vec3 *positions, const glm::vec3 *normals, const glm::vec3 *texCoords,
+                               size_t count, Vertex *out) {
+    for (size_t k = 0; k < count; ++k) {
+        out[k].Position = positions[k];
+        out[k].Normal = normals ? normals[k] : glm::vec3(0.f);
+        out[k].TexCoords = texCoords ? glm::vec2(texCoords[k]) : glm::vec2(0.f);
+    }
+}
+
+inline void packVertices(const Vertex *in, size_t count, PackedVertex *out) {
+    for (size_t k = 0; k < count; ++k) {
+        memcpy(out[k].Position, &in[k].Position, sizeof(out[k].Position));
+        out[k].Normal = packNormal(in[k].Normal);
+        out[k].TexCoords[0] = packUnorm16(in[k].TexCoords.x);
+        out[k].TexCoords[1] = packUnorm16(in[k].TexCoords.y);
+    }
+}
+
+constexpr VertexKernels vertexKernels = {interleaveVertices, packVertices};
+
+} // namespace scalar
+
+#if CPU_X86
+
+namespace sse41 {
+
+// three registers of four packed vec3s (x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3),
+// zeros for a null array
+CPU_TARGET("sse4.1") inline void loadVec3x4(const glm::vec3 *v, __m128 &a, __m128 &b, __m128 &c) {
+    if (!v) {
+        a = b = c = _mm_setzero_ps();
+        return;
+    }
+    const float *f = &v->x;
+    a = _mm_loadu_ps(f);
+    b = _mm_loadu_ps(f + 4);
+    c = _mm_loadu_ps(f + 8);
+}
+
+CPU_TARGET("sse4.1") inline __m128 align(__m128 hi, __m128 lo, int bytes) {
+    switch (bytes) {
+        case 4: return _mm_castsi128_ps(_mm_alignr_epi8(_mm_castps_si128(hi), _mm_castps_si128(lo), 4));
+        case 8: return _mm_castsi128_ps(_mm_alignr_epi8(_mm_castps_si128(hi), _mm_castps_si128(lo), 8));
+        default: return _mm_castsi128_ps(_mm_alignr_epi8(_mm_castps_si128(hi), _mm_castps_si128(lo), 12));
+    }
+}
+
+// four vertices from three loads per attribute and eight shuffles; the
+// texture coordinates are read with the stride of a vec3
+CPU_TARGET("sse4.1") inline void interleaveVertices(const glm::vec3 *positions, const glm::vec3 *normals,
+                                                    const glm::vec3 *texCoords, size_t count, Vertex *out) {
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        __m128 p0, p1, p2, n0, n1, n2, t0, t1, t2;
+        loadVec3x4(positions + k, p0, p1, p2);
+        loadVec3x4(normals ? normals + k : nullptr, n0, n1, n2);
+        loadVec3x4(texCoords ? texCoords + k : nullptr, t0, t1, t2);
+        float *o = &out[k].Position.x;
+        // px py pz nx | ny nz u v per vertex
+        _mm_storeu_ps(o, _mm_insert_ps(p0, n0, (0 << 6) | (3 << 4)));
+        _mm_storeu_ps(o + 4, _mm_shuffle_ps(n0, t0, _MM_SHUFFLE(1, 0, 2, 1)));
+        _mm_storeu_ps(o + 8, _mm_insert_ps(align(p1, p0, 12), n0, (3 << 6) | (3 << 4)));
+        _mm_storeu_ps(o + 12, _mm_shuffle_ps(n1, align(t1, t0, 12), _MM_SHUFFLE(1, 0, 1, 0)));
+        _mm_storeu_ps(o + 16, _mm_insert_ps(align(p2, p1, 8), n1, (2 << 6) | (3 << 4)));
+        _mm_storeu_ps(o + 20, _mm_shuffle_ps(align(n2, n1, 12), t1, _MM_SHUFFLE(3, 2, 1, 0)));
+        _mm_storeu_ps(o + 24, _mm_insert_ps(align(n2, p2, 4), n2, (1 << 6) | (3 << 4)));
+        _mm_storeu_ps(o + 28, _mm_shuffle_ps(n2, t2, _MM_SHUFFLE(2, 1, 3, 2)));
+    }
+    scalar::interleaveVertices(positions + k, normals ? normals + k : nullptr, texCoords ? texCoords + k : nullptr,
+                               count - k, out + k);
+}
+
+// c in [lo, hi] times scale, rounded
+CPU_TARGET("sse4.1") inline __m128i quantize(__m128 c, float lo, float hi, float scale) {
+    return _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(c, _mm_set1_ps(lo)), _mm_set1_ps(hi)), _mm_set1_ps(scale)));
+}
+
+// four vertices at a time: transposed so each component is one register,
+// quantized together, then stored per vertex
+CPU_TARGET("sse4.1") inline void packVertices(const Vertex *in, size_t count, PackedVertex *out) {
+    const __m128i tenBits = _mm_set1_epi32(0x3ff);
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        const float *v = &in[k].Position.x;
+        __m128 lo[4], hi[4];
+        for (int i = 0; i < 4; ++i) {
+            lo[i] = _mm_loadu_ps(v + 8 * i);
+            hi[i] = _mm_loadu_ps(v + 8 * i + 4);
+        }
+        __m128 x = lo[0], y = lo[1], z = lo[2], nx = lo[3];
+        _MM_TRANSPOSE4_PS(x, y, z, nx);
+        __m128 ny = hi[0], nz = hi[1], u = hi[2], w = hi[3];
+        _MM_TRANSPOSE4_PS(ny, nz, u, w);
+
+        const __m128i normal = _mm_or_si128(_mm_and_si128(quantize(nx, -1.f, 1.f, 511.f), tenBits),
+                                            _mm_or_si128(_mm_slli_epi32(_mm_and_si128(quantize(ny, -1.f, 1.f, 511.f), tenBits), 10),
+                                                         _mm_slli_epi32(_mm_and_si128(quantize(nz, -1.f, 1.f, 511.f), tenBits), 20)));
+        const __m128i uv = _mm_or_si128(quantize(u, 0.f, 1.f, 65535.f), _mm_slli_epi32(quantize(w, 0.f, 1.f, 65535.f), 16));
+
+        // normal and texture coordinates are the last 8 bytes of each
+        // vertex; the 16-byte position store runs into them first
+        const __m128i tail01 = _mm_unpacklo_epi32(normal, uv), tail23 = _mm_unpackhi_epi32(normal, uv);
+        const __m128i tails[4] = {tail01, _mm_srli_si128(tail01, 8), tail23, _mm_srli_si128(tail23, 8)};
+        for (int i = 0; i < 4; ++i) {
+            _mm_storeu_ps(out[k + i].Position, lo[i]);
+            _mm_storel_epi64((__m128i *)&out[k + i].Normal, tails[i]);
+        }
+    }
+    scalar::packVertices(in + k, count - k, out + k);
+}
+
+constexpr VertexKernels vertexKernels = {interleaveVertices, packVertices};
+
+} // namespace sse41
+
+#endif // CPU_X86
+
+#if CPU_NEON
+
+namespace neon {
+
+// vld3q deinterleaves the vec3 arrays for free; the two halves of each
+// vertex are then zipped back together
+inline void interleaveVertices(const glm::vec3 *positions, const glm::vec3 *normals, const glm::vec3 *texCoords,
+                               size_t count, Vertex *out) {
+    const float32x4_t zero = vdupq_n_f32(0.f);
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        const float32x4x3_t p = vld3q_f32(&positions[k].x);
+        const float32x4x3_t n = normals ? vld3q_f32(&normals[k].x) : float32x4x3_t{{zero, zero, zero}};
+        const float32x4x3_t t = texCoords ? vld3q_f32(&texCoords[k].x) : float32x4x3_t{{zero, zero, zero}};
+        // vst4q writes lane i of the four registers as one vertex half
+        float lo[16], hi[16];
+        vst4q_f32(lo, float32x4x4_t{{p.val[0], p.val[1], p.val[2], n.val[0]}});
+        vst4q_f32(hi, float32x4x4_t{{n.val[1], n.val[2], t.val[0], t.val[1]}});
+        float *o = &out[k].Position.x;
+        for (int i = 0; i < 4; ++i) {
+            vst1q_f32(o + 8 * i, vld1q_f32(lo + 4 * i));
+            vst1q_f32(o + 8 * i + 4, vld1q_f32(hi + 4 * i));
+        }
+    }
+    scalar::interleaveVertices(positions + k, normals ? normals + k : nullptr, texCoords ? texCoords + k : nullptr,
+                               count - k, out + k);
+}
+
+constexpr VertexKernels vertexKernels = {interleaveVertices, scalar::packVertices};
+
+} // namespace neon
+
+#endif // CPU_NEON
+
+// nothing here gains from the wider registers: the kernels are bound by
+// memory, not arithmetic
+inline const VertexKernels &vertexKernelsFor(SimdLevel level) {
+    switch (level) {
+#if CPU_X86
+        case SimdLevel::AVX512:
+        case SimdLevel::AVX2:
+        case SimdLevel::SSE41: return sse41::vertexKernels;
+#endif
+#if CPU_NEON
+        case SimdLevel::NEON: return neon::vertexKernels;
+#endif
+        default: return scalar::vertexKernels;
+    }
+}
+
+inline const VertexKernels &vertexKernels() {
+    static const VertexKernels &best = vertexKernelsFor(simdLevel());
+    return best;
+}
+
+inline void interleaveVertices(const glm::vec3 *positions, const glm::vec3 *normals, const glm::vec3 *texCoords,
+                               size_t count, Vertex *out) {
+    vertexKernels().interleaveVertices(positions, normals, texCoords, count, out);
+}
+
+inline void packVertices(const Vertex *in, size_t count, PackedVertex *out) {
+    vertexKernels().packVertices(in, count, out);
+}
+
+} // namespace batch
+
+#endif